@@ -63,7 +63,7 @@ private:
     bool is_row_visible(Gtk::TreeModel::const_iterator const& iter);
 
     bool test_tracker(tr_torrent const& tor, int active_tracker_type, Glib::ustring const& host);
-    bool test_torrent_activity(tr_torrent& tor, int type);
+    static bool test_torrent_activity(Gtk::TreeModel::const_iterator const& iter, int type);
 
     static Glib::ustring get_name_from_host(std::string const& host);
 
@@ -456,33 +456,34 @@ bool FilterBar::Impl::activity_is_it_a_separator(Gtk::TreeModel::const_iterator
     return iter->get_value(activity_filter_cols.type) == ACTIVITY_FILTER_SEPARATOR;
 }
 
-bool FilterBar::Impl::test_torrent_activity(tr_torrent& tor, int type)
+bool FilterBar::Impl::test_torrent_activity(Gtk::TreeModel::const_iterator const& iter, int type)
 {
-    auto const* st = tr_torrentStatCached(&tor);
+    // these columns are kept current by Session::update(),
+    // so there's no need to stat the torrent here
+    auto const activity = iter->get_value(torrent_cols.activity);
 
     switch (type)
     {
     case ACTIVITY_FILTER_DOWNLOADING:
-        return st->activity == TR_STATUS_DOWNLOAD || st->activity == TR_STATUS_DOWNLOAD_WAIT;
+        return activity == TR_STATUS_DOWNLOAD || activity == TR_STATUS_DOWNLOAD_WAIT;
 
     case ACTIVITY_FILTER_SEEDING:
-        return st->activity == TR_STATUS_SEED || st->activity == TR_STATUS_SEED_WAIT;
+        return activity == TR_STATUS_SEED || activity == TR_STATUS_SEED_WAIT;
 
     case ACTIVITY_FILTER_ACTIVE:
-        return st->peersSendingToUs > 0 || st->peersGettingFromUs > 0 || st->webseedsSendingToUs > 0 ||
-            st->activity == TR_STATUS_CHECK;
+        return iter->get_value(torrent_cols.active_peer_count) > 0 || activity == TR_STATUS_CHECK;
 
     case ACTIVITY_FILTER_PAUSED:
-        return st->activity == TR_STATUS_STOPPED;
+        return activity == TR_STATUS_STOPPED;
 
     case ACTIVITY_FILTER_FINISHED:
-        return st->finished;
+        return iter->get_value(torrent_cols.finished);
 
     case ACTIVITY_FILTER_VERIFYING:
-        return st->activity == TR_STATUS_CHECK || st->activity == TR_STATUS_CHECK_WAIT;
+        return activity == TR_STATUS_CHECK || activity == TR_STATUS_CHECK_WAIT;
 
     case ACTIVITY_FILTER_ERROR:
-        return st->error != 0;
+        return iter->get_value(torrent_cols.error) != 0;
 
     default: /* ACTIVITY_FILTER_ALL */
         return true;
@@ -506,7 +507,7 @@ bool FilterBar::Impl::activity_filter_model_update()
 
         for (auto const& torrent_row : torrent_model_->children())
         {
-            if (test_torrent_activity(*static_cast<tr_torrent*>(torrent_row.get_value(torrent_cols.torrent)), type))
+            if (test_torrent_activity(TR_GTK_TREE_MODEL_CHILD_ITER(torrent_row), type))
             {
                 ++hits;
             }
@@ -652,7 +653,7 @@ bool FilterBar::Impl::is_row_visible(Gtk::TreeModel::const_iterator const& iter)
     auto* const tor = static_cast<tr_torrent*>(iter->get_value(torrent_cols.torrent));
 
     return tor != nullptr && test_tracker(*tor, active_tracker_type_, active_tracker_sitename_) &&
-        test_torrent_activity(*tor, active_activity_type_) && testText(*tor, filter_text_);
+        test_torrent_activity(iter, active_activity_type_) && testText(*tor, filter_text_);
 }
 
 void FilterBar::Impl::selection_changed_cb()
@@ -8,6 +8,7 @@
 #include <cinttypes> // PRId64
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
@@ -84,6 +85,68 @@ private:
     Gtk::SortType sort_type_ = TR_GTK_SORT_TYPE(ASCENDING);
 };
 
+// The latest tr_stat_columns snapshot of every torrent,
+// plus a lookup from a model row to that row's stats.
+// It only changes in refresh(), never during a sort, so
+// comparators see consistent values throughout.
+class StatSnapshot
+{
+public:
+    explicit StatSnapshot(tr_session* session)
+        : session_{ session }
+    {
+        columns_.resize(1U); // unknown_row_
+    }
+
+    void refresh()
+    {
+        tr_sessionGetStatColumns(session_, &columns_);
+
+        auto const n_torrents = std::size(columns_);
+        std::fill(std::begin(rows_), std::end(rows_), NoRow);
+        for (size_t row = 0; row < n_torrents; ++row)
+        {
+            auto const id = static_cast<size_t>(columns_.id[row]);
+            if (id >= std::size(rows_))
+            {
+                rows_.resize(id + 1U, NoRow);
+            }
+
+            rows_[id] = row;
+        }
+
+        // an all-zeroes row for torrents that aren't in the session anymore
+        columns_.resize(n_torrents + 1U);
+        unknown_row_ = n_torrents;
+    }
+
+    [[nodiscard]] constexpr auto const& columns() const noexcept
+    {
+        return columns_;
+    }
+
+    [[nodiscard]] bool contains(tr_torrent_id_t id) const noexcept
+    {
+        auto const idx = static_cast<size_t>(id);
+        return idx < std::size(rows_) && rows_[idx] != NoRow;
+    }
+
+    // Torrents that aren't in the snapshot get an all-zeroes row
+    [[nodiscard]] size_t row(Gtk::TreeModel::const_iterator const& iter) const
+    {
+        auto const id = iter->get_value(torrent_cols.torrent_id);
+        return contains(id) ? rows_[static_cast<size_t>(id)] : unknown_row_;
+    }
+
+private:
+    static auto constexpr NoRow = std::numeric_limits<size_t>::max();
+
+    tr_session* const session_;
+    tr_stat_columns columns_;
+    std::vector<size_t> rows_; // torrent id -> row in columns_
+    size_t unknown_row_ = 0;
+};
+
 } // namespace
 
 class Session::Impl
@@ -204,6 +267,7 @@ private:
     Glib::RefPtr<Gtk::ListStore> raw_model_;
     Glib::RefPtr<Gtk::TreeModelSort> sorted_model_;
     tr_session* session_ = nullptr;
+    StatSnapshot stats_;
 };
 
 TorrentModelColumns::TorrentModelColumns() noexcept
@@ -375,138 +439,129 @@ constexpr int compare_ratio(double a, double b)
     return compare_generic(a, b);
 }
 
+// The comparators below read from a StatSnapshot instead of calling
+// tr_torrentStatCached() on both torrents in every comparison.
+using Iter = Gtk::TreeModel::const_iterator;
+
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_name(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_name(StatSnapshot const& /*stats*/, Iter const& a, Iter const& b)
 {
     return a->get_value(torrent_cols.name_collated).compare(b->get_value(torrent_cols.name_collated));
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_queue(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_queue(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    auto const* const sa = tr_torrentStatCached(static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent)));
-    auto const* const sb = tr_torrentStatCached(static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent)));
+    auto const& queue_position = stats.columns().queue_position;
 
-    return sb->queuePosition - sa->queuePosition;
+    return compare_generic(queue_position[stats.row(b)], queue_position[stats.row(a)]);
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_ratio(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_ratio(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    int ret = 0;
-
-    auto const* const sa = tr_torrentStatCached(static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent)));
-    auto const* const sb = tr_torrentStatCached(static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent)));
-
-    if (ret == 0)
-    {
-        ret = compare_ratio(sa->ratio, sb->ratio);
-    }
+    auto const& ratio = stats.columns().ratio;
+    int ret = compare_ratio(ratio[stats.row(a)], ratio[stats.row(b)]);
 
     if (ret == 0)
     {
-        ret = compare_by_queue(a, b);
+        ret = compare_by_queue(stats, a, b);
     }
 
     return ret;
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_activity(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_activity(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    int ret = 0;
+    auto const& cols = stats.columns();
+    auto const row_a = stats.row(a);
+    auto const row_b = stats.row(b);
 
-    auto* const ta = static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent));
-    auto* const tb = static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent));
-    auto const aUp = a->get_value(torrent_cols.speed_up);
-    auto const aDown = a->get_value(torrent_cols.speed_down);
-    auto const bUp = b->get_value(torrent_cols.speed_up);
-    auto const bDown = b->get_value(torrent_cols.speed_down);
-
-    ret = compare_generic(aUp + aDown, bUp + bDown);
+    int ret = compare_generic(
+        cols.piece_upload_speed_KBps[row_a] + cols.piece_download_speed_KBps[row_a],
+        cols.piece_upload_speed_KBps[row_b] + cols.piece_download_speed_KBps[row_b]);
 
     if (ret == 0)
     {
-        auto const* const sa = tr_torrentStatCached(ta);
-        auto const* const sb = tr_torrentStatCached(tb);
-        ret = compare_generic(sa->peersSendingToUs + sa->peersGettingFromUs, sb->peersSendingToUs + sb->peersGettingFromUs);
+        ret = compare_generic(
+            cols.peers_sending_to_us[row_a] + cols.peers_getting_from_us[row_a],
+            cols.peers_sending_to_us[row_b] + cols.peers_getting_from_us[row_b]);
     }
 
     if (ret == 0)
     {
-        ret = compare_by_queue(a, b);
+        ret = compare_by_queue(stats, a, b);
     }
 
     return ret;
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_age(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_age(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    auto* const ta = static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent));
-    auto* const tb = static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent));
-    int ret = compare_generic(tr_torrentStatCached(ta)->addedDate, tr_torrentStatCached(tb)->addedDate);
+    auto const& added_date = stats.columns().added_date;
+    int ret = compare_generic(added_date[stats.row(a)], added_date[stats.row(b)]);
 
     if (ret == 0)
     {
-        ret = compare_by_name(a, b);
+        ret = compare_by_name(stats, a, b);
     }
 
     return ret;
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_size(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_size(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    auto const size_a = tr_torrentTotalSize(static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent)));
-    auto const size_b = tr_torrentTotalSize(static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent)));
-    int ret = compare_generic(size_a, size_b);
+    auto const& total_size = stats.columns().total_size;
+    int ret = compare_generic(total_size[stats.row(a)], total_size[stats.row(b)]);
 
     if (ret == 0)
     {
-        ret = compare_by_name(a, b);
+        ret = compare_by_name(stats, a, b);
     }
 
     return ret;
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_progress(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_progress(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    auto const* const sa = tr_torrentStatCached(static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent)));
-    auto const* const sb = tr_torrentStatCached(static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent)));
-    int ret = compare_generic(sa->percentComplete, sb->percentComplete);
+    auto const& cols = stats.columns();
+    auto const row_a = stats.row(a);
+    auto const row_b = stats.row(b);
+    int ret = compare_generic(cols.percent_complete[row_a], cols.percent_complete[row_b]);
 
     if (ret == 0)
     {
-        ret = compare_generic(sa->seedRatioPercentDone, sb->seedRatioPercentDone);
+        ret = compare_generic(cols.seed_ratio_percent_done[row_a], cols.seed_ratio_percent_done[row_b]);
     }
 
     if (ret == 0)
     {
-        ret = compare_by_ratio(a, b);
+        ret = compare_by_ratio(stats, a, b);
     }
 
     return ret;
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_eta(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_eta(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
-    auto const* const sa = tr_torrentStatCached(static_cast<tr_torrent*>(a->get_value(torrent_cols.torrent)));
-    auto const* const sb = tr_torrentStatCached(static_cast<tr_torrent*>(b->get_value(torrent_cols.torrent)));
-    int ret = compare_eta(sa->eta, sb->eta);
+    auto const& eta = stats.columns().eta;
+    int ret = compare_eta(eta[stats.row(a)], eta[stats.row(b)]);
 
     if (ret == 0)
     {
-        ret = compare_by_name(a, b);
+        ret = compare_by_name(stats, a, b);
     }
 
     return ret;
 }
 
 // NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-int compare_by_state(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::const_iterator const& b)
+int compare_by_state(StatSnapshot const& stats, Iter const& a, Iter const& b)
 {
     auto const sa = a->get_value(torrent_cols.activity);
     auto const sb = b->get_value(torrent_cols.activity);
@@ -514,7 +569,7 @@ int compare_by_state(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::co
 
     if (ret == 0)
     {
-        ret = compare_by_queue(a, b);
+        ret = compare_by_queue(stats, a, b);
     }
 
     return ret;
@@ -525,49 +580,49 @@ int compare_by_state(Gtk::TreeModel::const_iterator const& a, Gtk::TreeModel::co
 void Session::Impl::set_sort_mode(std::string_view mode, bool is_reversed)
 {
     auto const& col = torrent_cols.torrent;
-    Gtk::TreeSortable::SlotCompare sort_func;
+    int (*compare)(StatSnapshot const&, Iter const&, Iter const&) = nullptr;
     auto type = is_reversed ? TR_GTK_SORT_TYPE(ASCENDING) : TR_GTK_SORT_TYPE(DESCENDING);
     auto const sortable = get_model();
 
     if (mode == "sort-by-activity")
     {
-        sort_func = &compare_by_activity;
+        compare = &compare_by_activity;
     }
     else if (mode == "sort-by-age")
     {
-        sort_func = &compare_by_age;
+        compare = &compare_by_age;
     }
     else if (mode == "sort-by-progress")
     {
-        sort_func = &compare_by_progress;
+        compare = &compare_by_progress;
     }
     else if (mode == "sort-by-queue")
     {
-        sort_func = &compare_by_queue;
+        compare = &compare_by_queue;
     }
     else if (mode == "sort-by-time-left")
     {
-        sort_func = &compare_by_eta;
+        compare = &compare_by_eta;
     }
     else if (mode == "sort-by-ratio")
     {
-        sort_func = &compare_by_ratio;
+        compare = &compare_by_ratio;
     }
     else if (mode == "sort-by-state")
     {
-        sort_func = &compare_by_state;
+        compare = &compare_by_state;
     }
     else if (mode == "sort-by-size")
     {
-        sort_func = &compare_by_size;
+        compare = &compare_by_size;
     }
     else
     {
-        sort_func = &compare_by_name;
+        compare = &compare_by_name;
         type = is_reversed ? TR_GTK_SORT_TYPE(DESCENDING) : TR_GTK_SORT_TYPE(ASCENDING);
     }
 
-    sortable->set_sort_func(col, sort_func);
+    sortable->set_sort_func(col, [this, compare](Iter const& a, Iter const& b) { return compare(stats_, a, b); });
     sortable->set_sort_column(col, type);
 }
 
@@ -823,6 +878,7 @@ Session::~Session() = default;
 Session::Impl::Impl(Session& core, tr_session* session)
     : core_(core)
     , session_(session)
+    , stats_(session)
 {
     raw_model_ = Gtk::ListStore::create(torrent_cols);
     sorted_model_ = Gtk::TreeModelSort::create(raw_model_);
@@ -980,6 +1036,13 @@ void Session::Impl::add_torrent(tr_torrent* tor, bool do_notify)
 {
     if (tor != nullptr)
     {
+        // make sure the sort comparators can see the new torrent's stats.
+        // When many torrents are added at once, the first refresh has them all.
+        if (!stats_.contains(tr_torrentId(tor)))
+        {
+            stats_.refresh();
+        }
+
         tr_stat const* st = tr_torrentStat(tor);
         auto const collated = get_collated_name(tor);
         auto const trackers_hash = build_torrent_trackers_hash(tor);
@@ -1000,6 +1063,8 @@ void Session::Impl::add_torrent(tr_torrent* tor, bool do_notify)
         (*iter)[torrent_cols.priority] = tr_torrentGetPriority(tor);
         (*iter)[torrent_cols.queue_position] = st->queuePosition;
         (*iter)[torrent_cols.trackers] = trackers_hash;
+        (*iter)[torrent_cols.error] = st->error;
+        (*iter)[torrent_cols.active_peer_count] = st->peersSendingToUs + st->peersGettingFromUs + st->webseedsSendingToUs;
 
         if (do_notify)
         {
@@ -1332,7 +1397,7 @@ int gtr_compare_double(double const a, double const b, int decimal_places)
     return 0;
 }
 
-void update_foreach(Gtk::TreeModel::Row& row)
+void update_foreach(Gtk::TreeModel::Row& row, StatSnapshot const& stats)
 {
     /* get the old states */
     auto* const tor = static_cast<tr_torrent*>(row.get_value(torrent_cols.torrent));
@@ -1351,20 +1416,23 @@ void update_foreach(Gtk::TreeModel::Row& row)
     auto const oldDownSpeed = row.get_value(torrent_cols.speed_down);
 
     /* get the new states */
-    auto const* const st = tr_torrentStat(tor);
-    auto const newActive = is_torrent_active(st);
-    auto const newActivity = st->activity;
-    auto const newFinished = st->finished;
-    auto const newPriority = tr_torrentGetPriority(tor);
-    auto const newQueuePosition = st->queuePosition;
+    auto const& cols = stats.columns();
+    auto const i = stats.row(TR_GTK_TREE_MODEL_CHILD_ITER(row));
+    auto const newActivity = cols.activity[i];
+    auto const newActive = cols.peers_sending_to_us[i] > 0 || cols.peers_getting_from_us[i] > 0 ||
+        newActivity == TR_STATUS_CHECK;
+    auto const newFinished = cols.finished[i] != 0;
+    auto const newPriority = cols.priority[i];
+    auto const newQueuePosition = cols.queue_position[i];
     auto const newTrackers = build_torrent_trackers_hash(tor);
-    auto const newUpSpeed = st->pieceUploadSpeed_KBps;
-    auto const newDownSpeed = st->pieceDownloadSpeed_KBps;
-    auto const newRecheckProgress = st->recheckProgress;
-    auto const newActivePeerCount = st->peersSendingToUs + st->peersGettingFromUs + st->webseedsSendingToUs;
-    auto const newDownloadPeerCount = st->peersSendingToUs;
-    auto const newUploadPeerCount = st->peersGettingFromUs + st->webseedsSendingToUs;
-    auto const newError = st->error;
+    auto const newUpSpeed = cols.piece_upload_speed_KBps[i];
+    auto const newDownSpeed = cols.piece_download_speed_KBps[i];
+    auto const newRecheckProgress = cols.recheck_progress[i];
+    auto const newActivePeerCount = cols.peers_sending_to_us[i] + cols.peers_getting_from_us[i] +
+        cols.webseeds_sending_to_us[i];
+    auto const newDownloadPeerCount = cols.peers_sending_to_us[i];
+    auto const newUploadPeerCount = cols.peers_getting_from_us[i] + cols.webseeds_sending_to_us[i];
+    auto const newError = cols.error[i];
 
     /* updating the model triggers off resort/refresh,
        so don't do it unless something's actually changed... */
@@ -1413,10 +1481,11 @@ void Session::start_now(tr_torrent_id_t id)
 
 void Session::Impl::update()
 {
-    /* update the model */
+    /* update the model from a single snapshot of every torrent's stats */
+    stats_.refresh();
     for (auto row : raw_model_->children())
     {
-        update_foreach(row);
+        update_foreach(row, stats_);
     }
 
     /* update hibernation */
@@ -165,6 +165,10 @@ struct tr_announce_response
  */
 auto inline constexpr TR_MULTISCRAPE_MAX = 60;
 
+/* udp trackers all follow bep 15, so their multiscrapes can start at
+ * the most info hashes that fit in a udp scrape packet */
+auto inline constexpr TR_UDP_MULTISCRAPE_MAX = 74;
+
 auto inline constexpr TR_ANNOUNCE_TIMEOUT_SEC = std::chrono::seconds{ 45 };
 auto inline constexpr TR_SCRAPE_TIMEOUT_SEC = std::chrono::seconds{ 30 };
 
@@ -177,7 +181,7 @@ struct tr_scrape_request
     char log_name[128];
 
     /* info hashes of the torrents to scrape */
-    std::array<tr_sha1_digest_t, TR_MULTISCRAPE_MAX> info_hash;
+    std::array<tr_sha1_digest_t, TR_UDP_MULTISCRAPE_MAX> info_hash;
 
     /* how many hashes to use in the info_hash field */
     int info_hash_count = 0;
@@ -215,7 +219,7 @@ struct tr_scrape_response
     int row_count;
 
     /* the individual torrents' scrape results */
-    std::array<tr_scrape_response_row, TR_MULTISCRAPE_MAX> rows;
+    std::array<tr_scrape_response_row, TR_UDP_MULTISCRAPE_MAX> rows;
 
     /* the raw scrape url */
     tr_interned_string scrape_url;
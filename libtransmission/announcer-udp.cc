@@ -3,14 +3,19 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm> // for std::find_if()
+#include <algorithm> // for std::min()
 #include <cerrno> // for errno, EAFNOSUPPORT
 #include <cstring> // for memset()
 #include <ctime>
+#include <deque>
+#include <functional> // for std::greater
 #include <future>
 #include <list>
 #include <memory>
+#include <queue>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -69,8 +74,9 @@ enum tau_action_t
 
 struct tau_scrape_request
 {
-    tau_scrape_request(tr_scrape_request const& in, tr_scrape_response_func on_response)
-        : on_response_{ std::move(on_response) }
+    tau_scrape_request(tau_transaction_t transaction_id_in, tr_scrape_request const& in, tr_scrape_response_func on_response)
+        : transaction_id{ transaction_id_in }
+        , on_response_{ std::move(on_response) }
     {
         this->response.scrape_url = in.scrape_url;
         this->response.row_count = in.info_hash_count;
@@ -151,7 +157,7 @@ struct tau_scrape_request
     std::vector<std::byte> payload;
 
     time_t sent_at = 0;
-    tau_transaction_t const transaction_id = tau_transaction_new();
+    tau_transaction_t const transaction_id;
 
     tr_scrape_response response = {};
 
@@ -167,8 +173,13 @@ private:
 
 struct tau_announce_request
 {
-    tau_announce_request(uint32_t announce_ip, tr_announce_request const& in, tr_announce_response_func on_response)
-        : on_response_{ std::move(on_response) }
+    tau_announce_request(
+        tau_transaction_t transaction_id_in,
+        uint32_t announce_ip,
+        tr_announce_request const& in,
+        tr_announce_response_func on_response)
+        : transaction_id{ transaction_id_in }
+        , on_response_{ std::move(on_response) }
     {
         response.seeders = -1;
         response.leechers = -1;
@@ -255,7 +266,7 @@ struct tau_announce_request
     std::vector<std::byte> payload;
 
     time_t sent_at = 0;
-    tau_transaction_t const transaction_id = tau_transaction_new();
+    tau_transaction_t const transaction_id;
 
     tr_announce_response response = {};
 
@@ -332,6 +343,49 @@ struct tau_tracker
         this->upkeep();
     }
 
+    void addAnnounce(uint32_t announce_ip, tr_announce_request const& request, tr_announce_response_func on_response)
+    {
+        auto const transaction_id = newTransactionId();
+        auto const [it, added] = announces_.try_emplace(
+            transaction_id,
+            transaction_id,
+            announce_ip,
+            request,
+            std::move(on_response));
+        TR_ASSERT(added);
+        enqueue(transaction_id, it->second.expiresAt());
+    }
+
+    void addScrape(tr_scrape_request const& request, tr_scrape_response_func on_response)
+    {
+        auto const transaction_id = newTransactionId();
+        auto const [it, added] = scrapes_.try_emplace(transaction_id, transaction_id, request, std::move(on_response));
+        TR_ASSERT(added);
+        enqueue(transaction_id, it->second.expiresAt());
+    }
+
+    // @return true if `transaction_id` matches one of this tracker's requests
+    bool onResponse(tau_transaction_t transaction_id, tau_action_t action, libtransmission::Buffer& buf)
+    {
+        // extract the request before invoking its callback,
+        // since the callback may queue up new requests
+        if (auto node = announces_.extract(transaction_id); node)
+        {
+            logtrace(this->key, fmt::format("{} is an announce request!", transaction_id));
+            node.mapped().onResponse(action, buf);
+            return true;
+        }
+
+        if (auto node = scrapes_.extract(transaction_id); node)
+        {
+            logtrace(this->key, fmt::format("{} is a scrape request!", transaction_id));
+            node.mapped().onResponse(action, buf);
+            return true;
+        }
+
+        return false;
+    }
+
     void upkeep(bool timeout_reqs = true)
     {
         time_t const now = tr_time();
@@ -371,7 +425,7 @@ struct tau_tracker
         if (addr_ && !is_connected(now) && this->connecting_at == 0)
         {
             this->connecting_at = now;
-            this->connection_transaction_id = tau_transaction_new();
+            this->connection_transaction_id = newTransactionId();
             logtrace(this->key, fmt::format("Trying to connect. Transaction ID is {}", this->connection_transaction_id));
 
             auto buf = libtransmission::Buffer{};
@@ -438,23 +492,47 @@ private:
 
     [[nodiscard]] bool isIdle() const noexcept
     {
-        return std::empty(announces) && std::empty(scrapes) && !addr_pending_dns_;
+        return std::empty(announces_) && std::empty(scrapes_) && !addr_pending_dns_;
+    }
+
+    // Responses are matched to requests by transaction id, so a request
+    // whose random id collided with a pending one would never be answered
+    [[nodiscard]] tau_transaction_t newTransactionId() const
+    {
+        for (;;)
+        {
+            if (auto const id = tau_transaction_new();
+                id != connection_transaction_id && announces_.count(id) == 0U && scrapes_.count(id) == 0U)
+            {
+                return id;
+            }
+        }
+    }
+
+    void enqueue(tau_transaction_t transaction_id, time_t expires_at)
+    {
+        unsent_.push_back(transaction_id);
+        deadlines_.emplace(expires_at, transaction_id);
     }
 
     void failAll(bool did_connect, bool did_timeout, std::string_view errmsg)
     {
-        for (auto& req : this->scrapes)
+        auto scrapes = std::move(scrapes_);
+        auto announces = std::move(announces_);
+        scrapes_.clear();
+        announces_.clear();
+        unsent_.clear();
+        deadlines_ = {};
+
+        for (auto& [transaction_id, req] : scrapes)
         {
             req.fail(did_connect, did_timeout, errmsg);
         }
 
-        for (auto& req : this->announces)
+        for (auto& [transaction_id, req] : announces)
         {
             req.fail(did_connect, did_timeout, errmsg);
         }
-
-        this->scrapes.clear();
-        this->announces.clear();
     }
 
     ///
@@ -467,26 +545,49 @@ private:
             on_connection_response(TAU_ACTION_ERROR, empty_buf);
         }
 
-        timeout_requests(this->announces, now, "announce");
-        timeout_requests(this->scrapes, now, "scrape");
+        // Every request has a deadline for expiring, plus one for retransmitting
+        // each time it's sent. Only look at the ones that are due; entries for
+        // requests that already got a response are stale and get skipped.
+        while (!std::empty(deadlines_) && deadlines_.top().first <= now)
+        {
+            auto const transaction_id = deadlines_.top().second;
+            deadlines_.pop();
+
+            if (!timeout_request(this->announces_, transaction_id, now, "announce"))
+            {
+                timeout_request(this->scrapes_, transaction_id, now, "scrape");
+            }
+        }
     }
 
     template<typename T>
-    void timeout_requests(std::list<T>& requests, time_t now, std::string_view name)
+    bool timeout_request(
+        std::unordered_map<tau_transaction_t, T>& requests,
+        tau_transaction_t transaction_id,
+        time_t now,
+        std::string_view name)
     {
-        for (auto it = std::begin(requests); it != std::end(requests);)
+        auto const it = requests.find(transaction_id);
+        if (it == std::end(requests))
         {
-            if (auto& req = *it; req.expiresAt() <= now)
-            {
-                logtrace(this->key, fmt::format("timeout {} req {}", name, fmt::ptr(&req)));
-                req.fail(false, true, "");
-                it = requests.erase(it);
-            }
-            else
-            {
-                ++it;
-            }
+            return false;
         }
+
+        if (auto& req = it->second; req.expiresAt() <= now)
+        {
+            logtrace(this->key, fmt::format("timeout {} req {}", name, fmt::ptr(&req)));
+            auto node = requests.extract(it);
+            node.mapped().fail(false, true, "");
+        }
+        else if (req.sent_at != 0 && req.sent_at + RetransmitIntervalSecs <= now)
+        {
+            // udp is lossy; resend it with the same transaction id (bep 15)
+            logtrace(this->key, fmt::format("retransmitting {} req {}", name, fmt::ptr(&req)));
+            req.sent_at = 0;
+            unsent_.push_back(transaction_id);
+        }
+
+        return true;
     }
 
     ///
@@ -498,41 +599,54 @@ private:
         TR_ASSERT(this->connecting_at == 0);
         TR_ASSERT(this->connection_expiration_time > tr_time());
 
-        send_requests(this->announces);
-        send_requests(this->scrapes);
-    }
-
-    template<typename T>
-    void send_requests(std::list<T>& reqs)
-    {
+        // Pipeline everything that's waiting: send it all now
+        // and match up the responses by transaction id as they arrive.
         auto const now = tr_time();
-
-        for (auto it = std::begin(reqs); it != std::end(reqs);)
+        while (!std::empty(unsent_))
         {
-            auto& req = *it;
+            auto const transaction_id = unsent_.front();
+            unsent_.pop_front();
 
-            if (req.sent_at != 0) // it's already been sent; we're awaiting a response
+            if (!send_request(this->announces_, transaction_id, now))
             {
-                ++it;
-                continue;
+                send_request(this->scrapes_, transaction_id, now);
             }
+        }
+    }
 
-            logdbg(this->key, fmt::format("sending req {}", fmt::ptr(&req)));
-            req.sent_at = now;
-            send_request(std::data(req.payload), std::size(req.payload));
+    template<typename T>
+    bool send_request(std::unordered_map<tau_transaction_t, T>& reqs, tau_transaction_t transaction_id, time_t now)
+    {
+        auto const it = reqs.find(transaction_id);
+        if (it == std::end(reqs))
+        {
+            return false;
+        }
 
-            if (req.has_callback())
-            {
-                ++it;
-                continue;
-            }
+        auto& req = it->second;
+        if (req.sent_at != 0) // it's already been sent; we're awaiting a response
+        {
+            return true;
+        }
 
+        logdbg(this->key, fmt::format("sending req {}", fmt::ptr(&req)));
+        req.sent_at = now;
+        send_payload(std::data(req.payload), std::size(req.payload));
+
+        if (req.has_callback())
+        {
+            deadlines_.emplace(std::min(now + RetransmitIntervalSecs, req.expiresAt()), transaction_id);
+        }
+        else
+        {
             // no response needed, so we can remove it now
-            it = reqs.erase(it);
+            reqs.erase(it);
         }
+
+        return true;
     }
 
-    void send_request(std::byte const* payload, size_t payload_len)
+    void send_payload(std::byte const* payload, size_t payload_len)
     {
         logdbg(this->key, fmt::format("sending request w/connection id {}", this->connection_id));
 
@@ -554,10 +668,18 @@ public:
     tau_connection_t connection_id = {};
     tau_transaction_t connection_transaction_id = {};
 
-    std::list<tau_announce_request> announces;
-    std::list<tau_scrape_request> scrapes;
-
 private:
+    using Deadline = std::pair<time_t, tau_transaction_t>;
+
+    std::unordered_map<tau_transaction_t, tau_announce_request> announces_;
+    std::unordered_map<tau_transaction_t, tau_scrape_request> scrapes_;
+
+    // requests waiting to be sent, in the order they were queued
+    std::deque<tau_transaction_t> unsent_;
+
+    // when to next look at a request to see if it needs retransmitting or has expired
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> deadlines_;
+
     Mediator& mediator_;
 
     std::optional<std::future<MaybeSockaddr>> addr_pending_dns_ = {};
@@ -567,6 +689,7 @@ private:
 
     static inline constexpr auto DnsRetryIntervalSecs = time_t{ 3600 };
     static inline constexpr auto ConnectionRequestTtl = int{ 30 };
+    static inline constexpr auto RetransmitIntervalSecs = time_t{ 15 };
 };
 
 /****
@@ -592,7 +715,7 @@ public:
         // Since size of IP field is only 4 bytes long, we can only announce IPv4 addresses
         auto const addr = mediator_.announceIP();
         uint32_t const announce_ip = addr && addr->is_ipv4() ? addr->addr.addr4.s_addr : 0;
-        tracker->announces.emplace_back(announce_ip, request, std::move(on_response));
+        tracker->addAnnounce(announce_ip, request, std::move(on_response));
         tracker->upkeep(false);
     }
 
@@ -604,7 +727,7 @@ public:
             return;
         }
 
-        tracker->scrapes.emplace_back(request, std::move(on_response));
+        tracker->addScrape(request, std::move(on_response));
         tracker->upkeep(false);
     }
 
@@ -648,38 +771,10 @@ public:
                 return true;
             }
 
-            // is it a response to one of this tracker's announces?
-            if (auto& reqs = tracker.announces; !std::empty(reqs))
+            // is it a response to one of this tracker's announces or scrapes?
+            if (tracker.onResponse(transaction_id, action_id, buf))
             {
-                auto it = std::find_if(
-                    std::begin(reqs),
-                    std::end(reqs),
-                    [&transaction_id](auto const& req) { return req.transaction_id == transaction_id; });
-                if (it != std::end(reqs))
-                {
-                    logtrace(tracker.key, fmt::format("{} is an announce request!", transaction_id));
-                    auto req = *it;
-                    it = reqs.erase(it);
-                    req.onResponse(action_id, buf);
-                    return true;
-                }
-            }
-
-            // is it a response to one of this tracker's scrapes?
-            if (auto& reqs = tracker.scrapes; !std::empty(reqs))
-            {
-                auto it = std::find_if(
-                    std::begin(reqs),
-                    std::end(reqs),
-                    [&transaction_id](auto const& req) { return req.transaction_id == transaction_id; });
-                if (it != std::end(reqs))
-                {
-                    logtrace(tracker.key, fmt::format("{} is a scrape request!", transaction_id));
-                    auto req = *it;
-                    it = reqs.erase(it);
-                    req.onResponse(action_id, buf);
-                    return true;
-                }
+                return true;
             }
         }
 
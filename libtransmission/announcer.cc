@@ -13,6 +13,7 @@
 #include <map>
 #include <memory>
 #include <numeric>
+#include <queue>
 #include <set>
 #include <string>
 #include <string_view>
@@ -52,9 +53,8 @@ static auto constexpr DefaultAnnounceMinIntervalSec = int{ 60 * 2 };
 /* the value of the 'numwant' argument passed in tracker requests. */
 static auto constexpr Numwant = int{ 80 };
 
-/* how often to announce & scrape */
-static auto constexpr MaxAnnouncesPerUpkeep = int{ 20 };
-static auto constexpr MaxScrapesPerUpkeep = int{ 20 };
+/* how many announces & scrapes can be in flight to a single tracker host */
+static auto constexpr MaxConcurrentRequestsPerHost = size_t{ 20 };
 
 /* how many infohashes to remove when we get a scrape-too-long error */
 static auto constexpr TrMultiscrapeStep = int{ 5 };
@@ -129,6 +129,8 @@ struct tr_scrape_info
     }
 };
 
+struct tr_tier;
+
 /**
  * "global" (per-tr_session) fields
  */
@@ -156,8 +158,8 @@ public:
     tr_announcer_impl& operator=(tr_announcer_impl const&) = delete;
 
     tr_torrent_announcer* addTorrent(tr_torrent* tor, tr_tracker_callback callback, void* callback_data) override;
-    void startTorrent(tr_torrent* tor) override;
-    void stopTorrent(tr_torrent* tor) override;
+    void startTorrent(tr_torrent* tor, time_t announce_at) override;
+    void stopTorrent(tr_torrent* tor, time_t announce_at) override;
     void resetTorrent(tr_torrent* tor) override;
     void removeTorrent(tr_torrent* tor) override;
 
@@ -169,8 +171,14 @@ public:
 
     void upkeep();
 
+    // Queue the tier's next announce and scrape deadlines.
+    // Must be called whenever `announceAt` or `scrapeAt` changes,
+    // or when a finished request may have made the tier eligible again.
+    void schedule(tr_tier& tier);
+
     void onAnnounceDone(int tier_id, tr_announce_event event, bool is_running_on_success, tr_announce_response const& response);
     void onScrapeDone(tr_scrape_response const& response);
+    void onRequestDone(tr_interned_string const& host);
 
     [[nodiscard]] tr_scrape_info* scrape_info(tr_interned_string url)
     {
@@ -179,7 +187,8 @@ public:
             return nullptr;
         }
 
-        auto const [it, is_new] = scrape_info_.try_emplace(url, url, TR_MULTISCRAPE_MAX);
+        auto const multiscrape_max = tr_strvStartsWith(url.sv(), "udp://"sv) ? TR_UDP_MULTISCRAPE_MAX : TR_MULTISCRAPE_MAX;
+        auto const [it, is_new] = scrape_info_.try_emplace(url, url, multiscrape_max);
         return &it->second;
     }
 
@@ -251,10 +260,48 @@ private:
         stops_.clear();
     }
 
+    // a tier's pending announce or scrape, keyed by when it's due
+    struct TierDeadline
+    {
+        time_t at;
+        tr_sha1_digest_t info_hash;
+        int tier_id;
+        bool is_scrape;
+
+        [[nodiscard]] constexpr bool operator>(TierDeadline const& that) const noexcept
+        {
+            return at > that.at;
+        }
+    };
+
+    struct TierKey
+    {
+        tr_sha1_digest_t info_hash;
+        int tier_id;
+    };
+
+    // per-tracker-host bookkeeping: requests in flight
+    // and due tiers that are waiting for a free slot
+    struct TrackerHost
+    {
+        size_t n_active = 0;
+        std::vector<TierKey> announce_ready;
+        std::vector<TierKey> scrape_ready;
+    };
+
+    void pullDueTiers(time_t now);
+    void scrapeHost(tr_interned_string const& host, TrackerHost& tracker_host, time_t now);
+    void announceHost(tr_interned_string const& host, TrackerHost& tracker_host, time_t now);
+    void scrapeAndAnnounceMore();
+
     static auto constexpr UpkeepInterval = 500ms;
 
     tr_announcer_udp& announcer_udp_;
 
+    std::priority_queue<TierDeadline, std::vector<TierDeadline>, std::greater<>> deadlines_;
+
+    std::map<tr_interned_string, TrackerHost> hosts_;
+
     std::map<tr_interned_string, tr_scrape_info> scrape_info_;
 
     std::unique_ptr<libtransmission::Timer> const upkeep_timer_;
@@ -354,13 +401,17 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
 /** @brief A group of trackers in a single tier, as per the multitracker spec */
 struct tr_tier
 {
-    tr_tier(tr_announcer_impl* announcer, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
-        : tor{ tor_in }
+    tr_tier(
+        tr_announcer_impl* announcer_in,
+        tr_torrent* tor_in,
+        std::vector<tr_announce_list::tracker_info const*> const& infos)
+        : announcer{ announcer_in }
+        , tor{ tor_in }
     {
         trackers.reserve(std::size(infos));
         for (auto const* info : infos)
         {
-            trackers.emplace_back(announcer, *info);
+            trackers.emplace_back(announcer_in, *info);
         }
         useNextTracker();
         scrapeSoon();
@@ -481,6 +532,7 @@ struct tr_tier
     void scheduleNextScrape(int interval)
     {
         this->scrapeAt = getNextScrapeTime(tor->session, this, interval);
+        announcer->schedule(*this);
     }
 
     std::deque<tr_announce_event> announce_events;
@@ -496,8 +548,14 @@ struct tr_tier
 
     std::optional<size_t> current_tracker_index_;
 
+    tr_announcer_impl* const announcer;
+
     tr_torrent* const tor;
 
+    // the deadlines that are currently queued in the announcer, or 0 if none
+    time_t scrapeQueuedAt = 0;
+    time_t announceQueuedAt = 0;
+
     time_t scrapeAt = 0;
     time_t lastScrapeStartTime = 0;
     time_t lastScrapeTime = 0;
@@ -527,6 +585,10 @@ struct tr_tier
     bool isAnnouncing = false;
     bool isScraping = false;
 
+    // true when the tier is due and waiting for a free tracker host slot
+    bool isAnnounceReady = false;
+    bool isScrapeReady = false;
+
 private:
     [[nodiscard]] static time_t getNextScrapeTime(tr_session const* session, tr_tier const* tier, int interval)
     {
@@ -856,6 +918,7 @@ static void tier_announce_event_push(tr_tier* tier, tr_announce_event e, time_t
     events.push_back(e);
     tier->announceAt = announce_at;
     tier_update_announce_priority(tier);
+    tier->announcer->schedule(*tier);
 
     tr_logAddTrace_tier_announce_queue(tier);
     tr_logAddTraceTier(tier, fmt::format("announcing in {} seconds", difftime(announce_at, tr_time())));
@@ -878,9 +941,9 @@ static void torrentAddAnnounce(tr_torrent* tor, tr_announce_event e, time_t anno
     }
 }
 
-void tr_announcer_impl::startTorrent(tr_torrent* tor)
+void tr_announcer_impl::startTorrent(tr_torrent* tor, time_t announce_at)
 {
-    torrentAddAnnounce(tor, TR_ANNOUNCE_EVENT_STARTED, tr_time());
+    torrentAddAnnounce(tor, TR_ANNOUNCE_EVENT_STARTED, announce_at);
 }
 
 void tr_announcerManualAnnounce(tr_torrent* tor)
@@ -888,9 +951,9 @@ void tr_announcerManualAnnounce(tr_torrent* tor)
     torrentAddAnnounce(tor, TR_ANNOUNCE_EVENT_NONE, tr_time());
 }
 
-void tr_announcer_impl::stopTorrent(tr_torrent* tor)
+void tr_announcer_impl::stopTorrent(tr_torrent* tor, time_t announce_at)
 {
-    torrentAddAnnounce(tor, TR_ANNOUNCE_EVENT_STOPPED, tr_time());
+    torrentAddAnnounce(tor, TR_ANNOUNCE_EVENT_STOPPED, announce_at);
 }
 
 void tr_announcerTorrentCompleted(tr_torrent* tor)
@@ -1202,6 +1265,9 @@ void tr_announcer_impl::onAnnounceDone(
             tier_announce_event_push(tier, TR_ANNOUNCE_EVENT_NONE, now + i);
         }
     }
+
+    // the tier may still have events queued up, e.g. "completed" after "started"
+    schedule(*tier);
 }
 
 static void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
@@ -1221,13 +1287,16 @@ static void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
 
     auto tier_id = tier->id;
     auto is_running_on_success = tor->isRunning;
+    auto host = tier->currentTracker()->host;
 
     announcer->announce(
         req,
-        [session = announcer->session, announcer, tier_id, event, is_running_on_success](tr_announce_response const& response)
+        [session = announcer->session, announcer, host, tier_id, event, is_running_on_success](
+            tr_announce_response const& response)
         {
             if (session->announcer_)
             {
+                announcer->onRequestDone(host);
                 announcer->onAnnounceDone(tier_id, event, is_running_on_success, response);
             }
         });
@@ -1417,11 +1486,16 @@ void tr_announcer_impl::onScrapeDone(tr_scrape_response const& response)
     checkMultiscrapeMax(this, response);
 }
 
-static void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tiers)
+// returns the number of scrape requests sent
+static size_t multiscrape(
+    tr_announcer_impl* announcer,
+    tr_interned_string const& host,
+    std::vector<tr_tier*> const& tiers,
+    size_t max_requests)
 {
     auto const now = tr_time();
-    auto requests = std::array<tr_scrape_request, MaxScrapesPerUpkeep>{};
-    auto request_count = size_t{};
+    auto requests = std::vector<tr_scrape_request>{};
+    requests.reserve(max_requests);
 
     // batch as many info_hashes into a request as we can
     for (auto* tier : tiers)
@@ -1432,56 +1506,56 @@ static void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> cons
         TR_ASSERT(scrape_info != nullptr);
 
         /* if there's a request with this scrape URL and a free slot, use it */
-        for (size_t j = 0; !found && j < request_count; ++j)
+        for (auto& req : requests)
         {
-            auto* const req = &requests[j];
-
-            if (req->info_hash_count >= scrape_info->multiscrape_max)
+            if (req.info_hash_count >= scrape_info->multiscrape_max)
             {
                 continue;
             }
 
-            if (scrape_info->scrape_url != req->scrape_url)
+            if (scrape_info->scrape_url != req.scrape_url)
             {
                 continue;
             }
 
-            req->info_hash[req->info_hash_count] = tier->tor->infoHash();
-            ++req->info_hash_count;
+            req.info_hash[req.info_hash_count] = tier->tor->infoHash();
+            ++req.info_hash_count;
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
             found = true;
+            break;
         }
 
         /* otherwise, if there's room for another request, build a new one */
-        if (!found && request_count < MaxScrapesPerUpkeep)
+        if (!found && std::size(requests) < max_requests)
         {
-            auto* const req = &requests[request_count];
-            req->scrape_url = scrape_info->scrape_url;
-            tier->buildLogName(req->log_name, sizeof(req->log_name));
+            auto& req = requests.emplace_back();
+            req.scrape_url = scrape_info->scrape_url;
+            tier->buildLogName(req.log_name, sizeof(req.log_name));
 
-            req->info_hash[req->info_hash_count] = tier->tor->infoHash();
-            ++req->info_hash_count;
+            req.info_hash[req.info_hash_count] = tier->tor->infoHash();
+            ++req.info_hash_count;
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
-
-            ++request_count;
         }
     }
 
     /* send the requests we just built */
-    for (size_t i = 0; i < request_count; ++i)
+    for (auto const& req : requests)
     {
         announcer->scrape(
-            requests[i],
-            [session = announcer->session, announcer](tr_scrape_response const& response)
+            req,
+            [session = announcer->session, announcer, host](tr_scrape_response const& response)
             {
                 if (session->announcer_)
                 {
+                    announcer->onRequestDone(host);
                     announcer->onScrapeDone(response);
                 }
             });
     }
+
+    return std::size(requests);
 }
 
 static int compareAnnounceTiers(tr_tier const* a, tr_tier const* b)
@@ -1523,51 +1597,212 @@ static int compareAnnounceTiers(tr_tier const* a, tr_tier const* b)
     return a < b ? -1 : 1;
 }
 
-static void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
+void tr_announcer_impl::schedule(tr_tier& tier)
 {
-    time_t const now = tr_time();
+    auto const& info_hash = tier.tor->infoHash();
 
-    /* build a list of tiers that need to be announced */
-    auto announce_me = std::vector<tr_tier*>{};
-    auto scrape_me = std::vector<tr_tier*>{};
-    for (auto* const tor : announcer->session->torrents())
+    if (tier.announceAt != 0 && tier.announceAt != tier.announceQueuedAt)
+    {
+        deadlines_.push(TierDeadline{ tier.announceAt, info_hash, tier.id, false });
+        tier.announceQueuedAt = tier.announceAt;
+    }
+
+    if (tier.scrapeAt != 0 && tier.scrapeAt != tier.scrapeQueuedAt)
+    {
+        deadlines_.push(TierDeadline{ tier.scrapeAt, info_hash, tier.id, true });
+        tier.scrapeQueuedAt = tier.scrapeAt;
+    }
+}
+
+void tr_announcer_impl::onRequestDone(tr_interned_string const& host)
+{
+    if (auto it = hosts_.find(host); it != std::end(hosts_) && it->second.n_active > 0U)
+    {
+        --it->second.n_active;
+    }
+}
+
+// Move the tiers whose deadlines have passed into their tracker host's ready queue.
+// Deadlines that were superseded by a later `schedule()` call are discarded here.
+void tr_announcer_impl::pullDueTiers(time_t now)
+{
+    while (!std::empty(deadlines_) && deadlines_.top().at <= now)
     {
-        for (auto& tier : tor->torrent_announcer->tiers)
+        auto const deadline = deadlines_.top();
+        deadlines_.pop();
+
+        auto* const tier = getTier(this, deadline.info_hash, deadline.tier_id);
+        if (tier == nullptr)
+        {
+            continue;
+        }
+
+        if (deadline.is_scrape)
         {
-            if (tier.needsToAnnounce(now))
+            if (tier->scrapeQueuedAt != deadline.at)
             {
-                announce_me.push_back(&tier);
+                continue;
             }
 
-            if (tier.needsToScrape(now))
+            tier->scrapeQueuedAt = 0;
+
+            if (!tier->isScrapeReady && tier->needsToScrape(now))
             {
-                scrape_me.push_back(&tier);
+                tier->isScrapeReady = true;
+                hosts_[tier->currentTracker()->host].scrape_ready.push_back({ deadline.info_hash, deadline.tier_id });
+            }
+        }
+        else
+        {
+            if (tier->announceQueuedAt != deadline.at)
+            {
+                continue;
+            }
+
+            tier->announceQueuedAt = 0;
+
+            if (!tier->isAnnounceReady && tier->needsToAnnounce(now))
+            {
+                tier->isAnnounceReady = true;
+                hosts_[tier->currentTracker()->host].announce_ready.push_back({ deadline.info_hash, deadline.tier_id });
             }
         }
     }
+}
 
-    /* First, scrape what we can. We handle scrapes first because
-     * we can work through that queue much faster than announces
-     * (thanks to multiscrape) _and_ the scrape responses will tell
-     * us which swarms are interesting and should be announced next. */
-    multiscrape(announcer, scrape_me);
+void tr_announcer_impl::scrapeHost(tr_interned_string const& host, TrackerHost& tracker_host, time_t now)
+{
+    auto scrape_me = std::vector<tr_tier*>{};
+    scrape_me.reserve(std::size(tracker_host.scrape_ready));
+    auto ready = std::vector<TierKey>{};
+    std::swap(ready, tracker_host.scrape_ready);
+    for (auto const& [info_hash, tier_id] : ready)
+    {
+        auto* const tier = getTier(this, info_hash, tier_id);
+        if (tier == nullptr)
+        {
+            continue;
+        }
+
+        tier->isScrapeReady = false;
+        if (!tier->needsToScrape(now))
+        {
+            continue;
+        }
 
-    /* Second, announce what we can. If there aren't enough slots
-     * available, use compareAnnounceTiers to prioritize. */
-    if (announce_me.size() > MaxAnnouncesPerUpkeep)
+        // the tier may have switched trackers while it was waiting
+        if (auto const& tier_host = tier->currentTracker()->host; tier_host != host)
+        {
+            tier->isScrapeReady = true;
+            hosts_[tier_host].scrape_ready.push_back({ info_hash, tier_id });
+            continue;
+        }
+
+        scrape_me.push_back(tier);
+    }
+
+    auto const n_free = MaxConcurrentRequestsPerHost - std::min(MaxConcurrentRequestsPerHost, tracker_host.n_active);
+    tracker_host.n_active += multiscrape(this, host, scrape_me, n_free);
+
+    // keep the tiers that didn't fit into a request for the next upkeep
+    for (auto* const tier : scrape_me)
+    {
+        if (!tier->isScraping)
+        {
+            tier->isScrapeReady = true;
+            tracker_host.scrape_ready.push_back({ tier->tor->infoHash(), tier->id });
+        }
+    }
+}
+
+void tr_announcer_impl::announceHost(tr_interned_string const& host, TrackerHost& tracker_host, time_t now)
+{
+    auto announce_me = std::vector<tr_tier*>{};
+    announce_me.reserve(std::size(tracker_host.announce_ready));
+    auto ready = std::vector<TierKey>{};
+    std::swap(ready, tracker_host.announce_ready);
+    for (auto const& [info_hash, tier_id] : ready)
+    {
+        auto* const tier = getTier(this, info_hash, tier_id);
+        if (tier == nullptr)
+        {
+            continue;
+        }
+
+        tier->isAnnounceReady = false;
+        if (!tier->needsToAnnounce(now))
+        {
+            continue;
+        }
+
+        // the tier may have switched trackers while it was waiting
+        if (auto const& tier_host = tier->currentTracker()->host; tier_host != host)
+        {
+            tier->isAnnounceReady = true;
+            hosts_[tier_host].announce_ready.push_back({ info_hash, tier_id });
+            continue;
+        }
+
+        announce_me.push_back(tier);
+    }
+
+    /* If there aren't enough slots available, use compareAnnounceTiers to prioritize. */
+    auto const n_free = MaxConcurrentRequestsPerHost - std::min(MaxConcurrentRequestsPerHost, tracker_host.n_active);
+    if (std::size(announce_me) > n_free)
     {
         std::partial_sort(
             std::begin(announce_me),
-            std::begin(announce_me) + MaxAnnouncesPerUpkeep,
+            std::begin(announce_me) + n_free,
             std::end(announce_me),
             [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
-        announce_me.resize(MaxAnnouncesPerUpkeep);
     }
 
-    for (auto*& tier : announce_me)
+    for (size_t i = 0, n = std::size(announce_me); i < n; ++i)
+    {
+        auto* const tier = announce_me[i];
+
+        if (i < n_free)
+        {
+            tr_logAddTraceTier(tier, "Announcing to tracker");
+            ++tracker_host.n_active;
+            tierAnnounce(this, tier);
+        }
+        else
+        {
+            // keep it for the next upkeep
+            tier->isAnnounceReady = true;
+            tracker_host.announce_ready.push_back({ tier->tor->infoHash(), tier->id });
+        }
+    }
+}
+
+void tr_announcer_impl::scrapeAndAnnounceMore()
+{
+    auto const now = tr_time();
+
+    pullDueTiers(now);
+
+    for (auto it = std::begin(hosts_); it != std::end(hosts_);)
     {
-        tr_logAddTraceTier(tier, "Announcing to tracker");
-        tierAnnounce(announcer, tier);
+        auto& [host, tracker_host] = *it;
+
+        /* First, scrape what we can. We handle scrapes first because
+         * we can work through that queue much faster than announces
+         * (thanks to multiscrape) _and_ the scrape responses will tell
+         * us which swarms are interesting and should be announced next. */
+        scrapeHost(host, tracker_host, now);
+
+        /* Second, announce what we can. */
+        announceHost(host, tracker_host, now);
+
+        if (tracker_host.n_active == 0U && std::empty(tracker_host.announce_ready) && std::empty(tracker_host.scrape_ready))
+        {
+            it = hosts_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
     }
 }
 
@@ -1581,7 +1816,7 @@ void tr_announcer_impl::upkeep()
     // maybe kick off some scrapes / announces whose time has come
     if (!is_shutting_down_)
     {
-        scrapeAndAnnounceMore(this);
+        scrapeAndAnnounceMore();
     }
 
     announcer_udp_.upkeep();
@@ -71,8 +71,9 @@ public:
     virtual ~tr_announcer() = default;
 
     virtual tr_torrent_announcer* addTorrent(tr_torrent*, tr_tracker_callback callback, void* callback_data) = 0;
-    virtual void startTorrent(tr_torrent* tor) = 0;
-    virtual void stopTorrent(tr_torrent* tor) = 0;
+    // `announce_at` is when to tell the trackers, e.g. tr_time() for right away
+    virtual void startTorrent(tr_torrent* tor, time_t announce_at) = 0;
+    virtual void stopTorrent(tr_torrent* tor, time_t announce_at) = 0;
     virtual void resetTorrent(tr_torrent* tor) = 0;
     virtual void removeTorrent(tr_torrent* tor) = 0;
     virtual void startShutdown() = 0;
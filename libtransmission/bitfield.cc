@@ -8,6 +8,14 @@
 #include <climits> // SIZE_MAX
 #include <vector>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TR_BITFIELD_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TR_BITFIELD_NEON
+#include <arm_neon.h>
+#endif
+
 #include "tr-popcount.h"
 
 #include "transmission.h"
@@ -22,145 +30,382 @@
 namespace
 {
 
+auto constexpr WordBits = size_t{ 64U };
+auto constexpr AllOnes = ~uint64_t{};
+
+[[nodiscard]] constexpr size_t getWordsNeeded(size_t bit_count) noexcept
+{
+    /* Not ((bit_count + 63) / 64), since bit_count can be near SIZE_MAX. */
+    return (bit_count / WordBits) + ((bit_count % WordBits) != 0 ? 1 : 0);
+}
+
 [[nodiscard]] constexpr size_t getBytesNeeded(size_t bit_count) noexcept
 {
-    /* NB: If can guarantee bit_count <= SIZE_MAX - 8 then faster logic
-       is ((bit_count + 7) >> 3). */
     return (bit_count >> 3) + ((bit_count & 7) != 0 ? 1 : 0);
 }
 
-/* Used only in cases where it can be guaranteed bit_count <= SIZE_MAX - 8 */
-[[nodiscard]] constexpr size_t getBytesNeededSafe(size_t bit_count) noexcept
+/* The nth bit's mask in its word. The first bit is the high bit. */
+[[nodiscard]] constexpr uint64_t bitMask(size_t nth) noexcept
 {
-    return ((bit_count + 7) >> 3);
+    return (uint64_t{ 1 } << 63U) >> (nth % WordBits);
 }
 
-void setAllTrue(uint8_t* array, size_t bit_count)
+/* The bits at or after `begin` in begin's word */
+[[nodiscard]] constexpr uint64_t headMask(size_t begin) noexcept
 {
-    uint8_t constexpr Val = 0xFF;
-    /* Only ever called internally with in-use bit counts. Impossible
-       for bitcount > SIZE_MAX - 8. */
-    size_t const n = getBytesNeededSafe(bit_count);
+    return AllOnes >> (begin % WordBits);
+}
+
+/* The bits before `end` in end's word, or all of them if `end` is on a word boundary */
+[[nodiscard]] constexpr uint64_t tailMask(size_t end) noexcept
+{
+    auto const n = end % WordBits;
+    return n == 0U ? AllOnes : ~(AllOnes >> n);
+}
+
+void setAllTrue(uint64_t* words, size_t bit_count)
+{
+    size_t const n = getWordsNeeded(bit_count);
 
     if (n > 0)
     {
-        std::fill_n(array, n, Val);
-        /* -bit_count & 7U. Since bitcount is unsigned do ~bitcount +
-           1 to replace -bitcount as linters warn about negating
-           unsigned types. Any compiler will optimize ~x + 1 to -x in
-           the backend. */
-        uint32_t const shift = ((~bit_count) + 1) & 7U;
-        array[n - 1] = Val << shift;
+        std::fill_n(words, n, AllOnes);
+        words[n - 1] = tailMask(bit_count);
     }
 }
 
 /* Switch to std::popcount if project upgrades to c++20 or newer */
-[[nodiscard]] uint32_t doPopcount(uint8_t flags) noexcept
+[[nodiscard]] uint32_t doPopcount(uint64_t flags) noexcept
 {
-    /* If flags are ever expanded to use machine words instead of
-       uint8_t popcnt64 is also available */
-    return tr_popcnt<uint8_t>::count(flags);
+    return tr_popcnt<uint64_t>::count(flags);
 }
 
-[[nodiscard]] size_t rawCountFlags(uint8_t const* flags, size_t n) noexcept
+[[nodiscard]] size_t countLeadingZeroes(uint64_t word) noexcept
 {
-    auto ret = size_t{};
+    TR_ASSERT(word != 0U);
 
-    for (auto const* const end = flags + n; flags != end; ++flags)
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_clzll(word));
+#else
+    auto ret = size_t{};
+    for (; (word & (uint64_t{ 1 } << 63U)) == 0U; word <<= 1U)
     {
-        ret += doPopcount(*flags);
+        ++ret;
     }
-
     return ret;
+#endif
 }
 
-} // namespace
+/* Kernels that walk arrays of words. In findAndNot(), a null `a` is all
+   ones and a null `b` is all zeroes, for "have all" and "have none". */
+struct WordKernels
+{
+    size_t (*count)(uint64_t const* a, size_t n);
+    size_t (*count_and_not)(uint64_t const* a, uint64_t const* b, size_t n);
+    bool (*intersects)(uint64_t const* a, uint64_t const* b, size_t n);
 
-/****
-*****
-****/
+    // the first i in [0, n) where `a[i] & ~b[i]` isn't zero, or n
+    size_t (*find_and_not)(uint64_t const* a, uint64_t const* b, size_t n);
+};
 
-size_t tr_bitfield::countFlags() const noexcept
+[[nodiscard]] constexpr uint64_t const* offset(uint64_t const* words, size_t n) noexcept
 {
-    return rawCountFlags(std::data(flags_), std::size(flags_));
+    return words != nullptr ? words + n : nullptr;
 }
 
-size_t tr_bitfield::countFlags(size_t begin, size_t end) const noexcept
+namespace portable
+{
+
+[[nodiscard]] size_t count(uint64_t const* a, size_t n)
 {
     auto ret = size_t{};
-    size_t const first_byte = begin >> 3U;
-    size_t const last_byte = (end - 1) >> 3U;
+    for (size_t i = 0; i < n; ++i)
+    {
+        ret += doPopcount(a[i]);
+    }
+    return ret;
+}
 
-    if (bit_count_ == 0)
+[[nodiscard]] size_t countAndNot(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto ret = size_t{};
+    for (size_t i = 0; i < n; ++i)
     {
-        return 0;
+        ret += doPopcount(a[i] & ~b[i]);
     }
+    return ret;
+}
 
-    if (first_byte >= std::size(flags_))
+[[nodiscard]] bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
     {
-        return 0;
+        if ((a[i] & b[i]) != 0U)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+[[nodiscard]] size_t findAndNot(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto const a_word = a != nullptr ? a[i] : AllOnes;
+        auto const b_word = b != nullptr ? b[i] : uint64_t{};
+        if ((a_word & ~b_word) != 0U)
+        {
+            return i;
+        }
     }
+    return n;
+}
 
-    TR_ASSERT(begin < end);
-    TR_ASSERT(!std::empty(flags_));
+} // namespace portable
 
-    if (first_byte == last_byte)
+#if defined(TR_BITFIELD_AVX2)
+
+// Built for AVX2 even when the rest of the file isn't;
+// only called after checking that the CPU has it.
+#define TR_TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace avx2
+{
+
+auto constexpr VecWords = size_t{ 4U };
+
+[[nodiscard]] TR_TARGET_AVX2 inline __m256i load(uint64_t const* words)
+{
+    return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(words));
+}
+
+// Count each byte's bits by looking up each nibble's count in a table
+// with vpshufb, then sum the bytes into the four 64-bit lanes with vpsadbw.
+[[nodiscard]] TR_TARGET_AVX2 inline __m256i popcount(__m256i vec)
+{
+    auto const lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, //
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    auto const low_mask = _mm256_set1_epi8(0x0F);
+    auto const lo = _mm256_and_si256(vec, low_mask);
+    auto const hi = _mm256_and_si256(_mm256_srli_epi16(vec, 4), low_mask);
+    auto const counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+[[nodiscard]] TR_TARGET_AVX2 inline size_t sum(__m256i vec)
+{
+    auto lanes = std::array<uint64_t, VecWords>{};
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(std::data(lanes)), vec);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+[[nodiscard]] TR_TARGET_AVX2 size_t count(uint64_t const* a, size_t n)
+{
+    auto total = _mm256_setzero_si256();
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
     {
-        uint8_t val = flags_[first_byte];
+        total = _mm256_add_epi64(total, popcount(load(a + i)));
+    }
+    return sum(total) + portable::count(a + i, n - i);
+}
 
-        auto i = begin & 7U;
-        val <<= i;
-        i = (begin - end) & 7U;
-        val >>= i;
-        ret = doPopcount(val);
+[[nodiscard]] TR_TARGET_AVX2 size_t countAndNot(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto total = _mm256_setzero_si256();
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
+    {
+        total = _mm256_add_epi64(total, popcount(_mm256_andnot_si256(load(b + i), load(a + i))));
     }
-    else
+    return sum(total) + portable::countAndNot(a + i, b + i, n - i);
+}
+
+[[nodiscard]] TR_TARGET_AVX2 bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
     {
-        size_t const walk_end = std::min(std::size(flags_), last_byte);
+        if (_mm256_testz_si256(load(a + i), load(b + i)) == 0)
+        {
+            return true;
+        }
+    }
+    return portable::intersects(a + i, b + i, n - i);
+}
 
-        /* first byte */
-        size_t const first_shift = begin & 7U;
-        uint8_t val = flags_[first_byte];
-        val <<= first_shift;
-        /* No need to shift back val for correct popcount. */
-        ret = doPopcount(val);
+[[nodiscard]] TR_TARGET_AVX2 size_t findAndNot(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto const ones = _mm256_set1_epi64x(-1);
+    auto const zeroes = _mm256_setzero_si256();
 
-        /* middle bytes */
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
+    {
+        auto const a_vec = a != nullptr ? load(a + i) : ones;
+        auto const b_vec = b != nullptr ? load(b + i) : zeroes;
 
-        /* Use 2x accumulators to help alleviate high latency of
-           popcnt instruction on many architectures. */
-        size_t tmp_accum = 0;
-        for (size_t i = first_byte + 1; i < walk_end;)
+        // testc is 0 iff `a_vec & ~b_vec` has a bit set
+        if (_mm256_testc_si256(b_vec, a_vec) == 0)
         {
-            tmp_accum += doPopcount(flags_[i]);
-            i += 2;
-            if (i > walk_end)
-            {
-                break;
-            }
-            ret += doPopcount(flags_[i - 1]);
+            break;
         }
-        ret += tmp_accum;
+    }
+    return i + portable::findAndNot(offset(a, i), offset(b, i), n - i);
+}
+
+} // namespace avx2
+
+#undef TR_TARGET_AVX2
 
-        /* last byte */
-        if (last_byte < std::size(flags_))
+#elif defined(TR_BITFIELD_NEON)
+
+// NEON is always there on ARM64, so there's nothing to check at runtime
+namespace neon
+{
+
+auto constexpr VecWords = size_t{ 2U };
+
+[[nodiscard]] inline bool isZero(uint64x2_t vec)
+{
+    return (vgetq_lane_u64(vec, 0) | vgetq_lane_u64(vec, 1)) == 0U;
+}
+
+[[nodiscard]] inline size_t popcount(uint64x2_t vec)
+{
+    // 16 bytes of at most 8 bits each can't overflow the uint8_t sum
+    return vaddvq_u8(vcntq_u8(vreinterpretq_u8_u64(vec)));
+}
+
+[[nodiscard]] size_t count(uint64_t const* a, size_t n)
+{
+    auto total = size_t{};
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
+    {
+        total += popcount(vld1q_u64(a + i));
+    }
+    return total + portable::count(a + i, n - i);
+}
+
+[[nodiscard]] size_t countAndNot(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto total = size_t{};
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
+    {
+        total += popcount(vbicq_u64(vld1q_u64(a + i), vld1q_u64(b + i)));
+    }
+    return total + portable::countAndNot(a + i, b + i, n - i);
+}
+
+[[nodiscard]] bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
+    {
+        if (!isZero(vandq_u64(vld1q_u64(a + i), vld1q_u64(b + i))))
         {
-            /* -end & 7U. Since bitcount is unsigned do ~end + 1 to
-               replace -end as linters warn about negating unsigned
-               types. Any compiler will optimize ~x + 1 to -x in the
-               backend. */
-            uint32_t const last_shift = (~end + 1) & 7U;
-            val = flags_[last_byte];
-            val >>= last_shift;
-            /* No need to shift back val for correct popcount. */
-            ret += doPopcount(val);
+            return true;
         }
     }
+    return portable::intersects(a + i, b + i, n - i);
+}
 
-    TR_ASSERT(ret <= (begin - end));
+[[nodiscard]] size_t findAndNot(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    auto i = size_t{};
+    for (; i + VecWords <= n; i += VecWords)
+    {
+        auto const a_vec = a != nullptr ? vld1q_u64(a + i) : vdupq_n_u64(AllOnes);
+        auto const b_vec = b != nullptr ? vld1q_u64(b + i) : vdupq_n_u64(0U);
+        if (!isZero(vbicq_u64(a_vec, b_vec)))
+        {
+            break;
+        }
+    }
+    return i + portable::findAndNot(offset(a, i), offset(b, i), n - i);
+}
+
+} // namespace neon
+
+#endif
+
+[[nodiscard]] WordKernels makeKernels()
+{
+#if defined(TR_BITFIELD_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return { avx2::count, avx2::countAndNot, avx2::intersects, avx2::findAndNot };
+    }
+#elif defined(TR_BITFIELD_NEON)
+    return { neon::count, neon::countAndNot, neon::intersects, neon::findAndNot };
+#endif
+
+    // NOLINTNEXTLINE(clang-diagnostic-unreachable-code)
+    return { portable::count, portable::countAndNot, portable::intersects, portable::findAndNot };
+}
+
+[[nodiscard]] WordKernels const& kernels()
+{
+    static auto const ret = makeKernels();
+    return ret;
+}
+
+} // namespace
+
+/****
+*****
+****/
+
+size_t tr_bitfield::countFlags() const noexcept
+{
+    return kernels().count(std::data(flags_), std::size(flags_));
+}
+
+size_t tr_bitfield::countFlags(size_t begin, size_t end) const noexcept
+{
+    // any bits past the end of flags_ are unset
+    end = std::min(end, std::size(flags_) * WordBits);
+    if (begin >= end)
+    {
+        return 0;
+    }
+
+    size_t const first_word = begin / WordBits;
+    size_t const last_word = (end - 1) / WordBits;
+
+    if (first_word == last_word)
+    {
+        return doPopcount(flags_[first_word] & headMask(begin) & tailMask(end));
+    }
+
+    auto ret = size_t{};
+    ret += doPopcount(flags_[first_word] & headMask(begin));
+    ret += kernels().count(std::data(flags_) + first_word + 1, last_word - first_word - 1);
+    ret += doPopcount(flags_[last_word] & tailMask(end));
+
+    TR_ASSERT(ret <= end - begin);
     return ret;
 }
 
+uint64_t tr_bitfield::getWord(size_t nth) const noexcept
+{
+    if (hasAll())
+    {
+        return AllOnes;
+    }
+
+    if (hasNone() || nth >= std::size(flags_))
+    {
+        return 0U;
+    }
+
+    return flags_[nth];
+}
+
 size_t tr_bitfield::count(size_t begin, size_t end) const
 {
     if (hasAll())
@@ -187,19 +432,21 @@ bool tr_bitfield::isValid() const
 
 std::vector<uint8_t> tr_bitfield::raw() const
 {
-    /* Impossible for bit_count_ to exceed SIZE_MAX - 8 */
-    auto const n = getBytesNeededSafe(bit_count_);
+    // if the size isn't known yet, e.g. for a magnet link's peers, use all the flags
+    auto const n = bit_count_ != 0U ? getBytesNeeded(bit_count_) : std::size(flags_) * sizeof(uint64_t);
+    auto raw = std::vector<uint8_t>(n);
 
-    if (!std::empty(flags_))
+    for (size_t i = 0; i < n; ++i)
     {
-        return flags_;
+        // the first byte is the word's high byte
+        auto const word = getWord(i / sizeof(uint64_t));
+        raw[i] = static_cast<uint8_t>(word >> (56U - 8U * (i % sizeof(uint64_t))));
     }
 
-    auto raw = std::vector<uint8_t>(n);
-
-    if (hasAll())
+    // the spare bits at the end are zero
+    if (auto const used_bit_count = bit_count_ & 7U; hasAll() && used_bit_count != 0U)
     {
-        setAllTrue(std::data(raw), bit_count_);
+        raw.back() &= 0xff << (8U - used_bit_count);
     }
 
     return raw;
@@ -209,12 +456,11 @@ void tr_bitfield::ensureBitsAlloced(size_t n)
 {
     bool const has_all = hasAll();
 
-    /* Cant use getBytesNeededSafe as n can be > SIZE_MAX - 8. */
-    size_t const bytes_needed = has_all ? getBytesNeeded(std::max(n, true_count_)) : getBytesNeeded(n);
+    size_t const words_needed = has_all ? getWordsNeeded(std::max(n, true_count_)) : getWordsNeeded(n);
 
-    if (std::size(flags_) < bytes_needed)
+    if (std::size(flags_) < words_needed)
     {
-        flags_.resize(bytes_needed);
+        flags_.resize(words_needed);
         if (has_all)
         {
             setAllTrue(std::data(flags_), true_count_);
@@ -236,7 +482,7 @@ bool tr_bitfield::ensureNthBitAlloced(size_t nth)
 
 void tr_bitfield::freeArray() noexcept
 {
-    flags_ = std::vector<uint8_t>{};
+    flags_ = std::vector<uint64_t>{};
 }
 
 void tr_bitfield::setTrueCount(size_t n) noexcept
@@ -308,19 +554,18 @@ void tr_bitfield::setHasAll() noexcept
 
 void tr_bitfield::setRaw(uint8_t const* raw, size_t byte_count)
 {
-    flags_.assign(raw, raw + byte_count);
+    flags_.assign(byte_count / sizeof(uint64_t) + (byte_count % sizeof(uint64_t) != 0U ? 1U : 0U), 0U);
 
-    // ensure any excess bits at the end of the array are set to '0'.
-    if (byte_count == getBytesNeededSafe(bit_count_))
+    for (size_t i = 0; i < byte_count; ++i)
     {
-        auto const excess_bit_count = byte_count * 8 - bit_count_;
-
-        TR_ASSERT(excess_bit_count <= 7);
+        // the first byte goes in the word's high byte
+        flags_[i / sizeof(uint64_t)] |= uint64_t{ raw[i] } << (56U - 8U * (i % sizeof(uint64_t)));
+    }
 
-        if (excess_bit_count != 0)
-        {
-            flags_.back() &= 0xff << excess_bit_count;
-        }
+    // ensure any excess bits at the end of the array are set to '0'.
+    if (byte_count != 0U && byte_count == getBytesNeeded(bit_count_))
+    {
+        flags_.back() &= tailMask(bit_count_);
     }
 
     rebuildTrueCount();
@@ -338,7 +583,7 @@ void tr_bitfield::setFromBools(bool const* flags, size_t n)
         if (flags[i])
         {
             ++true_count;
-            flags_[i >> 3U] |= (0x80 >> (i & 7U));
+            flags_[i / WordBits] |= bitMask(i);
         }
     }
 
@@ -358,24 +603,24 @@ void tr_bitfield::set(size_t nth, bool value)
     }
 
     /* Already tested that val != nth bit so just swap */
-    auto& byte = flags_[nth >> 3U];
+    auto& word = flags_[nth / WordBits];
 #ifdef TR_ENABLE_ASSERTS
-    auto const old_byte_pop = doPopcount(byte);
+    auto const old_word_pop = doPopcount(word);
 #endif
-    byte ^= 0x80 >> (nth & 7U);
+    word ^= bitMask(nth);
 #ifdef TR_ENABLE_ASSERTS
-    auto const new_byte_pop = doPopcount(byte);
+    auto const new_word_pop = doPopcount(word);
 #endif
 
     if (value)
     {
         ++true_count_;
-        TR_ASSERT(old_byte_pop + 1 == new_byte_pop);
+        TR_ASSERT(old_word_pop + 1 == new_word_pop);
     }
     else
     {
         --true_count_;
-        TR_ASSERT(new_byte_pop + 1 == old_byte_pop);
+        TR_ASSERT(new_word_pop + 1 == old_word_pop);
     }
     have_all_hint_ = true_count_ == bit_count_;
     have_none_hint_ = true_count_ == 0;
@@ -407,27 +652,28 @@ void tr_bitfield::setSpan(size_t begin, size_t end, bool value)
         return;
     }
 
-    auto walk = begin >> 3;
-    auto const last_byte = end >> 3;
+    auto walk = begin / WordBits;
+    auto const last_word = end / WordBits;
 
-    unsigned char first_mask = 0xff >> (begin & 7U);
-    unsigned char last_mask = 0xff << ((~end) & 7U);
+    // `end` is inclusive here, and ensureNthBitAlloced() checked that end + 1 won't overflow
+    auto first_mask = headMask(begin);
+    auto last_mask = tailMask(end + 1);
     if (value)
     {
 
-        if (walk == last_byte)
+        if (walk == last_word)
         {
             flags_[walk] |= first_mask & last_mask;
         }
         else
         {
             flags_[walk] |= first_mask;
-            /* last_byte is expected to be hot in cache due to earlier
+            /* last_word is expected to be hot in cache due to earlier
                count(begin, end) */
-            flags_[last_byte] |= last_mask;
-            if (++walk < last_byte)
+            flags_[last_word] |= last_mask;
+            if (++walk < last_word)
             {
-                std::fill_n(std::data(flags_) + walk, last_byte - walk, 0xff);
+                std::fill_n(std::data(flags_) + walk, last_word - walk, AllOnes);
             }
         }
 
@@ -437,19 +683,19 @@ void tr_bitfield::setSpan(size_t begin, size_t end, bool value)
     {
         first_mask = ~first_mask;
         last_mask = ~last_mask;
-        if (walk == last_byte)
+        if (walk == last_word)
         {
             flags_[walk] &= first_mask | last_mask;
         }
         else
         {
             flags_[walk] &= first_mask;
-            /* last_byte is expected to be hot in cache due to earlier
+            /* last_word is expected to be hot in cache due to earlier
                count(begin, end) */
-            flags_[last_byte] &= last_mask;
-            if (++walk < last_byte)
+            flags_[last_word] &= last_mask;
+            if (++walk < last_word)
             {
-                std::fill_n(std::data(flags_) + walk, last_byte - walk, 0);
+                std::fill_n(std::data(flags_) + walk, last_word - walk, 0U);
             }
         }
 
@@ -471,7 +717,6 @@ tr_bitfield& tr_bitfield::operator|=(tr_bitfield const& that) noexcept
     }
 
     flags_.resize(std::max(std::size(flags_), std::size(that.flags_)));
-
     for (size_t i = 0, n = std::size(that.flags_); i < n; ++i)
     {
         flags_[i] |= that.flags_[i];
@@ -495,7 +740,6 @@ tr_bitfield& tr_bitfield::operator&=(tr_bitfield const& that) noexcept
     }
 
     flags_.resize(std::min(std::size(flags_), std::size(that.flags_)));
-
     for (size_t i = 0, n = std::size(flags_); i < n; ++i)
     {
         flags_[i] &= that.flags_[i];
@@ -504,3 +748,97 @@ tr_bitfield& tr_bitfield::operator&=(tr_bitfield const& that) noexcept
     rebuildTrueCount();
     return *this;
 }
+
+bool tr_bitfield::intersects(tr_bitfield const& that) const noexcept
+{
+    if (hasNone() || that.hasNone())
+    {
+        return false;
+    }
+
+    if (hasAll())
+    {
+        return that.count() > 0U;
+    }
+
+    if (that.hasAll())
+    {
+        return count() > 0U;
+    }
+
+    auto const n = std::min(std::size(flags_), std::size(that.flags_));
+    return kernels().intersects(std::data(flags_), std::data(that.flags_), n);
+}
+
+size_t tr_bitfield::countAndNot(tr_bitfield const& that) const noexcept
+{
+    if (hasNone() || that.hasAll())
+    {
+        return 0U;
+    }
+
+    if (that.hasNone())
+    {
+        return count();
+    }
+
+    if (hasAll())
+    {
+        return size() - std::min(size(), that.count());
+    }
+
+    auto const* const a = std::data(flags_);
+    auto const n_a = std::size(flags_);
+    auto const n = std::min(n_a, std::size(that.flags_));
+
+    // past the end of `that`, nothing is masked out
+    return kernels().count_and_not(a, std::data(that.flags_), n) + kernels().count(a + n, n_a - n);
+}
+
+size_t tr_bitfield::findNextAndNot(tr_bitfield const& that, size_t begin, size_t end) const noexcept
+{
+    if (begin >= end || hasNone() || that.hasAll())
+    {
+        return end;
+    }
+
+    // the first word may start partway through
+    auto nth = begin / WordBits;
+    auto word = getWord(nth) & ~that.getWord(nth) & headMask(begin);
+
+    if (word == 0U)
+    {
+        // for the rest, a null array is all ones in `this` or all zeroes in `that`
+        auto const* const a = hasAll() ? nullptr : std::data(flags_);
+        auto const* const b = that.hasNone() ? nullptr : std::data(that.flags_);
+        auto const n_a = a == nullptr ? SIZE_MAX : std::size(flags_);
+        auto const n_b = b == nullptr ? SIZE_MAX : std::size(that.flags_);
+        auto const n_words = getWordsNeeded(end);
+
+        for (++nth; word == 0U && nth < n_words;)
+        {
+            // past the end of `this`, no bits are set
+            if (nth >= n_a)
+            {
+                return end;
+            }
+
+            // past the end of `that`, no bits are masked out
+            auto const* const b_words = nth < n_b ? offset(b, nth) : nullptr;
+            auto const stop = std::min({ n_words, n_a, nth < n_b ? n_b : SIZE_MAX });
+
+            nth += kernels().find_and_not(offset(a, nth), b_words, stop - nth);
+            if (nth < stop)
+            {
+                word = getWord(nth) & ~that.getWord(nth);
+            }
+        }
+
+        if (word == 0U)
+        {
+            return end;
+        }
+    }
+
+    return std::min(nth * WordBits + countLeadingZeroes(word), end);
+}
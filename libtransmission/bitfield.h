@@ -113,18 +113,35 @@ public:
     tr_bitfield& operator|=(tr_bitfield const& that) noexcept;
     tr_bitfield& operator&=(tr_bitfield const& that) noexcept;
 
+    // These work a word at a time, with SIMD where the CPU has it,
+    // and are meant for comparing two bitfields with the same size().
+
+    // true iff some bit is set in both `this` and `that`
+    [[nodiscard]] bool intersects(tr_bitfield const& that) const noexcept;
+
+    // the number of bits that are set in `this` but not in `that`
+    [[nodiscard]] size_t countAndNot(tr_bitfield const& that) const noexcept;
+
+    // the first bit in [begin, end) that is set in `this` but not in `that`,
+    // or `end` if there isn't one. `end` is explicit so that a "have all"
+    // bitfield whose size() isn't known yet can still be searched.
+    [[nodiscard]] size_t findNextAndNot(tr_bitfield const& that, size_t begin, size_t end) const noexcept;
+
 private:
     [[nodiscard]] size_t countFlags() const noexcept;
     [[nodiscard]] size_t countFlags(size_t begin, size_t end) const noexcept;
 
+    // the nth word of the bitfield, taking "have all" and "have none" into account
+    [[nodiscard]] uint64_t getWord(size_t nth) const noexcept;
+
     [[nodiscard]] bool testFlag(size_t n) const
     {
-        if (n >> 3U >= std::size(flags_))
+        if (n >> 6U >= std::size(flags_))
         {
             return false;
         }
 
-        bool ret = (flags_[n >> 3U] << (n & 7U) & 0x80) != 0;
+        bool ret = (flags_[n >> 6U] << (n & 63U) & (uint64_t{ 1 } << 63U)) != 0;
         return ret;
     }
 
@@ -137,7 +154,9 @@ private:
     void incrementTrueCount(size_t inc) noexcept;
     void decrementTrueCount(size_t dec) noexcept;
 
-    std::vector<uint8_t> flags_;
+    // The bits are stored a 64-bit word at a time. To keep BEP0003's
+    // bit order, the first bit in each word is its high bit.
+    std::vector<uint64_t> flags_;
 
     size_t bit_count_ = 0;
     size_t true_count_ = 0;
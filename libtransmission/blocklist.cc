@@ -5,8 +5,11 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <fstream>
+#include <limits>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include <fmt/core.h>
@@ -316,6 +319,93 @@ auto getFilenamesInDir(std::string_view folder)
     return files;
 }
 
+namespace IndexHelpers
+{
+[[nodiscard]] uint32_t toKey(in_addr const& addr) noexcept
+{
+    return ntohl(addr.s_addr);
+}
+
+[[nodiscard]] std::pair<uint64_t, uint64_t> toKey(in6_addr const& addr) noexcept
+{
+    auto key = std::pair<uint64_t, uint64_t>{};
+    for (size_t i = 0; i < 8U; ++i)
+    {
+        key.first = (key.first << 8U) | addr.s6_addr[i];
+        key.second = (key.second << 8U) | addr.s6_addr[i + 8U];
+    }
+    return key;
+}
+
+// true iff `key` comes right after `prev`
+[[nodiscard]] constexpr bool isNext(uint32_t prev, uint32_t key) noexcept
+{
+    return prev != std::numeric_limits<uint32_t>::max() && key == prev + 1U;
+}
+
+[[nodiscard]] constexpr bool isNext(std::pair<uint64_t, uint64_t> const& prev, std::pair<uint64_t, uint64_t> const& key) noexcept
+{
+    auto next = prev;
+    if (++next.second == 0U && ++next.first == 0U)
+    {
+        return false; // `prev` was the last address
+    }
+
+    return key == next;
+}
+
+// Sort `ranges` by their start and coalesce any that overlap or touch,
+// then split them into parallel `begins` and `ends` arrays.
+template<typename Key>
+void compile(std::vector<std::pair<Key, Key>>& ranges, std::vector<Key>& begins, std::vector<Key>& ends)
+{
+    std::sort(std::begin(ranges), std::end(ranges));
+
+    begins.clear();
+    ends.clear();
+    begins.reserve(std::size(ranges));
+    ends.reserve(std::size(ranges));
+
+    for (auto const& [low, high] : ranges)
+    {
+        if (!std::empty(ends) && (low <= ends.back() || isNext(ends.back(), low)))
+        {
+            ends.back() = std::max(ends.back(), high);
+        }
+        else
+        {
+            begins.push_back(low);
+            ends.push_back(high);
+        }
+    }
+
+    begins.shrink_to_fit();
+    ends.shrink_to_fit();
+}
+
+// Find the last range that begins at or before `key` and see if `key` is in it.
+// The loop's only branch is the loop condition; the step is a conditional move.
+template<typename Key>
+[[nodiscard]] bool rangesContain(std::vector<Key> const& begins, std::vector<Key> const& ends, Key const& key) noexcept
+{
+    auto n = std::size(begins);
+    if (n == 0U)
+    {
+        return false;
+    }
+
+    auto const* base = std::data(begins);
+    while (n > 1U)
+    {
+        auto const half = n / 2U;
+        base = base[half] <= key ? base + half : base;
+        n -= half;
+    }
+
+    return *base <= key && key <= ends[base - std::data(begins)];
+}
+} // namespace IndexHelpers
+
 } // namespace
 
 void Blocklist::ensureLoaded() const
@@ -325,6 +415,12 @@ void Blocklist::ensureLoaded() const
         return;
     }
 
+    load();
+    rule_count_ = std::size(rules_);
+}
+
+void Blocklist::load() const
+{
     // get the file's size
     tr_error* error = nullptr;
     auto const file_info = tr_sys_path_get_info(bin_file_, 0, &error);
@@ -482,6 +578,65 @@ bool Blocklist::contains(tr_address const& addr) const
     return std::binary_search(std::begin(rules_), std::end(rules_), addr, Compare{});
 }
 
+BlocklistIndex::BlocklistIndex(std::vector<Blocklist> const& blocklists)
+{
+    using namespace IndexHelpers;
+
+    auto v4 = std::vector<std::pair<uint32_t, uint32_t>>{};
+    auto v6 = std::vector<std::pair<v6_key_t, v6_key_t>>{};
+
+    for (auto const& blocklist : blocklists)
+    {
+        if (!blocklist.enabled())
+        {
+            continue;
+        }
+
+        for (auto const& [low, high] : blocklist.rules())
+        {
+            if (low.is_ipv4() && high.is_ipv4())
+            {
+                v4.emplace_back(toKey(low.addr.addr4), toKey(high.addr.addr4));
+            }
+            else if (low.is_ipv6() && high.is_ipv6())
+            {
+                v6.emplace_back(toKey(low.addr.addr6), toKey(high.addr.addr6));
+            }
+        }
+    }
+
+    compile(v4, v4_begin_, v4_end_);
+    compile(v6, v6_begin_, v6_end_);
+}
+
+bool BlocklistIndex::contains(tr_address const& addr) const noexcept
+{
+    using namespace IndexHelpers;
+
+    if (addr.is_ipv4())
+    {
+        return rangesContain(v4_begin_, v4_end_, toKey(addr.addr.addr4));
+    }
+
+    if (addr.is_ipv6())
+    {
+        return rangesContain(v6_begin_, v6_end_, toKey(addr.addr.addr6));
+    }
+
+    return false;
+}
+
+void BlocklistIndex::contains(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept
+{
+    if (empty())
+    {
+        std::fill_n(setme, n_addrs, false);
+        return;
+    }
+
+    std::transform(addrs, addrs + n_addrs, setme, [this](auto const& addr) { return contains(addr); });
+}
+
 std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled)
 {
     // if we can't parse the file, do nothing
@@ -515,6 +670,7 @@ std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std:
     // return a new Blocklist with these rules
     auto ret = Blocklist{ bin_file, is_enabled };
     ret.rules_ = std::move(rules);
+    ret.rule_count_ = std::size(ret.rules_);
     return ret;
 }
 
@@ -9,6 +9,8 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // for size_t
+#include <cstdint> // for uint32_t, uint64_t
 #include <optional>
 #include <string>
 #include <string_view>
@@ -39,11 +41,28 @@ public:
 
     [[nodiscard]] bool contains(tr_address const& addr) const;
 
-    [[nodiscard]] auto size() const
+    [[nodiscard]] auto const& rules() const
     {
         ensureLoaded();
 
-        return std::size(rules_);
+        return rules_;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        if (!rule_count_)
+        {
+            ensureLoaded();
+        }
+
+        return rule_count_.value_or(0U);
+    }
+
+    // Free the in-memory copy of the rules, e.g. once they've been merged
+    // into a BlocklistIndex. They're reread from `binFile()` if needed again.
+    void releaseRules() noexcept
+    {
+        rules_ = {};
     }
 
     [[nodiscard]] constexpr bool enabled() const noexcept
@@ -64,10 +83,49 @@ public:
 private:
     void ensureLoaded() const;
 
+    void load() const;
+
     mutable std::vector<std::pair<tr_address, tr_address>> rules_;
+    mutable std::optional<size_t> rule_count_;
 
     std::string bin_file_;
     bool is_enabled_ = false;
 };
 
+// The rules of all the enabled blocklists, merged into one sorted,
+// non-overlapping set of ranges per address family. Range starts and
+// ends are kept in separate flat arrays of integer keys, so a lookup
+// is a single branch-light binary search over contiguous memory.
+class BlocklistIndex
+{
+public:
+    BlocklistIndex() = default;
+
+    explicit BlocklistIndex(std::vector<Blocklist> const& blocklists);
+
+    [[nodiscard]] bool contains(tr_address const& addr) const noexcept;
+
+    // Batch lookup, e.g. for PEX ingest. Sets `setme[i]` iff `addrs[i]` is blocked.
+    void contains(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept;
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(v4_begin_) + std::size(v6_begin_);
+    }
+
+    [[nodiscard]] auto empty() const noexcept
+    {
+        return size() == 0U;
+    }
+
+private:
+    // host-endian IPv6 address, ordered the same as its network-endian bytes
+    using v6_key_t = std::pair<uint64_t, uint64_t>;
+
+    std::vector<uint32_t> v4_begin_;
+    std::vector<uint32_t> v4_end_;
+    std::vector<v6_key_t> v6_begin_;
+    std::vector<v6_key_t> v6_end_;
+};
+
 } // namespace libtransmission
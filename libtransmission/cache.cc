@@ -4,11 +4,13 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <cerrno> // EAGAIN
 #include <cstdlib> // std::lldiv()
 #include <iterator> // std::distance(), std::next(), std::prev()
 #include <limits> // std::numeric_limits<size_t>::max()
 #include <memory>
 #include <numeric> // std::accumulate()
+#include <tuple> // std::make_tuple()
 #include <utility> // std::make_pair()
 #include <vector>
 
@@ -23,6 +25,154 @@
 #include "tr-assert.h"
 #include "utils.h" // tr_time(), tr_formatter
 
+void ReadCache::setLimit(size_t max_bytes)
+{
+    max_bytes_ = max_bytes;
+    trim();
+}
+
+bool ReadCache::read(Key const& key, uint32_t offset, uint32_t len, uint8_t* setme)
+{
+    auto const it = index_.find(key);
+    if (it == std::end(index_) || size_t{ offset } + len > std::size(it->second->data))
+    {
+        ++misses_;
+        return false;
+    }
+
+    auto const entry = it->second;
+    std::copy_n(std::data(entry->data) + offset, len, setme);
+    ++hits_;
+
+    // a hit in `am_` makes the piece most-recently-used.
+    // a hit in `a1in_` doesn't reorder anything: it's likely to be
+    // a correlated reference, e.g. the same peer asking for the rest
+    // of the piece, and shouldn't be taken as a sign of popularity.
+    if (entry->in_am)
+    {
+        am_.splice(std::begin(am_), am_, entry);
+    }
+
+    return true;
+}
+
+void ReadCache::add(Key const& key, std::vector<uint8_t>&& data)
+{
+    auto const size = std::size(data);
+    if (!accepts(size) || index_.count(key) != 0U)
+    {
+        return;
+    }
+
+    // if it was evicted recently and is being asked for again, it's popular
+    if (auto const ghost = ghost_index_.find(key); ghost != std::end(ghost_index_))
+    {
+        a1out_bytes_ -= ghost->second->size;
+        a1out_.erase(ghost->second);
+        ghost_index_.erase(ghost);
+
+        am_.push_front(Entry{ key, std::move(data), true });
+        am_bytes_ += size;
+        index_.emplace(key, std::begin(am_));
+    }
+    else
+    {
+        a1in_.push_front(Entry{ key, std::move(data), false });
+        a1in_bytes_ += size;
+        index_.emplace(key, std::begin(a1in_));
+    }
+
+    trim();
+}
+
+void ReadCache::erase(Key const& key)
+{
+    auto const it = index_.find(key);
+    if (it == std::end(index_))
+    {
+        return;
+    }
+
+    auto const entry = it->second;
+    auto const size = std::size(entry->data);
+    index_.erase(it);
+
+    if (entry->in_am)
+    {
+        am_bytes_ -= size;
+        am_.erase(entry);
+    }
+    else
+    {
+        a1in_bytes_ -= size;
+        a1in_.erase(entry);
+    }
+}
+
+void ReadCache::erase(tr_torrent_id_t tor_id)
+{
+    auto keys = std::vector<Key>{};
+    for (auto it = index_.lower_bound({ tor_id, 0 }); it != std::end(index_) && it->first.first == tor_id; ++it)
+    {
+        keys.push_back(it->first);
+    }
+
+    for (auto const& key : keys)
+    {
+        erase(key);
+    }
+}
+
+void ReadCache::evictFifo()
+{
+    auto& entry = a1in_.back();
+    auto const size = std::size(entry.data);
+
+    // remember the key, but not the data, in case it gets asked for again
+    a1out_.push_front(Ghost{ entry.key, size });
+    a1out_bytes_ += size;
+    ghost_index_.insert_or_assign(entry.key, std::begin(a1out_));
+
+    index_.erase(entry.key);
+    a1in_bytes_ -= size;
+    a1in_.pop_back();
+}
+
+void ReadCache::evictLru()
+{
+    auto& entry = am_.back();
+    index_.erase(entry.key);
+    am_bytes_ -= std::size(entry.data);
+    am_.pop_back();
+}
+
+void ReadCache::trim()
+{
+    while (a1in_bytes_ + am_bytes_ > max_bytes_)
+    {
+        if (!std::empty(a1in_) && (a1in_bytes_ > maxFifoBytes() || std::empty(am_)))
+        {
+            evictFifo();
+        }
+        else
+        {
+            evictLru();
+        }
+    }
+
+    while (!std::empty(a1out_) && a1out_bytes_ > maxGhostBytes())
+    {
+        auto const& ghost = a1out_.back();
+        a1out_bytes_ -= ghost.size;
+        ghost_index_.erase(ghost.key);
+        a1out_.pop_back();
+    }
+}
+
+/***
+****
+***/
+
 Cache::Key Cache::makeKey(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
 {
     return std::make_pair(torrent->id(), loc.block);
@@ -109,21 +259,35 @@ int Cache::writeContiguous(CIter const begin, CIter const end) const
 
 size_t Cache::getMaxBlocks(int64_t max_bytes) noexcept
 {
-    return std::lldiv(max_bytes, tr_block_info::BlockSize).quot;
+    return std::lldiv(max_bytes - max_bytes / ReadCacheMinShare, tr_block_info::BlockSize).quot;
+}
+
+void Cache::updateReadCacheLimit()
+{
+    auto const write_bytes = std::size(blocks_) * tr_block_info::BlockSize;
+    auto const min_read_bytes = max_bytes_ / ReadCacheMinShare;
+    read_cache_.setLimit(std::max(max_bytes_ - std::min(max_bytes_, write_bytes), min_read_bytes));
 }
 
 int Cache::setLimit(int64_t new_limit)
 {
     max_bytes_ = new_limit;
     max_blocks_ = getMaxBlocks(new_limit);
+    updateReadCacheLimit();
 
     tr_logAddDebug(fmt::format("Maximum cache size set to {} ({} blocks)", tr_formatter_mem_B(max_bytes_), max_blocks_));
 
     return cacheTrim();
 }
 
+void Cache::setFlushBatch(size_t bytes) noexcept
+{
+    flush_batch_blocks_ = bytes / tr_block_info::BlockSize;
+}
+
 Cache::Cache(tr_torrents& torrents, int64_t max_bytes)
     : torrents_{ torrents }
+    , read_cache_{ static_cast<size_t>(max_bytes) }
     , max_blocks_(getMaxBlocks(max_bytes))
     , max_bytes_(max_bytes)
 {
@@ -145,12 +309,25 @@ int Cache::writeBlock(tr_torrent_id_t tor_id, tr_block_index_t block, std::uniqu
 
     iter->time_added = tr_time();
 
+    // the read cache's copy of any piece this block touches is now stale
+    if (auto const* const tor = torrents_.get(tor_id); tor != nullptr)
+    {
+        auto const loc = tor->blockLoc(block);
+        auto const last = tor->byteLoc(loc.byte + tor->blockSize(block) - 1);
+        for (auto piece = loc.piece; piece <= last.piece; ++piece)
+        {
+            read_cache_.erase({ tor_id, piece });
+        }
+    }
+
     iter->buf = std::move(writeme);
 
     ++cache_writes_;
     cache_write_bytes_ += std::size(*iter->buf);
 
-    return cacheTrim();
+    auto const err = cacheTrim();
+    updateReadCacheLimit();
+    return err;
 }
 
 Cache::CIter Cache::getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
@@ -168,7 +345,12 @@ Cache::CIter Cache::getBlock(tr_torrent const* torrent, tr_block_info::Location
     return std::end(blocks_);
 }
 
-int Cache::readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, uint8_t* setme)
+int Cache::readBlock(
+    tr_torrent* torrent,
+    tr_block_info::Location loc,
+    uint32_t len,
+    uint8_t* setme,
+    tr_disk_scheduler::IoClass io_class)
 {
     if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
     {
@@ -176,7 +358,60 @@ int Cache::readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t
         return {};
     }
 
-    return tr_ioRead(torrent, loc, len, setme);
+    if (read_cache_.read({ torrent->id(), loc.piece }, loc.piece_offset, len, setme))
+    {
+        return {};
+    }
+
+    // when a peer starts on a piece, it'll probably want the rest of it too
+    if (loc.piece_offset == 0 && readAhead(torrent, loc, len, setme, io_class))
+    {
+        return {};
+    }
+
+    return tr_ioRead(torrent, loc, len, setme, io_class);
+}
+
+bool Cache::hasBlocksInPiece(tr_torrent const* torrent, tr_piece_index_t piece) const noexcept
+{
+    auto const tor_id = torrent->id();
+    auto const [block_begin, block_end] = torrent->blockSpanForPiece(piece);
+    auto const iter = std::lower_bound(
+        std::begin(blocks_),
+        std::end(blocks_),
+        std::make_pair(tor_id, block_begin),
+        CompareCacheBlockByKey{});
+    return iter != std::end(blocks_) && iter->key < std::make_pair(tor_id, block_end);
+}
+
+bool Cache::readAhead(
+    tr_torrent* torrent,
+    tr_block_info::Location loc,
+    uint32_t len,
+    uint8_t* setme,
+    tr_disk_scheduler::IoClass io_class)
+{
+    auto const piece_size = torrent->pieceSize(loc.piece);
+
+    // pick up any room that the write cache has freed since the last write
+    updateReadCacheLimit();
+
+    // only cache pieces that are complete on disk
+    if (!read_cache_.accepts(piece_size) || !torrent->hasPiece(loc.piece) || hasBlocksInPiece(torrent, loc.piece) ||
+        loc.piece_offset + len > piece_size)
+    {
+        return false;
+    }
+
+    auto buf = std::vector<uint8_t>(piece_size);
+    if (tr_ioRead(torrent, torrent->pieceLoc(loc.piece), piece_size, std::data(buf), io_class) != 0)
+    {
+        return false;
+    }
+
+    std::copy_n(std::data(buf) + loc.piece_offset, len, setme);
+    read_cache_.add({ torrent->id(), loc.piece }, std::move(buf));
+    return true;
 }
 
 int Cache::prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len)
@@ -217,6 +452,12 @@ int Cache::flushFile(tr_torrent const* torrent, tr_file_index_t file)
     auto const tor_id = torrent->id();
     auto const [block_begin, block_end] = tr_torGetFileBlockSpan(torrent, file);
 
+    auto const [piece_begin, piece_end] = torrent->piecesInFile(file);
+    for (auto piece = piece_begin; piece < piece_end; ++piece)
+    {
+        read_cache_.erase({ tor_id, piece });
+    }
+
     return flushSpan(
         std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_begin), compare),
         std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_end), compare));
@@ -227,43 +468,171 @@ int Cache::flushTorrent(tr_torrent const* torrent)
     auto const compare = CompareCacheBlockByKey{};
     auto const tor_id = torrent->id();
 
+    read_cache_.erase(tor_id);
+
     return flushSpan(
         std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, 0), compare),
         std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id + 1, 0), compare));
 }
 
-int Cache::flushOldest()
+std::vector<Cache::FlushRun> Cache::getFlushRuns() const
 {
+    auto runs = std::vector<FlushRun>{};
+
+    for (auto walk = std::begin(blocks_), end = std::end(blocks_); walk != end;)
+    {
+        auto const [begin, run_end] = findContiguous(walk, end, walk);
+
+        auto run = FlushRun{};
+        run.tor_id = begin->key.first;
+        run.blocks = { begin->key.second, std::prev(run_end)->key.second + 1 };
+        run.oldest = std::min_element(begin, run_end, [](auto const& a, auto const& b) { return a.time_added < b.time_added; })
+                         ->time_added;
+
+        if (auto const* const tor = torrents_.get(run.tor_id); tor != nullptr)
+        {
+            run.dir = tor->currentDir().sv();
+
+            auto const first_byte = tor->blockLoc(run.blocks.begin).byte;
+            auto const last_byte = tor->blockLoc(run.blocks.end - 1).byte + tor->blockSize(run.blocks.end - 1) - 1;
+            auto const& open_files = tor->session->openFiles();
+            for (auto file = tor->fileOffset(tor->byteLoc(first_byte)).index,
+                      last_file = tor->fileOffset(tor->byteLoc(last_byte)).index;
+                 file <= last_file && !run.held;
+                 ++file)
+            {
+                run.held = open_files.isPreallocating(run.tor_id, file);
+            }
+
+            auto const first = tor->blockLoc(run.blocks.begin).piece;
+            auto const last = tor->blockLoc(run.blocks.end - 1).piece;
+            for (auto piece = first; piece <= last && !run.has_whole_piece; ++piece)
+            {
+                auto const span = tor->blockSpanForPiece(piece);
+                run.has_whole_piece = run.blocks.begin <= span.begin && span.end <= run.blocks.end;
+            }
+        }
+
+        runs.push_back(run);
+        walk = run_end;
+    }
+
+    return runs;
+}
+
+std::vector<Cache::FlushRun> Cache::planFlush(std::vector<FlushRun> runs, size_t n_blocks)
+{
+    auto const n_blocks_in = [](FlushRun const& run)
+    {
+        return size_t{ run.blocks.end - run.blocks.begin };
+    };
+
+    runs.erase(
+        std::remove_if(std::begin(runs), std::end(runs), [](auto const& run) { return run.held; }),
+        std::end(runs));
+
+    // Always take the oldest run so that nothing lingers in the cache
+    // indefinitely. Then prefer runs that finish writing out a piece.
     auto const oldest = std::min_element(
-        std::begin(blocks_),
-        std::end(blocks_),
-        [](auto const& a, auto const& b) { return a.time_added < b.time_added; });
+        std::begin(runs),
+        std::end(runs),
+        [](auto const& a, auto const& b) { return a.oldest < b.oldest; });
+    if (oldest != std::end(runs))
+    {
+        std::iter_swap(std::begin(runs), oldest);
+        std::sort(
+            std::next(std::begin(runs)),
+            std::end(runs),
+            [](auto const& a, auto const& b)
+            { return std::make_pair(!a.has_whole_piece, a.oldest) < std::make_pair(!b.has_whole_piece, b.oldest); });
+    }
 
-    if (oldest == std::end(blocks_)) // nothing to flush
+    auto n_chosen = size_t{};
+    auto chosen_end = std::begin(runs);
+    while (chosen_end != std::end(runs) && n_chosen < n_blocks)
     {
-        return 0;
+        n_chosen += n_blocks_in(*chosen_end);
+        ++chosen_end;
     }
+    runs.erase(chosen_end, std::end(runs));
+
+    // elevator order: sweep through each file in one direction
+    std::sort(
+        std::begin(runs),
+        std::end(runs),
+        [](auto const& a, auto const& b)
+        {
+            return std::make_tuple(a.dir, a.tor_id, a.blocks.begin) < std::make_tuple(b.dir, b.tor_id, b.blocks.begin);
+        });
+
+    return runs;
+}
 
-    auto const [begin, end] = findContiguous(std::begin(blocks_), std::end(blocks_), oldest);
+int Cache::flushRuns(std::vector<FlushRun> const& runs)
+{
+    auto const compare = CompareCacheBlockByKey{};
 
-    if (auto const err = writeContiguous(begin, end); err != 0)
+    for (auto const& run : runs)
     {
-        return err;
+        auto const begin = std::lower_bound(
+            std::begin(blocks_),
+            std::end(blocks_),
+            std::make_pair(run.tor_id, run.blocks.begin),
+            compare);
+        auto const end = std::lower_bound(begin, std::end(blocks_), std::make_pair(run.tor_id, run.blocks.end), compare);
+
+        if (auto const err = writeContiguous(begin, end); err == EAGAIN)
+        {
+            continue; // a file is still being preallocated; keep the blocks for now
+        }
+        else if (err != 0)
+        {
+            return err;
+        }
+
+        blocks_.erase(begin, end);
     }
 
-    blocks_.erase(begin, end);
     return 0;
 }
 
 int Cache::cacheTrim()
 {
-    while (std::size(blocks_) > max_blocks_)
+    if (std::size(blocks_) <= max_blocks_)
     {
-        if (auto const err = flushOldest(); err != 0)
+        return 0;
+    }
+
+    auto const target = max_blocks_ - std::min(max_blocks_, flush_batch_blocks_);
+    auto runs = getFlushRuns();
+
+    // Blocks for files that are still being preallocated are held back,
+    // but only while the other blocks can make room for them. If the held
+    // blocks alone would keep the cache over its size, give up on the
+    // preallocation so that their blocks can be written out.
+    auto n_held = size_t{};
+    for (auto const& run : runs)
+    {
+        n_held += run.held ? size_t{ run.blocks.end - run.blocks.begin } : 0U;
+    }
+
+    if (n_held > target)
+    {
+        auto n_canceled = size_t{};
+        for (auto const& run : runs)
         {
-            return err;
+            if (auto* const tor = torrents_.get(run.tor_id); tor != nullptr && run.held)
+            {
+                tor->session->openFiles().cancelPreallocation(run.tor_id);
+                ++n_canceled;
+            }
+        }
+
+        if (n_canceled > 0U)
+        {
+            runs = getFlushRuns();
         }
     }
 
-    return 0;
+    return flushRuns(planFlush(std::move(runs), std::size(blocks_) - target));
 }
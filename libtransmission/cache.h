@@ -12,17 +12,118 @@
 #include <cstdint> // for size_t
 #include <cstdint> // for intX_t, uintX_t
 #include <ctime>
+#include <list>
+#include <map>
 #include <memory> // for std::unique_ptr
+#include <string_view>
 #include <utility> // for std::pair
 #include <vector>
 
 #include "transmission.h"
 
 #include "block-info.h"
+#include "disk-scheduler.h"
 
 class tr_torrents;
 struct tr_torrent;
 
+// A size-bounded cache of whole pieces for serving uploads.
+//
+// Admission is 2Q-style so that a single pass over a torrent, e.g. one
+// peer downloading all of it, can't push out the pieces that many peers
+// keep asking for: a newly-read piece goes into a small FIFO (`a1in_`)
+// and is only promoted to the LRU (`am_`) if it's asked for again after
+// being evicted, which is noticed via a list of recently-evicted keys
+// (`a1out_`) that holds no data. Since entries are whole pieces rather
+// than pages, the FIFO gets half of the cache instead of 2Q's usual
+// quarter so that it can hold more than one or two of them.
+class ReadCache
+{
+public:
+    using Key = std::pair<tr_torrent_id_t, tr_piece_index_t>;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t size_bytes = 0;
+    };
+
+    explicit ReadCache(size_t max_bytes)
+        : max_bytes_{ max_bytes }
+    {
+    }
+
+    void setLimit(size_t max_bytes);
+
+    // If the piece is cached, copy `len` bytes starting at `offset` into `setme`.
+    // @return true if it was a cache hit; false if it was a miss
+    bool read(Key const& key, uint32_t offset, uint32_t len, uint8_t* setme);
+
+    // @return true if a piece of this size is small enough to be worth caching
+    [[nodiscard]] constexpr bool accepts(size_t piece_size) const noexcept
+    {
+        return piece_size > 0 && piece_size <= maxFifoBytes();
+    }
+
+    void add(Key const& key, std::vector<uint8_t>&& data);
+
+    void erase(Key const& key);
+    void erase(tr_torrent_id_t tor_id);
+
+    [[nodiscard]] auto stats() const noexcept
+    {
+        return Stats{ hits_, misses_, a1in_bytes_ + am_bytes_ };
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        std::vector<uint8_t> data;
+        bool in_am = false;
+    };
+
+    using Entries = std::list<Entry>;
+
+    struct Ghost
+    {
+        Key key;
+        size_t size = 0;
+    };
+
+    using Ghosts = std::list<Ghost>;
+
+    [[nodiscard]] constexpr size_t maxFifoBytes() const noexcept
+    {
+        return max_bytes_ / 2;
+    }
+
+    [[nodiscard]] constexpr size_t maxGhostBytes() const noexcept
+    {
+        return max_bytes_ / 2;
+    }
+
+    void evictFifo();
+    void evictLru();
+    void trim();
+
+    Entries a1in_;
+    Entries am_;
+    Ghosts a1out_;
+
+    std::map<Key, Entries::iterator> index_;
+    std::map<Key, Ghosts::iterator> ghost_index_;
+
+    size_t max_bytes_ = 0;
+    size_t a1in_bytes_ = 0;
+    size_t am_bytes_ = 0;
+    size_t a1out_bytes_ = 0;
+
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
 class Cache
 {
 public:
@@ -35,14 +136,49 @@ public:
         return max_bytes_;
     }
 
+    // When the cache fills up, write out this many bytes more than
+    // needed so that the writes can be batched and sorted.
+    void setFlushBatch(size_t bytes) noexcept;
+
     // @return any error code from cacheTrim()
     int writeBlock(tr_torrent_id_t tor, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>>& writeme);
 
-    int readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, uint8_t* setme);
+    // `io_class` is what the read is for, if it has to go to disk
+    int readBlock(
+        tr_torrent* torrent,
+        tr_block_info::Location loc,
+        uint32_t len,
+        uint8_t* setme,
+        tr_disk_scheduler::IoClass io_class);
     int prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len);
     int flushTorrent(tr_torrent const* torrent);
     int flushFile(tr_torrent const* torrent, tr_file_index_t file);
 
+    [[nodiscard]] auto readCacheStats() const noexcept
+    {
+        return read_cache_.stats();
+    }
+
+    // A contiguous run of unflushed blocks.
+    struct FlushRun
+    {
+        // the torrent's data directory, as a stand-in for its device
+        std::string_view dir;
+        tr_torrent_id_t tor_id = {};
+        tr_block_span_t blocks = {};
+        time_t oldest = {};
+        // true if the run holds every block of at least one piece
+        bool has_whole_piece = false;
+        // true if the run touches a file that's still being preallocated
+        bool held = false;
+    };
+
+    // Choose runs that add up to at least `n_blocks`, preferring the
+    // oldest run, then runs that hold whole pieces, then older runs.
+    // Held runs are never chosen.
+    // @return the chosen runs, sorted by (dir, torrent, offset)
+    [[nodiscard]] static std::vector<FlushRun> planFlush(std::vector<FlushRun> runs, size_t n_blocks);
+
 private:
     using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
 
@@ -78,21 +214,45 @@ private:
     // @return any error code from writeContiguous()
     [[nodiscard]] int flushSpan(CIter const begin, CIter const end);
 
+    [[nodiscard]] std::vector<FlushRun> getFlushRuns() const;
+
+    // Runs whose files are still being preallocated are skipped.
     // @return any error code from writeContiguous()
-    [[nodiscard]] int flushOldest();
+    [[nodiscard]] int flushRuns(std::vector<FlushRun> const& runs);
 
     // @return any error code from writeContiguous()
     [[nodiscard]] int cacheTrim();
 
     [[nodiscard]] static size_t getMaxBlocks(int64_t max_bytes) noexcept;
 
+    // The read cache gets whatever part of the budget the write cache
+    // isn't using, which is never less than 1/ReadCacheMinShare of it.
+    static auto constexpr ReadCacheMinShare = int64_t{ 4 };
+    void updateReadCacheLimit();
+
     [[nodiscard]] CIter getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
 
+    [[nodiscard]] bool hasBlocksInPiece(tr_torrent const* torrent, tr_piece_index_t piece) const noexcept;
+
+    // Read all of `loc`'s piece from disk into the read cache,
+    // then copy `len` bytes of it from `loc` into `setme`.
+    // This is a synchronous read of up to half the read cache's limit.
+    // @return true if the piece was read ahead
+    bool readAhead(
+        tr_torrent* torrent,
+        tr_block_info::Location loc,
+        uint32_t len,
+        uint8_t* setme,
+        tr_disk_scheduler::IoClass io_class);
+
     tr_torrents& torrents_;
 
+    ReadCache read_cache_;
+
     Blocks blocks_ = {};
     size_t max_blocks_ = 0;
     size_t max_bytes_ = 0;
+    size_t flush_batch_blocks_ = 0;
 
     mutable size_t disk_writes_ = 0;
     mutable size_t disk_write_bytes_ = 0;
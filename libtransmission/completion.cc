@@ -4,7 +4,6 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
-#include <memory>
 #include <utility>
 #include <vector>
 
@@ -14,21 +13,52 @@
 #include "torrent.h"
 #include "tr-assert.h"
 
-uint64_t tr_completion::computeHasValid() const
+uint64_t tr_completion::countValidBytes(tr_piece_index_t begin, tr_piece_index_t end) const
+{
+    end = std::min(end, block_info_->pieceCount());
+    if (begin >= end || block_info_->pieceSize() == 0)
+    {
+        return 0;
+    }
+
+    // every piece but the last one is the same size
+    auto size = uint64_t{ pieces_.count(begin, end) } * block_info_->pieceSize();
+
+    if (auto const last = block_info_->pieceCount() - 1; end == last + 1 && pieces_.test(last))
+    {
+        size -= block_info_->pieceSize() - block_info_->pieceSize(last);
+    }
+
+    return size;
+}
+
+uint64_t tr_completion::countSizeWhenDone(tr_piece_index_t begin, tr_piece_index_t end) const
 {
-    uint64_t size = 0;
+    end = std::min(end, block_info_->pieceCount());
+
+    // count bytes that we want or that we already have
+    auto size = uint64_t{};
 
-    for (tr_piece_index_t piece = 0, n_pieces = block_info_->pieceCount(); piece < n_pieces; ++piece)
+    for (tr_piece_index_t piece = begin; piece < end; ++piece)
     {
-        if (hasPiece(piece))
+        if (tor_->pieceIsWanted(piece))
         {
             size += block_info_->pieceSize(piece);
         }
+        else
+        {
+            size += countHasBytesInPiece(piece);
+        }
     }
 
     return size;
 }
 
+uint64_t tr_completion::computeHasValid() const
+{
+    return countValidBytes(0, block_info_->pieceCount());
+}
+
 uint64_t tr_completion::hasValid() const
 {
     if (!has_valid_)
@@ -48,21 +78,7 @@ uint64_t tr_completion::computeSizeWhenDone() const
         return block_info_->totalSize();
     }
 
-    // count bytes that we want or that we already have
-    auto size = uint64_t{ 0 };
-    for (tr_piece_index_t piece = 0, n_pieces = block_info_->pieceCount(); piece < n_pieces; ++piece)
-    {
-        if (tor_->pieceIsWanted(piece))
-        {
-            size += block_info_->pieceSize(piece);
-        }
-        else
-        {
-            size += countHasBytesInPiece(piece);
-        }
-    }
-
-    return size;
+    return countSizeWhenDone(0, block_info_->pieceCount());
 }
 
 uint64_t tr_completion::sizeWhenDone() const
@@ -107,21 +123,104 @@ size_t tr_completion::countMissingBytesInPiece(tr_piece_index_t piece) const
 
 std::vector<uint8_t> tr_completion::createPieceBitfield() const
 {
-    size_t const n = block_info_->pieceCount();
-    auto pieces = tr_bitfield{ n };
+    return pieces_.raw();
+}
+
+/// mutators
 
-    // NOLINTNEXTLINE modernize-avoid-c-arrays
-    auto flags = std::make_unique<bool[]>(n);
-    for (tr_piece_index_t piece = 0; piece < n; ++piece)
+void tr_completion::updatePieces(tr_piece_index_t begin, tr_piece_index_t end)
+{
+    for (tr_piece_index_t piece = begin; piece < end; ++piece)
     {
-        flags[piece] = hasPiece(piece);
+        pieces_.set(piece, countMissingBlocksInPiece(piece) == 0);
     }
-    pieces.setFromBools(flags.get(), n);
+}
 
-    return pieces.raw();
+void tr_completion::rebuildPieces()
+{
+    auto const n_pieces = block_info_->pieceCount();
+    pieces_ = tr_bitfield{ n_pieces };
+
+    if (blocks_.hasAll())
+    {
+        pieces_.setHasAll();
+        return;
+    }
+
+    if (blocks_.hasNone() || block_info_->pieceSize() == 0)
+    {
+        pieces_.setHasNone();
+        return;
+    }
+
+    // Skip from one missing block to the next instead of counting every
+    // piece's blocks. Finding them is a search for the next block that's
+    // in `all_blocks` but not in blocks_.
+    auto all_blocks = tr_bitfield{ std::size(blocks_) };
+    all_blocks.setHasAll();
+    auto const n_blocks = block_info_->blockCount();
+
+    for (tr_piece_index_t piece = 0; piece < n_pieces;)
+    {
+        auto const missing = all_blocks.findNextAndNot(blocks_, block_info_->blockSpanForPiece(piece).begin, n_blocks);
+        if (missing >= n_blocks)
+        {
+            pieces_.setSpan(piece, n_pieces);
+            break;
+        }
+
+        // we have the pieces before the one that the missing block starts in...
+        auto const loc = block_info_->blockLoc(missing);
+        if (piece < loc.piece)
+        {
+            pieces_.setSpan(piece, loc.piece);
+        }
+
+        // ...but not any of the pieces that it overlaps
+        piece = block_info_->byteLoc(loc.byte + block_info_->blockSize(missing) - 1).piece + 1;
+    }
 }
 
-/// mutators
+template<typename Change>
+void tr_completion::changeBlocks(tr_block_index_t begin, tr_block_index_t end, Change&& change)
+{
+    if (begin >= end)
+    {
+        change();
+        return;
+    }
+
+    // A block can straddle two pieces, so find every piece
+    // that has bytes in [begin, end) and take those pieces'
+    // old contributions out of the totals before the change...
+    auto const piece_begin = block_info_->blockLoc(begin).piece;
+    auto const end_byte = block_info_->blockLoc(end - 1).byte + block_info_->blockSize(end - 1);
+    auto const piece_end = block_info_->byteLoc(end_byte - 1).piece + 1;
+
+    if (has_valid_)
+    {
+        *has_valid_ -= countValidBytes(piece_begin, piece_end);
+    }
+
+    if (size_when_done_)
+    {
+        *size_when_done_ -= countSizeWhenDone(piece_begin, piece_end);
+    }
+
+    change();
+    updatePieces(piece_begin, piece_end);
+
+    // ...and put their new contributions back in afterwards
+    if (has_valid_)
+    {
+        *has_valid_ += countValidBytes(piece_begin, piece_end);
+    }
+
+    if (size_when_done_)
+    {
+        *size_when_done_ += countSizeWhenDone(piece_begin, piece_end);
+    }
+}
 
 void tr_completion::addBlock(tr_block_index_t block)
 {
@@ -130,11 +229,14 @@ void tr_completion::addBlock(tr_block_index_t block)
         return; // already had it
     }
 
-    blocks_.set(block);
-    size_now_ += block_info_->blockSize(block);
-
-    size_when_done_.reset();
-    has_valid_.reset();
+    changeBlocks(
+        block,
+        block + 1,
+        [this, block]()
+        {
+            blocks_.set(block);
+            size_now_ += block_info_->blockSize(block);
+        });
 }
 
 void tr_completion::setBlocks(tr_bitfield blocks)
@@ -142,6 +244,7 @@ void tr_completion::setBlocks(tr_bitfield blocks)
     TR_ASSERT(std::size(blocks_) == std::size(blocks));
 
     blocks_ = std::move(blocks);
+    rebuildPieces();
     size_now_ = countHasBytesInSpan({ 0, block_info_->totalSize() });
     size_when_done_.reset();
     has_valid_.reset();
@@ -152,6 +255,7 @@ void tr_completion::setHasAll() noexcept
     auto const total_size = block_info_->totalSize();
 
     blocks_.setHasAll();
+    pieces_.setHasAll();
     size_now_ = total_size;
     size_when_done_ = total_size;
     has_valid_ = total_size;
@@ -159,21 +263,40 @@ void tr_completion::setHasAll() noexcept
 
 void tr_completion::addPiece(tr_piece_index_t piece)
 {
-    auto const span = block_info_->blockSpanForPiece(piece);
+    auto const [begin, end] = block_info_->blockSpanForPiece(piece);
 
-    for (tr_block_index_t block = span.begin; block < span.end; ++block)
-    {
-        addBlock(block);
-    }
+    changeBlocks(
+        begin,
+        end,
+        [this, begin = begin, end = end]()
+        {
+            for (tr_block_index_t block = begin; block < end; ++block)
+            {
+                if (!hasBlock(block))
+                {
+                    blocks_.set(block);
+                    size_now_ += block_info_->blockSize(block);
+                }
+            }
+        });
 }
 
 void tr_completion::removePiece(tr_piece_index_t piece)
 {
     auto const [begin, end] = block_info_->blockSpanForPiece(piece);
-    size_now_ -= countHasBytesInPiece(piece);
-    size_when_done_.reset();
-    has_valid_.reset();
-    blocks_.unsetSpan(begin, end);
+
+    changeBlocks(
+        begin,
+        end,
+        [this, begin = begin, end = end]()
+        {
+            // The piece's first and last blocks may straddle its neighbours,
+            // but they get unset in full, so subtract the whole blocks' bytes
+            auto const begin_byte = block_info_->blockLoc(begin).byte;
+            auto const end_byte = block_info_->blockLoc(end - 1).byte + block_info_->blockSize(end - 1);
+            size_now_ -= countHasBytesInSpan({ begin_byte, end_byte });
+            blocks_.unsetSpan(begin, end);
+        });
 }
 
 uint64_t tr_completion::countHasBytesInSpan(tr_byte_span_t span) const
@@ -36,8 +36,10 @@ struct tr_completion
         : tor_{ tor }
         , block_info_{ block_info }
         , blocks_{ block_info_->blockCount() }
+        , pieces_{ block_info_->pieceCount() }
     {
         blocks_.setHasNone();
+        pieces_.setHasNone();
     }
 
     [[nodiscard]] constexpr tr_bitfield const& blocks() const noexcept
@@ -45,6 +47,12 @@ struct tr_completion
         return blocks_;
     }
 
+    // the pieces that we have all the blocks of
+    [[nodiscard]] constexpr tr_bitfield const& pieces() const noexcept
+    {
+        return pieces_;
+    }
+
     [[nodiscard]] constexpr bool hasAll() const noexcept
     {
         return hasMetainfo() && blocks_.hasAll();
@@ -67,7 +75,7 @@ struct tr_completion
 
     [[nodiscard]] bool hasPiece(tr_piece_index_t piece) const
     {
-        return block_info_->pieceSize() != 0 && countMissingBlocksInPiece(piece) == 0;
+        return block_info_->pieceSize() != 0 && pieces_.test(piece);
     }
 
     [[nodiscard]] constexpr uint64_t hasTotal() const noexcept
@@ -148,6 +156,35 @@ struct tr_completion
         size_when_done_.reset();
     }
 
+    // Run `change` to change which pieces are wanted, e.g. when files get
+    // selected or deselected. `spans` are disjoint [begin, end) piece spans
+    // that must cover every piece that `change` might affect. This keeps
+    // sizeWhenDone() current without rescanning the whole torrent.
+    template<typename PieceSpans, typename Change>
+    void changeWanted(PieceSpans const& spans, Change&& change)
+    {
+        if (!size_when_done_)
+        {
+            change();
+            return;
+        }
+
+        auto size = *size_when_done_;
+        for (auto const& [begin, end] : spans)
+        {
+            size -= countSizeWhenDone(begin, end);
+        }
+
+        change();
+
+        for (auto const& [begin, end] : spans)
+        {
+            size += countSizeWhenDone(begin, end);
+        }
+
+        size_when_done_ = size;
+    }
+
     [[nodiscard]] uint64_t countHasBytesInSpan(tr_byte_span_t) const;
 
     [[nodiscard]] constexpr bool hasMetainfo() const noexcept
@@ -159,6 +196,20 @@ private:
     [[nodiscard]] uint64_t computeHasValid() const;
     [[nodiscard]] uint64_t computeSizeWhenDone() const;
 
+    // the verified bytes in pieces [begin, end)
+    [[nodiscard]] uint64_t countValidBytes(tr_piece_index_t begin, tr_piece_index_t end) const;
+
+    // what pieces [begin, end) contribute to sizeWhenDone()
+    [[nodiscard]] uint64_t countSizeWhenDone(tr_piece_index_t begin, tr_piece_index_t end) const;
+
+    // update blocks [begin, end) with `change`, keeping pieces_ and the cached totals current
+    template<typename Change>
+    void changeBlocks(tr_block_index_t begin, tr_block_index_t end, Change&& change);
+
+    // recheck which of pieces [begin, end) we have, e.g. after their blocks changed
+    void updatePieces(tr_piece_index_t begin, tr_piece_index_t end);
+    void rebuildPieces();
+
     [[nodiscard]] uint64_t countHasBytesInPiece(tr_piece_index_t piece) const
     {
         return countHasBytesInSpan(block_info_->byteSpanForPiece(piece));
@@ -169,12 +220,19 @@ private:
 
     tr_bitfield blocks_{ 0 };
 
+    // Which pieces we have. Kept up-to-date as blocks and pieces are
+    // added and removed, so that hasPiece() and hasValid() don't need
+    // to count each piece's blocks.
+    tr_bitfield pieces_{ 0 };
+
     // Number of bytes we'll have when done downloading. [0..totalSize]
-    // Mutable because lazy-calculated
+    // Mutable because lazy-calculated. Once calculated, it is kept
+    // up-to-date as blocks and pieces are added and removed.
     mutable std::optional<uint64_t> size_when_done_;
 
     // Number of verified bytes we have right now. [0..totalSize]
-    // Mutable because lazy-calculated
+    // Mutable because lazy-calculated. Once calculated, it is kept
+    // up-to-date as blocks and pieces are added and removed.
     mutable std::optional<uint64_t> has_valid_;
 
     // Number of bytes we have now. [0..sizeWhenDone]
@@ -42,6 +42,7 @@ using TR_WC_RNG = RNG;
 #endif
 
 #define TR_CRYPTO_X509_FALLBACK
+#define TR_CRYPTO_POWM_FALLBACK
 #include "crypto-utils-fallback.cc" // NOLINT(bugprone-suspicious-include)
 
 /***
@@ -8,8 +8,10 @@
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #endif
 
+#include <algorithm> // std::fill_n()
 #include <memory>
 
+#include <openssl/bn.h>
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
@@ -298,6 +300,57 @@ void tr_x509_cert_free(tr_x509_cert_t handle)
 ****
 ***/
 
+bool tr_powm(
+    void const* base,
+    size_t base_length,
+    void const* exponent,
+    size_t exponent_length,
+    void const* modulus,
+    size_t modulus_length,
+    void* setme)
+{
+    auto const to_bn = [](void const* bin, size_t bin_length)
+    {
+        return std::unique_ptr<BIGNUM, decltype(&BN_free)>{
+            BN_bin2bn(static_cast<unsigned char const*>(bin), static_cast<int>(bin_length), nullptr),
+            &BN_free
+        };
+    };
+
+    // BN_CTX is a scratch-space pool; keep one per thread instead of one per call
+    thread_local auto const ctx = std::unique_ptr<BN_CTX, decltype(&BN_CTX_free)>{ BN_CTX_new(), &BN_CTX_free };
+    auto const bn_base = to_bn(base, base_length);
+    auto const bn_exponent = to_bn(exponent, exponent_length);
+    auto const bn_modulus = to_bn(modulus, modulus_length);
+    auto const bn_result = std::unique_ptr<BIGNUM, decltype(&BN_free)>{ BN_new(), &BN_free };
+    if (!ctx || !bn_base || !bn_exponent || !bn_modulus || !bn_result)
+    {
+        log_error();
+        return false;
+    }
+
+    // The exponent is our secret key, so don't leak it through timing.
+    // With this flag set, BN_mod_exp() uses BN_mod_exp_mont_consttime().
+    BN_set_flags(bn_exponent.get(), BN_FLG_CONSTTIME);
+
+    if (!check_result(BN_mod_exp(bn_result.get(), bn_base.get(), bn_exponent.get(), bn_modulus.get(), ctx.get())))
+    {
+        return false;
+    }
+
+    // left-pad the result with zeroes
+    auto const result_length = static_cast<size_t>(BN_num_bytes(bn_result.get()));
+    TR_ASSERT(result_length <= modulus_length);
+    auto* const out = static_cast<unsigned char*>(setme);
+    std::fill_n(out, modulus_length - result_length, 0);
+    BN_bn2bin(bn_result.get(), out + (modulus_length - result_length));
+    return true;
+}
+
+/***
+****
+***/
+
 bool tr_rand_buffer(void* buffer, size_t length)
 {
     if (length == 0)
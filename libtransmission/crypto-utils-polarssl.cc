@@ -34,6 +34,7 @@
 #include "utils.h"
 
 #define TR_CRYPTO_X509_FALLBACK
+#define TR_CRYPTO_POWM_FALLBACK
 #include "crypto-utils-fallback.cc" // NOLINT(bugprone-suspicious-include)
 
 /***
@@ -114,6 +114,21 @@ T tr_rand_obj()
     return t;
 }
 
+/**
+ * @brief Compute `base` ^ `exponent` mod `modulus` with the crypto library's bignum support.
+ *
+ * All the numbers are big-endian. `setme` must be `modulus_length` bytes long.
+ * @return `false` if the crypto library can't do it, e.g. it has no bignum support.
+ */
+bool tr_powm(
+    void const* base,
+    size_t base_length,
+    void const* exponent,
+    size_t exponent_length,
+    void const* modulus,
+    size_t modulus_length,
+    void* setme);
+
 /**
  * @brief Generate a SSHA password from its plaintext source.
  */
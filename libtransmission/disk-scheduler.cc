@@ -0,0 +1,282 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include "transmission.h"
+
+#include "disk-scheduler.h"
+#include "tr-assert.h"
+
+namespace
+{
+
+// Usage is measured over two periods of this length
+auto constexpr UsagePeriod = std::chrono::milliseconds{ 500 };
+
+// A class that's used less of a device than this, and has nothing
+// in flight, isn't busy and doesn't take a share of the device
+auto constexpr BusyFraction = 0.05;
+
+// How often waiting I/O rechecks whether it's its turn. Usage decays
+// as time passes, so it can be its turn even if no I/O has finished.
+auto constexpr RecheckInterval = std::chrono::milliseconds{ 10 };
+
+// How many paths deviceOf() remembers
+auto constexpr MaxCachedDevices = size_t{ 1024 };
+
+[[nodiscard]] constexpr size_t toIndex(tr_disk_scheduler::IoClass io_class) noexcept
+{
+    return static_cast<size_t>(io_class);
+}
+
+[[nodiscard]] size_t latencyBucket(tr_disk_scheduler::clock::duration latency) noexcept
+{
+    auto const usec = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+    auto bucket = size_t{};
+    for (auto val = uint64_t(std::max(usec, decltype(usec){})); val != 0U; val >>= 1U)
+    {
+        ++bucket;
+    }
+
+    return std::min(bucket, tr_disk_scheduler::ClassStats::NumBuckets - 1U);
+}
+
+} // namespace
+
+// ---
+
+void tr_disk_scheduler::Usage::roll(clock::time_point now)
+{
+    if (auto const elapsed = now - period_begin_; elapsed >= 2 * UsagePeriod)
+    {
+        period_begin_ = now;
+        previous_ = current_ = {};
+    }
+    else if (elapsed >= UsagePeriod)
+    {
+        period_begin_ += UsagePeriod;
+        previous_ = current_;
+        current_ = {};
+    }
+}
+
+void tr_disk_scheduler::Usage::add(clock::duration busy, clock::time_point now)
+{
+    roll(now);
+    current_ += busy;
+}
+
+double tr_disk_scheduler::Usage::fraction(clock::time_point now) const
+{
+    auto elapsed = now - period_begin_;
+    auto previous = previous_;
+    auto current = current_;
+
+    if (elapsed >= 2 * UsagePeriod)
+    {
+        return 0.0;
+    }
+
+    if (elapsed >= UsagePeriod)
+    {
+        elapsed -= UsagePeriod;
+        previous = current;
+        current = {};
+    }
+
+    // weigh the previous period by how much of it is in the last UsagePeriod
+    using seconds = std::chrono::duration<double>;
+    auto const period = seconds{ UsagePeriod }.count();
+    auto const previous_weight = 1.0 - seconds{ elapsed }.count() / period;
+    return (seconds{ previous }.count() * previous_weight + seconds{ current }.count()) / period;
+}
+
+// ---
+
+tr_disk_scheduler::tr_disk_scheduler()
+{
+    configs_[toIndex(IoClass::SeedRead)] = { 8U, 16U };
+    configs_[toIndex(IoClass::Flush)] = { 4U, 16U };
+    configs_[toIndex(IoClass::HashRead)] = { 4U, 16U };
+    configs_[toIndex(IoClass::Background)] = { 1U, 1U };
+}
+
+void tr_disk_scheduler::setClassConfig(IoClass io_class, ClassConfig config)
+{
+    TR_ASSERT(config.weight > 0U);
+    TR_ASSERT(config.max_in_flight > 0U);
+
+    auto const lock = std::lock_guard{ mutex_ };
+    configs_[toIndex(io_class)] = config;
+    cv_.notify_all();
+}
+
+tr_disk_scheduler::ClassConfig tr_disk_scheduler::classConfig(IoClass io_class) const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    return configs_[toIndex(io_class)];
+}
+
+bool tr_disk_scheduler::isBusy(Device const& device, size_t io_class, clock::time_point now) const
+{
+    return device.in_flight[io_class] > 0U || device.usage[io_class].fraction(now) >= BusyFraction;
+}
+
+bool tr_disk_scheduler::mayStart(Device const& device, size_t io_class, clock::time_point now) const
+{
+    auto const& config = configs_[io_class];
+    if (device.in_flight[io_class] >= config.max_in_flight)
+    {
+        return false;
+    }
+
+    auto total_weight = config.weight;
+    for (size_t other = 0; other < NumClasses; ++other)
+    {
+        if (other != io_class && isBusy(device, other, now))
+        {
+            total_weight += configs_[other].weight;
+        }
+    }
+
+    if (total_weight == config.weight) // nothing else wants the device
+    {
+        return true;
+    }
+
+    auto const share = static_cast<double>(config.weight) / total_weight;
+    return device.usage[io_class].fraction(now) <= share;
+}
+
+tr_disk_scheduler::Ticket tr_disk_scheduler::start(device_t device, IoClass io_class)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    auto const now = clock::now();
+    ++devices_[device].in_flight[toIndex(io_class)];
+    return Ticket{ this, device, io_class, now, now };
+}
+
+tr_disk_scheduler::Ticket tr_disk_scheduler::wait(
+    device_t device,
+    IoClass io_class,
+    std::function<bool()> const& cancelled)
+{
+    auto lock = std::unique_lock{ mutex_ };
+    auto const idx = toIndex(io_class);
+    auto const requested_at = clock::now();
+    auto& dev = devices_[device];
+
+    auto now = requested_at;
+    auto waited = false;
+    while (!mayStart(dev, idx, now))
+    {
+        if (cancelled && cancelled())
+        {
+            return {};
+        }
+
+        waited = true;
+        cv_.wait_for(lock, RecheckInterval);
+        now = clock::now();
+    }
+
+    if (waited)
+    {
+        ++stats_[idx].waits;
+    }
+
+    ++dev.in_flight[idx];
+    return Ticket{ this, device, io_class, requested_at, now };
+}
+
+void tr_disk_scheduler::done(Ticket const& ticket)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    auto const idx = toIndex(ticket.io_class_);
+    auto const now = clock::now();
+
+    auto& dev = devices_[ticket.device_];
+    TR_ASSERT(dev.in_flight[idx] > 0U);
+    --dev.in_flight[idx];
+    dev.usage[idx].add(now - ticket.started_at_, now);
+
+    auto& stats = stats_[idx];
+    ++stats.count;
+    ++stats.latency_histogram[latencyBucket(now - ticket.requested_at_)];
+
+    cv_.notify_all();
+}
+
+tr_disk_scheduler::Stats tr_disk_scheduler::stats() const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    return stats_;
+}
+
+void tr_disk_scheduler::setDeviceFunc(DeviceFunc func)
+{
+    auto const lock = std::lock_guard{ device_cache_mutex_ };
+    device_func_ = std::move(func);
+    device_cache_.clear();
+}
+
+tr_disk_scheduler::device_t tr_disk_scheduler::deviceOf(std::string_view path)
+{
+    auto const lock = std::lock_guard{ device_cache_mutex_ };
+
+    if (device_func_)
+    {
+        return device_func_(path);
+    }
+
+    if (auto const iter = device_cache_.find(path); iter != std::end(device_cache_))
+    {
+        return iter->second;
+    }
+
+    auto device = device_t{};
+
+#ifndef _WIN32
+    // the path might not have been created yet, so walk up to the nearest parent that has
+    auto dir = std::string{ path };
+    for (;;)
+    {
+        if (struct stat sb = {}; stat(dir.c_str(), &sb) == 0)
+        {
+            device = static_cast<device_t>(sb.st_dev);
+            break;
+        }
+
+        auto const pos = dir.find_last_of('/');
+        if (pos == std::string::npos || std::size(dir) <= 1U)
+        {
+            break;
+        }
+
+        dir.resize(pos == 0U ? 1U : pos);
+    }
+#endif
+
+    if (std::size(device_cache_) >= MaxCachedDevices)
+    {
+        device_cache_.clear();
+    }
+
+    device_cache_.try_emplace(std::string{ path }, device);
+    return device;
+}
@@ -0,0 +1,211 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/**
+ * @addtogroup file_io File IO
+ * @{
+ */
+
+// Shares each disk's time between the different kinds of I/O that
+// the session does, so that e.g. verifying a torrent doesn't make
+// seeding from the same disk crawl.
+//
+// When more than one class of I/O is busy on a device, each class gets
+// a share of the device's time in proportion to its weight. Classes that
+// aren't busy don't hold anything back, so a class that's alone on a
+// device gets all of it.
+//
+// Seeding reads, flushes, and hash checks are done in the session thread,
+// which can't be made to wait without stalling everything else, so they
+// are started right away with start(). Their time is still counted, so
+// the worker threads' I/O, which uses wait(), backs off while they're busy.
+class tr_disk_scheduler
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum class IoClass : uint8_t
+    {
+        SeedRead, // reading blocks to upload to peers
+        Flush, // writing downloaded blocks from the cache
+        HashRead, // reading downloaded pieces to check them
+        Background // verifying, preallocating, and moving
+    };
+
+    static auto constexpr NumClasses = size_t{ 4 };
+
+    // Identifies a device, e.g. the `st_dev` of the files on it
+    using device_t = uint64_t;
+
+    struct ClassConfig
+    {
+        uint32_t weight = 1;
+
+        // How many of the class' I/Os may be in progress on a device at once
+        size_t max_in_flight = 1;
+    };
+
+    struct ClassStats
+    {
+        // Latencies from when I/O was requested until it was done.
+        // latency_histogram[i] counts I/O that took less than 2^i microseconds;
+        // the last bucket counts everything that took longer.
+        static auto constexpr NumBuckets = size_t{ 24 };
+
+        uint64_t count = 0;
+        uint64_t waits = 0; // how many I/Os had to wait for their turn
+        std::array<uint64_t, NumBuckets> latency_histogram = {};
+    };
+
+    using Stats = std::array<ClassStats, NumClasses>;
+
+    // The right to do some I/O. The I/O is done when the ticket is destroyed.
+    class Ticket
+    {
+    public:
+        Ticket() noexcept = default;
+        Ticket(Ticket const&) = delete;
+        Ticket& operator=(Ticket const&) = delete;
+
+        Ticket(Ticket&& that) noexcept
+        {
+            *this = std::move(that);
+        }
+
+        Ticket& operator=(Ticket&& that) noexcept
+        {
+            std::swap(scheduler_, that.scheduler_);
+            std::swap(device_, that.device_);
+            std::swap(io_class_, that.io_class_);
+            std::swap(requested_at_, that.requested_at_);
+            std::swap(started_at_, that.started_at_);
+            return *this;
+        }
+
+        ~Ticket()
+        {
+            if (scheduler_ != nullptr)
+            {
+                scheduler_->done(*this);
+            }
+        }
+
+        [[nodiscard]] constexpr explicit operator bool() const noexcept
+        {
+            return scheduler_ != nullptr;
+        }
+
+    private:
+        friend class tr_disk_scheduler;
+
+        Ticket(
+            tr_disk_scheduler* scheduler,
+            device_t device,
+            IoClass io_class,
+            clock::time_point requested_at,
+            clock::time_point started_at) noexcept
+            : scheduler_{ scheduler }
+            , device_{ device }
+            , io_class_{ io_class }
+            , requested_at_{ requested_at }
+            , started_at_{ started_at }
+        {
+        }
+
+        tr_disk_scheduler* scheduler_ = nullptr;
+        device_t device_ = {};
+        IoClass io_class_ = {};
+        clock::time_point requested_at_;
+        clock::time_point started_at_;
+    };
+
+    tr_disk_scheduler();
+    tr_disk_scheduler(tr_disk_scheduler&&) = delete;
+    tr_disk_scheduler(tr_disk_scheduler const&) = delete;
+    tr_disk_scheduler& operator=(tr_disk_scheduler&&) = delete;
+    tr_disk_scheduler& operator=(tr_disk_scheduler const&) = delete;
+    ~tr_disk_scheduler() = default;
+
+    void setClassConfig(IoClass io_class, ClassConfig config);
+    [[nodiscard]] ClassConfig classConfig(IoClass io_class) const;
+
+    // Start some I/O right away. For the session thread, which mustn't block.
+    [[nodiscard]] Ticket start(device_t device, IoClass io_class);
+
+    // Block until it's `io_class`' turn to use the device, then start some I/O.
+    // Gives up and returns an empty ticket if `cancelled` returns true.
+    [[nodiscard]] Ticket wait(device_t device, IoClass io_class, std::function<bool()> const& cancelled = {});
+
+    // @return the device that holds `path`, or of its nearest existing parent.
+    // Results are cached, so this is cheap to call for every I/O.
+    [[nodiscard]] device_t deviceOf(std::string_view path);
+
+    // Make deviceOf() ask `func` instead of the filesystem, e.g. so that
+    // tests can pretend that two directories are on different disks.
+    // Pass an empty func to go back to the filesystem.
+    using DeviceFunc = std::function<device_t(std::string_view path)>;
+    void setDeviceFunc(DeviceFunc func);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    // Time spent doing I/O over the last ~second
+    class Usage
+    {
+    public:
+        void add(clock::duration busy, clock::time_point now);
+
+        // @return the fraction of recent time spent doing I/O
+        [[nodiscard]] double fraction(clock::time_point now) const;
+
+    private:
+        void roll(clock::time_point now);
+
+        clock::time_point period_begin_;
+        clock::duration current_ = {};
+        clock::duration previous_ = {};
+    };
+
+    struct Device
+    {
+        std::array<size_t, NumClasses> in_flight = {};
+        std::array<Usage, NumClasses> usage = {};
+    };
+
+    [[nodiscard]] bool isBusy(Device const& device, size_t io_class, clock::time_point now) const;
+    [[nodiscard]] bool mayStart(Device const& device, size_t io_class, clock::time_point now) const;
+    void done(Ticket const& ticket);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    std::array<ClassConfig, NumClasses> configs_;
+    std::map<device_t, Device> devices_;
+    Stats stats_ = {};
+
+    std::mutex device_cache_mutex_;
+    std::map<std::string, device_t, std::less<>> device_cache_;
+    DeviceFunc device_func_;
+};
+
+/* @} */
@@ -602,7 +602,22 @@ tr_sys_file_t tr_sys_file_open(char const* path, int flags, int permissions, tr_
         }
     }
 
-    tr_sys_file_t const ret = open(path, native_flags, permissions);
+#ifdef O_DIRECT
+    if ((flags & TR_SYS_FILE_DIRECT) != 0)
+    {
+        native_flags |= O_DIRECT;
+    }
+#endif
+
+    tr_sys_file_t ret = open(path, native_flags, permissions);
+
+#ifdef O_DIRECT
+    // some filesystems refuse O_DIRECT; fall back to buffered I/O
+    if (ret == TR_BAD_SYS_FILE && errno == EINVAL && (native_flags & O_DIRECT) != 0)
+    {
+        ret = open(path, native_flags & ~O_DIRECT, permissions);
+    }
+#endif
 
     if (ret != TR_BAD_SYS_FILE)
     {
@@ -610,6 +625,13 @@ tr_sys_file_t tr_sys_file_open(char const* path, int flags, int permissions, tr_
         {
             set_file_for_single_pass(ret);
         }
+
+#ifdef F_NOCACHE
+        if ((flags & TR_SYS_FILE_DIRECT) != 0)
+        {
+            (void)fcntl(ret, F_NOCACHE, 1);
+        }
+#endif
     }
     else
     {
@@ -791,6 +813,91 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_copy_range(
+    tr_sys_file_t in,
+    uint64_t in_offset,
+    tr_sys_file_t out,
+    uint64_t out_offset,
+    uint64_t size,
+    tr_error** error)
+{
+    TR_ASSERT(in != TR_BAD_SYS_FILE);
+    TR_ASSERT(out != TR_BAD_SYS_FILE);
+
+#if defined(USE_COPY_FILE_RANGE)
+
+    /* Kernel copy by copy_file_range, which can share extents (reflink)
+     * on filesystems that support it. It might not work across filesystems,
+     * in which case we fall back to copying through userspace. */
+    while (size > 0U)
+    {
+        auto off_in = static_cast<off_t>(in_offset);
+        auto off_out = static_cast<off_t>(out_offset);
+        auto const copied = copy_file_range(in, &off_in, out, &off_out, std::min(size, uint64_t{ SSIZE_MAX }), 0);
+
+        if (copied == -1)
+        {
+            if (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)
+            {
+                break;
+            }
+
+            set_system_error(error, errno);
+            return false;
+        }
+
+        if (copied == 0) /* unexpected EOF; let the fallback report it */
+        {
+            break;
+        }
+
+        in_offset += copied;
+        out_offset += copied;
+        size -= copied;
+    }
+
+#endif /* USE_COPY_FILE_RANGE */
+
+    /* Userspace fallback */
+    auto buf = std::vector<char>(std::min(size, uint64_t{ 4U * 1024U * 1024U }));
+    while (size > 0U)
+    {
+        uint64_t bytes_read = 0;
+        if (!tr_sys_file_read_at(in, std::data(buf), std::min(size, uint64_t{ std::size(buf) }), in_offset, &bytes_read, error))
+        {
+            if (error != nullptr && *error == nullptr) /* EOF */
+            {
+                set_system_error(error, EIO);
+            }
+
+            return false;
+        }
+
+        for (uint64_t written = 0; written < bytes_read;)
+        {
+            uint64_t bytes_written = 0;
+            if (!tr_sys_file_write_at(
+                    out,
+                    std::data(buf) + written,
+                    bytes_read - written,
+                    out_offset + written,
+                    &bytes_written,
+                    error))
+            {
+                return false;
+            }
+
+            written += bytes_written;
+        }
+
+        in_offset += bytes_read;
+        out_offset += bytes_read;
+        size -= bytes_read;
+    }
+
+    return true;
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
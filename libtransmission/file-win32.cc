@@ -11,6 +11,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <shlobj.h> /* SHCreateDirectoryEx() */
 #include <winioctl.h> /* FSCTL_SET_SPARSE */
@@ -887,6 +888,11 @@ tr_sys_file_t tr_sys_file_open(char const* path, int flags, int /*permissions*/,
         native_flags |= FILE_FLAG_SEQUENTIAL_SCAN;
     }
 
+    if ((flags & TR_SYS_FILE_DIRECT) != 0)
+    {
+        native_flags |= FILE_FLAG_NO_BUFFERING;
+    }
+
     ret = open_file(path, native_access, native_disposition, native_flags, error);
 
     success = ret != TR_BAD_SYS_FILE;
@@ -1092,6 +1098,57 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_copy_range(
+    tr_sys_file_t in,
+    uint64_t in_offset,
+    tr_sys_file_t out,
+    uint64_t out_offset,
+    uint64_t size,
+    tr_error** error)
+{
+    TR_ASSERT(in != TR_BAD_SYS_FILE);
+    TR_ASSERT(out != TR_BAD_SYS_FILE);
+
+    auto buf = std::vector<char>(std::min(size, uint64_t{ 4U * 1024U * 1024U }));
+    while (size > 0U)
+    {
+        uint64_t bytes_read = 0;
+        if (!tr_sys_file_read_at(in, std::data(buf), std::min(size, uint64_t{ std::size(buf) }), in_offset, &bytes_read, error))
+        {
+            return false;
+        }
+
+        if (bytes_read == 0) /* EOF */
+        {
+            set_system_error(error, ERROR_HANDLE_EOF);
+            return false;
+        }
+
+        for (uint64_t written = 0; written < bytes_read;)
+        {
+            uint64_t bytes_written = 0;
+            if (!tr_sys_file_write_at(
+                    out,
+                    std::data(buf) + written,
+                    bytes_read - written,
+                    out_offset + written,
+                    &bytes_written,
+                    error))
+            {
+                return false;
+            }
+
+            written += bytes_written;
+        }
+
+        in_offset += bytes_read;
+        out_offset += bytes_read;
+        size -= bytes_read;
+    }
+
+    return true;
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
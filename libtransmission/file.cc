@@ -4,7 +4,13 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <cstring> // for std::memcpy()
+#include <memory>
+#include <mutex>
+#include <new> // for std::align_val_t
+#include <optional>
 #include <string_view>
+#include <vector>
 
 #include "transmission.h"
 #include "error.h"
@@ -32,3 +38,228 @@ bool tr_sys_file_write_line(tr_sys_file_t handle, std::string_view buffer, tr_er
 
     return ret;
 }
+
+/***
+****  Direct I/O
+***/
+
+namespace
+{
+
+// A pool of aligned bounce buffers for direct I/O.
+// Shared between the session thread and the verify thread.
+class AlignedBufferPool
+{
+public:
+    static auto constexpr BufferSize = size_t{ 1024 * 1024 };
+
+    struct Deleter
+    {
+        void operator()(std::byte* buf) const noexcept
+        {
+            operator delete[](buf, std::align_val_t{ TR_SYS_FILE_DIRECT_ALIGNMENT });
+        }
+    };
+
+    using Buffer = std::unique_ptr<std::byte[], Deleter>;
+
+    [[nodiscard]] Buffer get()
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        if (std::empty(free_))
+        {
+            return Buffer{ static_cast<std::byte*>(
+                operator new[](BufferSize, std::align_val_t{ TR_SYS_FILE_DIRECT_ALIGNMENT })) };
+        }
+
+        auto buf = std::move(free_.back());
+        free_.pop_back();
+        return buf;
+    }
+
+    void put(Buffer buf)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        if (std::size(free_) < MaxFree)
+        {
+            free_.emplace_back(std::move(buf));
+        }
+    }
+
+    [[nodiscard]] static AlignedBufferPool& instance()
+    {
+        static auto pool = AlignedBufferPool{};
+        return pool;
+    }
+
+private:
+    static auto constexpr MaxFree = size_t{ 4 };
+
+    std::mutex mutex_;
+    std::vector<Buffer> free_;
+};
+
+[[nodiscard]] constexpr uint64_t alignDown(uint64_t n) noexcept
+{
+    return n - n % TR_SYS_FILE_DIRECT_ALIGNMENT;
+}
+
+[[nodiscard]] constexpr uint64_t alignUp(uint64_t n) noexcept
+{
+    return alignDown(n + TR_SYS_FILE_DIRECT_ALIGNMENT - 1);
+}
+
+// Read up to `len` bytes at `offset` into `buf`, stopping early only at EOF.
+bool readChunk(tr_sys_file_t handle, std::byte* buf, uint64_t len, uint64_t offset, uint64_t* bytes_read, tr_error** error)
+{
+    auto n_total = uint64_t{};
+
+    while (n_total < len)
+    {
+        auto n_read = uint64_t{};
+        tr_error* my_error = nullptr;
+        if (!tr_sys_file_read_at(handle, buf + n_total, len - n_total, offset + n_total, &n_read, &my_error))
+        {
+            if (my_error == nullptr) // EOF
+            {
+                break;
+            }
+
+            tr_error_propagate(error, &my_error);
+            return false;
+        }
+
+        n_total += n_read;
+    }
+
+    *bytes_read = n_total;
+    return true;
+}
+
+bool writeChunk(tr_sys_file_t handle, std::byte const* buf, uint64_t len, uint64_t offset, tr_error** error)
+{
+    for (auto n_total = uint64_t{}; n_total < len;)
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(handle, buf + n_total, len - n_total, offset + n_total, &n_written, error))
+        {
+            return false;
+        }
+
+        n_total += n_written;
+    }
+
+    return true;
+}
+
+} // namespace
+
+bool tr_sys_file_read_at_aligned(
+    tr_sys_file_t handle,
+    void* buffer,
+    uint64_t size,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(buffer != nullptr || size == 0);
+
+    auto& pool = AlignedBufferPool::instance();
+    auto bounce = pool.get();
+    auto* out = static_cast<std::byte*>(buffer);
+    auto n_total = uint64_t{};
+    auto ret = true;
+
+    while (n_total < size)
+    {
+        auto const want_begin = offset + n_total;
+        auto const chunk_begin = alignDown(want_begin);
+        auto const chunk_end = std::min(alignUp(offset + size), chunk_begin + AlignedBufferPool::BufferSize);
+
+        auto n_read = uint64_t{};
+        if (ret = readChunk(handle, bounce.get(), chunk_end - chunk_begin, chunk_begin, &n_read, error); !ret)
+        {
+            break;
+        }
+
+        auto const skip = want_begin - chunk_begin;
+        if (n_read <= skip) // EOF
+        {
+            break;
+        }
+
+        auto const n_copy = std::min(n_read - skip, size - n_total);
+        std::memcpy(out + n_total, bounce.get() + skip, n_copy);
+        n_total += n_copy;
+
+        if (n_read < chunk_end - chunk_begin) // EOF
+        {
+            break;
+        }
+    }
+
+    pool.put(std::move(bounce));
+
+    if (bytes_read != nullptr)
+    {
+        *bytes_read = n_total;
+    }
+
+    return ret;
+}
+
+bool tr_sys_file_write_at_aligned(tr_sys_file_t handle, void const* buffer, uint64_t size, uint64_t offset, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(buffer != nullptr || size == 0);
+
+    auto& pool = AlignedBufferPool::instance();
+    auto bounce = pool.get();
+    auto const* in = static_cast<std::byte const*>(buffer);
+    auto const end = offset + size;
+    auto truncate_to = std::optional<uint64_t>{};
+    auto ret = true;
+
+    for (auto pos = offset; ret && pos < end;)
+    {
+        auto const chunk_begin = alignDown(pos);
+        auto const chunk_end = std::min(alignUp(end), chunk_begin + AlignedBufferPool::BufferSize);
+        auto const chunk_len = chunk_end - chunk_begin;
+        auto const n_copy = std::min(end, chunk_end) - pos;
+
+        // if we're only overwriting part of the chunk, start with what's already there
+        if (pos != chunk_begin || pos + n_copy != chunk_end)
+        {
+            auto n_read = uint64_t{};
+            if (ret = readChunk(handle, bounce.get(), chunk_len, chunk_begin, &n_read, error); !ret)
+            {
+                break;
+            }
+
+            std::fill_n(bounce.get() + n_read, chunk_len - n_read, std::byte{});
+
+            // the file ended inside this chunk, so writing all of it
+            // would leave the file longer than a plain write would
+            if (n_read < chunk_len && chunk_end > end)
+            {
+                truncate_to = std::max(chunk_begin + n_read, end);
+            }
+        }
+
+        std::memcpy(bounce.get() + (pos - chunk_begin), in + (pos - offset), n_copy);
+        ret = writeChunk(handle, bounce.get(), chunk_len, chunk_begin, error);
+        pos += n_copy;
+    }
+
+    pool.put(std::move(bounce));
+
+    if (ret && truncate_to)
+    {
+        ret = tr_sys_file_truncate(handle, *truncate_to, error);
+    }
+
+    return ret;
+}
@@ -60,9 +60,16 @@ enum tr_sys_file_open_flags_t
     TR_SYS_FILE_CREATE = (1 << 2),
     TR_SYS_FILE_APPEND = (1 << 3),
     TR_SYS_FILE_TRUNCATE = (1 << 4),
-    TR_SYS_FILE_SEQUENTIAL = (1 << 5)
+    TR_SYS_FILE_SEQUENTIAL = (1 << 5),
+    // Bypass the OS's page cache if the platform and filesystem allow it.
+    // Reads and writes must then be aligned to TR_SYS_FILE_DIRECT_ALIGNMENT,
+    // e.g. by using tr_sys_file_read_at_aligned() and tr_sys_file_write_at_aligned().
+    TR_SYS_FILE_DIRECT = (1 << 6)
 };
 
+// Offsets, sizes, and buffers for direct I/O are aligned to this many bytes
+auto inline constexpr TR_SYS_FILE_DIRECT_ALIGNMENT = size_t{ 4096 };
+
 enum tr_sys_file_lock_flags_t
 {
     TR_SYS_FILE_LOCK_SH = (1 << 0),
@@ -391,6 +398,32 @@ bool tr_sys_file_read_at(
     uint64_t* bytes_read,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like @ref tr_sys_file_read_at, but works on files opened with @ref TR_SYS_FILE_DIRECT.
+ *
+ * Reads whole aligned chunks into an aligned bounce buffer and copies the
+ * requested part out, so `buffer`, `size`, and `offset` needn't be aligned.
+ * Keeps reading until `size` bytes are read or the end of the file is reached.
+ *
+ * @param[in]  handle     Valid file descriptor.
+ * @param[out] buffer     Buffer to store read data to.
+ * @param[in]  size       Number of bytes to read.
+ * @param[in]  offset     File offset in bytes to start reading from.
+ * @param[out] bytes_read Number of bytes actually read. Optional, pass `nullptr`
+ *                        if you are not interested.
+ * @param[out] error      Pointer to error object. Optional, pass `nullptr` if
+ *                        you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_read_at_aligned(
+    tr_sys_file_t handle,
+    void* buffer,
+    uint64_t size,
+    uint64_t offset,
+    uint64_t* bytes_read,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `write()`.
  *
@@ -434,6 +467,55 @@ bool tr_sys_file_write_at(
     uint64_t* bytes_written,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like @ref tr_sys_file_write_at, but works on files opened with @ref TR_SYS_FILE_DIRECT.
+ *
+ * Writes whole aligned chunks from an aligned bounce buffer, reading back
+ * whatever's already on disk around the edges of the written range. If that
+ * extends the file past `offset + size`, it's truncated back afterwards.
+ * Writes all `size` bytes or fails.
+ *
+ * @param[in]  handle Valid file descriptor. Must be readable as well as writable.
+ * @param[in]  buffer Buffer to get data being written from.
+ * @param[in]  size   Number of bytes to write.
+ * @param[in]  offset File offset in bytes to start writing from.
+ * @param[out] error  Pointer to error object. Optional, pass `nullptr` if you
+ *                    are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_write_at_aligned(
+    tr_sys_file_t handle,
+    void const* buffer,
+    uint64_t size,
+    uint64_t offset,
+    struct tr_error** error = nullptr);
+
+/**
+ * @brief Copy part of one file to another, in the kernel if possible, with a
+ *        fallback to a userspace read/write loop.
+ *
+ * Unlike @ref tr_sys_path_copy, this can be used to copy a big file in
+ * pieces, e.g. to report progress or to copy just the parts that changed.
+ *
+ * @param[in]  in          Valid file descriptor to copy from.
+ * @param[in]  in_offset   Offset in `in` to start copying from.
+ * @param[in]  out         Valid file descriptor to copy to.
+ * @param[in]  out_offset  Offset in `out` to start copying to.
+ * @param[in]  size        Number of bytes to copy.
+ * @param[out] error       Pointer to error object. Optional, pass `nullptr`
+ *                         if you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_copy_range(
+    tr_sys_file_t in,
+    uint64_t in_offset,
+    tr_sys_file_t out,
+    uint64_t out_offset,
+    uint64_t size,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `fsync()`.
  *
@@ -14,6 +14,7 @@
 #include "transmission.h"
 
 #include "block-info.h"
+#include "disk-scheduler.h"
 
 struct tr_torrent;
 
@@ -22,11 +23,19 @@ struct tr_torrent;
  * @{
  */
 
+// These read and write through the torrent's tr_storage backend.
+// The I/O is counted against its class' share of the session's tr_disk_scheduler.
+
 /**
  * Reads the block specified by the piece index, offset, and length.
  * @return 0 on success, or an errno value on failure.
  */
-int tr_ioRead(struct tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t* setme);
+int tr_ioRead(
+    struct tr_torrent* tor,
+    tr_block_info::Location loc,
+    size_t len,
+    uint8_t* setme,
+    tr_disk_scheduler::IoClass io_class);
 
 int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location loc, size_t len);
 
@@ -5,6 +5,9 @@
 
 #include <algorithm>
 #include <cerrno> // for ENOENT
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -169,8 +172,190 @@ bool tr_metainfo_builder::setPieceSize(uint32_t piece_size) noexcept
     return true;
 }
 
+namespace checksum_helpers
+{
+
+// Each read covers this many bytes' worth of whole pieces
+auto constexpr ReadChunkSize = uint64_t{ 4U * 1024U * 1024U };
+
+// A chunk is at least one piece, so with big pieces this caps the memory
+// that the chunks being read and hashed can use, however many cores there are
+auto constexpr MaxBytesInFlight = uint64_t{ 256U * 1024U * 1024U };
+
+// Reads the torrent's files back-to-back, as if they were one big file
+class FileStream
+{
+public:
+    FileStream(std::string_view parent, tr_torrent_files const& files)
+        : parent_{ parent }
+        , files_{ files }
+    {
+    }
+
+    FileStream(FileStream&&) = delete;
+    FileStream(FileStream const&) = delete;
+    FileStream& operator=(FileStream&&) = delete;
+    FileStream& operator=(FileStream const&) = delete;
+
+    ~FileStream()
+    {
+        if (fd_ != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd_);
+        }
+    }
+
+    bool read(char* buf, uint64_t len, tr_error** error)
+    {
+        while (len > 0U || (file_index_ < files_.fileCount() && files_.fileSize(file_index_) == 0U))
+        {
+            TR_ASSERT(file_index_ < files_.fileCount());
+
+            auto const file_size = files_.fileSize(file_index_);
+
+            if (fd_ == TR_BAD_SYS_FILE && file_size > 0U)
+            {
+                fd_ = tr_sys_file_open(
+                    tr_pathbuf{ parent_, '/', files_.path(file_index_) },
+                    TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+                    0,
+                    error);
+                if (fd_ == TR_BAD_SYS_FILE)
+                {
+                    return false;
+                }
+            }
+
+            if (auto const n_this_pass = std::min(file_size - offset_, len); n_this_pass > 0U)
+            {
+                auto n_read = uint64_t{};
+                if (!tr_sys_file_read(fd_, buf, n_this_pass, &n_read, error))
+                {
+                    return false;
+                }
+
+                // the file got shorter since we looked at it
+                if (n_read == 0U)
+                {
+                    tr_error_set(error, EIO, tr_strerror(EIO));
+                    return false;
+                }
+
+                buf += n_read;
+                len -= n_read;
+                offset_ += n_read;
+            }
+
+            if (offset_ == file_size)
+            {
+                if (fd_ != TR_BAD_SYS_FILE)
+                {
+                    tr_sys_file_close(fd_);
+                    fd_ = TR_BAD_SYS_FILE;
+                }
+
+                offset_ = 0U;
+                ++file_index_;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    std::string_view const parent_;
+    tr_torrent_files const& files_;
+    tr_file_index_t file_index_ = 0U;
+    uint64_t offset_ = 0U;
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+};
+
+// A run of consecutive pieces that has been read and is waiting to be hashed
+struct Chunk
+{
+    tr_piece_index_t first_piece = 0U;
+    std::vector<char> buf;
+};
+
+// Hands chunks from the reader to the hashing threads. Buffers cycle
+// between `free_` and `ready_`, so memory use is capped at `n_buffers`
+// chunks no matter how big the torrent is.
+class ChunkQueue
+{
+public:
+    explicit ChunkQueue(size_t n_buffers)
+        : free_(n_buffers)
+    {
+    }
+
+    // Called by the reader. Blocks until a buffer is free.
+    [[nodiscard]] Chunk takeFree()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        free_cv_.wait(lock, [this]() { return !std::empty(free_); });
+        auto chunk = std::move(free_.back());
+        free_.pop_back();
+        return chunk;
+    }
+
+    void pushReady(Chunk&& chunk)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            ready_.emplace_back(std::move(chunk));
+        }
+        ready_cv_.notify_one();
+    }
+
+    // Called by the hashing threads. Returns nullopt when there's no more work.
+    [[nodiscard]] std::optional<Chunk> takeReady()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        ready_cv_.wait(lock, [this]() { return closed_ || !std::empty(ready_); });
+        if (std::empty(ready_))
+        {
+            return {};
+        }
+
+        auto chunk = std::move(ready_.front());
+        ready_.pop_front();
+        return chunk;
+    }
+
+    void giveBack(Chunk&& chunk)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            free_.emplace_back(std::move(chunk));
+        }
+        free_cv_.notify_one();
+    }
+
+    // No more chunks will be pushed
+    void close()
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            closed_ = true;
+        }
+        ready_cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable free_cv_;
+    std::condition_variable ready_cv_;
+    std::vector<Chunk> free_;
+    std::deque<Chunk> ready_;
+    bool closed_ = false;
+};
+
+} // namespace checksum_helpers
+
 bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
 {
+    using namespace checksum_helpers;
+
     checksum_piece_ = 0;
     cancel_ = false;
 
@@ -180,87 +365,87 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
         return false;
     }
 
-    auto hashes = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * pieceCount());
-    auto* walk = std::data(hashes);
-    auto sha = tr_sha1::create();
+    auto const n_pieces = pieceCount();
+    auto hashes = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * n_pieces);
 
-    auto file_index = tr_file_index_t{ 0U };
-    auto piece_index = tr_piece_index_t{ 0U };
-    auto total_remain = totalSize();
-    auto off = uint64_t{ 0U };
+    auto n_threads = hash_thread_count_ != 0U ? hash_thread_count_ : std::thread::hardware_concurrency();
+    n_threads = std::clamp(n_threads, size_t{ 1U }, size_t{ n_pieces });
 
-    auto buf = std::vector<char>(pieceSize());
+    // Keep every hashing thread busy while the next chunks are being read,
+    // as far as MaxBytesInFlight allows. There's no point in having more
+    // hashing threads than there are chunks for them to work on.
+    auto const pieces_per_chunk = static_cast<tr_piece_index_t>(std::max(uint64_t{ 1U }, ReadChunkSize / pieceSize()));
+    auto const chunk_bytes = uint64_t{ pieces_per_chunk } * pieceSize();
+    auto const n_buffers = static_cast<size_t>(
+        std::clamp(MaxBytesInFlight / chunk_bytes, uint64_t{ 2U }, uint64_t{ n_threads * 2U }));
+    n_threads = std::min(n_threads, n_buffers);
+    auto queue = ChunkQueue{ n_buffers };
 
-    auto const parent = tr_sys_path_dirname(top_);
-    auto fd = tr_sys_file_open(
-        tr_pathbuf{ parent, '/', path(file_index) },
-        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-        0,
-        error);
-    if (fd == TR_BAD_SYS_FILE)
+    auto hash_chunks = [this, &queue, &hashes]()
     {
-        return false;
-    }
+        auto sha = tr_sha1::create();
 
-    while (!cancel_ && (total_remain > 0U))
-    {
-        checksum_piece_ = piece_index;
+        while (auto chunk = queue.takeReady())
+        {
+            auto const* walk = std::data(chunk->buf);
+            auto const* const end = walk + std::size(chunk->buf);
 
-        TR_ASSERT(piece_index < pieceCount());
+            for (auto piece = chunk->first_piece; walk < end && !cancel_; ++piece)
+            {
+                auto const piece_size = block_info_.pieceSize(piece);
+                sha->add(walk, piece_size);
+                auto const digest = sha->finish();
+                std::copy(std::begin(digest), std::end(digest), std::data(hashes) + std::size(digest) * piece);
+                sha->clear();
+
+                walk += piece_size;
+                ++checksum_piece_;
+            }
 
-        uint32_t const piece_size = block_info_.pieceSize(piece_index);
-        buf.resize(piece_size);
-        auto* bufptr = std::data(buf);
+            queue.giveBack(std::move(*chunk));
+        }
+    };
 
-        auto left_in_piece = piece_size;
-        while (left_in_piece > 0U)
-        {
-            auto const n_this_pass = std::min(fileSize(file_index) - off, uint64_t{ left_in_piece });
-            auto n_read = uint64_t{};
+    auto hashers = std::vector<std::thread>{};
+    hashers.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        hashers.emplace_back(hash_chunks);
+    }
 
-            (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error);
-            bufptr += n_read;
-            off += n_read;
-            left_in_piece -= n_read;
+    // Read the files as one sequential stream on this thread,
+    // handing off chunks of whole pieces to the hashers.
+    auto stream = FileStream{ tr_sys_path_dirname(top_), files_ };
+    auto ok = true;
 
-            if (off == fileSize(file_index))
-            {
-                off = 0;
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
+    for (tr_piece_index_t piece = 0; !cancel_ && piece < n_pieces; piece += pieces_per_chunk)
+    {
+        auto const last_piece = std::min(piece + pieces_per_chunk, n_pieces) - 1U;
+        auto const chunk_size = uint64_t{ last_piece - piece } * pieceSize() + block_info_.pieceSize(last_piece);
 
-                if (++file_index < fileCount())
-                {
-                    fd = tr_sys_file_open(
-                        tr_pathbuf{ parent, '/', path(file_index) },
-                        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-                        0,
-                        error);
-                    if (fd == TR_BAD_SYS_FILE)
-                    {
-                        return false;
-                    }
-                }
-            }
-        }
+        auto chunk = queue.takeFree();
+        chunk.first_piece = piece;
+        chunk.buf.resize(chunk_size);
 
-        TR_ASSERT(bufptr - std::data(buf) == (int)piece_size);
-        TR_ASSERT(left_in_piece == 0);
-        sha->add(std::data(buf), std::size(buf));
-        auto const digest = sha->finish();
-        walk = std::copy(std::begin(digest), std::end(digest), walk);
-        sha->clear();
+        if (!stream.read(std::data(chunk.buf), chunk_size, error))
+        {
+            ok = false;
+            cancel_ = true;
+            break;
+        }
 
-        total_remain -= piece_size;
-        ++piece_index;
+        queue.pushReady(std::move(chunk));
     }
 
-    TR_ASSERT(cancel_ || size_t(walk - std::data(hashes)) == std::size(hashes));
-    TR_ASSERT(cancel_ || total_remain == 0U);
+    queue.close();
+    for (auto& hasher : hashers)
+    {
+        hasher.join();
+    }
 
-    if (fd != TR_BAD_SYS_FILE)
+    if (!ok)
     {
-        tr_sys_file_close(fd);
+        return false;
     }
 
     if (cancel_)
@@ -269,6 +454,7 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
         return false;
     }
 
+    TR_ASSERT(checksum_piece_ == n_pieces);
     piece_hashes_ = std::move(hashes);
     return true;
 }
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <algorithm> // std::move
+#include <atomic>
 #include <cstddef> // std::byte
 #include <cstdint>
 #include <future>
@@ -50,14 +51,14 @@ public:
     }
 
     // Returns the status of a `makeChecksums()` call:
-    // The current piece being tested and the total number of pieces in the torrent.
-    [[nodiscard]] constexpr std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
+    // The number of pieces checksummed so far and the total number of pieces in the torrent.
+    [[nodiscard]] std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
     {
-        return std::make_pair(checksum_piece_, block_info_.pieceCount());
+        return std::make_pair(checksum_piece_.load(), block_info_.pieceCount());
     }
 
-    // Tell the `makeChecksums()` worker thread to cleanly exit ASAP.
-    constexpr void cancelChecksums() noexcept
+    // Tell the `makeChecksums()` worker threads to cleanly exit ASAP.
+    void cancelChecksums() noexcept
     {
         cancel_ = true;
     }
@@ -89,6 +90,13 @@ public:
         comment_ = comment;
     }
 
+    // How many threads `makeChecksums()` hashes pieces in.
+    // 0, the default, means one per CPU core.
+    constexpr void setHashThreadCount(size_t n_threads) noexcept
+    {
+        hash_thread_count_ = n_threads;
+    }
+
     bool setPieceSize(uint32_t piece_size) noexcept;
 
     constexpr void setPrivate(bool is_private) noexcept
@@ -123,6 +131,11 @@ public:
         return comment_;
     }
 
+    [[nodiscard]] constexpr auto hashThreadCount() const noexcept
+    {
+        return hash_thread_count_;
+    }
+
     [[nodiscard]] auto fileCount() const noexcept
     {
         return files_.fileCount();
@@ -235,9 +248,11 @@ private:
     std::string comment_;
     std::string source_;
 
-    tr_piece_index_t checksum_piece_ = 0;
+    size_t hash_thread_count_ = 0;
+
+    std::atomic<tr_piece_index_t> checksum_piece_ = 0;
 
     bool is_private_ = false;
     bool anonymize_ = false;
-    bool cancel_ = false;
+    std::atomic<bool> cancel_ = false;
 };
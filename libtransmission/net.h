@@ -11,6 +11,7 @@
 #include <algorithm> // for std::copy_n
 #include <array>
 #include <cstddef> // size_t
+#include <functional> // std::hash
 #include <optional>
 #include <string>
 #include <string_view>
@@ -280,6 +281,18 @@ struct tr_address
     [[nodiscard]] bool is_valid_for_peers(tr_port port) const noexcept;
 };
 
+template<>
+struct std::hash<tr_address>
+{
+    [[nodiscard]] size_t operator()(tr_address const& address) const noexcept
+    {
+        auto const bytes = address.is_ipv4() ?
+            std::string_view{ reinterpret_cast<char const*>(&address.addr.addr4), sizeof(address.addr.addr4) } :
+            std::string_view{ reinterpret_cast<char const*>(&address.addr.addr6), sizeof(address.addr.addr6) };
+        return std::hash<std::string_view>{}(bytes);
+    }
+};
+
 /***********************************************************************
  * Sockets
  **********************************************************************/
@@ -4,15 +4,20 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
-#include <array>
+#include <cerrno>
 #include <cstdint> // uint8_t, uint64_t
+#include <functional>
+#include <list>
+#include <mutex>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <fmt/core.h>
 
 #include "transmission.h"
 
+#include "disk-scheduler.h"
 #include "error-types.h"
 #include "error.h"
 #include "file.h"
@@ -65,7 +70,15 @@ bool preallocate_file_sparse(tr_sys_file_t fd, uint64_t length, tr_error** error
     return false;
 }
 
-bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error** error)
+// Everything before `from` has already been written.
+// `keep_going` is called with the number of bytes written so far;
+// returning false from it cancels the preallocation.
+bool preallocate_file_full(
+    tr_sys_file_t fd,
+    uint64_t from,
+    uint64_t length,
+    std::function<bool(uint64_t)> const& keep_going,
+    tr_error** error)
 {
     tr_error* my_error = nullptr;
 
@@ -83,18 +96,26 @@ bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error** error)
 
     if (!TR_ERROR_IS_ENOSPC(my_error->code))
     {
-        auto buf = std::array<uint8_t, 4096>{};
+        auto const buf = std::vector<uint8_t>(1024U * 1024U);
+        auto done = from;
         bool success = true;
 
         tr_error_clear(&my_error);
 
         /* fallback: the old-fashioned way */
-        while (success && length > 0)
+        while (success && done < length)
         {
-            uint64_t const this_pass = std::min(length, uint64_t{ std::size(buf) });
+            if (!keep_going(done))
+            {
+                tr_error_set(&my_error, ECANCELED, tr_strerror(ECANCELED));
+                success = false;
+                break;
+            }
+
+            uint64_t const this_pass = std::min(length - done, uint64_t{ std::size(buf) });
             uint64_t bytes_written = 0;
-            success = tr_sys_file_write(fd, std::data(buf), this_pass, &bytes_written, &my_error);
-            length -= bytes_written;
+            success = tr_sys_file_write_at(fd, std::data(buf), this_pass, done, &bytes_written, &my_error);
+            done += bytes_written;
         }
 
         if (success)
@@ -113,6 +134,289 @@ bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error** error)
 
 ///
 
+tr_preallocator::~tr_preallocator()
+{
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        stop_ = true;
+        cancel_current_ = true;
+    }
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void tr_preallocator::add(
+    tr_torrent_id_t tor_id,
+    tr_file_index_t file_num,
+    std::string_view filename,
+    tr_preallocation_mode allocation,
+    uint64_t file_size)
+{
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        jobs_.push_back({ ++next_job_id_, tor_id, file_num, std::string{ filename }, allocation, file_size, 0U });
+
+        if (!thread_.joinable())
+        {
+            thread_ = std::thread(&tr_preallocator::threadFunc, this);
+        }
+    }
+
+    cv_.notify_all();
+}
+
+bool tr_preallocator::isPending(tr_torrent_id_t tor_id, tr_file_index_t file_num) const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    return std::any_of(
+        std::begin(jobs_),
+        std::end(jobs_),
+        [tor_id, file_num](auto const& job) { return job.tor_id == tor_id && job.file_num == file_num; });
+}
+
+std::optional<tr_preallocator::Progress> tr_preallocator::progress(tr_torrent_id_t tor_id) const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+
+    auto ret = std::optional<Progress>{};
+    for (auto const& job : jobs_)
+    {
+        if (job.tor_id == tor_id)
+        {
+            auto& progress = ret ? *ret : ret.emplace();
+            progress.done += job.bytes_done;
+            progress.total += job.file_size;
+        }
+    }
+
+    return ret;
+}
+
+void tr_preallocator::cancel(tr_torrent_id_t tor_id)
+{
+    auto cancelled = cancelIf([tor_id](Job const& job) { return job.tor_id == tor_id; });
+
+    auto const lock = std::lock_guard{ mutex_ };
+    stopped_.splice(std::end(stopped_), cancelled);
+}
+
+void tr_preallocator::cancel(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+{
+    auto const test = [tor_id, file_num](Job const& job)
+    {
+        return job.tor_id == tor_id && job.file_num == file_num;
+    };
+
+    cancelIf(test);
+
+    auto const lock = std::lock_guard{ mutex_ };
+    stopped_.remove_if(test);
+}
+
+void tr_preallocator::resume(tr_torrent_id_t tor_id)
+{
+    auto resumed = std::list<Job>{};
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        for (auto iter = std::begin(stopped_); iter != std::end(stopped_);)
+        {
+            auto const next = std::next(iter);
+            if (iter->tor_id == tor_id)
+            {
+                resumed.splice(std::end(resumed), stopped_, iter);
+            }
+            iter = next;
+        }
+    }
+
+    resumed.remove_if([](Job const& job) { return !tr_sys_path_exists(job.filename); });
+    if (std::empty(resumed))
+    {
+        return;
+    }
+
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        for (auto& job : resumed)
+        {
+            job.id = ++next_job_id_;
+            job.bytes_done = 0U;
+        }
+        jobs_.splice(std::end(jobs_), resumed);
+
+        if (!thread_.joinable())
+        {
+            thread_ = std::thread(&tr_preallocator::threadFunc, this);
+        }
+    }
+
+    cv_.notify_all();
+}
+
+void tr_preallocator::forget(tr_torrent_id_t tor_id)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    stopped_.remove_if([tor_id](Job const& job) { return job.tor_id == tor_id; });
+}
+
+std::list<tr_preallocator::Job> tr_preallocator::cancelIf(std::function<bool(Job const&)> const& test)
+{
+    auto lock = std::unique_lock{ mutex_ };
+    auto cancelled = std::list<Job>{};
+
+    // remove the jobs that haven't been started yet
+    for (auto iter = busy_ ? std::next(std::begin(jobs_)) : std::begin(jobs_); iter != std::end(jobs_);)
+    {
+        auto const next = std::next(iter);
+        if (test(*iter))
+        {
+            cancelled.splice(std::end(cancelled), jobs_, iter);
+        }
+        iter = next;
+    }
+
+    // if the worker is on one of them, wait for it to give up
+    if (busy_ && test(jobs_.front()))
+    {
+        cancelled.push_front(jobs_.front());
+
+        auto const id = jobs_.front().id;
+        cancel_current_ = true;
+        cv_.wait(lock, [this, id]() { return !busy_ || std::empty(jobs_) || jobs_.front().id != id; });
+    }
+
+    return cancelled;
+}
+
+void tr_preallocator::threadFunc()
+{
+    auto lock = std::unique_lock{ mutex_ };
+
+    for (;;)
+    {
+        cv_.wait(lock, [this]() { return stop_ || !std::empty(jobs_); });
+        if (stop_)
+        {
+            break;
+        }
+
+        auto const job = jobs_.front();
+        busy_ = true;
+        cancel_current_ = false;
+        lock.unlock();
+
+        createFile(job);
+
+        lock.lock();
+        busy_ = false;
+        jobs_.pop_front();
+        cv_.notify_all();
+    }
+}
+
+void tr_preallocator::createFile(Job const& job)
+{
+    tr_error* error = nullptr;
+    auto const fd = tr_sys_file_open(job.filename.c_str(), TR_SYS_FILE_WRITE, 0666, &error);
+    if (!isOpen(fd))
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't open '{path}': {error} ({error_code})"),
+            fmt::arg("path", job.filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        if (on_failed_)
+        {
+            on_failed_(job.tor_id, job.file_num, job.filename, error->code);
+        }
+        tr_error_free(error);
+        return;
+    }
+
+    // A file that's being resumed may have data in it by now,
+    // so only the part past its current end gets zeroed out.
+    auto const info = tr_sys_path_get_info(job.filename);
+    auto const from = info ? std::min(info->size, job.file_size) : uint64_t{};
+
+    // each chunk that's written is a turn of Background I/O
+    auto ticket = tr_disk_scheduler::Ticket{};
+    auto const device = disk_scheduler_ != nullptr ? disk_scheduler_->deviceOf(tr_sys_path_dirname(job.filename)) :
+                                                     tr_disk_scheduler::device_t{};
+    auto const keep_going = [this, id = job.id, device, &ticket](uint64_t bytes_done)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            if (!std::empty(jobs_) && jobs_.front().id == id)
+            {
+                jobs_.front().bytes_done = bytes_done;
+            }
+        }
+
+        if (disk_scheduler_ != nullptr)
+        {
+            ticket = {};
+            ticket = disk_scheduler_->wait(
+                device,
+                tr_disk_scheduler::IoClass::Background,
+                [this]() { return cancel_current_.load(); });
+        }
+
+        return !cancel_current_;
+    };
+
+    bool success = false;
+    char const* type = nullptr;
+
+    if (from == job.file_size)
+    {
+        success = true;
+        type = "done";
+    }
+    else if (job.allocation == TR_PREALLOCATE_FULL)
+    {
+        success = preallocate_file_full(fd, from, job.file_size, keep_going, &error);
+        type = "full";
+    }
+    else if (job.allocation == TR_PREALLOCATE_SPARSE)
+    {
+        success = preallocate_file_sparse(fd, job.file_size, &error);
+        type = "sparse";
+    }
+
+    TR_ASSERT(type != nullptr);
+    ticket = {};
+
+    if (success)
+    {
+        tr_logAddDebug(fmt::format("Preallocated file '{}' ({}, size: {})", job.filename, type, job.file_size));
+    }
+    else if (error != nullptr && error->code == ECANCELED)
+    {
+        tr_logAddDebug(fmt::format("Cancelled preallocating file '{}'", job.filename));
+    }
+    else if (error != nullptr)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't preallocate '{path}': {error} ({error_code})"),
+            fmt::arg("path", job.filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        if (on_failed_)
+        {
+            on_failed_(job.tor_id, job.file_num, job.filename, error->code);
+        }
+    }
+
+    tr_error_clear(&error);
+    tr_sys_file_close(fd);
+}
+
+///
+
 std::optional<tr_sys_file_t> tr_open_files::get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable)
 {
     if (auto* const found = pool_.get(makeKey(tor_id, file_num)); found != nullptr)
@@ -148,6 +452,13 @@ std::optional<tr_sys_file_t> tr_open_files::get(
         pool_.erase(key); // close so we can re-open as writable
     }
 
+    // is it still being created in the background
+    if (preallocator_.isPending(tor_id, file_num))
+    {
+        errno = EAGAIN;
+        return {};
+    }
+
     // create subfolders, if any
     auto const filename = tr_pathbuf{ filename_in };
     tr_error* error = nullptr;
@@ -170,6 +481,29 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     auto const info = tr_sys_path_get_info(filename);
     bool const already_existed = info && info->isFile();
 
+    // Preallocating can take a long time, so do it in the background.
+    // The file itself is created now so that, if the preallocation gets
+    // cancelled, the file is just opened normally on the next attempt.
+    if (writable && !already_existed && allocation != TR_PREALLOCATE_NONE && file_size > 0)
+    {
+        auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0666, &error);
+        if (!isOpen(fd))
+        {
+            tr_logAddError(fmt::format(
+                _("Couldn't open '{path}': {error} ({error_code})"),
+                fmt::arg("path", filename),
+                fmt::arg("error", error->message),
+                fmt::arg("error_code", error->code)));
+            tr_error_free(error);
+            return {};
+        }
+        tr_sys_file_close(fd);
+
+        preallocator_.add(tor_id, file_num, filename, allocation, file_size);
+        errno = EAGAIN;
+        return {};
+    }
+
     // we need write permissions to resize the file
     bool const resize_needed = already_existed && (file_size < info->size);
     writable |= resize_needed;
@@ -177,6 +511,10 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     // open the file
     int flags = writable ? (TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE) : 0;
     flags |= TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL;
+    if (direct_io_)
+    {
+        flags |= TR_SYS_FILE_DIRECT;
+    }
     auto const fd = tr_sys_file_open(filename, flags, 0666, &error);
     if (!isOpen(fd))
     {
@@ -189,39 +527,6 @@ std::optional<tr_sys_file_t> tr_open_files::get(
         return {};
     }
 
-    if (writable && !already_existed && allocation != TR_PREALLOCATE_NONE)
-    {
-        bool success = false;
-        char const* type = nullptr;
-
-        if (allocation == TR_PREALLOCATE_FULL)
-        {
-            success = preallocate_file_full(fd, file_size, &error);
-            type = "full";
-        }
-        else if (allocation == TR_PREALLOCATE_SPARSE)
-        {
-            success = preallocate_file_sparse(fd, file_size, &error);
-            type = "sparse";
-        }
-
-        TR_ASSERT(type != nullptr);
-
-        if (!success)
-        {
-            tr_logAddError(fmt::format(
-                _("Couldn't preallocate '{path}': {error} ({error_code})"),
-                fmt::arg("path", filename),
-                fmt::arg("error", error->message),
-                fmt::arg("error_code", error->code)));
-            tr_sys_file_close(fd);
-            tr_error_free(error);
-            return {};
-        }
-
-        tr_logAddDebug(fmt::format("Preallocated file '{}' ({}, size: {})", filename, type, file_size));
-    }
-
     // If the file already exists and it's too large, truncate it.
     // This is a fringe case that happens if a torrent's been updated
     // and one of the updated torrent's files is smaller.
@@ -247,6 +552,15 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     return fd;
 }
 
+void tr_open_files::setDirectIo(bool direct_io)
+{
+    if (direct_io_ != direct_io)
+    {
+        direct_io_ = direct_io;
+        closeAll();
+    }
+}
+
 void tr_open_files::closeAll()
 {
     pool_.clear();
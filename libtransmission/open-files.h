@@ -9,10 +9,17 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <atomic>
+#include <condition_variable>
 #include <cstddef> // for size_t
 #include <cstdint> // for uintX_t
+#include <functional>
+#include <list>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 
 #include "transmission.h"
@@ -20,14 +27,113 @@
 #include "file.h" // tr_sys_file_t
 #include "lru-cache.h"
 
+class tr_disk_scheduler;
 struct tr_session;
 
+// Preallocates new files on a worker thread, so that slow
+// preallocation, e.g. writing zeroes on filesystems without fallocate(),
+// doesn't stall the session thread.
+class tr_preallocator
+{
+public:
+    struct Progress
+    {
+        uint64_t done = 0;
+        uint64_t total = 0;
+    };
+
+    // Called from the worker thread when a file couldn't be preallocated.
+    // The file is left as-is, so it's up to the owner to decide what to do.
+    using FailedFunc = std::function<
+        void(tr_torrent_id_t tor_id, tr_file_index_t file_num, std::string_view filename, int err)>;
+
+    // Writing files out is Background I/O in `disk_scheduler`, if there is one
+    explicit tr_preallocator(tr_disk_scheduler* disk_scheduler = nullptr, FailedFunc on_failed = {})
+        : on_failed_{ std::move(on_failed) }
+        , disk_scheduler_{ disk_scheduler }
+    {
+    }
+
+    tr_preallocator(tr_preallocator&&) = delete;
+    tr_preallocator(tr_preallocator const&) = delete;
+    tr_preallocator& operator=(tr_preallocator&&) = delete;
+    tr_preallocator& operator=(tr_preallocator const&) = delete;
+    ~tr_preallocator();
+
+    void add(
+        tr_torrent_id_t tor_id,
+        tr_file_index_t file_num,
+        std::string_view filename,
+        tr_preallocation_mode allocation,
+        uint64_t file_size);
+
+    [[nodiscard]] bool isPending(tr_torrent_id_t tor_id, tr_file_index_t file_num) const;
+
+    // Stop preallocating the torrent's files.
+    // Returns once the worker thread is no longer touching them.
+    // The torrent's unfinished files are remembered for resume().
+    void cancel(tr_torrent_id_t tor_id);
+    void cancel(tr_torrent_id_t tor_id, tr_file_index_t file_num);
+
+    // Pick up preallocating the files that cancel() stopped, unless they've
+    // been moved or renamed since. Data written to them in the meantime is kept.
+    void resume(tr_torrent_id_t tor_id);
+
+    // Forget the files that cancel() stopped, e.g. when the torrent is removed.
+    void forget(tr_torrent_id_t tor_id);
+
+    // @return the progress of the torrent's pending files, if it has any
+    [[nodiscard]] std::optional<Progress> progress(tr_torrent_id_t tor_id) const;
+
+private:
+    struct Job
+    {
+        uint64_t id = 0;
+        tr_torrent_id_t tor_id = {};
+        tr_file_index_t file_num = {};
+        std::string filename;
+        tr_preallocation_mode allocation = TR_PREALLOCATE_NONE;
+        uint64_t file_size = 0;
+        uint64_t bytes_done = 0;
+    };
+
+    // @return the jobs that were cancelled
+    std::list<Job> cancelIf(std::function<bool(Job const&)> const& test);
+    void threadFunc();
+    void createFile(Job const& job);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    // if `busy_`, then `jobs_.front()` is being worked on
+    std::list<Job> jobs_;
+    bool busy_ = false;
+    bool stop_ = false;
+
+    // jobs that cancel() stopped before they were done
+    std::list<Job> stopped_;
+    uint64_t next_job_id_ = 0;
+
+    std::atomic<bool> cancel_current_ = false;
+    std::thread thread_;
+
+    FailedFunc const on_failed_;
+    tr_disk_scheduler* const disk_scheduler_;
+};
+
 // A pool of open files that are cached while reading / writing torrents' data
 class tr_open_files
 {
 public:
+    explicit tr_open_files(tr_disk_scheduler* disk_scheduler = nullptr, tr_preallocator::FailedFunc on_failed = {})
+        : preallocator_{ disk_scheduler, std::move(on_failed) }
+    {
+    }
+
     [[nodiscard]] std::optional<tr_sys_file_t> get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable);
 
+    // If the file needs to be created and preallocated, that's done in the
+    // background; this returns nothing and sets errno to EAGAIN until it's ready.
     [[nodiscard]] std::optional<tr_sys_file_t> get(
         tr_torrent_id_t tor_id,
         tr_file_index_t file_num,
@@ -36,6 +142,42 @@ public:
         tr_preallocation_mode allocation,
         uint64_t file_size);
 
+    [[nodiscard]] bool isPreallocating(tr_torrent_id_t tor_id, tr_file_index_t file_num) const
+    {
+        return preallocator_.isPending(tor_id, file_num);
+    }
+
+    [[nodiscard]] auto preallocationProgress(tr_torrent_id_t tor_id) const
+    {
+        return preallocator_.progress(tor_id);
+    }
+
+    // Give up on preallocating the torrent's files in the background,
+    // e.g. because their data needs to be written now.
+    // resumePreallocation() picks up where this left off.
+    void cancelPreallocation(tr_torrent_id_t tor_id)
+    {
+        preallocator_.cancel(tor_id);
+    }
+
+    void resumePreallocation(tr_torrent_id_t tor_id)
+    {
+        preallocator_.resume(tor_id);
+    }
+
+    void forgetPreallocation(tr_torrent_id_t tor_id)
+    {
+        preallocator_.forget(tor_id);
+    }
+
+    void cancelPreallocation(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+    {
+        preallocator_.cancel(tor_id, file_num);
+    }
+
+    // Open files with TR_SYS_FILE_DIRECT. Closes any files that are already open.
+    void setDirectIo(bool direct_io);
+
     void closeAll();
     void closeTorrent(tr_torrent_id_t tor_id);
     void closeFile(tr_torrent_id_t tor_id, tr_file_index_t file_num);
@@ -71,4 +213,7 @@ private:
 
     static constexpr size_t MaxOpenFiles = 32;
     tr_lru_cache<Key, Val, MaxOpenFiles> pool_;
+    bool direct_io_ = false;
+
+    tr_preallocator preallocator_;
 };
@@ -0,0 +1,177 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <ctime> // time_t
+#include <functional> // std::greater
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h" // tr_rand_int_weak()
+#include "net.h" // tr_address
+#include "tr-assert.h"
+
+/**
+ * A swarm's atoms that we might want to connect to, best first,
+ * so that picking connection candidates doesn't need to scan every atom.
+ *
+ * The queue is validated lazily: callers only need to call queue() when
+ * an atom might have become a candidate. peek() re-scores the entry at
+ * the top of the queue, drops it if it's stale, and parks atoms that are
+ * only waiting out their reconnect interval until they're due.
+ *
+ * `Atom` needs an `addr` and a `std::optional<uint64_t> candidate_score`,
+ * which the queue uses to remember the score of the atom's live entry.
+ */
+template<typename Atom>
+class CandidateQueue
+{
+public:
+    struct Mediator
+    {
+        // the atom with this address, or nullptr if it's been pruned
+        [[nodiscard]] virtual Atom* find(tr_address const& addr) const = 0;
+
+        // Smaller is better. The low 8 bits must be `salt`, which
+        // breaks ties between otherwise equal atoms.
+        [[nodiscard]] virtual uint64_t score(Atom const& atom, uint8_t salt) const = 0;
+
+        [[nodiscard]] virtual bool isCandidate(Atom const& atom, time_t now) const = 0;
+
+        // when an atom that isn't a candidate now might become one
+        [[nodiscard]] virtual time_t retryAt(Atom const& atom, time_t now) const = 0;
+
+        virtual ~Mediator() = default;
+    };
+
+    explicit CandidateQueue(Mediator const& mediator)
+        : mediator_{ mediator }
+    {
+    }
+
+    void queue(Atom& atom)
+    {
+        auto const salt = static_cast<uint8_t>(tr_rand_int_weak(256));
+        auto const score = mediator_.score(atom, salt);
+        if (atom.candidate_score && (*atom.candidate_score >> 8U) == (score >> 8U))
+        {
+            return; // already queued
+        }
+
+        candidates_.push({ score, atom.addr, salt });
+        atom.candidate_score = score;
+    }
+
+    // Forget every entry. The caller is responsible for resetting
+    // its atoms' `candidate_score` and queueing them again.
+    void clear()
+    {
+        candidates_ = {};
+        waiting_ = {};
+    }
+
+    // the best candidate, or nullptr if there isn't one right now
+    [[nodiscard]] Atom* peek(time_t now)
+    {
+        // requeue the atoms whose reconnect interval has passed
+        while (!std::empty(waiting_) && waiting_.top().first <= now)
+        {
+            if (auto* const atom = mediator_.find(waiting_.top().second); atom != nullptr)
+            {
+                queue(*atom);
+            }
+
+            waiting_.pop();
+        }
+
+        while (!std::empty(candidates_))
+        {
+            auto const entry = candidates_.top();
+
+            // skip entries that are out-of-date or whose atom was pruned
+            auto* const atom = mediator_.find(entry.addr);
+            if (atom == nullptr || atom->candidate_score != entry.score)
+            {
+                candidates_.pop();
+                continue;
+            }
+
+            // if the atom's score changed since it was queued, requeue it
+            if (auto const score = mediator_.score(*atom, entry.salt); score != entry.score)
+            {
+                candidates_.pop();
+                candidates_.push({ score, entry.addr, entry.salt });
+                atom->candidate_score = score;
+                continue;
+            }
+
+            if (mediator_.isCandidate(*atom, now))
+            {
+                return atom;
+            }
+
+            // not a candidate right now. If that's only because we tried them
+            // recently, park them until their reconnect interval has passed.
+            candidates_.pop();
+            atom->candidate_score.reset();
+            if (auto const retry_at = mediator_.retryAt(*atom, now); retry_at > now)
+            {
+                waiting_.emplace(retry_at, entry.addr);
+            }
+        }
+
+        return nullptr;
+    }
+
+    // remove the atom that peek() returned
+    void pop()
+    {
+        TR_ASSERT(!std::empty(candidates_));
+
+        if (auto* const atom = mediator_.find(candidates_.top().addr); atom != nullptr)
+        {
+            atom->candidate_score.reset();
+        }
+
+        candidates_.pop();
+    }
+
+    // how many entries are queued, including stale ones not dropped yet
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return std::size(candidates_) + std::size(waiting_);
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t score;
+        tr_address addr;
+        uint8_t salt;
+
+        [[nodiscard]] constexpr bool operator>(Entry const& that) const noexcept
+        {
+            return score > that.score;
+        }
+    };
+
+    Mediator const& mediator_;
+
+    // atoms that might be connection candidates, lowest (best) score first
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> candidates_;
+
+    // atoms that are waiting for their reconnect interval to pass
+    std::priority_queue<std::pair<time_t, tr_address>, std::vector<std::pair<time_t, tr_address>>, std::greater<>> waiting_;
+};
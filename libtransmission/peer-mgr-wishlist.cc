@@ -68,8 +68,14 @@ std::vector<Candidate> getCandidates(Wishlist::Mediator const& mediator)
     // count up the pieces that we still want
     auto wanted_pieces = std::vector<std::pair<tr_piece_index_t, size_t>>{};
     auto const n_pieces = mediator.countAllPieces();
-    wanted_pieces.reserve(n_pieces);
-    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    auto const& peer_pieces = mediator.peerPieces();
+    auto const& client_pieces = mediator.clientPieces();
+    auto const next_piece = [&](tr_piece_index_t begin)
+    {
+        return static_cast<tr_piece_index_t>(peer_pieces.findNextAndNot(client_pieces, begin, n_pieces));
+    };
+
+    for (auto i = next_piece(0); i < n_pieces; i = next_piece(i + 1))
     {
         if (!mediator.clientCanRequestPiece(i))
         {
@@ -14,6 +14,7 @@
 
 #include "transmission.h"
 
+#include "bitfield.h"
 #include "torrent.h"
 
 /**
@@ -32,6 +33,11 @@ public:
         virtual tr_block_span_t blockSpan(tr_piece_index_t) const = 0;
         virtual tr_piece_index_t countAllPieces() const = 0;
         virtual tr_priority_t priority(tr_piece_index_t) const = 0;
+
+        // Only pieces that the peer has and we don't are worth a closer look,
+        // so these are used to skip past the rest a word at a time.
+        virtual tr_bitfield const& peerPieces() const = 0;
+        virtual tr_bitfield const& clientPieces() const = 0;
         virtual ~Mediator() = default;
     };
 
@@ -11,12 +11,12 @@
 #include <cmath>
 #include <cstdint>
 #include <ctime> // time_t
-#include <deque>
 #include <iterator> // std::back_inserter
 #include <memory>
 #include <numeric> // std::accumulate
 #include <optional>
 #include <tuple> // std::tie
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -37,6 +37,7 @@
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr-active-requests.h"
+#include "peer-mgr-candidates.h"
 #include "peer-mgr-wishlist.h"
 #include "peer-mgr.h"
 #include "peer-msgs.h"
@@ -286,6 +287,9 @@ struct peer_atom
     uint8_t flags = {}; /* these match the added_f flags */
     uint8_t flags2 = {}; /* flags that aren't defined in added_f */
 
+    // the score of this atom's entry in its swarm's candidate queue, if any
+    std::optional<uint64_t> candidate_score;
+
     bool utp_failed = false; /* We recently failed to connect over µTP */
     bool is_connected = false;
 
@@ -437,6 +441,9 @@ public:
         TR_ASSERT(stats.peer_count == peerCount());
 
         delete peer;
+
+        // now that we're disconnected, they may be worth reconnecting to later
+        queueCandidate(*atom);
     }
 
     void removeAllPeers()
@@ -496,7 +503,10 @@ public:
     {
         if (!pool_is_all_seeds_)
         {
-            pool_is_all_seeds_ = std::all_of(std::begin(pool), std::end(pool), [](auto const& atom) { return atom.isSeed(); });
+            pool_is_all_seeds_ = std::all_of(
+                std::begin(pool),
+                std::end(pool),
+                [](auto const& pair) { return pair.second.isSeed(); });
         }
 
         return *pool_is_all_seeds_;
@@ -507,6 +517,24 @@ public:
         pool_is_all_seeds_.reset();
     }
 
+    // the atoms that we might want to connect to; see CandidateQueue
+    void queueCandidate(peer_atom& atom)
+    {
+        candidates_.queue(atom);
+    }
+
+    void rebuildCandidates();
+
+    [[nodiscard]] peer_atom* peekCandidate(time_t now)
+    {
+        return candidates_.peek(now);
+    }
+
+    void popCandidate()
+    {
+        candidates_.pop();
+    }
+
     Handshakes outgoing_handshakes;
 
     uint16_t interested_count = 0;
@@ -527,12 +555,15 @@ public:
     std::vector<tr_peerMsgs*> peers;
 
     // tr_peers hold pointers to the items in this container,
-    // so use a deque instead of vector to prevent insertion from
-    // invalidating those pointers
-    std::deque<peer_atom> pool;
+    // so use a node-based map to keep those pointers valid
+    // when other atoms are added or pruned
+    std::unordered_map<tr_address, peer_atom> pool;
 
     tr_peerMsgs* optimistic = nullptr; /* the optimistic peer, or nullptr if none */
 
+    // true if the candidate queue was last rebuilt while we were seeding
+    bool candidates_built_while_seeding = false;
+
     time_t lastCancel = 0;
 
     ActiveRequests active_requests;
@@ -554,8 +585,27 @@ private:
     // how long we'll let requests we've made linger before we cancel them
     static auto constexpr RequestTtlSecs = int{ 90 };
 
+    struct CandidateMediator final : public CandidateQueue<peer_atom>::Mediator
+    {
+        explicit CandidateMediator(tr_swarm& swarm)
+            : swarm_{ swarm }
+        {
+        }
+
+        [[nodiscard]] peer_atom* find(tr_address const& addr) const override;
+        [[nodiscard]] uint64_t score(peer_atom const& atom, uint8_t salt) const override;
+        [[nodiscard]] bool isCandidate(peer_atom const& atom, time_t now) const override;
+        [[nodiscard]] time_t retryAt(peer_atom const& atom, time_t now) const override;
+
+    private:
+        tr_swarm& swarm_;
+    };
+
     mutable std::optional<bool> pool_is_all_seeds_;
 
+    CandidateMediator const candidate_mediator_{ *this };
+    CandidateQueue<peer_atom> candidates_{ candidate_mediator_ };
+
     bool is_endgame_ = false;
 };
 
@@ -674,12 +724,8 @@ static tr_swarm* getExistingSwarm(tr_peerMgr* manager, tr_sha1_digest_t const& h
 static struct peer_atom* getExistingAtom(tr_swarm const* cswarm, tr_address const& addr)
 {
     auto* swarm = const_cast<tr_swarm*>(cswarm);
-    auto const test = [&addr](auto const& atom)
-    {
-        return atom.addr == addr;
-    };
-    auto const it = std::find_if(std::begin(swarm->pool), std::end(swarm->pool), test);
-    return it != std::end(swarm->pool) ? &*it : nullptr;
+    auto const it = swarm->pool.find(addr);
+    return it != std::end(swarm->pool) ? &it->second : nullptr;
 }
 
 static bool peerIsInUse(tr_swarm const* swarm, struct peer_atom const* atom)
@@ -688,6 +734,63 @@ static bool peerIsInUse(tr_swarm const* swarm, struct peer_atom const* atom)
         swarm->manager->incoming_handshakes.contains(atom->addr);
 }
 
+// When a swarm's pool gets too big, evict the atoms that are least likely
+// to be useful. Atoms that are in use or banned are never evicted.
+static void pruneAtoms(tr_swarm* swarm)
+{
+    auto& pool = swarm->pool;
+    if (std::size(pool) < TR_MAX_ATOMS_PER_SWARM)
+    {
+        return;
+    }
+
+    auto evictable = std::vector<peer_atom const*>{};
+    evictable.reserve(std::size(pool));
+    for (auto const& [addr, atom] : pool)
+    {
+        if ((atom.flags2 & MyflagBanned) == 0 && !peerIsInUse(swarm, &atom))
+        {
+            evictable.push_back(&atom);
+        }
+    }
+
+    // prune down to 90% so that we don't need to do this on every add
+    auto const n_evict = std::min(std::size(evictable), std::size(pool) - TR_MAX_ATOMS_PER_SWARM * 9 / 10);
+    auto const is_staler = [](peer_atom const* a, peer_atom const* b)
+    {
+        // peers we've failed to connect to go first
+        if (a->num_fails != b->num_fails)
+        {
+            return a->num_fails > b->num_fails;
+        }
+
+        // then the ones that haven't given us piece data in the longest time
+        if (a->piece_data_time != b->piece_data_time)
+        {
+            return a->piece_data_time < b->piece_data_time;
+        }
+
+        // then the ones whose connection status is the oldest
+        if (a->time != b->time)
+        {
+            return a->time < b->time;
+        }
+
+        // then the ones from the least trusted sources
+        return a->fromBest > b->fromBest;
+    };
+    std::nth_element(std::begin(evictable), std::begin(evictable) + n_evict, std::end(evictable), is_staler);
+
+    tr_logAddTraceSwarm(swarm, fmt::format("pruning {} stale atoms from a pool of {}", n_evict, std::size(pool)));
+    for (size_t i = 0; i < n_evict; ++i)
+    {
+        auto const addr = evictable[i]->addr;
+        pool.erase(addr);
+    }
+
+    swarm->markAllSeedsFlagDirty();
+}
+
 static void swarmFree(tr_swarm* s)
 {
     TR_ASSERT(s != nullptr);
@@ -722,10 +825,13 @@ void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr)
        since the blocklist has changed, erase that cached value */
     for (auto* const tor : mgr->session->torrents())
     {
-        for (auto& atom : tor->swarm->pool)
+        for (auto& [addr, atom] : tor->swarm->pool)
         {
             atom.setBlocklistedDirty();
         }
+
+        // some atoms might not be blocklisted anymore
+        tor->swarm->rebuildCandidates();
     }
 }
 
@@ -850,6 +956,16 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
             return torrent_->pieceCount();
         }
 
+        [[nodiscard]] tr_bitfield const& peerPieces() const override
+        {
+            return peer_->has();
+        }
+
+        [[nodiscard]] tr_bitfield const& clientPieces() const override
+        {
+            return torrent_->completion.pieces();
+        }
+
         [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
         {
             return torrent_->piecePriority(piece);
@@ -1093,7 +1209,8 @@ static struct peer_atom* ensureAtomExists(
 
     if (a == nullptr)
     {
-        a = &s->pool.emplace_back(addr, port, flags, from);
+        pruneAtoms(s);
+        a = &s->pool.try_emplace(addr, addr, port, flags, from).first->second;
     }
     else
     {
@@ -1102,6 +1219,7 @@ static struct peer_atom* ensureAtomExists(
     }
 
     s->markAllSeedsFlagDirty();
+    s->queueCandidate(*a);
 
     return a;
 }
@@ -1229,6 +1347,15 @@ static bool on_handshake_done(tr_handshake_result const& result)
         }
     }
 
+    // if we didn't connect, they may be worth retrying later
+    if (s != nullptr && !success)
+    {
+        if (auto* const atom = getExistingAtom(s, addr); atom != nullptr)
+        {
+            s->queueCandidate(*atom);
+        }
+    }
+
     return success;
 }
 
@@ -1268,7 +1395,7 @@ void tr_peerMgrSetSwarmIsAllSeeds(tr_torrent* tor)
 
     auto* const swarm = tor->swarm;
 
-    for (auto& atom : swarm->pool)
+    for (auto& [addr, atom] : swarm->pool)
     {
         atomSetSeed(swarm, atom);
     }
@@ -1282,10 +1409,17 @@ size_t tr_peerMgrAddPex(tr_torrent* tor, uint8_t from, tr_pex const* pex, size_t
     tr_swarm* s = tor->swarm;
     auto const lock = s->manager->unique_lock();
 
-    for (tr_pex const* const end = pex + n_pex; pex != end; ++pex)
+    // look up the whole batch in the blocklist at once
+    auto addrs = std::vector<tr_address>{};
+    addrs.reserve(n_pex);
+    std::transform(pex, pex + n_pex, std::back_inserter(addrs), [](auto const& p) { return p.addr; });
+    auto const blocked = std::make_unique<bool[]>(n_pex);
+    s->manager->session->addressesAreBlocked(std::data(addrs), n_pex, blocked.get());
+
+    for (size_t i = 0; i < n_pex; ++i, ++pex)
     {
         if (tr_isPex(pex) && /* safeguard against corrupt data */
-            !s->manager->session->addressIsBlocked(pex->addr) && pex->is_valid_for_peers())
+            !blocked[i] && pex->is_valid_for_peers())
         {
             ensureAtomExists(s, pex->addr, pex->port, pex->flags, from);
             ++n_used;
@@ -1462,7 +1596,7 @@ std::vector<tr_pex> tr_peerMgrGetPeers(tr_torrent const* tor, uint8_t address_ty
     }
     else /* TR_PEERS_INTERESTING */
     {
-        for (auto const& atom : s->pool)
+        for (auto const& [addr, atom] : s->pool)
         {
             if (isAtomInteresting(tor, atom))
             {
@@ -1505,6 +1639,7 @@ void tr_peerMgrStartTorrent(tr_torrent* tor)
 
     swarm->is_running = true;
     swarm->max_peers = tor->peerLimit();
+    swarm->rebuildCandidates();
 
     swarm->manager->rechokeSoon();
 }
@@ -1559,6 +1694,15 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
     }
 }
 
+void tr_peerMgrOnPiecesWantedChanged(tr_torrent* tor)
+{
+    /* some peers may have become more or less interesting to us */
+    for (auto* peer : tor->swarm->peers)
+    {
+        peer->on_pieces_wanted_changed();
+    }
+}
+
 int8_t tr_peerMgrPieceAvailability(tr_torrent const* tor, tr_piece_index_t piece)
 {
     if (!tor->hasMetainfo())
@@ -1649,9 +1793,12 @@ uint64_t tr_peerMgrGetDesiredAvailable(tr_torrent const* tor)
 
     auto desired_available = uint64_t{};
 
-    for (tr_piece_index_t i = 0, n = tor->pieceCount(); i < n; ++i)
+    // only look at the pieces that a peer has and we don't
+    auto const& client_pieces = tor->completion.pieces();
+    auto const n = tor->pieceCount();
+    for (auto i = available.findNextAndNot(client_pieces, 0, n); i < n; i = available.findNextAndNot(client_pieces, i + 1, n))
     {
-        if (tor->pieceIsWanted(i) && available.test(i))
+        if (tor->pieceIsWanted(i))
         {
             desired_available += tor->countMissingBytesInPiece(i);
         }
@@ -1809,32 +1956,6 @@ namespace rechoke_downloads_helpers
 namespace
 {
 
-/* does this peer have any pieces that we want? */
-[[nodiscard]] bool isPeerInteresting(
-    tr_torrent const* const tor,
-    std::vector<bool> const& piece_is_interesting,
-    tr_peerMsgs const* const peer)
-{
-    /* these cases should have already been handled by the calling code... */
-    TR_ASSERT(!tor->isDone());
-    TR_ASSERT(tor->clientCanDownload());
-
-    if (peer->isSeed())
-    {
-        return true;
-    }
-
-    for (tr_piece_index_t i = 0; i < tor->pieceCount(); ++i)
-    {
-        if (piece_is_interesting[i] && peer->hasPiece(i))
-        {
-            return true;
-        }
-    }
-
-    return false;
-}
-
 enum tr_rechoke_state
 {
     RECHOKE_STATE_GOOD,
@@ -1972,22 +2093,10 @@ void rechokeDownloads(tr_swarm* s)
     {
         rechoke.reserve(peer_count);
 
-        auto const* const tor = s->tor;
-        int const n = tor->pieceCount();
-
-        /* build a bitfield of interesting pieces... */
-        auto piece_is_interesting = std::vector<bool>{};
-        piece_is_interesting.resize(n);
-
-        for (int i = 0; i < n; ++i)
-        {
-            piece_is_interesting[i] = tor->pieceIsWanted(i) && !tor->hasPiece(i);
-        }
-
         /* decide WHICH peers to be interested in (based on their cancel-to-block ratio) */
         for (auto* const peer : peers)
         {
-            if (!isPeerInteresting(s->tor, piece_is_interesting, peer))
+            if (!peer->is_interesting())
             {
                 peer->set_interested(false);
             }
@@ -2708,8 +2817,44 @@ struct peer_candidate
 }
 
 } // namespace
+} // namespace connect_helpers
+
+peer_atom* tr_swarm::CandidateMediator::find(tr_address const& addr) const
+{
+    return getExistingAtom(&swarm_, addr);
+}
+
+uint64_t tr_swarm::CandidateMediator::score(peer_atom const& atom, uint8_t salt) const
+{
+    return connect_helpers::getPeerCandidateScore(swarm_.tor, atom, salt);
+}
+
+bool tr_swarm::CandidateMediator::isCandidate(peer_atom const& atom, time_t now) const
+{
+    return connect_helpers::isPeerCandidate(swarm_.tor, atom, now);
+}
+
+time_t tr_swarm::CandidateMediator::retryAt(peer_atom const& atom, time_t now) const
+{
+    return atom.time + atom.getReconnectIntervalSecs(now);
+}
 
-/** @return an array of all the atoms we might want to connect to */
+void tr_swarm::rebuildCandidates()
+{
+    candidates_.clear();
+    candidates_built_while_seeding = tor->isDone();
+
+    for (auto& [addr, atom] : pool)
+    {
+        atom.candidate_score.reset();
+        queueCandidate(atom);
+    }
+}
+
+namespace connect_helpers
+{
+
+/** @return the best `max` atoms that we might want to connect to */
 [[nodiscard]] std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t max)
 {
     auto const now = tr_time();
@@ -2718,14 +2863,11 @@ struct peer_candidate
     // leave 5% of connection slots for incoming connections -- ticket #2609
     auto const max_candidates = static_cast<size_t>(session->peerLimit() * 0.95);
 
-    /* count how many peers and atoms we've got */
-    auto atom_count = size_t{};
+    /* count how many peers we've got */
     auto peer_count = size_t{};
     for (auto const* const tor : session->torrents())
     {
-        auto const* const swarm = tor->swarm;
-        atom_count += std::size(swarm->pool);
-        peer_count += swarm->peerCount();
+        peer_count += tor->swarm->peerCount();
     }
 
     /* don't start any new handshakes if we're full up */
@@ -2734,11 +2876,8 @@ struct peer_candidate
         return {};
     }
 
-    auto candidates = std::vector<peer_candidate>{};
-    candidates.reserve(atom_count);
-
-    /* populate the candidate array */
-    auto salter = tr_salt_shaker{};
+    /* gather the best candidate from each swarm that wants more peers */
+    auto heads = std::vector<peer_candidate>{};
     for (auto* const tor : session->torrents())
     {
         auto* const swarm = tor->swarm;
@@ -2768,24 +2907,42 @@ struct peer_candidate
             continue;
         }
 
-        for (auto& atom : swarm->pool)
+        /* we skip seeds while seeding, so if we stopped seeding, look at them again */
+        if (swarm->candidates_built_while_seeding && !seeding)
         {
-            if (isPeerCandidate(tor, atom, now))
-            {
-                candidates.push_back({ getPeerCandidateScore(tor, atom, salter()), tor, &atom });
-            }
+            swarm->rebuildCandidates();
+        }
+
+        if (auto* const atom = swarm->peekCandidate(now); atom != nullptr)
+        {
+            heads.push_back({ *atom->candidate_score, tor, atom });
         }
     }
 
-    // only keep the best `max` candidates
-    if (std::size(candidates) > max)
+    /* pop the best `max` candidates, refilling from whichever swarm the last one came from */
+    auto const greater = [](auto const& a, auto const& b)
+    {
+        return a.score > b.score;
+    };
+    std::make_heap(std::begin(heads), std::end(heads), greater);
+
+    auto candidates = std::vector<peer_candidate>{};
+    candidates.reserve(max);
+    while (!std::empty(heads) && std::size(candidates) < max)
     {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + max,
-            std::end(candidates),
-            [](auto const& a, auto const& b) { return a.score < b.score; });
-        candidates.resize(max);
+        std::pop_heap(std::begin(heads), std::end(heads), greater);
+        auto const best = heads.back();
+        heads.pop_back();
+
+        auto* const swarm = best.tor->swarm;
+        swarm->popCandidate();
+        candidates.push_back(best);
+
+        if (auto* const atom = swarm->peekCandidate(now); atom != nullptr)
+        {
+            heads.push_back({ *atom->candidate_score, best.tor, atom });
+            std::push_heap(std::begin(heads), std::end(heads), greater);
+        }
     }
 
     return candidates;
@@ -2853,6 +3010,13 @@ void tr_peerMgr::makeNewPeerConnections(size_t max)
 
     for (auto& candidate : getPeerCandidates(session, max))
     {
-        initiateConnection(this, candidate.tor->swarm, *candidate.atom);
+        auto* const swarm = candidate.tor->swarm;
+        initiateConnection(this, swarm, *candidate.atom);
+
+        // if we didn't start a handshake, keep them around for later
+        if (!peerIsInUse(swarm, candidate.atom))
+        {
+            swarm->queueCandidate(*candidate.atom);
+        }
     }
 }
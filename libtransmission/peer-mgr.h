@@ -154,6 +154,10 @@ struct tr_pex
     uint8_t flags = 0;
 };
 
+// How many atoms a swarm's pool can hold. Adding more prunes the stale
+// ones, unless they're all in use or banned.
+auto inline constexpr TR_MAX_ATOMS_PER_SWARM = size_t{ 4096 };
+
 constexpr bool tr_isPex(tr_pex const* pex)
 {
     return pex != nullptr && pex->addr.is_valid();
@@ -210,6 +214,8 @@ void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned
 
 void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor);
 
+void tr_peerMgrOnPiecesWantedChanged(tr_torrent* tor);
+
 void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr);
 
 [[nodiscard]] struct tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, size_t* setme_count);
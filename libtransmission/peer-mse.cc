@@ -3,64 +3,296 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::copy_n()
 #include <array>
-#include <memory>
-
-#include <math/wide_integer/uintwide_t.h>
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // uint64_t
 
 #include "transmission.h"
 
-#include "crypto-utils.h" // tr_sha1
+#include "crypto-utils.h" // tr_sha1, tr_powm()
 #include "peer-mse.h"
 #include "tr-arc4.h"
 
 using namespace std::literals;
 
-namespace wi
+namespace
+{
+// Montgomery arithmetic for the fixed MSE prime, in 64-bit limbs.
+// Lookups and reductions don't branch on secret values.
+namespace mont
 {
-using key_t = math::wide_integer::uintwide_t<
-    tr_message_stream_encryption::DH::KeySize * std::numeric_limits<unsigned char>::digits>;
+using DH = tr_message_stream_encryption::DH;
+
+using limb_t = uint64_t;
+auto constexpr LimbSize = sizeof(limb_t);
+auto constexpr NumLimbs = DH::KeySize / LimbSize;
+static_assert(NumLimbs * LimbSize == DH::KeySize);
 
-using private_key_t = math::wide_integer::uintwide_t<
-    tr_message_stream_encryption::DH::PrivateKeySize * std::numeric_limits<unsigned char>::digits>;
+// least significant limb first
+using number_t = std::array<limb_t, NumLimbs>;
 
-template<typename UIntWide>
-auto import_bits(std::array<std::byte, UIntWide::my_width2 / std::numeric_limits<uint8_t>::digits> const& bigend_bin)
+// @return the low half of a * b + c + d, and stores the high half in `hi`
+[[nodiscard]] constexpr limb_t mulAdd(limb_t a, limb_t b, limb_t c, limb_t d, limb_t& hi) noexcept
 {
-    auto ret = UIntWide{};
-    static_assert(sizeof(UIntWide) == sizeof(bigend_bin));
+#ifdef __SIZEOF_INT128__
+    __extension__ using wide_t = unsigned __int128;
+    auto const wide = wide_t{ a } * b + c + d;
+    hi = static_cast<limb_t>(wide >> 64U);
+    return static_cast<limb_t>(wide);
+#else
+    auto constexpr Mask = limb_t{ 0xFFFFFFFFU };
+    auto const lo_lo = (a & Mask) * (b & Mask);
+    auto const lo_hi = (a & Mask) * (b >> 32U);
+    auto const hi_lo = (a >> 32U) * (b & Mask);
+    auto const hi_hi = (a >> 32U) * (b >> 32U);
+    auto const mid = (lo_lo >> 32U) + (lo_hi & Mask) + (hi_lo & Mask);
+    auto lo = (mid << 32U) | (lo_lo & Mask);
+    hi = hi_hi + (lo_hi >> 32U) + (hi_lo >> 32U) + (mid >> 32U);
+    lo += c;
+    hi += lo < c ? 1U : 0U;
+    lo += d;
+    hi += lo < d ? 1U : 0U;
+    return lo;
+#endif
+}
 
-    for (auto const walk : bigend_bin)
+[[nodiscard]] constexpr number_t fromBigEndian(std::byte const* bytes) noexcept
+{
+    auto ret = number_t{};
+    for (size_t i = 0; i < NumLimbs; ++i)
     {
-        ret <<= 8;
-        ret += static_cast<uint8_t>(walk);
+        auto const* const limb_bytes = bytes + DH::KeySize - (i + 1U) * LimbSize;
+        for (size_t j = 0; j < LimbSize; ++j)
+        {
+            ret[i] = (ret[i] << 8U) | static_cast<uint8_t>(limb_bytes[j]);
+        }
     }
+    return ret;
+}
 
+[[nodiscard]] constexpr DH::key_bigend_t toBigEndian(number_t const& num) noexcept
+{
+    auto ret = DH::key_bigend_t{};
+    for (size_t i = 0; i < NumLimbs; ++i)
+    {
+        for (size_t j = 0; j < LimbSize; ++j)
+        {
+            ret[DH::KeySize - 1U - i * LimbSize - j] = std::byte(static_cast<uint8_t>(num[i] >> (j * 8U)));
+        }
+    }
     return ret;
 }
 
-template<typename UIntWide>
-auto export_bits(UIntWide i)
+// MSE spec: "P is 0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74
+// 020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245
+// E485B576625E7EC6F44C42E9A63A36210000000000090563"
+auto constexpr Prime = number_t{
+    0x0000000000090563U, 0xF44C42E9A63A3621U, 0xE485B576625E7EC6U, 0x4FE1356D6D51C245U,
+    0x302B0A6DF25F1437U, 0xEF9519B3CD3A431BU, 0x514A08798E3404DDU, 0x020BBEA63B139B22U,
+    0x29024E088A67CC74U, 0xC4C6628B80DC1CD1U, 0xC90FDAA22168C234U, 0xFFFFFFFFFFFFFFFFU,
+};
+auto constexpr PrimeBigEnd = toBigEndian(Prime);
+
+// MSE spec: "G is 2"
+auto constexpr Generator = limb_t{ 2U };
+
+// -Prime^-1 mod 2^64
+[[nodiscard]] constexpr limb_t negInverse(limb_t n) noexcept
 {
-    auto ret = std::array<std::byte, UIntWide::my_width2 / std::numeric_limits<uint8_t>::digits>{};
+    auto inv = n; // correct to 3 bits, since n is odd
+    for (int i = 0; i < 5; ++i) // Newton's method doubles that each pass
+    {
+        inv *= 2U - n * inv;
+    }
+    return ~inv + 1U;
+}
+
+auto constexpr PrimeInv = negInverse(Prime[0]);
+static_assert(Prime[0] * ~(PrimeInv - 1U) == 1U);
 
-    for (auto walk = std::rbegin(ret), end = std::rend(ret); walk != end; ++walk)
+// @return a - b, and stores the borrow (0 or 1) in `borrow`
+[[nodiscard]] constexpr number_t sub(number_t const& a, number_t const& b, limb_t& borrow) noexcept
+{
+    auto ret = number_t{};
+    borrow = 0U;
+    for (size_t i = 0; i < NumLimbs; ++i)
     {
-        *walk = std::byte(static_cast<uint8_t>(i & 0xFF));
-        i >>= 8;
+        auto const diff = a[i] - b[i];
+        auto const next_borrow = (a[i] < b[i] ? 1U : 0U) | (diff < borrow ? 1U : 0U);
+        ret[i] = diff - borrow;
+        borrow = next_borrow;
     }
+    return ret;
+}
 
+// @return `if_true` if mask is all ones, or `if_false` if it's all zeroes
+[[nodiscard]] constexpr number_t select(limb_t mask, number_t const& if_true, number_t const& if_false) noexcept
+{
+    auto ret = number_t{};
+    for (size_t i = 0; i < NumLimbs; ++i)
+    {
+        ret[i] = (if_true[i] & mask) | (if_false[i] & ~mask);
+    }
     return ret;
 }
 
-// NOLINTBEGIN(readability-identifier-naming)
-auto WIDE_INTEGER_CONSTEXPR const generator = wi::key_t{ "2" };
-auto WIDE_INTEGER_CONSTEXPR const prime = wi::key_t{
-    "0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563"
+// Reduces a number in [0, 2 * Prime) to [0, Prime).
+[[nodiscard]] constexpr number_t reduce(number_t const& num, limb_t carry = 0U) noexcept
+{
+    auto borrow = limb_t{};
+    auto const diff = sub(num, Prime, borrow);
+    // use the difference unless subtracting underflowed
+    return select(limb_t{ 0U } - (carry | (borrow ^ 1U)), diff, num);
+}
+
+// Montgomery multiplication: a * b / 2^768 mod Prime
+[[nodiscard]] number_t mul(number_t const& a, number_t const& b) noexcept
+{
+    auto t = std::array<limb_t, NumLimbs + 2U>{};
+
+    for (size_t i = 0; i < NumLimbs; ++i)
+    {
+        auto carry = limb_t{};
+        for (size_t j = 0; j < NumLimbs; ++j)
+        {
+            t[j] = mulAdd(a[j], b[i], t[j], carry, carry);
+        }
+        t[NumLimbs] = mulAdd(1U, t[NumLimbs], carry, 0U, t[NumLimbs + 1U]);
+
+        auto const m = t[0] * PrimeInv;
+        (void)mulAdd(m, Prime[0], t[0], 0U, carry);
+        for (size_t j = 1; j < NumLimbs; ++j)
+        {
+            t[j - 1U] = mulAdd(m, Prime[j], t[j], carry, carry);
+        }
+        t[NumLimbs - 1U] = mulAdd(1U, t[NumLimbs], carry, 0U, carry);
+        t[NumLimbs] = t[NumLimbs + 1U] + carry;
+    }
+
+    auto ret = number_t{};
+    std::copy_n(std::begin(t), NumLimbs, std::begin(ret));
+    return reduce(ret, t[NumLimbs]);
+}
+
+// @return the `index`th 4-bit digit of the exponent, least significant first
+[[nodiscard]] constexpr size_t nibble(DH::private_key_bigend_t const& exponent, size_t index) noexcept
+{
+    auto const byte = static_cast<uint8_t>(exponent[DH::PrivateKeySize - 1U - index / 2U]);
+    return (index % 2U == 0U ? byte : byte >> 4U) & 0xFU;
+}
+
+auto constexpr NumNibbles = DH::PrivateKeySize * 2U;
+using window_t = std::array<number_t, 16U>;
+
+// @return `window[index]`, reading every entry so that `index` doesn't leak
+[[nodiscard]] constexpr number_t lookup(window_t const& window, size_t index) noexcept
+{
+    auto ret = number_t{};
+    for (size_t i = 0; i < std::size(window); ++i)
+    {
+        ret = select(limb_t{ 0U } - (i == index ? 1U : 0U), window[i], ret);
+    }
+    return ret;
+}
+
+class Engine
+{
+public:
+    Engine() noexcept
+    {
+        // R mod Prime is 2^768 - Prime, since Prime > 2^767
+        auto borrow = limb_t{};
+        one_ = sub(number_t{}, Prime, borrow);
+
+        // R^2 mod Prime, by doubling R another 768 times
+        r_squared_ = one_;
+        for (size_t i = 0; i < NumLimbs * 64U; ++i)
+        {
+            auto carry = limb_t{};
+            for (auto& limb : r_squared_)
+            {
+                auto const next_carry = limb >> 63U;
+                limb = (limb << 1U) | carry;
+                carry = next_carry;
+            }
+            r_squared_ = reduce(r_squared_, carry);
+        }
+
+        // g_powers_[i][j] is G^(j * 16^i)
+        auto base = toMont(number_t{ Generator });
+        for (auto& window : g_powers_)
+        {
+            window = makeWindow(base);
+            for (int i = 0; i < 4; ++i)
+            {
+                base = mul(base, base);
+            }
+        }
+    }
+
+    [[nodiscard]] DH::key_bigend_t powG(DH::private_key_bigend_t const& exponent) const noexcept
+    {
+        auto acc = one_;
+        for (size_t i = 0; i < NumNibbles; ++i)
+        {
+            acc = mul(acc, lookup(g_powers_[i], nibble(exponent, i)));
+        }
+        return toBigEndian(fromMont(acc));
+    }
+
+    [[nodiscard]] DH::key_bigend_t pow(DH::key_bigend_t const& base, DH::private_key_bigend_t const& exponent) const noexcept
+    {
+        auto const window = makeWindow(toMont(reduce(fromBigEndian(std::data(base)))));
+
+        auto acc = one_;
+        for (size_t i = NumNibbles; i-- > 0U;)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                acc = mul(acc, acc);
+            }
+            acc = mul(acc, lookup(window, nibble(exponent, i)));
+        }
+        return toBigEndian(fromMont(acc));
+    }
+
+private:
+    [[nodiscard]] number_t toMont(number_t const& num) const noexcept
+    {
+        return mul(num, r_squared_);
+    }
+
+    [[nodiscard]] static number_t fromMont(number_t const& num) noexcept
+    {
+        return mul(num, number_t{ 1U });
+    }
+
+    // @return [ base^0, base^1, ... base^15 ]
+    [[nodiscard]] window_t makeWindow(number_t const& base) const noexcept
+    {
+        auto window = window_t{};
+        window[0] = one_;
+        for (size_t i = 1; i < std::size(window); ++i)
+        {
+            window[i] = mul(window[i - 1U], base);
+        }
+        return window;
+    }
+
+    number_t one_ = {};
+    number_t r_squared_ = {};
+    std::array<window_t, NumNibbles> g_powers_ = {};
 };
-// NOLINTEND(readability-identifier-naming)
 
-} // namespace wi
+[[nodiscard]] Engine const& engine() noexcept
+{
+    static auto const instance = Engine{};
+    return instance;
+}
+
+} // namespace mont
+} // namespace
 
 namespace tr_message_stream_encryption
 {
@@ -72,18 +304,35 @@ namespace tr_message_stream_encryption
     return tr_rand_obj<DH::private_key_bigend_t>();
 }
 
-[[nodiscard]] auto generatePublicKey(DH::private_key_bigend_t const& private_key) noexcept
+DH::key_bigend_t DH::powG(private_key_bigend_t const& exponent) noexcept
 {
-    auto const private_key_wi = wi::import_bits<wi::private_key_t>(private_key);
-    auto const public_key_wi = math::wide_integer::powm(wi::generator, private_key_wi, wi::prime);
-    return wi::export_bits(public_key_wi);
+    return mont::engine().powG(exponent);
+}
+
+DH::key_bigend_t DH::pow(key_bigend_t const& base, private_key_bigend_t const& exponent, bool use_crypto_library) noexcept
+{
+    auto ret = key_bigend_t{};
+    if (use_crypto_library &&
+        tr_powm(
+            std::data(base),
+            std::size(base),
+            std::data(exponent),
+            std::size(exponent),
+            std::data(mont::PrimeBigEnd),
+            std::size(mont::PrimeBigEnd),
+            std::data(ret)))
+    {
+        return ret;
+    }
+
+    return mont::engine().pow(base, exponent);
 }
 
 DH::key_bigend_t DH::publicKey() noexcept
 {
     if (public_key_ == key_bigend_t{})
     {
-        public_key_ = generatePublicKey(private_key_);
+        public_key_ = powG(private_key_);
     }
 
     return public_key_;
@@ -91,11 +340,7 @@ DH::key_bigend_t DH::publicKey() noexcept
 
 void DH::setPeerPublicKey(key_bigend_t const& peer_public_key)
 {
-    auto const secret = math::wide_integer::powm(
-        wi::import_bits<wi::key_t>(peer_public_key),
-        wi::import_bits<wi::private_key_t>(private_key_),
-        wi::prime);
-    secret_ = wi::export_bits(secret);
+    secret_ = pow(peer_public_key, private_key_);
 }
 
 /// Filter
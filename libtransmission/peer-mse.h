@@ -69,6 +69,19 @@ public:
 
     [[nodiscard]] static private_key_bigend_t randomPrivateKey() noexcept;
 
+    // The modular arithmetic behind publicKey() and setPeerPublicKey(),
+    // exposed for testing and benchmarking.
+
+    // Returns G ^ exponent mod P, using a table of precomputed powers of G.
+    [[nodiscard]] static key_bigend_t powG(private_key_bigend_t const& exponent) noexcept;
+
+    // Returns base ^ exponent mod P, using the crypto library if it can
+    // and `use_crypto_library` is true, or a built-in implementation if not.
+    [[nodiscard]] static key_bigend_t pow(
+        key_bigend_t const& base,
+        private_key_bigend_t const& exponent,
+        bool use_crypto_library = true) noexcept;
+
 private:
     private_key_bigend_t const private_key_;
     key_bigend_t public_key_ = {};
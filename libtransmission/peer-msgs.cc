@@ -423,14 +423,19 @@ public:
         return have_;
     }
 
+    [[nodiscard]] bool is_interesting() const noexcept override
+    {
+        return interesting_piece_count_ > 0;
+    }
+
     void onTorrentGotMetainfo() noexcept override
     {
-        invalidatePercentDone();
+        recountInterestingPieces();
     }
 
-    void invalidatePercentDone()
+    void on_pieces_wanted_changed() override
     {
-        updateInterest();
+        recountInterestingPieces();
     }
 
     void cancel_block_request(tr_block_index_t block) override
@@ -472,7 +477,10 @@ public:
         protocolSendHave(this, piece);
 
         // since we have more pieces now, we might not be interested in this peer
-        updateInterest();
+        if (interesting_piece_count_ > 0 && have_.test(piece) && torrent->pieceIsWanted(piece))
+        {
+            setInterestingPieceCount(interesting_piece_count_ - 1);
+        }
     }
 
     void set_interested(bool interested) override
@@ -485,9 +493,61 @@ public:
         }
     }
 
+    [[nodiscard]] bool isPieceInteresting(tr_piece_index_t piece) const
+    {
+        return torrent->pieceIsWanted(piece) && !torrent->hasPiece(piece);
+    }
+
+    // the peer got a piece; see if it's one that we want
+    void onPeerGotPiece(tr_piece_index_t piece)
+    {
+        if (torrent->hasMetainfo() && isPieceInteresting(piece))
+        {
+            setInterestingPieceCount(interesting_piece_count_ + 1);
+        }
+    }
+
+    // the peer's pieces or our wanted pieces changed wholesale; start over
+    void recountInterestingPieces()
+    {
+        auto n = size_t{};
+
+        if (torrent->hasMetainfo() && !have_.hasNone())
+        {
+            // only look at the pieces that the peer has and we don't
+            auto const& client_pieces = torrent->completion.pieces();
+            auto const n_pieces = torrent->pieceCount();
+            for (auto piece = have_.findNextAndNot(client_pieces, 0, n_pieces); piece < n_pieces;
+                 piece = have_.findNextAndNot(client_pieces, piece + 1, n_pieces))
+            {
+                if (torrent->pieceIsWanted(piece))
+                {
+                    ++n;
+                }
+            }
+        }
+
+        setInterestingPieceCount(n);
+    }
+
+    void setInterestingPieceCount(size_t n)
+    {
+        auto const was_interesting = is_interesting();
+        interesting_piece_count_ = n;
+
+        if (was_interesting != is_interesting())
+        {
+            updateInterest();
+        }
+    }
+
+    // Called when the peer goes from having nothing we want to having
+    // something we want, or vice versa. Tell them right away instead
+    // of waiting for the next rechokeDownloads(), which still decides
+    // which of the interesting peers we stay interested in.
     void updateInterest()
     {
-        // TODO -- might need to poke the mgr on startup
+        set_interested(is_interesting() && torrent->clientCanDownload());
     }
 
     //
@@ -704,6 +764,9 @@ public:
     tr_bitfield have_;
 
 private:
+    // how many pieces the peer has that we want and don't have yet
+    size_t interesting_piece_count_ = 0;
+
     std::array<bool, 2> is_active_ = { false, false };
 
     tr_peer_callback const callback_;
@@ -1570,9 +1633,9 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
         {
             msgs->have_.set(ui32);
             msgs->publish(tr_peer_event::GotHave(ui32));
+            msgs->onPeerGotPiece(ui32);
         }
 
-        msgs->invalidatePercentDone();
         break;
 
     case BtPeerMsgs::Bitfield:
@@ -1583,7 +1646,7 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
             msgs->have_ = tr_bitfield{ msgs->torrent->hasMetainfo() ? msgs->torrent->pieceCount() : std::size(tmp) * 8 };
             msgs->have_.setRaw(std::data(tmp), std::size(tmp));
             msgs->publish(tr_peer_event::GotBitfield(&msgs->have_));
-            msgs->invalidatePercentDone();
+            msgs->recountInterestingPieces();
             break;
         }
 
@@ -1686,7 +1749,7 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
         {
             msgs->have_.setHasAll();
             msgs->publish(tr_peer_event::GotHaveAll());
-            msgs->invalidatePercentDone();
+            msgs->recountInterestingPieces();
         }
         else
         {
@@ -1703,7 +1766,7 @@ static ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
         {
             msgs->have_.setHasNone();
             msgs->publish(tr_peer_event::GotHaveNone());
-            msgs->invalidatePercentDone();
+            msgs->recountInterestingPieces();
         }
         else
         {
@@ -2052,7 +2115,8 @@ static size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
                            msgs->torrent,
                            msgs->torrent->pieceLoc(req.index, req.offset),
                            req.length,
-                           std::data(buf)) != 0;
+                           std::data(buf),
+                           tr_disk_scheduler::IoClass::SeedRead) != 0;
             out.add(std::data(buf), req.length);
 
             /* check the piece if it needs checking... */
@@ -42,6 +42,9 @@ public:
     [[nodiscard]] virtual bool is_client_choked() const noexcept = 0;
     [[nodiscard]] virtual bool is_client_interested() const noexcept = 0;
 
+    // whether or not this peer has any pieces that we want and don't have yet
+    [[nodiscard]] virtual bool is_interesting() const noexcept = 0;
+
     [[nodiscard]] virtual bool is_utp_connection() const noexcept = 0;
     [[nodiscard]] virtual bool is_encrypted() const = 0;
     [[nodiscard]] virtual bool is_incoming_connection() const = 0;
@@ -62,6 +65,8 @@ public:
 
     virtual void on_piece_completed(tr_piece_index_t) = 0;
 
+    virtual void on_pieces_wanted_changed() = 0;
+
     // The client name. This is the app name derived from the `v' string in LTEP's handshake dictionary
     tr_interned_string client;
 
@@ -18,7 +18,7 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
+auto constexpr MyStatic = std::array<std::string_view, 416>{ ""sv,
                                                              "activeTorrentCount"sv,
                                                              "activity-date"sv,
                                                              "activityDate"sv,
@@ -45,6 +45,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "anti-brute-force-threshold"sv,
                                                              "arguments"sv,
                                                              "availability"sv,
+                                                             "background"sv,
                                                              "bandwidth-priority"sv,
                                                              "bandwidthPriority"sv,
                                                              "bind-address-ipv4"sv,
@@ -57,6 +58,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "blocklist-url"sv,
                                                              "blocks"sv,
                                                              "bytesCompleted"sv,
+                                                             "cache-flush-batch-mb"sv,
                                                              "cache-size-mb"sv,
                                                              "clientIsChoked"sv,
                                                              "clientIsInterested"sv,
@@ -69,6 +71,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "cookies"sv,
                                                              "corrupt"sv,
                                                              "corruptEver"sv,
+                                                             "count"sv,
                                                              "created by"sv,
                                                              "created by.utf-8"sv,
                                                              "creation date"sv,
@@ -84,6 +87,8 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "details-window-height"sv,
                                                              "details-window-width"sv,
                                                              "dht-enabled"sv,
+                                                             "direct-io-enabled"sv,
+                                                             "disk-io-stats"sv,
                                                              "dnd"sv,
                                                              "done-date"sv,
                                                              "doneDate"sv,
@@ -126,6 +131,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "filter-trackers"sv,
                                                              "flagStr"sv,
                                                              "flags"sv,
+                                                             "flush"sv,
                                                              "format"sv,
                                                              "fromCache"sv,
                                                              "fromDht"sv,
@@ -137,10 +143,12 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "group"sv,
                                                              "hasAnnounced"sv,
                                                              "hasScraped"sv,
+                                                             "hash-read"sv,
                                                              "hashString"sv,
                                                              "have"sv,
                                                              "haveUnchecked"sv,
                                                              "haveValid"sv,
+                                                             "hits"sv,
                                                              "honorsSessionLimits"sv,
                                                              "host"sv,
                                                              "id"sv,
@@ -177,6 +185,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "lastScrapeSucceeded"sv,
                                                              "lastScrapeTime"sv,
                                                              "lastScrapeTimedOut"sv,
+                                                             "latency-histogram"sv,
                                                              "leecherCount"sv,
                                                              "leftUntilDone"sv,
                                                              "length"sv,
@@ -201,7 +210,10 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "metainfo"sv,
                                                              "method"sv,
                                                              "min_request_interval"sv,
+                                                             "misses"sv,
                                                              "move"sv,
+                                                             "move-queue-size"sv,
+                                                             "moveProgress"sv,
                                                              "msg_type"sv,
                                                              "mtimes"sv,
                                                              "name"sv,
@@ -248,6 +260,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "port-forwarding-enabled"sv,
                                                              "port-is-open"sv,
                                                              "preallocation"sv,
+                                                             "preallocationProgress"sv,
                                                              "prefetch-enabled"sv,
                                                              "primary-mime-type"sv,
                                                              "priorities"sv,
@@ -272,6 +285,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "ratio-limit"sv,
                                                              "ratio-limit-enabled"sv,
                                                              "ratio-mode"sv,
+                                                             "read-cache-stats"sv,
                                                              "read-clipboard"sv,
                                                              "recent-download-dir-1"sv,
                                                              "recent-download-dir-2"sv,
@@ -322,6 +336,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "secondsSeeding"sv,
                                                              "seed-queue-enabled"sv,
                                                              "seed-queue-size"sv,
+                                                             "seed-read"sv,
                                                              "seedIdleLimit"sv,
                                                              "seedIdleMode"sv,
                                                              "seedRatioLimit"sv,
@@ -360,6 +375,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "startDate"sv,
                                                              "status"sv,
                                                              "statusbar-stats"sv,
+                                                             "storage-backend"sv,
                                                              "tag"sv,
                                                              "tcp-enabled"sv,
                                                              "tier"sv,
@@ -412,6 +428,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "utp-enabled"sv,
                                                              "v"sv,
                                                              "version"sv,
+                                                             "waits"sv,
                                                              "wanted"sv,
                                                              "watch-dir"sv,
                                                              "watch-dir-enabled"sv,
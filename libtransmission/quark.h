@@ -48,6 +48,7 @@ enum
     TR_KEY_anti_brute_force_threshold, /* rpc */
     TR_KEY_arguments, /* rpc */
     TR_KEY_availability, // rpc
+    TR_KEY_background,
     TR_KEY_bandwidth_priority,
     TR_KEY_bandwidthPriority,
     TR_KEY_bind_address_ipv4,
@@ -60,6 +61,7 @@ enum
     TR_KEY_blocklist_url,
     TR_KEY_blocks,
     TR_KEY_bytesCompleted,
+    TR_KEY_cache_flush_batch_mb,
     TR_KEY_cache_size_mb,
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
@@ -72,6 +74,7 @@ enum
     TR_KEY_cookies,
     TR_KEY_corrupt,
     TR_KEY_corruptEver,
+    TR_KEY_count,
     TR_KEY_created_by,
     TR_KEY_created_by_utf_8,
     TR_KEY_creation_date,
@@ -87,6 +90,8 @@ enum
     TR_KEY_details_window_height,
     TR_KEY_details_window_width,
     TR_KEY_dht_enabled,
+    TR_KEY_direct_io_enabled,
+    TR_KEY_disk_io_stats,
     TR_KEY_dnd,
     TR_KEY_done_date,
     TR_KEY_doneDate,
@@ -129,6 +134,7 @@ enum
     TR_KEY_filter_trackers,
     TR_KEY_flagStr,
     TR_KEY_flags,
+    TR_KEY_flush,
     TR_KEY_format,
     TR_KEY_fromCache,
     TR_KEY_fromDht,
@@ -140,10 +146,12 @@ enum
     TR_KEY_group,
     TR_KEY_hasAnnounced,
     TR_KEY_hasScraped,
+    TR_KEY_hash_read,
     TR_KEY_hashString,
     TR_KEY_have,
     TR_KEY_haveUnchecked,
     TR_KEY_haveValid,
+    TR_KEY_hits,
     TR_KEY_honorsSessionLimits,
     TR_KEY_host,
     TR_KEY_id,
@@ -180,6 +188,7 @@ enum
     TR_KEY_lastScrapeSucceeded,
     TR_KEY_lastScrapeTime,
     TR_KEY_lastScrapeTimedOut,
+    TR_KEY_latency_histogram,
     TR_KEY_leecherCount,
     TR_KEY_leftUntilDone,
     TR_KEY_length,
@@ -204,7 +213,10 @@ enum
     TR_KEY_metainfo,
     TR_KEY_method,
     TR_KEY_min_request_interval,
+    TR_KEY_misses,
     TR_KEY_move,
+    TR_KEY_move_queue_size,
+    TR_KEY_moveProgress,
     TR_KEY_msg_type,
     TR_KEY_mtimes,
     TR_KEY_name,
@@ -251,6 +263,7 @@ enum
     TR_KEY_port_forwarding_enabled,
     TR_KEY_port_is_open,
     TR_KEY_preallocation,
+    TR_KEY_preallocationProgress,
     TR_KEY_prefetch_enabled,
     TR_KEY_primary_mime_type,
     TR_KEY_priorities,
@@ -275,6 +288,7 @@ enum
     TR_KEY_ratio_limit,
     TR_KEY_ratio_limit_enabled,
     TR_KEY_ratio_mode,
+    TR_KEY_read_cache_stats,
     TR_KEY_read_clipboard,
     TR_KEY_recent_download_dir_1,
     TR_KEY_recent_download_dir_2,
@@ -325,6 +339,7 @@ enum
     TR_KEY_secondsSeeding,
     TR_KEY_seed_queue_enabled,
     TR_KEY_seed_queue_size,
+    TR_KEY_seed_read,
     TR_KEY_seedIdleLimit,
     TR_KEY_seedIdleMode,
     TR_KEY_seedRatioLimit,
@@ -363,6 +378,7 @@ enum
     TR_KEY_startDate,
     TR_KEY_status,
     TR_KEY_statusbar_stats,
+    TR_KEY_storage_backend,
     TR_KEY_tag,
     TR_KEY_tcp_enabled,
     TR_KEY_tier,
@@ -415,6 +431,7 @@ enum
     TR_KEY_utp_enabled,
     TR_KEY_v,
     TR_KEY_version,
+    TR_KEY_waits,
     TR_KEY_wanted,
     TR_KEY_watch_dir,
     TR_KEY_watch_dir_enabled,
@@ -0,0 +1,317 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "disk-scheduler.h"
+#include "error.h"
+#include "file.h"
+#include "relocator.h"
+#include "tr-assert.h"
+#include "tr-strbuf.h"
+
+namespace
+{
+
+// How much to copy between checking for cancellation and updating progress
+auto constexpr ChunkSize = uint64_t{ 8U * 1024U * 1024U };
+
+// Open the task's source and destination, creating the destination if needed
+[[nodiscard]] bool openFiles(tr_relocator::Task const& task, tr_sys_file_t& in, tr_sys_file_t& out, tr_error** error)
+{
+    if (task.create)
+    {
+        if (auto const dir = tr_pathbuf{ tr_sys_path_dirname(task.dst) };
+            !tr_sys_dir_create(dir, TR_SYS_DIR_CREATE_PARENTS, 0777, error))
+        {
+            tr_error_prefix(error, "Unable to create directory for new file: ");
+            return false;
+        }
+    }
+
+    in = tr_sys_file_open(task.src.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, error);
+    if (in == TR_BAD_SYS_FILE)
+    {
+        tr_error_prefix(error, "Unable to open source file: ");
+        return false;
+    }
+
+    auto const flags = TR_SYS_FILE_WRITE | (task.create ? TR_SYS_FILE_CREATE | TR_SYS_FILE_TRUNCATE : 0);
+    out = tr_sys_file_open(task.dst.c_str(), flags, 0666, error);
+    if (out == TR_BAD_SYS_FILE)
+    {
+        tr_error_prefix(error, "Unable to open destination file: ");
+        tr_sys_file_close(in);
+        return false;
+    }
+
+    return true;
+}
+
+// Where to stop copying. The source might not have been
+// written all the way to the end of the task yet.
+[[nodiscard]] uint64_t copyEnd(tr_relocator::Task const& task)
+{
+    auto const src_size = tr_sys_path_get_info(task.src).value_or(tr_sys_path_info{}).size;
+    return std::min(task.offset + task.length, std::max(src_size, task.offset));
+}
+
+} // namespace
+
+tr_relocator::Job::Job(uint64_t id_in, tr_torrent_id_t tor_id_in, std::vector<Task>&& tasks_in, DoneFunc&& on_done_in)
+    : id{ id_in }
+    , tor_id{ tor_id_in }
+    , tasks{ std::move(tasks_in) }
+    , on_done{ std::move(on_done_in) }
+{
+    progress.total = std::accumulate(
+        std::begin(tasks),
+        std::end(tasks),
+        uint64_t{},
+        [](uint64_t sum, Task const& task) { return sum + task.length; });
+}
+
+tr_relocator::~tr_relocator()
+{
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        stop_ = true;
+        for (auto& job : jobs_)
+        {
+            job.cancelled = true;
+        }
+    }
+    cv_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void tr_relocator::setMaxConcurrent(size_t max_concurrent)
+{
+    TR_ASSERT(max_concurrent > 0U);
+
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        max_concurrent_ = max_concurrent;
+    }
+
+    cv_.notify_all();
+}
+
+void tr_relocator::add(tr_torrent_id_t tor_id, std::vector<Task> tasks, DoneFunc on_done)
+{
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        jobs_.emplace_back(++next_job_id_, tor_id, std::move(tasks), std::move(on_done));
+
+        // workers are started as they're needed
+        auto const n_wanted = std::min(max_concurrent_, std::size(jobs_));
+        while (std::size(threads_) < n_wanted)
+        {
+            threads_.emplace_back(&tr_relocator::threadFunc, this);
+        }
+    }
+
+    cv_.notify_all();
+}
+
+void tr_relocator::cancel(tr_torrent_id_t tor_id)
+{
+    auto lock = std::unique_lock{ mutex_ };
+
+    // remove the jobs that haven't been started yet
+    jobs_.remove_if([tor_id](Job const& job) { return job.tor_id == tor_id && !job.busy; });
+
+    // if the workers are on any of them, wait for them to give up
+    auto const is_busy = [this, tor_id]()
+    {
+        return std::any_of(std::begin(jobs_), std::end(jobs_), [tor_id](Job const& job) { return job.tor_id == tor_id; });
+    };
+
+    for (auto& job : jobs_)
+    {
+        if (job.tor_id == tor_id)
+        {
+            job.cancelled = true;
+        }
+    }
+
+    cv_.wait(lock, [&is_busy]() { return !is_busy(); });
+}
+
+std::optional<tr_relocator::Progress> tr_relocator::progress(tr_torrent_id_t tor_id) const
+{
+    auto const lock = std::lock_guard{ mutex_ };
+
+    auto ret = std::optional<Progress>{};
+    for (auto const& job : jobs_)
+    {
+        if (job.tor_id == tor_id && !job.finished)
+        {
+            auto& progress = ret ? *ret : ret.emplace();
+            progress.done += job.progress.done;
+            progress.total += job.progress.total;
+        }
+    }
+
+    return ret;
+}
+
+void tr_relocator::threadFunc()
+{
+    auto lock = std::unique_lock{ mutex_ };
+
+    for (;;)
+    {
+        auto iter = std::end(jobs_);
+        cv_.wait(
+            lock,
+            [this, &iter]()
+            {
+                if (stop_)
+                {
+                    return true;
+                }
+
+                if (n_busy_ >= max_concurrent_)
+                {
+                    return false;
+                }
+
+                iter = std::find_if(std::begin(jobs_), std::end(jobs_), [](Job const& job) { return !job.busy; });
+                return iter != std::end(jobs_);
+            });
+
+        if (stop_)
+        {
+            break;
+        }
+
+        iter->busy = true;
+        ++n_busy_;
+        lock.unlock();
+
+        runJob(*iter);
+
+        lock.lock();
+        --n_busy_;
+        jobs_.erase(iter);
+        cv_.notify_all();
+    }
+}
+
+void tr_relocator::runJob(Job& job)
+{
+    tr_error* error = nullptr;
+
+    for (auto const& task : job.tasks)
+    {
+        if (job.cancelled || !copy(job, task, &error))
+        {
+            break;
+        }
+    }
+
+    // the caller counts this job as done once it's told so,
+    // so stop reporting its progress separately
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        job.finished = true;
+    }
+
+    if (!job.cancelled && job.on_done)
+    {
+        job.on_done(error);
+    }
+
+    tr_error_clear(&error);
+}
+
+bool tr_relocator::copy(Job& job, Task const& task, tr_error** error)
+{
+    tr_sys_file_t in = TR_BAD_SYS_FILE;
+    tr_sys_file_t out = TR_BAD_SYS_FILE;
+    if (!openFiles(task, in, out, error))
+    {
+        return false;
+    }
+
+    auto const device = disk_scheduler_ != nullptr ? disk_scheduler_->deviceOf(tr_sys_path_dirname(task.src)) :
+                                                     tr_disk_scheduler::device_t{};
+    auto const cancelled = [&job]()
+    {
+        return job.cancelled.load();
+    };
+
+    auto const end = copyEnd(task);
+
+    auto ok = true;
+    for (auto offset = task.offset; ok && offset < end && !job.cancelled;)
+    {
+        // each chunk is a turn of Background I/O
+        auto ticket = tr_disk_scheduler::Ticket{};
+        if (disk_scheduler_ != nullptr)
+        {
+            ticket = disk_scheduler_->wait(device, tr_disk_scheduler::IoClass::Background, cancelled);
+            if (!ticket)
+            {
+                break;
+            }
+        }
+
+        auto const len = std::min(end - offset, ChunkSize);
+        ok = tr_sys_file_copy_range(in, offset, out, offset, len, error);
+        offset += len;
+
+        auto const lock = std::lock_guard{ mutex_ };
+        job.progress.done += len;
+    }
+
+    if (!ok)
+    {
+        tr_error_prefix(error, "Unable to copy: ");
+    }
+    else if (!job.cancelled)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        job.progress.done += task.offset + task.length - end;
+    }
+
+    tr_sys_file_close(out);
+    tr_sys_file_close(in);
+    return ok;
+}
+
+bool tr_relocator::copyNow(Task const& task, tr_error** error)
+{
+    tr_sys_file_t in = TR_BAD_SYS_FILE;
+    tr_sys_file_t out = TR_BAD_SYS_FILE;
+    if (!openFiles(task, in, out, error))
+    {
+        return false;
+    }
+
+    auto const end = copyEnd(task);
+    auto const ok = end <= task.offset || tr_sys_file_copy_range(in, task.offset, out, task.offset, end - task.offset, error);
+    if (!ok)
+    {
+        tr_error_prefix(error, "Unable to copy: ");
+    }
+
+    tr_sys_file_close(out);
+    tr_sys_file_close(in);
+    return ok;
+}
@@ -0,0 +1,126 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "transmission.h"
+
+class tr_disk_scheduler;
+struct tr_error;
+
+/**
+ * @addtogroup file_io File IO
+ * @{
+ */
+
+// Copies torrents' files to a new location on worker threads, so that
+// moving a torrent to another filesystem doesn't stall the session thread.
+// The torrent keeps using its old files while they're copied; it's up to
+// the caller to switch over to the copies when they're done.
+class tr_relocator
+{
+public:
+    // Copy `length` bytes at `offset` in `src` to the same offset in `dst`.
+    // If `create` is true, `dst` and its parent directories are created
+    // first, and `dst` is truncated if it already exists.
+    // Bytes past the end of `src` are skipped.
+    struct Task
+    {
+        std::string src;
+        std::string dst;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        bool create = false;
+    };
+
+    struct Progress
+    {
+        uint64_t done = 0;
+        uint64_t total = 0;
+    };
+
+    // Called from a worker thread when a job's tasks are done.
+    // `error` is nullptr if they all succeeded.
+    using DoneFunc = std::function<void(tr_error const* error)>;
+
+    // Copying is Background I/O in `disk_scheduler`, if there is one
+    explicit tr_relocator(tr_disk_scheduler* disk_scheduler = nullptr, size_t max_concurrent = 1U) noexcept
+        : disk_scheduler_{ disk_scheduler }
+        , max_concurrent_{ max_concurrent }
+    {
+    }
+
+    tr_relocator(tr_relocator&&) = delete;
+    tr_relocator(tr_relocator const&) = delete;
+    tr_relocator& operator=(tr_relocator&&) = delete;
+    tr_relocator& operator=(tr_relocator const&) = delete;
+    ~tr_relocator();
+
+    // How many torrents' jobs may be worked on at once
+    void setMaxConcurrent(size_t max_concurrent);
+
+    void add(tr_torrent_id_t tor_id, std::vector<Task> tasks, DoneFunc on_done);
+
+    // Stop working on the torrent's jobs and drop them.
+    // Returns once the workers are no longer touching its files.
+    // A job that was already finishing might still call `on_done` first.
+    void cancel(tr_torrent_id_t tor_id);
+
+    // @return the progress of the torrent's pending jobs, if it has any
+    [[nodiscard]] std::optional<Progress> progress(tr_torrent_id_t tor_id) const;
+
+    // Copy a task right away in the calling thread, e.g. a last few
+    // changed pieces that aren't worth handing off to the workers
+    [[nodiscard]] static bool copyNow(Task const& task, tr_error** error);
+
+private:
+    struct Job
+    {
+        Job(uint64_t id_in, tr_torrent_id_t tor_id_in, std::vector<Task>&& tasks_in, DoneFunc&& on_done_in);
+
+        uint64_t const id;
+        tr_torrent_id_t const tor_id;
+        std::vector<Task> const tasks;
+        DoneFunc const on_done;
+        Progress progress;
+        bool busy = false;
+        bool finished = false; // its progress is no longer reported
+        std::atomic<bool> cancelled = false;
+    };
+
+    void threadFunc();
+    void runJob(Job& job);
+    [[nodiscard]] bool copy(Job& job, Task const& task, tr_error** error);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    std::list<Job> jobs_;
+    size_t n_busy_ = 0;
+    uint64_t next_job_id_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+
+    tr_disk_scheduler* const disk_scheduler_;
+    size_t max_concurrent_;
+};
+
+/* @} */
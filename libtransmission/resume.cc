@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <cstring>
 #include <ctime>
+#include <optional>
 #include <string_view>
 #include <vector>
 
@@ -21,6 +22,7 @@
 #include "peer-mgr.h" /* pex */
 #include "resume.h"
 #include "session.h"
+#include "storage.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "utils.h"
@@ -147,6 +149,34 @@ static auto loadGroup(tr_variant* dict, tr_torrent* tor)
 ****
 ***/
 
+static void saveStorageBackend(tr_variant* dict, tr_torrent const* tor)
+{
+    // the memory backend is only for tests, and has nothing to restore
+    if (auto const backend = tor->storage().backend(); backend != TR_STORAGE_MEMORY)
+    {
+        libtransmission::VariantConverter::save<tr_storage_backend>(tr_variantDictAdd(dict, TR_KEY_storage_backend), backend);
+    }
+}
+
+static auto loadStorageBackend(tr_variant* dict, tr_torrent* tor)
+{
+    // Resume files from before there was a choice of backends don't say,
+    // but their torrents' data is on the filesystem. Don't let them pick up
+    // the session's `storage-backend`, which is only for new torrents.
+    auto backend = std::optional<tr_storage_backend>{};
+    if (tr_variant* child = tr_variantDictFind(dict, TR_KEY_storage_backend); child != nullptr)
+    {
+        backend = libtransmission::VariantConverter::load<tr_storage_backend>(child);
+    }
+
+    tor->storage_ = tr_storage::create(backend.value_or(TR_STORAGE_FILESYSTEM), *tor);
+    return tr_resume::StorageBackend;
+}
+
+/***
+****
+***/
+
 static void saveDND(tr_variant* dict, tr_torrent const* tor)
 {
     auto const n = tor->fileCount();
@@ -662,9 +692,10 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, bo
     auto const filename = tor->resumeFile();
     auto buf = std::vector<char>{};
     tr_error* error = nullptr;
+    auto arena = tr_variant_arena{};
     auto top = tr_variant{};
     if (!tr_loadFile(filename, buf, &error) ||
-        !tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
+        !tr_variantFromBuf(&top, arena, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
     {
         tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
         tr_error_clear(&error);
@@ -774,6 +805,11 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, bo
         fields_loaded |= loadPeers(&top, tor);
     }
 
+    if ((fields_to_load & tr_resume::StorageBackend) != 0)
+    {
+        fields_loaded |= loadStorageBackend(&top, tor);
+    }
+
     // Note: loadFilenames() must come before loadProgress()
     // so that loadProgress() -> tor->initCheckedPieces() -> tor->findFile()
     // will know where to look
@@ -941,6 +977,7 @@ void save(tr_torrent* tor)
     saveName(&top, tor);
     saveLabels(&top, tor);
     saveGroup(&top, tor);
+    saveStorageBackend(&top, tor);
 
     auto const resume_file = tor->resumeFile();
     if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, resume_file); err != 0)
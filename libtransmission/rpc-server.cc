@@ -296,8 +296,9 @@ static void rpc_response_func(tr_session* /*session*/, tr_variant* content, void
 
 static void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* server, std::string_view json)
 {
+    auto arena = tr_variant_arena{};
     auto top = tr_variant{};
-    auto const have_content = tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
+    auto const have_content = tr_variantFromBuf(&top, arena, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
 
     tr_rpc_request_exec_json(
         server->session,
@@ -22,8 +22,10 @@
 #include "transmission.h"
 
 #include "announcer.h"
+#include "cache.h"
 #include "completion.h"
 #include "crypto-utils.h"
+#include "disk-scheduler.h"
 #include "error.h"
 #include "file.h"
 #include "log.h"
@@ -215,13 +217,8 @@ static char const* queueMoveBottom(
     return nullptr;
 }
 
-struct CompareTorrentByQueuePosition
-{
-    constexpr bool operator()(tr_torrent const* a, tr_torrent const* b) const
-    {
-        return a->queuePosition < b->queuePosition;
-    }
-};
+// Start, stop, and verify the torrents in batches rather than one at a time,
+// so that doing it to thousands of torrents at once doesn't stall the session.
 
 static char const* torrentStart(
     tr_session* session,
@@ -230,14 +227,14 @@ static char const* torrentStart(
     tr_rpc_idle_data* /*idle_data*/)
 {
     auto torrents = getTorrents(session, args_in);
-    std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition{});
+    torrents.erase(
+        std::remove_if(std::begin(torrents), std::end(torrents), [](auto const* tor) { return tor->isRunning; }),
+        std::end(torrents));
+
+    tr_torrentsStart(std::data(torrents), std::size(torrents));
     for (auto* tor : torrents)
     {
-        if (!tor->isRunning)
-        {
-            tr_torrentStart(tor);
-            session->rpcNotify(TR_RPC_TORRENT_STARTED, tor);
-        }
+        session->rpcNotify(TR_RPC_TORRENT_STARTED, tor);
     }
 
     return nullptr;
@@ -250,14 +247,14 @@ static char const* torrentStartNow(
     tr_rpc_idle_data* /*idle_data*/)
 {
     auto torrents = getTorrents(session, args_in);
-    std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition{});
+    torrents.erase(
+        std::remove_if(std::begin(torrents), std::end(torrents), [](auto const* tor) { return tor->isRunning; }),
+        std::end(torrents));
+
+    tr_torrentsStartNow(std::data(torrents), std::size(torrents));
     for (auto* tor : torrents)
     {
-        if (!tor->isRunning)
-        {
-            tr_torrentStartNow(tor);
-            session->rpcNotify(TR_RPC_TORRENT_STARTED, tor);
-        }
+        session->rpcNotify(TR_RPC_TORRENT_STARTED, tor);
     }
 
     return nullptr;
@@ -269,13 +266,18 @@ static char const* torrentStop(
     tr_variant* /*args_out*/,
     tr_rpc_idle_data* /*idle_data*/)
 {
-    for (auto* tor : getTorrents(session, args_in))
+    auto torrents = getTorrents(session, args_in);
+    torrents.erase(
+        std::remove_if(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* tor) { return !tor->isRunning && !tor->isQueued() && tor->verifyState() == TR_VERIFY_NONE; }),
+        std::end(torrents));
+
+    tr_torrentsStop(std::data(torrents), std::size(torrents));
+    for (auto* tor : torrents)
     {
-        if (tor->isRunning || tor->isQueued() || tor->verifyState() != TR_VERIFY_NONE)
-        {
-            tor->isStopping = true;
-            session->rpcNotify(TR_RPC_TORRENT_STOPPED, tor);
-        }
+        session->rpcNotify(TR_RPC_TORRENT_STOPPED, tor);
     }
 
     return nullptr;
@@ -327,9 +329,10 @@ static char const* torrentVerify(
     tr_variant* /*args_out*/,
     tr_rpc_idle_data* /*idle_data*/)
 {
-    for (auto* tor : getTorrents(session, args_in))
+    auto const torrents = getTorrents(session, args_in);
+    tr_torrentsVerify(std::data(torrents), std::size(torrents));
+    for (auto* tor : torrents)
     {
-        tr_torrentVerify(tor);
         session->rpcNotify(TR_RPC_TORRENT_CHANGED, tor);
     }
 
@@ -499,6 +502,7 @@ static void addPeers(tr_torrent const* tor, tr_variant* list)
     case TR_KEY_manualAnnounceTime:
     case TR_KEY_maxConnectedPeers:
     case TR_KEY_metadataPercentComplete:
+    case TR_KEY_moveProgress:
     case TR_KEY_name:
     case TR_KEY_peer_limit:
     case TR_KEY_peers:
@@ -511,6 +515,7 @@ static void addPeers(tr_torrent const* tor, tr_variant* list)
     case TR_KEY_pieceCount:
     case TR_KEY_pieceSize:
     case TR_KEY_pieces:
+    case TR_KEY_preallocationProgress:
     case TR_KEY_primary_mime_type:
     case TR_KEY_priorities:
     case TR_KEY_queuePosition:
@@ -703,6 +708,10 @@ static void initField(tr_torrent const* const tor, tr_stat const* const st, tr_v
         tr_variantInitReal(initme, st->metadataPercentComplete);
         break;
 
+    case TR_KEY_moveProgress:
+        tr_variantInitReal(initme, st->moveProgress);
+        break;
+
     case TR_KEY_name:
         tr_variantInitStrView(initme, tr_torrentName(tor));
         break;
@@ -767,6 +776,10 @@ static void initField(tr_torrent const* const tor, tr_stat const* const st, tr_v
         tr_variantInitInt(initme, tor->pieceSize());
         break;
 
+    case TR_KEY_preallocationProgress:
+        tr_variantInitReal(initme, st->preallocationProgress);
+        break;
+
     case TR_KEY_primary_mime_type:
         tr_variantInitStrView(initme, tor->primaryMimeType());
         break;
@@ -2158,6 +2171,36 @@ static char const* sessionStats(
     tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
     tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
 
+    auto const read_cache_stats = session->cache->readCacheStats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_read_cache_stats, 3);
+    tr_variantDictAddInt(d, TR_KEY_hits, read_cache_stats.hits);
+    tr_variantDictAddInt(d, TR_KEY_misses, read_cache_stats.misses);
+    tr_variantDictAddInt(d, TR_KEY_size_bytes, read_cache_stats.size_bytes);
+
+    static auto constexpr IoClassKeys = std::array<tr_quark, tr_disk_scheduler::NumClasses>{
+        TR_KEY_seed_read,
+        TR_KEY_flush,
+        TR_KEY_hash_read,
+        TR_KEY_background,
+    };
+    auto const disk_io_stats = session->diskScheduler().stats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_disk_io_stats, std::size(disk_io_stats));
+    for (size_t i = 0; i < std::size(disk_io_stats); ++i)
+    {
+        auto const& class_stats = disk_io_stats[i];
+        auto* const class_dict = tr_variantDictAddDict(d, IoClassKeys[i], 3);
+        tr_variantDictAddInt(class_dict, TR_KEY_count, class_stats.count);
+        tr_variantDictAddInt(class_dict, TR_KEY_waits, class_stats.waits);
+        auto* const histogram = tr_variantDictAddList(
+            class_dict,
+            TR_KEY_latency_histogram,
+            std::size(class_stats.latency_histogram));
+        for (auto const n : class_stats.latency_histogram)
+        {
+            tr_variantListAddInt(histogram, n);
+        }
+    }
+
     return nullptr;
 }
 
@@ -23,9 +23,11 @@ struct tr_variant;
     V(TR_KEY_bind_address_ipv6, bind_address_ipv6, std::string, "::", "") \
     V(TR_KEY_blocklist_enabled, blocklist_enabled, bool, false, "") \
     V(TR_KEY_blocklist_url, blocklist_url, std::string, "http://www.example.com/blocklist", "") \
+    V(TR_KEY_cache_flush_batch_mb, cache_flush_batch_mb, size_t, 1U, "") \
     V(TR_KEY_cache_size_mb, cache_size_mb, size_t, 4U, "") \
     V(TR_KEY_default_trackers, default_trackers_str, std::string, "", "") \
     V(TR_KEY_dht_enabled, dht_enabled, bool, true, "") \
+    V(TR_KEY_direct_io_enabled, is_direct_io_enabled, bool, false, "") \
     V(TR_KEY_download_dir, download_dir, std::string, tr_getDefaultDownloadDir(), "") \
     V(TR_KEY_download_queue_enabled, download_queue_enabled, bool, true, "") \
     V(TR_KEY_download_queue_size, download_queue_size, size_t, 5U, "") \
@@ -36,6 +38,7 @@ struct tr_variant;
     V(TR_KEY_incomplete_dir_enabled, incomplete_dir_enabled, bool, false, "") \
     V(TR_KEY_lpd_enabled, lpd_enabled, bool, true, "") \
     V(TR_KEY_message_level, log_level, tr_log_level, TR_LOG_INFO, "") \
+    V(TR_KEY_move_queue_size, move_queue_size, size_t, 1U, "") \
     V(TR_KEY_peer_congestion_algorithm, peer_congestion_algorithm, std::string, "", "") \
     V(TR_KEY_peer_id_ttl_hours, peer_id_ttl_hours, size_t, 6U, "") \
     V(TR_KEY_peer_limit_global, peer_limit_global, size_t, TR_DEFAULT_PEER_LIMIT_GLOBAL, "") \
@@ -68,6 +71,7 @@ struct tr_variant;
     V(TR_KEY_speed_limit_up, speed_limit_up, size_t, 100U, "") \
     V(TR_KEY_speed_limit_up_enabled, speed_limit_up_enabled, bool, false, "") \
     V(TR_KEY_start_added_torrents, should_start_added_torrents, bool, true, "") \
+    V(TR_KEY_storage_backend, storage_backend, tr_storage_backend, TR_STORAGE_FILESYSTEM, "") \
     V(TR_KEY_tcp_enabled, tcp_enabled, bool, true, "") \
     V(TR_KEY_trash_original_torrent_files, should_delete_source_torrents, bool, false, "") \
     V(TR_KEY_umask, umask, tr_mode_t, 022, "") \
@@ -6,8 +6,8 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint> // uint64_t
 #include <functional>
-#include <list>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -198,25 +198,81 @@ public:
         return thread_id_ == std::this_thread::get_id();
     }
 
-    void run(std::function<void(void)>&& func) override
+    [[nodiscard]] Stats stats() const noexcept override
+    {
+        return { n_tasks_posted_.load(), n_wakeups_.load() };
+    }
+
+    void run(Task&& task) override
     {
         if (amInSessionThread())
         {
-            func();
+            task();
+            return;
         }
-        else
-        {
-            work_queue_mutex_.lock();
-            work_queue_.emplace_back(std::move(func));
-            work_queue_mutex_.unlock();
 
+        work_queue_.push(new WorkQueue::Node{ std::move(task) });
+        ++n_tasks_posted_;
+
+        // Only wake the session thread if it isn't already due to drain the
+        // queue. Posts that land before the drain are picked up by it.
+        if (!drain_pending_.exchange(true))
+        {
             event_active(work_queue_event_.get(), 0, {});
         }
     }
 
 private:
-    using callback = std::function<void(void)>;
-    using work_queue_t = std::list<callback>;
+    // A lock-free multi-producer, single-consumer queue.
+    // Producers push onto a stack; the consumer takes the whole
+    // stack at once and reverses it to restore posting order.
+    class WorkQueue
+    {
+    public:
+        struct Node
+        {
+            Task task;
+            Node* next = nullptr;
+        };
+
+        WorkQueue() = default;
+        WorkQueue(WorkQueue&&) = delete;
+        WorkQueue(WorkQueue const&) = delete;
+        WorkQueue& operator=(WorkQueue&&) = delete;
+        WorkQueue& operator=(WorkQueue const&) = delete;
+
+        ~WorkQueue()
+        {
+            for (auto* node = popAll(); node != nullptr;)
+            {
+                delete std::exchange(node, node->next);
+            }
+        }
+
+        void push(Node* node) noexcept
+        {
+            node->next = head_.load(std::memory_order_relaxed);
+            while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // @return the queued nodes, oldest first
+        [[nodiscard]] Node* popAll() noexcept
+        {
+            auto* node = head_.exchange(nullptr, std::memory_order_acquire);
+
+            Node* reversed = nullptr;
+            while (node != nullptr)
+            {
+                reversed = std::exchange(node, std::exchange(node->next, reversed));
+            }
+            return reversed;
+        }
+
+    private:
+        std::atomic<Node*> head_ = nullptr;
+    };
 
     void sessionThreadFunc(struct event_base* evbase)
     {
@@ -260,16 +316,17 @@ private:
     {
         TR_ASSERT(amInSessionThread());
 
-        // steal the work queue
-        auto work_queue_lock = std::unique_lock(work_queue_mutex_);
-        auto work_queue = work_queue_t{};
-        std::swap(work_queue, work_queue_);
-        work_queue_lock.unlock();
+        ++n_wakeups_;
+
+        // Clear this before stealing the queue, so that a task posted
+        // after the steal is guaranteed to schedule another drain.
+        drain_pending_ = false;
 
         // process the work queue
-        for (auto const& func : work_queue)
+        for (auto* node = work_queue_.popAll(); node != nullptr;)
         {
-            func();
+            node->task();
+            delete std::exchange(node, node->next);
         }
     }
 
@@ -278,8 +335,10 @@ private:
         event_new(evbase_.get(), -1, 0, onWorkAvailableStatic, this)
     };
 
-    work_queue_t work_queue_;
-    std::mutex work_queue_mutex_;
+    WorkQueue work_queue_;
+    std::atomic<bool> drain_pending_ = false;
+    std::atomic<uint64_t> n_tasks_posted_ = 0;
+    std::atomic<uint64_t> n_wakeups_ = 0;
 
     std::thread thread_;
     std::thread::id thread_id_;
@@ -9,9 +9,12 @@
 #error only libtransmission should #include this header.
 #endif
 
-#include <functional>
+#include <cstddef> // size_t, std::byte, std::max_align_t
+#include <cstdint> // uint64_t
 #include <memory>
+#include <new> // placement new
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
 struct event_base;
@@ -19,6 +22,127 @@ struct event_base;
 class tr_session_thread
 {
 public:
+    // A move-only `void()` callable. Unlike std::function, small
+    // callables are stored inline so that posting them doesn't allocate.
+    class Task
+    {
+    public:
+        static auto constexpr InlineSize = sizeof(void*) * 6;
+
+        template<typename Func>
+        [[nodiscard]] static constexpr bool isInline() noexcept
+        {
+            return sizeof(Func) <= InlineSize && alignof(Func) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible_v<Func>;
+        }
+
+        Task() noexcept = default;
+
+        template<typename Func, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, Task>>>
+        Task(Func&& func) // NOLINT(google-explicit-constructor, bugprone-forwarding-reference-overload)
+        {
+            using F = std::decay_t<Func>;
+
+            if constexpr (isInline<F>())
+            {
+                new (&storage_) F{ std::forward<Func>(func) };
+                vtable_ = &InlineVTable<F>;
+            }
+            else
+            {
+                *reinterpret_cast<F**>(&storage_) = new F{ std::forward<Func>(func) };
+                vtable_ = &HeapVTable<F>;
+            }
+        }
+
+        Task(Task&& that) noexcept
+        {
+            *this = std::move(that);
+        }
+
+        Task& operator=(Task&& that) noexcept
+        {
+            if (this != &that)
+            {
+                reset();
+
+                if (that.vtable_ != nullptr)
+                {
+                    that.vtable_->move(&storage_, &that.storage_);
+                    vtable_ = that.vtable_;
+                    that.vtable_ = nullptr;
+                }
+            }
+
+            return *this;
+        }
+
+        Task(Task const&) = delete;
+        Task& operator=(Task const&) = delete;
+
+        ~Task()
+        {
+            reset();
+        }
+
+        void operator()()
+        {
+            vtable_->invoke(&storage_);
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return vtable_ != nullptr;
+        }
+
+    private:
+        struct VTable
+        {
+            void (*invoke)(void* storage);
+            void (*move)(void* dst, void* src) noexcept;
+            void (*destroy)(void* storage) noexcept;
+        };
+
+        template<typename F>
+        static inline VTable constexpr InlineVTable = {
+            [](void* storage) { (*static_cast<F*>(storage))(); },
+            [](void* dst, void* src) noexcept
+            {
+                new (dst) F{ std::move(*static_cast<F*>(src)) };
+                static_cast<F*>(src)->~F();
+            },
+            [](void* storage) noexcept { static_cast<F*>(storage)->~F(); },
+        };
+
+        template<typename F>
+        static inline VTable constexpr HeapVTable = {
+            [](void* storage) { (**static_cast<F**>(storage))(); },
+            [](void* dst, void* src) noexcept { *static_cast<F**>(dst) = *static_cast<F**>(src); },
+            [](void* storage) noexcept { delete *static_cast<F**>(storage); },
+        };
+
+        void reset() noexcept
+        {
+            if (vtable_ != nullptr)
+            {
+                vtable_->destroy(&storage_);
+                vtable_ = nullptr;
+            }
+        }
+
+        std::aligned_storage_t<InlineSize, alignof(std::max_align_t)> storage_;
+        VTable const* vtable_ = nullptr;
+    };
+
+    struct Stats
+    {
+        // tasks posted from other threads
+        uint64_t tasks_posted = 0;
+
+        // times the session thread was woken up to run them
+        uint64_t wakeups = 0;
+    };
+
     static void tr_evthread_init();
 
     static std::unique_ptr<tr_session_thread> create();
@@ -28,15 +152,23 @@ public:
 
     [[nodiscard]] virtual bool amInSessionThread() const noexcept = 0;
 
-    virtual void run(std::function<void(void)>&& func) = 0;
+    [[nodiscard]] virtual Stats stats() const noexcept = 0;
+
+    virtual void run(Task&& task) = 0;
 
     template<typename Func, typename... Args>
     void run(Func&& func, Args&&... args)
     {
-        run(std::function<void(void)>{
-            [func = std::forward<Func&&>(func), args = std::make_tuple(std::forward<Args>(args)...)]()
-            {
-                std::apply(std::move(func), std::move(args));
-            } });
+        if constexpr (sizeof...(Args) == 0U)
+        {
+            run(Task{ std::forward<Func>(func) });
+        }
+        else
+        {
+            run(Task{ [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+                      {
+                          std::apply(std::move(func), std::move(args));
+                      } });
+        }
     }
 };
@@ -537,6 +537,21 @@ void tr_session::onNowTimer()
     now_timer_->setInterval(std::chrono::duration_cast<std::chrono::milliseconds>(target_interval));
 }
 
+void tr_session::onPreallocationFailed(tr_torrent_id_t tor_id, std::string_view filename, int err)
+{
+    // Don't let the torrent go on to write into a partially-allocated file,
+    // e.g. after ENOSPC. This is what a failed write would do, too.
+    runInSessionThread(
+        [this, tor_id, filename = std::string{ filename }, err]()
+        {
+            if (auto* const tor = torrents().get(tor_id); tor != nullptr && tor->error != TR_STAT_LOCAL_ERROR)
+            {
+                tor->setLocalError(fmt::format(FMT_STRING("{:s} ({:s})"), tr_strerror(err), filename));
+                tr_torrentStop(tor);
+            }
+        });
+}
+
 void tr_session::initImpl(init_data& data)
 {
     auto lock = unique_lock();
@@ -621,6 +636,21 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
         tr_sessionSetCacheLimit_MB(this, val);
     }
 
+    if (auto const& val = new_settings.is_direct_io_enabled; force || val != old_settings.is_direct_io_enabled)
+    {
+        openFiles().setDirectIo(val);
+    }
+
+    if (auto const& val = new_settings.cache_flush_batch_mb; force || val != old_settings.cache_flush_batch_mb)
+    {
+        cache->setFlushBatch(tr_toMemBytes(val));
+    }
+
+    if (auto const& val = new_settings.move_queue_size; force || val != old_settings.move_queue_size)
+    {
+        relocator().setMaxConcurrent(std::max(val, size_t{ 1U }));
+    }
+
     if (auto const& val = new_settings.default_trackers_str; force || val != old_settings.default_trackers_str)
     {
         setDefaultTrackers(val);
@@ -631,7 +661,10 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
         tr_sessionSetUTPEnabled(this, val);
     }
 
-    useBlocklist(new_settings.blocklist_enabled);
+    if (auto const& val = new_settings.blocklist_enabled; force || val != old_settings.blocklist_enabled)
+    {
+        setBlocklistsEnabled(val);
+    }
 
     auto local_peer_port = force && settings_.peer_port_random_on_start ? randomPort() : new_settings.peer_port;
     bool port_changed = false;
@@ -1559,25 +1592,50 @@ bool tr_sessionIsPortForwardingEnabled(tr_session const* session)
 
 void tr_session::useBlocklist(bool enabled)
 {
+    if (enabled == settings_.blocklist_enabled)
+    {
+        return;
+    }
+
     settings_.blocklist_enabled = enabled;
+    setBlocklistsEnabled(enabled);
+}
 
+void tr_session::setBlocklistsEnabled(bool enabled)
+{
     std::for_each(
         std::begin(blocklists_),
         std::end(blocklists_),
         [enabled](auto& blocklist) { blocklist.setEnabled(enabled); });
+
+    rebuildBlocklistIndex();
+}
+
+void tr_session::rebuildBlocklistIndex()
+{
+    blocklist_index_ = libtransmission::BlocklistIndex{ blocklists_ };
+
+    // the index has its own copy of the rules now
+    for (auto& blocklist : blocklists_)
+    {
+        blocklist.releaseRules();
+    }
 }
 
 bool tr_session::addressIsBlocked(tr_address const& addr) const noexcept
 {
-    return std::any_of(
-        std::begin(blocklists_),
-        std::end(blocklists_),
-        [&addr](auto& blocklist) { return blocklist.contains(addr); });
+    return blocklist_index_.contains(addr);
+}
+
+void tr_session::addressesAreBlocked(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept
+{
+    blocklist_index_.contains(addrs, n_addrs, setme);
 }
 
 void tr_sessionReloadBlocklists(tr_session* session)
 {
     session->blocklists_ = libtransmission::Blocklist::loadBlocklists(session->blocklist_dir_, session->useBlocklist());
+    session->rebuildBlocklistIndex();
 
     if (session->peer_mgr_)
     {
@@ -1646,6 +1704,8 @@ size_t tr_blocklistSetContent(tr_session* session, char const* content_filename)
         src.emplace_back(std::move(*added));
     }
 
+    session->rebuildBlocklistIndex();
+
     return n_rules;
 }
 
@@ -2077,14 +2137,17 @@ static int bandwidthGroupWrite(tr_session const* session, std::string_view confi
 
 void tr_session::closeTorrentFiles(tr_torrent* tor) noexcept
 {
+    // the cached blocks can't be written until preallocation stops
+    openFiles().cancelPreallocation(tor->id());
     this->cache->flushTorrent(tor);
-    openFiles().closeTorrent(tor->id());
+    tor->storage().flush();
 }
 
 void tr_session::closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept
 {
+    openFiles().cancelPreallocation(tor->id(), file_num);
     this->cache->flushFile(tor, file_num);
-    openFiles().closeFile(tor->id(), file_num);
+    tor->storage().flushFile(file_num);
 }
 
 ///
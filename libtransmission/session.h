@@ -32,12 +32,15 @@
 #include "announcer.h"
 #include "bandwidth.h"
 #include "bitfield.h"
+#include "blocklist.h"
 #include "cache.h"
+#include "disk-scheduler.h"
 #include "interned-string.h"
 #include "net.h" // tr_socket_t
 #include "open-files.h"
 #include "port-forwarding.h"
 #include "quark.h"
+#include "relocator.h"
 #include "session-alt-speeds.h"
 #include "session-id.h"
 #include "session-settings.h"
@@ -49,6 +52,7 @@
 #include "utils-ev.h"
 #include "verify.h"
 #include "web.h"
+#include "webseed.h"
 
 tr_peer_id_t tr_peerIdInit();
 
@@ -65,7 +69,6 @@ struct tr_variant;
 
 namespace libtransmission
 {
-class Blocklist;
 class Dns;
 class Timer;
 class TimerMaker;
@@ -330,9 +333,9 @@ public:
         return session_thread_->amInSessionThread();
     }
 
-    void runInSessionThread(std::function<void(void)>&& func)
+    void runInSessionThread(tr_session_thread::Task&& task)
     {
-        session_thread_->run(std::move(func));
+        session_thread_->run(std::move(task));
     }
 
     template<typename Func, typename... Args>
@@ -541,6 +544,21 @@ public:
         return open_files_;
     }
 
+    [[nodiscard]] constexpr auto& diskScheduler() noexcept
+    {
+        return disk_scheduler_;
+    }
+
+    [[nodiscard]] constexpr auto& relocator() noexcept
+    {
+        return relocator_;
+    }
+
+    [[nodiscard]] constexpr auto& webseedLimiters() noexcept
+    {
+        return webseed_limiters_;
+    }
+
     void closeTorrentFiles(tr_torrent* tor) noexcept;
     void closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept;
 
@@ -731,6 +749,11 @@ public:
         return settings_.preallocation_mode;
     }
 
+    [[nodiscard]] constexpr auto storageBackend() const noexcept
+    {
+        return settings_.storage_backend;
+    }
+
     [[nodiscard]] constexpr auto shouldScrapePausedTorrents() const noexcept
     {
         return settings_.should_scrape_paused_torrents;
@@ -773,6 +796,11 @@ public:
         return settings_.is_prefetch_enabled;
     }
 
+    [[nodiscard]] constexpr auto allowsDirectIo() const noexcept
+    {
+        return settings_.is_direct_io_enabled;
+    }
+
     [[nodiscard]] constexpr auto isIdleLimited() const noexcept
     {
         return settings_.idle_seeding_limit_enabled;
@@ -806,6 +834,9 @@ public:
 
     [[nodiscard]] bool addressIsBlocked(tr_address const& addr) const noexcept;
 
+    // batch form of addressIsBlocked(): sets `setme[i]` iff `addrs[i]` is blocked
+    void addressesAreBlocked(tr_address const* addrs, size_t n_addrs, bool* setme) const noexcept;
+
     struct PublicAddressResult
     {
         tr_address address;
@@ -939,6 +970,12 @@ private:
 
     void onNowTimer();
 
+    // safe to call from any thread
+    void onPreallocationFailed(tr_torrent_id_t tor_id, std::string_view filename, int err);
+
+    void setBlocklistsEnabled(bool enabled);
+    void rebuildBlocklistIndex();
+
     static void onIncomingPeerConnection(tr_socket_t fd, void* vsession);
 
     friend class libtransmission::test::SessionTest;
@@ -1093,9 +1130,20 @@ private:
 
     tr_session_id session_id_;
 
-    tr_open_files open_files_;
+    tr_disk_scheduler disk_scheduler_;
+
+    // depends-on: disk_scheduler_, session_thread_
+    tr_open_files open_files_{ &disk_scheduler_,
+                               [this](tr_torrent_id_t tor_id, tr_file_index_t /*file_num*/, std::string_view filename, int err)
+                               { onPreallocationFailed(tor_id, filename, err); } };
+
+    // depends-on: disk_scheduler_
+    tr_relocator relocator_{ &disk_scheduler_ };
 
     std::vector<libtransmission::Blocklist> blocklists_;
+    libtransmission::BlocklistIndex blocklist_index_;
+
+    libtransmission::WebseedLimiters webseed_limiters_;
 
     /// other fields
 
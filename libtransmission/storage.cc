@@ -0,0 +1,875 @@
+// This file Copyright © 2007-2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "open-files.h"
+#include "storage.h"
+#include "torrent.h"
+#include "tr-assert.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+
+using namespace std::literals;
+
+namespace
+{
+
+bool readEntireBuf(tr_sys_file_t fd, bool direct_io, uint64_t file_offset, uint8_t* buf, uint64_t buflen, tr_error** error)
+{
+    if (direct_io)
+    {
+        auto n_read = uint64_t{};
+        return tr_sys_file_read_at_aligned(fd, buf, buflen, file_offset, &n_read, error) && n_read == buflen;
+    }
+
+    while (buflen > 0)
+    {
+        auto n_read = uint64_t{};
+
+        if (!tr_sys_file_read_at(fd, buf, buflen, file_offset, &n_read, error))
+        {
+            return false;
+        }
+
+        buf += n_read;
+        buflen -= n_read;
+        file_offset += n_read;
+    }
+
+    return true;
+}
+
+bool writeEntireBuf(
+    tr_sys_file_t fd,
+    bool direct_io,
+    uint64_t file_offset,
+    uint8_t const* buf,
+    uint64_t buflen,
+    tr_error** error)
+{
+    if (direct_io)
+    {
+        return tr_sys_file_write_at_aligned(fd, buf, buflen, file_offset, error);
+    }
+
+    while (buflen > 0)
+    {
+        auto n_written = uint64_t{};
+
+        if (!tr_sys_file_write_at(fd, buf, buflen, file_offset, &n_written, error))
+        {
+            return false;
+        }
+
+        buf += n_written;
+        buflen -= n_written;
+        file_offset += n_written;
+    }
+
+    return true;
+}
+
+// The file that a verify is reading. It's kept open by the verify itself
+// instead of in the session's tr_open_files pool, and stays open until the
+// verify moves on to another file. The data is dropped from the OS's page
+// cache after it's read, since verifying a torrent touches each byte just once.
+class VerifyFile
+{
+public:
+    explicit VerifyFile(bool direct_io)
+        : direct_io_{ direct_io }
+    {
+    }
+
+    VerifyFile(VerifyFile&&) = delete;
+    VerifyFile(VerifyFile const&) = delete;
+    VerifyFile& operator=(VerifyFile&&) = delete;
+    VerifyFile& operator=(VerifyFile const&) = delete;
+
+    ~VerifyFile()
+    {
+        close();
+    }
+
+    // @return an errno, or 0 on success
+    int read(std::string_view filename, uint64_t file_offset, uint8_t* buf, uint64_t buflen)
+    {
+        tr_error* error = nullptr;
+
+        if (fd_ == TR_BAD_SYS_FILE || filename != filename_.sv())
+        {
+            close();
+
+            auto const flags = TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL | (direct_io_ ? TR_SYS_FILE_DIRECT : 0);
+            filename_.assign(filename);
+            fd_ = tr_sys_file_open(filename_, flags, 0, &error);
+            if (fd_ == TR_BAD_SYS_FILE)
+            {
+                auto const err = error != nullptr ? error->code : ENOENT;
+                tr_error_clear(&error);
+                return err;
+            }
+        }
+
+        if (!readEntireBuf(fd_, direct_io_, file_offset, buf, buflen, &error))
+        {
+            auto const err = error != nullptr ? error->code : EIO;
+            tr_error_clear(&error);
+            return err;
+        }
+
+        if (!direct_io_)
+        {
+            tr_sys_file_advise(fd_, file_offset, buflen, TR_SYS_FILE_ADVICE_DONT_NEED);
+        }
+
+        return 0;
+    }
+
+private:
+    void close()
+    {
+        if (fd_ != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd_);
+            fd_ = TR_BAD_SYS_FILE;
+        }
+    }
+
+    tr_pathbuf filename_;
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    bool const direct_io_;
+};
+
+void stopOnWriteError(tr_torrent* tor, int err, std::string_view path)
+{
+    if (err != 0 && err != EAGAIN && tor->error != TR_STAT_LOCAL_ERROR)
+    {
+        tor->setLocalError(fmt::format(FMT_STRING("{:s} ({:s})"), tr_strerror(err), path));
+        tr_torrentStop(tor);
+    }
+}
+
+/***
+****  Filesystem: each of the torrent's files is a file on disk
+***/
+
+class FilesystemStorage final : public tr_storage
+{
+public:
+    explicit FilesystemStorage(tr_torrent& tor)
+        : tor_{ tor }
+    {
+    }
+
+    [[nodiscard]] tr_storage_backend backend() const noexcept override
+    {
+        return TR_STORAGE_FILESYSTEM;
+    }
+
+    int read(tr_block_info::Location loc, size_t len, uint8_t* setme) override
+    {
+        return readOrWritePiece(IoMode::Read, loc, setme, len);
+    }
+
+    int write(tr_block_info::Location loc, size_t len, uint8_t const* writeme) override
+    {
+        return readOrWritePiece(IoMode::Write, loc, const_cast<uint8_t*>(writeme), len);
+    }
+
+    int prefetch(tr_block_info::Location loc, size_t len) override
+    {
+        return readOrWritePiece(IoMode::Prefetch, loc, nullptr, len);
+    }
+
+    void flush() override
+    {
+        tor_.session->openFiles().closeTorrent(tor_.id());
+    }
+
+    void flushFile(tr_file_index_t file) override
+    {
+        tor_.session->openFiles().closeFile(tor_.id(), file);
+    }
+
+    [[nodiscard]] std::unique_ptr<VerifyReader> verifyReader() override
+    {
+        return std::make_unique<Reader>(tor_);
+    }
+
+    [[nodiscard]] bool hasAnyData() const override
+    {
+        return tor_.hasAnyLocalData();
+    }
+
+    [[nodiscard]] std::string dataDir() const override
+    {
+        auto const found = tor_.findFile(0);
+        return found ? std::string{ found->base() } : std::string{};
+    }
+
+    bool move(std::string_view old_parent, std::string_view parent, double volatile* setme_progress, tr_error** error)
+        override
+    {
+        return tor_.metainfo_.files().move(old_parent, parent, setme_progress, tor_.name(), error);
+    }
+
+    void remove(tr_torrent_files::FileFunc const& delete_func) override
+    {
+        tor_.metainfo_.files().remove(tor_.currentDir(), tor_.name(), delete_func);
+    }
+
+private:
+    enum class IoMode
+    {
+        Read,
+        Prefetch,
+        Write
+    };
+
+    class Reader final : public VerifyReader
+    {
+    public:
+        explicit Reader(tr_torrent const& tor)
+            : tor_{ tor }
+            , file_{ tor.session->allowsDirectIo() }
+        {
+        }
+
+        int read(tr_block_info::Location loc, size_t len, uint8_t* setme) override
+        {
+            auto [file_index, file_offset] = tor_.fileOffset(loc);
+
+            while (len != 0)
+            {
+                auto const bytes_this_pass = std::min(uint64_t{ len }, tor_.fileSize(file_index) - file_offset);
+
+                if (bytes_this_pass != 0)
+                {
+                    // only look for each file once
+                    if (file_index != file_index_)
+                    {
+                        auto const found = tor_.findFile(file_index);
+                        filename_.assign(found ? found->filename() : ""sv);
+                        file_index_ = file_index;
+                    }
+
+                    if (std::empty(filename_))
+                    {
+                        return ENOENT;
+                    }
+
+                    auto const err = file_.read(filename_, file_offset, setme, bytes_this_pass);
+                    if (err != 0)
+                    {
+                        return err;
+                    }
+                }
+
+                setme += bytes_this_pass;
+                len -= bytes_this_pass;
+                ++file_index;
+                file_offset = 0;
+            }
+
+            return 0;
+        }
+
+    private:
+        tr_torrent const& tor_;
+        VerifyFile file_;
+        tr_file_index_t file_index_ = ~tr_file_index_t{};
+        tr_pathbuf filename_;
+    };
+
+    bool getFilename(tr_pathbuf& setme, tr_file_index_t file_index, IoMode io_mode) const
+    {
+        if (auto found = tor_.findFile(file_index); found)
+        {
+            setme.assign(found->filename());
+            return true;
+        }
+
+        if (io_mode != IoMode::Write)
+        {
+            return false;
+        }
+
+        // We didn't find the file that we want to write to.
+        // Let's figure out where it goes so that we can create it.
+        auto const base = tor_.currentDir();
+        auto const suffix = tor_.session->isIncompleteFileNamingEnabled() ? tr_torrent_files::PartialFileSuffix : ""sv;
+        setme.assign(base, '/', tor_.fileSubpath(file_index), suffix);
+        return true;
+    }
+
+    /* returns 0 on success, or an errno on failure */
+    int readOrWriteBytes(IoMode io_mode, tr_file_index_t file_index, uint64_t file_offset, uint8_t* buf, size_t buflen)
+    {
+        auto* const tor = &tor_;
+        auto* const session = tor->session;
+
+        TR_ASSERT(file_index < tor->fileCount());
+
+        bool const do_write = io_mode == IoMode::Write;
+        auto const file_size = tor->fileSize(file_index);
+        TR_ASSERT(file_size == 0 || file_offset < file_size);
+        TR_ASSERT(file_offset + buflen <= file_size);
+
+        if (file_size == 0)
+        {
+            return 0;
+        }
+
+        /***
+        ****  Find the fd
+        ***/
+
+        auto fd = session->openFiles().get(tor->id(), file_index, do_write);
+        auto filename = tr_pathbuf{};
+        if (!fd && !getFilename(filename, file_index, io_mode))
+        {
+            return ENOENT;
+        }
+
+        if (!fd) // not in the cache, so open or create it now
+        {
+            // open (and maybe create) the file
+            auto const prealloc = (!do_write || !tor->fileIsWanted(file_index)) ? TR_PREALLOCATE_NONE :
+                                                                                  tor->session->preallocationMode();
+            fd = session->openFiles().get(tor->id(), file_index, do_write, filename, prealloc, file_size);
+            if (fd && do_write)
+            {
+                // make a note that we just created a file
+                tor->session->addFileCreated();
+            }
+        }
+
+        if (!fd) // couldn't create/open it either
+        {
+            int const err = errno;
+            if (err == EAGAIN) // still being preallocated; try again later
+            {
+                return err;
+            }
+
+            tr_logAddErrorTor(
+                tor,
+                fmt::format(
+                    _("Couldn't get '{path}': {error} ({error_code})"),
+                    fmt::arg("path", filename),
+                    fmt::arg("error", tr_strerror(err)),
+                    fmt::arg("error_code", err)));
+            return err;
+        }
+
+        auto const direct_io = session->allowsDirectIo();
+
+        switch (io_mode)
+        {
+        case IoMode::Read:
+            if (tr_error* error = nullptr; !readEntireBuf(*fd, direct_io, file_offset, buf, buflen, &error) && error != nullptr)
+            {
+                auto const err = error->code;
+                tr_logAddErrorTor(
+                    tor,
+                    fmt::format(
+                        _("Couldn't read '{path}': {error} ({error_code})"),
+                        fmt::arg("path", tor->fileSubpath(file_index)),
+                        fmt::arg("error", error->message),
+                        fmt::arg("error_code", error->code)));
+                tr_error_free(error);
+                return err;
+            }
+            break;
+
+        case IoMode::Write:
+            if (tr_error* error = nullptr;
+                !writeEntireBuf(*fd, direct_io, file_offset, buf, buflen, &error) && error != nullptr)
+            {
+                auto const err = error->code;
+                tr_logAddErrorTor(
+                    tor,
+                    fmt::format(
+                        _("Couldn't save '{path}': {error} ({error_code})"),
+                        fmt::arg("path", tor->fileSubpath(file_index)),
+                        fmt::arg("error", error->message),
+                        fmt::arg("error_code", error->code)));
+                tr_error_free(error);
+                return err;
+            }
+            break;
+
+        case IoMode::Prefetch:
+            // there's no page cache to prefetch into when using direct I/O
+            if (!direct_io)
+            {
+                tr_sys_file_advise(*fd, file_offset, buflen, TR_SYS_FILE_ADVICE_WILL_NEED);
+            }
+            break;
+        }
+
+        return 0;
+    }
+
+    /* returns 0 on success, or an errno on failure */
+    int readOrWritePiece(IoMode io_mode, tr_block_info::Location loc, uint8_t* buf, size_t buflen)
+    {
+        int err = 0;
+
+        auto [file_index, file_offset] = tor_.fileOffset(loc);
+
+        while (buflen != 0 && err == 0)
+        {
+            uint64_t const bytes_this_pass = std::min(uint64_t{ buflen }, uint64_t{ tor_.fileSize(file_index) - file_offset });
+
+            err = readOrWriteBytes(io_mode, file_index, file_offset, buf, bytes_this_pass);
+            if (buf != nullptr)
+            {
+                buf += bytes_this_pass;
+            }
+            buflen -= bytes_this_pass;
+
+            if (io_mode == IoMode::Write)
+            {
+                stopOnWriteError(&tor_, err, tr_pathbuf{ tor_.downloadDir(), '/', tor_.fileSubpath(file_index) });
+            }
+
+            ++file_index;
+            file_offset = 0;
+        }
+
+        return err;
+    }
+
+    tr_torrent& tor_;
+};
+
+/***
+****  Memory: nothing touches the disk. Only tests can pick this backend;
+****  it isn't a valid `storage-backend` setting and isn't saved in resume files.
+***/
+
+class MemoryStorage final : public tr_storage
+{
+public:
+    explicit MemoryStorage(tr_torrent const& tor)
+        : tor_{ tor }
+    {
+    }
+
+    [[nodiscard]] tr_storage_backend backend() const noexcept override
+    {
+        return TR_STORAGE_MEMORY;
+    }
+
+    int read(tr_block_info::Location loc, size_t len, uint8_t* setme) override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        return forEachPieceSpan(
+            loc,
+            len,
+            [this, &setme](tr_piece_index_t piece, uint32_t offset, uint32_t n_bytes)
+            {
+                if (piece >= std::size(pieces_) || !pieces_[piece])
+                {
+                    return ENOENT;
+                }
+
+                std::copy_n(pieces_[piece].get() + offset, n_bytes, setme);
+                setme += n_bytes;
+                return 0;
+            });
+    }
+
+    int write(tr_block_info::Location loc, size_t len, uint8_t const* writeme) override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+
+        return forEachPieceSpan(
+            loc,
+            len,
+            [this, &writeme](tr_piece_index_t piece, uint32_t offset, uint32_t n_bytes)
+            {
+                if (piece >= std::size(pieces_))
+                {
+                    pieces_.resize(tor_.pieceCount());
+                }
+
+                auto& buf = pieces_[piece];
+                if (!buf)
+                {
+                    buf = std::make_unique<uint8_t[]>(tor_.pieceSize(piece));
+                }
+
+                std::copy_n(writeme, n_bytes, buf.get() + offset);
+                writeme += n_bytes;
+                return 0;
+            });
+    }
+
+    int prefetch(tr_block_info::Location /*loc*/, size_t /*len*/) override
+    {
+        return 0;
+    }
+
+    void flush() override
+    {
+    }
+
+    void flushFile(tr_file_index_t /*file*/) override
+    {
+    }
+
+    [[nodiscard]] std::unique_ptr<VerifyReader> verifyReader() override
+    {
+        return std::make_unique<Reader>(*this);
+    }
+
+    [[nodiscard]] bool hasAnyData() const override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        return std::any_of(std::begin(pieces_), std::end(pieces_), [](auto const& buf) { return !!buf; });
+    }
+
+    [[nodiscard]] std::string dataDir() const override
+    {
+        return {};
+    }
+
+    bool move(
+        std::string_view /*old_parent*/,
+        std::string_view /*parent*/,
+        double volatile* setme_progress,
+        tr_error** /*error*/) override
+    {
+        if (setme_progress != nullptr)
+        {
+            *setme_progress = 1.0;
+        }
+
+        return true;
+    }
+
+    void remove(tr_torrent_files::FileFunc const& /*delete_func*/) override
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        pieces_.clear();
+    }
+
+private:
+    class Reader final : public VerifyReader
+    {
+    public:
+        explicit Reader(MemoryStorage& storage)
+            : storage_{ storage }
+        {
+        }
+
+        int read(tr_block_info::Location loc, size_t len, uint8_t* setme) override
+        {
+            return storage_.read(loc, len, setme);
+        }
+
+    private:
+        MemoryStorage& storage_;
+    };
+
+    template<typename Func>
+    int forEachPieceSpan(tr_block_info::Location loc, size_t len, Func&& func) const
+    {
+        auto piece = loc.piece;
+        auto offset = loc.piece_offset;
+
+        while (len != 0)
+        {
+            auto const n_bytes = static_cast<uint32_t>(std::min(size_t{ tor_.pieceSize(piece) - offset }, len));
+            if (auto const err = func(piece, offset, n_bytes); err != 0)
+            {
+                return err;
+            }
+
+            len -= n_bytes;
+            ++piece;
+            offset = 0;
+        }
+
+        return 0;
+    }
+
+    tr_torrent const& tor_;
+
+    // pieces are allocated when they're first written to
+    std::vector<std::unique_ptr<uint8_t[]>> pieces_;
+    mutable std::mutex mutex_;
+};
+
+/***
+****  Container: all of the torrent's data is kept in a single,
+****  preallocated file. This avoids the overhead of creating, opening,
+****  and preallocating each file in torrents that have huge numbers of
+****  small files.
+***/
+
+class ContainerStorage final : public tr_storage
+{
+public:
+    explicit ContainerStorage(tr_torrent& tor)
+        : tor_{ tor }
+    {
+    }
+
+    [[nodiscard]] tr_storage_backend backend() const noexcept override
+    {
+        return TR_STORAGE_CONTAINER;
+    }
+
+    int read(tr_block_info::Location loc, size_t len, uint8_t* setme) override
+    {
+        return readOrWrite(IoMode::Read, loc, setme, len);
+    }
+
+    int write(tr_block_info::Location loc, size_t len, uint8_t const* writeme) override
+    {
+        auto const err = readOrWrite(IoMode::Write, loc, const_cast<uint8_t*>(writeme), len);
+        stopOnWriteError(&tor_, err, filename());
+        return err;
+    }
+
+    int prefetch(tr_block_info::Location loc, size_t len) override
+    {
+        return readOrWrite(IoMode::Prefetch, loc, nullptr, len);
+    }
+
+    void flush() override
+    {
+        tor_.session->openFiles().closeTorrent(tor_.id());
+    }
+
+    void flushFile(tr_file_index_t /*file*/) override
+    {
+        // the container holds all of the files, so there's nothing to do
+    }
+
+    [[nodiscard]] std::unique_ptr<VerifyReader> verifyReader() override
+    {
+        return std::make_unique<Reader>(filename(), tor_.session->allowsDirectIo());
+    }
+
+    [[nodiscard]] bool hasAnyData() const override
+    {
+        return tr_sys_path_exists(filename());
+    }
+
+    [[nodiscard]] std::string dataDir() const override
+    {
+        for (auto const& dir : { tor_.downloadDir(), tor_.incompleteDir() })
+        {
+            if (!std::empty(dir) && tr_sys_path_exists(filename(dir.sv())))
+            {
+                return std::string{ dir.sv() };
+            }
+        }
+
+        return {};
+    }
+
+    bool move(std::string_view old_parent, std::string_view parent, double volatile* setme_progress, tr_error** error)
+        override
+    {
+        flush();
+
+        auto const old_filename = filename(old_parent);
+        auto const new_filename = filename(parent);
+        auto ok = true;
+        if (tr_sys_path_exists(old_filename) && !tr_sys_path_is_same(old_filename, new_filename))
+        {
+            ok = tr_moveFile(old_filename, new_filename, error);
+        }
+
+        if (ok && setme_progress != nullptr)
+        {
+            *setme_progress = 1.0;
+        }
+
+        return ok;
+    }
+
+    void remove(tr_torrent_files::FileFunc const& delete_func) override
+    {
+        flush();
+
+        if (auto const filename = this->filename(); tr_sys_path_exists(filename))
+        {
+            delete_func(filename.c_str());
+        }
+    }
+
+private:
+    enum class IoMode
+    {
+        Read,
+        Prefetch,
+        Write
+    };
+
+    // The torrent's data is one file with a single key in tr_open_files,
+    // so it shares the pool's fd limits and background preallocation.
+    static auto constexpr FileNum = tr_file_index_t{ 0 };
+
+    // The container is in the torrent's current dir,
+    // so it follows the torrent when setLocation() moves it
+    [[nodiscard]] tr_pathbuf filename(std::string_view parent) const
+    {
+        return tr_pathbuf{ parent, '/', tor_.infoHashString(), ".container"sv };
+    }
+
+    [[nodiscard]] tr_pathbuf filename() const
+    {
+        return filename(tor_.currentDir().sv());
+    }
+
+    class Reader final : public VerifyReader
+    {
+    public:
+        Reader(std::string_view filename, bool direct_io)
+            : filename_{ filename }
+            , file_{ direct_io }
+        {
+        }
+
+        int read(tr_block_info::Location loc, size_t len, uint8_t* setme) override
+        {
+            return file_.read(filename_, loc.byte, setme, len);
+        }
+
+    private:
+        tr_pathbuf const filename_;
+        VerifyFile file_;
+    };
+
+    int readOrWrite(IoMode io_mode, tr_block_info::Location loc, uint8_t* buf, size_t buflen)
+    {
+        auto* const session = tor_.session;
+        auto& open_files = session->openFiles();
+        bool const do_write = io_mode == IoMode::Write;
+        auto const filename = this->filename();
+
+        auto fd = open_files.get(tor_.id(), FileNum, do_write);
+        if (!fd && !do_write && !tr_sys_path_exists(filename))
+        {
+            return ENOENT;
+        }
+
+        if (!fd)
+        {
+            // the container is always preallocated so that it's never fragmented
+            // or resized, but a sparse file is good enough if that's all the user wants
+            auto const prealloc = !do_write ? TR_PREALLOCATE_NONE :
+                                              std::max(session->preallocationMode(), TR_PREALLOCATE_SPARSE);
+            fd = open_files.get(tor_.id(), FileNum, do_write, filename, prealloc, tor_.totalSize());
+            if (fd && do_write)
+            {
+                session->addFileCreated();
+            }
+        }
+
+        if (!fd)
+        {
+            int const err = errno;
+            if (err == EAGAIN) // still being preallocated; try again later
+            {
+                return err;
+            }
+
+            tr_logAddErrorTor(
+                &tor_,
+                fmt::format(
+                    _("Couldn't get '{path}': {error} ({error_code})"),
+                    fmt::arg("path", filename),
+                    fmt::arg("error", tr_strerror(err)),
+                    fmt::arg("error_code", err)));
+            return err;
+        }
+
+        auto const direct_io = session->allowsDirectIo();
+        auto ok = true;
+        tr_error* error = nullptr;
+
+        switch (io_mode)
+        {
+        case IoMode::Read:
+            ok = readEntireBuf(*fd, direct_io, loc.byte, buf, buflen, &error);
+            break;
+
+        case IoMode::Write:
+            ok = writeEntireBuf(*fd, direct_io, loc.byte, buf, buflen, &error);
+            break;
+
+        case IoMode::Prefetch:
+            if (!direct_io)
+            {
+                tr_sys_file_advise(*fd, loc.byte, buflen, TR_SYS_FILE_ADVICE_WILL_NEED);
+            }
+            break;
+        }
+
+        if (!ok && error == nullptr) // short read
+        {
+            tr_error_set(&error, EIO, tr_strerror(EIO));
+        }
+
+        if (error != nullptr)
+        {
+            auto const err = error->code;
+            tr_logAddErrorTor(
+                &tor_,
+                fmt::format(
+                    do_write ? _("Couldn't save '{path}': {error} ({error_code})") :
+                               _("Couldn't read '{path}': {error} ({error_code})"),
+                    fmt::arg("path", filename),
+                    fmt::arg("error", error->message),
+                    fmt::arg("error_code", error->code)));
+            tr_error_free(error);
+            return err;
+        }
+
+        return 0;
+    }
+
+    tr_torrent& tor_;
+};
+
+} // namespace
+
+std::unique_ptr<tr_storage> tr_storage::create(tr_storage_backend backend, tr_torrent& tor)
+{
+    switch (backend)
+    {
+    case TR_STORAGE_MEMORY:
+        return std::make_unique<MemoryStorage>(tor);
+
+    case TR_STORAGE_CONTAINER:
+        return std::make_unique<ContainerStorage>(tor);
+
+    default:
+        return std::make_unique<FilesystemStorage>(tor);
+    }
+}
@@ -0,0 +1,92 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "transmission.h"
+
+#include "block-info.h"
+#include "torrent-files.h"
+
+struct tr_error;
+struct tr_torrent;
+
+/**
+ * @addtogroup file_io File IO
+ * @{
+ */
+
+// Where a torrent's data is kept.
+//
+// Each torrent has its own tr_storage, picked by the session's
+// `storage-backend` setting when the torrent is added and restored
+// from the torrent's resume file after that. Unless noted,
+// the methods are called from the session thread and return 0 on
+// success or an errno value on failure.
+class tr_storage
+{
+public:
+    // Reads pieces' data for tr_verify_worker. Readers are used in the
+    // verify thread, so they must not share state with the session thread's
+    // I/O. Any handles they open are released when the reader is destroyed.
+    class VerifyReader
+    {
+    public:
+        virtual ~VerifyReader() = default;
+
+        [[nodiscard]] virtual int read(tr_block_info::Location loc, size_t len, uint8_t* setme) = 0;
+    };
+
+    [[nodiscard]] static std::unique_ptr<tr_storage> create(tr_storage_backend backend, tr_torrent& tor);
+
+    virtual ~tr_storage() = default;
+
+    [[nodiscard]] virtual tr_storage_backend backend() const noexcept = 0;
+
+    [[nodiscard]] virtual int read(tr_block_info::Location loc, size_t len, uint8_t* setme) = 0;
+
+    [[nodiscard]] virtual int write(tr_block_info::Location loc, size_t len, uint8_t const* writeme) = 0;
+
+    // Hint that this data is going to be read soon
+    virtual int prefetch(tr_block_info::Location loc, size_t len) = 0;
+
+    // Write out anything that's buffered and release any handles to
+    // the torrent's data, e.g. before it's moved or removed.
+    virtual void flush() = 0;
+
+    // Like flush(), but only for one file, e.g. before it's renamed
+    virtual void flushFile(tr_file_index_t file) = 0;
+
+    [[nodiscard]] virtual std::unique_ptr<VerifyReader> verifyReader() = 0;
+
+    // @return true if any of the torrent's data has been stored
+    [[nodiscard]] virtual bool hasAnyData() const = 0;
+
+    // @return the download or incomplete dir that holds the torrent's
+    // data, or an empty string if none of it has been stored there
+    [[nodiscard]] virtual std::string dataDir() const = 0;
+
+    // Move the torrent's data from `old_parent` to `parent`
+    virtual bool move(
+        std::string_view old_parent,
+        std::string_view parent,
+        double volatile* setme_progress,
+        tr_error** error) = 0;
+
+    // Delete the torrent's data, passing each file to be deleted to `delete_func`
+    virtual void remove(tr_torrent_files::FileFunc const& delete_func) = 0;
+};
+
+/* @} */
@@ -216,23 +216,27 @@ bool tr_torrent_files::move(
         }
     }
 
-    // after moving the files, remove any leftover empty directories
     if (!err)
     {
-        auto const remove_empty_directories = [](char const* filename)
-        {
-            if (isEmptyFolder(filename))
-            {
-                tr_sys_path_remove(filename, nullptr);
-            }
-        };
-
-        remove(old_parent, parent_name, remove_empty_directories);
+        removeLeftovers(old_parent, parent_name);
     }
 
     return !err;
 }
 
+void tr_torrent_files::removeLeftovers(std::string_view old_parent, std::string_view parent_name) const
+{
+    auto const remove_empty_directories = [](char const* filename)
+    {
+        if (isEmptyFolder(filename))
+        {
+            tr_sys_path_remove(filename, nullptr);
+        }
+    };
+
+    remove(old_parent, parent_name, remove_empty_directories);
+}
+
 ///
 
 /**
@@ -116,6 +116,10 @@ public:
         std::string_view parent_name = "",
         tr_error** error = nullptr) const;
 
+    // After the files have been moved out of `old_parent`,
+    // remove the empty directories and junk files left behind
+    void removeLeftovers(std::string_view old_parent, std::string_view parent_name = "") const;
+
     using FileFunc = std::function<void(char const* filename)>;
     void remove(std::string_view parent_in, std::string_view tmpdir_prefix, FileFunc const& func) const;
 
@@ -9,6 +9,7 @@
 #include <climits> /* INT_MAX */
 #include <csignal> /* signal() */
 #include <ctime>
+#include <future>
 #include <map>
 #include <sstream>
 #include <string>
@@ -35,12 +36,14 @@
 #include "bandwidth.h"
 #include "completion.h"
 #include "crypto-utils.h" /* for tr_sha1 */
+#include "disk-scheduler.h"
 #include "error.h"
 #include "file.h"
 #include "inout.h" /* tr_ioTestPiece() */
 #include "log.h"
 #include "magnet-metainfo.h"
 #include "peer-mgr.h"
+#include "relocator.h"
 #include "resume.h"
 #include "session.h"
 #include "subprocess.h"
@@ -513,6 +516,9 @@ struct torrent_start_opts
     // true or false if we know whether or not local data exists,
     // or unset if we don't know and need to check for ourselves
     std::optional<bool> has_local_data;
+
+    // when to tell the trackers, or 0 for right away
+    time_t announce_at = 0;
 };
 
 static void torrentStart(tr_torrent* tor, torrent_start_opts opts);
@@ -571,7 +577,7 @@ bool tr_torrent::hasAnyLocalData() const
 
 static bool setLocalErrorIfFilesDisappeared(tr_torrent* tor, std::optional<bool> has_local_data = {})
 {
-    auto const has = has_local_data ? *has_local_data : tor->hasAnyLocalData();
+    auto const has = has_local_data ? *has_local_data : tor->storage().hasAnyData();
     bool const files_disappeared = tor->hasTotal() > 0 && !has;
 
     if (files_disappeared)
@@ -694,6 +700,13 @@ static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     tr_ctorInitTorrentPriorities(ctor, tor);
     tr_ctorInitTorrentWanted(ctor, tor);
 
+    // tr_resume::load() restores the backend of torrents that were added
+    // before, so that changing the setting only affects new torrents
+    if (!tor->storage_)
+    {
+        tor->storage_ = tr_storage::create(session->storageBackend(), *tor);
+    }
+
     tor->refreshCurrentDir();
 
     bool const do_start = tor->isRunning;
@@ -721,7 +734,7 @@ static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     }
 
     auto has_local_data = std::optional<bool>{};
-    if ((loaded & tr_resume::Progress) != 0)
+    if ((loaded & tr_resume::Progress) != 0 && tor->storage().backend() == TR_STORAGE_FILESYSTEM)
     {
         // if tr_resume::load() loaded progress info, then initCheckedPieces()
         // has already looked for local data on the filesystem
@@ -969,6 +982,17 @@ tr_stat const* tr_torrentStat(tr_torrent* tor)
 
     auto const verify_progress = tor->verifyProgress();
     s->recheckProgress = verify_progress.value_or(0.0);
+    auto const preallocation_progress = tor->session->openFiles().preallocationProgress(tor->id());
+    s->preallocationProgress = preallocation_progress && preallocation_progress->total > 0 ?
+        static_cast<float>(preallocation_progress->done) / preallocation_progress->total :
+        1.0F;
+    s->moveProgress = 1.0F;
+    if (auto const& relocation = tor->relocation_; relocation && relocation->bytes_total > 0U)
+    {
+        auto const copying = tor->session->relocator().progress(tor->id());
+        auto const done = relocation->bytes_done + (copying ? copying->done : 0U);
+        s->moveProgress = static_cast<float>(done) / relocation->bytes_total;
+    }
     s->activityDate = tor->activityDate;
     s->addedDate = tor->addedDate;
     s->doneDate = tor->doneDate;
@@ -1086,6 +1110,50 @@ tr_stat const* tr_torrentStat(tr_torrent* tor)
     return s;
 }
 
+void tr_sessionGetStatColumns(tr_session* session, tr_stat_columns* setme)
+{
+    TR_ASSERT(session != nullptr);
+    TR_ASSERT(setme != nullptr);
+
+    auto done_promise = std::promise<void>{};
+    auto done_future = done_promise.get_future();
+    session->runInSessionThread(
+        [session, setme, &done_promise]()
+        {
+            auto& cols = *setme;
+            cols.resize(std::size(session->torrents()));
+
+            auto row = size_t{};
+            for (auto* const tor : session->torrents())
+            {
+                auto const* const st = tr_torrentStat(tor);
+                cols.id[row] = st->id;
+                cols.activity[row] = st->activity;
+                cols.error[row] = st->error;
+                cols.priority[row] = tor->getPriority();
+                cols.finished[row] = st->finished ? 1U : 0U;
+                cols.queue_position[row] = st->queuePosition;
+                cols.added_date[row] = st->addedDate;
+                cols.eta[row] = st->eta;
+                cols.total_size[row] = tor->totalSize();
+                cols.percent_complete[row] = st->percentComplete;
+                cols.seed_ratio_percent_done[row] = st->seedRatioPercentDone;
+                cols.recheck_progress[row] = st->recheckProgress;
+                cols.ratio[row] = st->ratio;
+                cols.piece_upload_speed_KBps[row] = st->pieceUploadSpeed_KBps;
+                cols.piece_download_speed_KBps[row] = st->pieceDownloadSpeed_KBps;
+                cols.peers_sending_to_us[row] = st->peersSendingToUs;
+                cols.peers_getting_from_us[row] = st->peersGettingFromUs;
+                cols.webseeds_sending_to_us[row] = st->webseedsSendingToUs;
+                ++row;
+            }
+
+            TR_ASSERT(row == std::size(cols));
+            done_promise.set_value();
+        });
+    done_future.wait();
+}
+
 /***
 ****
 ***/
@@ -1231,6 +1299,7 @@ static void freeTorrent(tr_torrent* tor)
     tr_peerMgrRemoveTorrent(tor);
 
     session->announcer_->removeTorrent(tor);
+    session->openFiles().forgetPreallocation(tor->id());
 
     session->torrents().remove(tor, tr_time());
 
@@ -1259,7 +1328,7 @@ static void freeTorrent(tr_torrent* tor)
 
 static void torrentSetQueued(tr_torrent* tor, bool queued);
 
-static void torrentStartImpl(tr_torrent* const tor)
+static void torrentStartImpl(tr_torrent* const tor, time_t announce_at)
 {
     auto const lock = tor->unique_lock();
 
@@ -1278,7 +1347,11 @@ static void torrentStartImpl(tr_torrent* const tor)
     tor->finishedSeedingByIdle = false;
 
     tr_torrentResetTransferStats(tor);
-    tor->session->announcer_->startTorrent(tor);
+
+    // finish preallocating any files that stopping the torrent interrupted
+    tor->session->openFiles().resumePreallocation(tor->id());
+
+    tor->session->announcer_->startTorrent(tor, announce_at != 0 ? announce_at : now);
     tor->lpdAnnounceAt = now;
     tr_peerMgrStartTorrent(tor);
 }
@@ -1348,7 +1421,7 @@ static void torrentStart(tr_torrent* tor, torrent_start_opts opts)
     tr_torrentUnsetPeerId(tor);
     tor->isRunning = true;
     tor->setDirty();
-    tor->session->runInSessionThread(torrentStartImpl, tor);
+    tor->session->runInSessionThread(torrentStartImpl, tor, opts.announce_at);
 }
 
 void tr_torrentStart(tr_torrent* tor)
@@ -1448,7 +1521,7 @@ void tr_torrentSave(tr_torrent* tor)
     }
 }
 
-static void stopTorrent(tr_torrent* const tor)
+static void stopTorrent(tr_torrent* const tor, time_t announce_at)
 {
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tor->session->amInSessionThread());
@@ -1462,7 +1535,7 @@ static void stopTorrent(tr_torrent* const tor)
     tor->session->verifyRemove(tor);
 
     tr_peerMgrStopTorrent(tor);
-    tor->session->announcer_->stopTorrent(tor);
+    tor->session->announcer_->stopTorrent(tor, announce_at);
 
     tor->session->closeTorrentFiles(tor);
 
@@ -1496,9 +1569,157 @@ void tr_torrentStop(tr_torrent* tor)
     tor->isRunning = false;
     tor->isStopping = false;
     tor->setDirty();
-    tor->session->runInSessionThread(stopTorrent, tor);
+    tor->session->runInSessionThread(stopTorrent, tor, tr_time());
+}
+
+/**
+***  Starting and stopping many torrents at once
+**/
+
+// Starting or stopping thousands of torrents at once, e.g. with one RPC
+// request, would have them all announce to their trackers at the same time.
+// Batches spread their announces out at this rate instead.
+static auto constexpr BatchAnnouncesPerSecond = size_t{ 20 };
+
+[[nodiscard]] static time_t batchAnnounceAt(time_t now, size_t n_announced)
+{
+    return now + static_cast<time_t>(n_announced / BatchAnnouncesPerSecond);
+}
+
+[[nodiscard]] static std::vector<tr_torrent*> sortedByQueuePosition(tr_torrent* const* torrents, size_t torrent_count)
+{
+    auto sorted = std::vector<tr_torrent*>(torrents, torrents + torrent_count);
+    std::sort(
+        std::begin(sorted),
+        std::end(sorted),
+        [](auto const* a, auto const* b) { return a->queuePosition < b->queuePosition; });
+    return sorted;
 }
 
+static void torrentsStartInSessionThread(std::vector<tr_torrent*> const& torrents, bool bypass_queue)
+{
+    auto* const session = torrents.front()->session;
+    TR_ASSERT(session->amInSessionThread());
+
+    // count the queues' free slots once instead of once per torrent
+    auto free_slots = std::array<size_t, 2>{};
+    free_slots[TR_UP] = session->countQueueFreeSlots(TR_UP);
+    free_slots[TR_DOWN] = session->countQueueFreeSlots(TR_DOWN);
+
+    auto const now = tr_time();
+    auto n_started = size_t{};
+    for (auto* const tor : torrents)
+    {
+        auto opts = torrent_start_opts{};
+        opts.bypass_queue = bypass_queue;
+
+        if (!bypass_queue)
+        {
+            tor->startAfterVerify = true;
+
+            // like torrentStart() would, but without recounting the slots
+            if (tor->activity() == TR_STATUS_STOPPED)
+            {
+                auto& n_free = free_slots[tor->queueDirection()];
+                if (n_free == 0U)
+                {
+                    torrentSetQueued(tor, true);
+                    continue;
+                }
+
+                --n_free;
+                opts.bypass_queue = true;
+            }
+        }
+
+        opts.announce_at = batchAnnounceAt(now, n_started++);
+        torrentStart(tor, opts);
+    }
+}
+
+void tr_torrentsStart(tr_torrent* const* torrents, size_t torrent_count)
+{
+    if (torrent_count > 0U)
+    {
+        torrents[0]->session->runInSessionThread(
+            torrentsStartInSessionThread,
+            sortedByQueuePosition(torrents, torrent_count),
+            false);
+    }
+}
+
+void tr_torrentsStartNow(tr_torrent* const* torrents, size_t torrent_count)
+{
+    if (torrent_count > 0U)
+    {
+        torrents[0]->session->runInSessionThread(
+            torrentsStartInSessionThread,
+            sortedByQueuePosition(torrents, torrent_count),
+            true);
+    }
+}
+
+static void torrentsStopInSessionThread(std::vector<tr_torrent*> const& torrents)
+{
+    auto const now = tr_time();
+    auto n_stopped = size_t{};
+    for (auto* const tor : torrents)
+    {
+        auto const lock = tor->unique_lock();
+
+        tor->isRunning = false;
+        tor->isStopping = false;
+        tor->setDirty();
+        stopTorrent(tor, batchAnnounceAt(now, n_stopped++));
+    }
+}
+
+void tr_torrentsStop(tr_torrent* const* torrents, size_t torrent_count)
+{
+    if (torrent_count > 0U)
+    {
+        torrents[0]->session->runInSessionThread(
+            torrentsStopInSessionThread,
+            std::vector<tr_torrent*>(torrents, torrents + torrent_count));
+    }
+}
+
+static void torrentsVerifyInSessionThread(std::vector<tr_torrent*> const& torrents)
+{
+    auto const now = tr_time();
+    auto n_stopped = size_t{};
+    for (auto* const tor : torrents)
+    {
+        // Stop the running ones here rather than in verifyTorrent(),
+        // so that their announces are spread out too. They still get
+        // restarted once they've been verified.
+        if (tor->isRunning && !tor->isDeleting)
+        {
+            auto const lock = tor->unique_lock();
+
+            tor->startAfterVerify = !tor->isStopping;
+            tor->isRunning = false;
+            tor->isStopping = false;
+            tor->setDirty();
+            stopTorrent(tor, batchAnnounceAt(now, n_stopped++));
+        }
+
+        verifyTorrent(tor);
+    }
+}
+
+void tr_torrentsVerify(tr_torrent* const* torrents, size_t torrent_count)
+{
+    if (torrent_count > 0U)
+    {
+        torrents[0]->session->runInSessionThread(
+            torrentsVerifyInSessionThread,
+            std::vector<tr_torrent*>(torrents, torrents + torrent_count));
+    }
+}
+
+static void cancelRelocation(tr_torrent* tor);
+
 void tr_torrentFreeInSessionThread(tr_torrent* tor)
 {
     TR_ASSERT(tr_isTorrent(tor));
@@ -1511,7 +1732,8 @@ void tr_torrentFreeInSessionThread(tr_torrent* tor)
     }
 
     tor->magnetVerify = false;
-    stopTorrent(tor);
+    stopTorrent(tor, tr_time());
+    cancelRelocation(tor);
 
     if (tor->isDeleting)
     {
@@ -1548,7 +1770,7 @@ static void removeTorrentInSessionThread(tr_torrent* tor, bool delete_flag, tr_f
         {
             delete_func(filename, user_data, nullptr);
         };
-        tor->metainfo_.files().remove(tor->currentDir(), tor->name(), delete_func_wrapper);
+        tor->storage().remove(delete_func_wrapper);
     }
 
     tr_torrentFreeInSessionThread(tor);
@@ -1707,7 +1929,8 @@ void tr_torrent::recheckCompleteness()
                 tr_peerMgrClearInterest(this);
             }
 
-            if (this->currentDir() == this->incompleteDir())
+            // a move that's already in progress takes the files out of the incomplete dir
+            if (this->currentDir() == this->incompleteDir() && !this->relocation_)
             {
                 this->setLocation(this->downloadDir(), true, nullptr, nullptr);
             }
@@ -1736,6 +1959,13 @@ void tr_torrent::recheckCompleteness()
 ***  File DND
 **/
 
+void tr_torrent::onPiecesWantedChanged()
+{
+    setDirty();
+    tr_peerMgrOnPiecesWantedChanged(this);
+    recheckCompleteness();
+}
+
 void tr_torrentSetFileDLs(tr_torrent* tor, tr_file_index_t const* files, tr_file_index_t n_files, bool wanted)
 {
     TR_ASSERT(tr_isTorrent(tor));
@@ -2008,8 +2238,386 @@ uint64_t tr_torrentGetBytesLeftToAllocate(tr_torrent const* tor)
     return bytes_left;
 }
 
+/* if the torrent's current filename isn't the same as the one in the
+ * metadata -- for example, if it had the ".part" suffix appended to
+ * it until now -- then rename it to match the one in the metadata */
+static void renameCompletedFile(tr_torrent* tor, tr_file_index_t i)
+{
+    if (auto found = tor->findFile(i); found)
+    {
+        if (auto const& file_subpath = tor->fileSubpath(i); file_subpath != found->subpath())
+        {
+            auto const& oldpath = found->filename();
+            auto const newpath = tr_pathbuf{ found->base(), '/', file_subpath };
+            tr_error* error = nullptr;
+
+            if (!tr_sys_path_rename(oldpath, newpath, &error))
+            {
+                tr_logAddErrorTor(
+                    tor,
+                    fmt::format(
+                        _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
+                        fmt::arg("old_path", oldpath),
+                        fmt::arg("path", newpath),
+                        fmt::arg("error", error->message),
+                        fmt::arg("error_code", error->code)));
+                tr_error_free(error);
+            }
+        }
+    }
+}
+
+// Rename the files that were completed while the torrent was being moved
+static void renameCompletedFiles(tr_torrent* tor)
+{
+    for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
+    {
+        if (tor->completion.hasBlocks(tr_torGetFileBlockSpan(tor, i)))
+        {
+            tor->session->closeTorrentFile(tor, i);
+            renameCompletedFile(tor, i);
+        }
+    }
+}
+
 ///
 
+// Relocation
+
+// Once no more than this is left to copy, it's copied right away in the
+// session thread, where no more pieces can be written while it's copied,
+// and then the torrent switches over. Otherwise a torrent that's busy
+// downloading could keep dirtying pieces faster than they're recopied.
+static auto constexpr RelocationFinalDeltaBytes = uint64_t{ 4U * 1024U * 1024U };
+
+static void removeRelocationCopies(tr_torrent::Relocation const& relocation)
+{
+    for (auto const& file : relocation.files)
+    {
+        if (file.copied)
+        {
+            tr_sys_path_remove(file.dst);
+        }
+    }
+}
+
+// Give up on moving the torrent's files, e.g. because it's being removed
+// or it's been told to go somewhere else. Its files stay where they were.
+static void cancelRelocation(tr_torrent* tor)
+{
+    if (!tor->relocation_)
+    {
+        return;
+    }
+
+    tor->session->relocator().cancel(tor->id());
+    removeRelocationCopies(*tor->relocation_);
+
+    if (auto* const setme_state = tor->relocation_->setme_state; setme_state != nullptr)
+    {
+        *setme_state = TR_LOC_ERROR;
+    }
+
+    tor->relocation_.reset();
+    renameCompletedFiles(tor);
+}
+
+static void failRelocation(tr_torrent* tor, tr_torrent::Relocation const& relocation, int error_code, std::string_view message)
+{
+    removeRelocationCopies(relocation);
+
+    tor->setLocalError(fmt::format(
+        _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
+        fmt::arg("old_path", relocation.old_parent),
+        fmt::arg("path", relocation.path),
+        fmt::arg("error", message),
+        fmt::arg("error_code", error_code)));
+    tr_torrentStop(tor);
+    renameCompletedFiles(tor);
+
+    if (relocation.setme_state != nullptr)
+    {
+        *relocation.setme_state = TR_LOC_ERROR;
+    }
+}
+
+// Plan the move of any files that have turned up in the old location
+// since the last time we looked, e.g. because they were just created
+static void addRelocationFiles(tr_torrent const* tor, tr_torrent::Relocation& relocation)
+{
+    auto& disk_scheduler = tor->session->diskScheduler();
+    auto const new_device = disk_scheduler.deviceOf(relocation.path);
+    auto const search_path = std::string_view{ relocation.old_parent };
+
+    auto planned = std::vector<bool>(tor->fileCount());
+    for (auto const& file : relocation.files)
+    {
+        planned[file.index] = true;
+    }
+
+    for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
+    {
+        if (planned[i])
+        {
+            continue;
+        }
+
+        auto const found = tor->metainfo_.files().find(i, &search_path, 1U);
+        if (!found)
+        {
+            continue;
+        }
+
+        auto dst = tr_pathbuf{ relocation.path, '/', found->subpath() };
+        if (tr_sys_path_is_same(found->filename(), dst))
+        {
+            continue;
+        }
+
+        auto& file = relocation.files.emplace_back();
+        file.index = i;
+        file.src = found->filename();
+        file.dst = dst;
+        file.copy = disk_scheduler.deviceOf(tr_sys_path_dirname(file.src)) != new_device;
+        file.size = found->size;
+    }
+}
+
+// Recopy the parts of `file` that were written to since it was copied
+static void addDirtyRanges(
+    tr_torrent const* tor,
+    tr_torrent::Relocation::File const& file,
+    tr_bitfield const& dirty_pieces,
+    std::vector<tr_relocator::Task>& tasks)
+{
+    auto const file_span = tor->byteSpan(file.index);
+    auto const [begin_piece, end_piece] = tor->piecesInFile(file.index);
+
+    for (auto piece = begin_piece; piece < end_piece; ++piece)
+    {
+        if (!dirty_pieces.test(piece))
+        {
+            continue;
+        }
+
+        // copy runs of dirty pieces in one go
+        auto run_end = piece + 1;
+        while (run_end < end_piece && dirty_pieces.test(run_end))
+        {
+            ++run_end;
+        }
+
+        auto const begin = std::max(tor->blockInfo().byteSpanForPiece(piece).begin, file_span.begin);
+        auto const end = std::min(tor->blockInfo().byteSpanForPiece(run_end - 1).end, file_span.end);
+        if (begin < end)
+        {
+            tasks.push_back({ file.src, file.dst, begin - file_span.begin, end - begin, false });
+        }
+
+        piece = run_end;
+    }
+}
+
+// Everything's been copied, so switch the torrent over to its new location
+static void finishRelocation(tr_torrent* tor)
+{
+    auto const relocation = std::move(*tor->relocation_);
+    tor->relocation_.reset();
+
+    // ensure the files are all closed and idle before moving
+    tor->session->closeTorrentFiles(tor);
+    tor->session->verifyRemove(tor);
+
+    for (auto const& file : relocation.files)
+    {
+        // if the rename fails, e.g. because the file's on another filesystem
+        // after all, tr_moveFile() falls back to copying it
+        if (tr_error* error = nullptr; !file.copy && !tr_moveFile(file.src, file.dst, &error))
+        {
+            failRelocation(tor, relocation, error->code, error->message);
+            tr_error_clear(&error);
+            return;
+        }
+    }
+
+    for (auto const& file : relocation.files)
+    {
+        if (file.copy)
+        {
+            tr_sys_path_remove(file.src);
+        }
+    }
+
+    tor->metainfo_.files().removeLeftovers(relocation.old_parent, tor->name());
+
+    // tell the torrent where the files are
+    tor->setDownloadDir(relocation.path);
+    tor->incomplete_dir.clear();
+    tor->current_dir = tor->downloadDir();
+    renameCompletedFiles(tor);
+
+    if (relocation.setme_progress != nullptr)
+    {
+        *relocation.setme_progress = 1.0;
+    }
+
+    if (relocation.setme_state != nullptr)
+    {
+        *relocation.setme_state = TR_LOC_DONE;
+    }
+}
+
+static void onRelocationCopied(
+    tr_session* session,
+    tr_torrent_id_t tor_id,
+    uint64_t relocation_id,
+    int error_code,
+    std::string const& error_message);
+
+// Copy the files that haven't been copied yet, and the parts of copied files
+// that have changed since. When there's little or nothing left, switch over.
+static void continueRelocation(tr_torrent* tor)
+{
+    auto& relocation = *tor->relocation_;
+    relocation.bytes_done = relocation.bytes_total;
+
+    // bring the old files up-to-date.
+    // tr_ioWrite() marks the pieces that this writes as dirty.
+    tor->session->cache->flushTorrent(tor);
+    addRelocationFiles(tor, relocation);
+
+    auto tasks = std::vector<tr_relocator::Task>{};
+    for (auto& file : relocation.files)
+    {
+        if (!file.copy)
+        {
+            continue;
+        }
+
+        if (!file.copied)
+        {
+            tasks.push_back({ file.src, file.dst, 0U, file.size, true });
+            file.copied = true;
+        }
+        else
+        {
+            addDirtyRanges(tor, file, relocation.dirty_pieces, tasks);
+        }
+    }
+
+    relocation.dirty_pieces.setHasNone();
+
+    if (std::empty(tasks))
+    {
+        finishRelocation(tor);
+        return;
+    }
+
+    auto n_bytes = uint64_t{};
+    for (auto const& task : tasks)
+    {
+        n_bytes += task.length;
+    }
+
+    relocation.bytes_total += n_bytes;
+
+    // if every file's been copied and only a few changed pieces are left,
+    // copy them now instead of giving the torrent time to change more
+    if (n_bytes <= RelocationFinalDeltaBytes &&
+        std::none_of(std::begin(tasks), std::end(tasks), [](auto const& task) { return task.create; }))
+    {
+        for (auto const& task : tasks)
+        {
+            if (tr_error* error = nullptr; !tr_relocator::copyNow(task, &error))
+            {
+                auto const failed = std::move(relocation);
+                tor->relocation_.reset();
+                failRelocation(tor, failed, error->code, error->message);
+                tr_error_clear(&error);
+                return;
+            }
+        }
+
+        finishRelocation(tor);
+        return;
+    }
+
+    if (relocation.setme_progress != nullptr)
+    {
+        *relocation.setme_progress = static_cast<double>(relocation.bytes_done) / relocation.bytes_total;
+    }
+
+    auto on_done = [session = tor->session, tor_id = tor->id(), id = relocation.id](tr_error const* error)
+    {
+        session->runInSessionThread(
+            onRelocationCopied,
+            session,
+            tor_id,
+            id,
+            error != nullptr ? error->code : 0,
+            std::string{ error != nullptr ? error->message : "" });
+    };
+    tor->session->relocator().add(tor->id(), std::move(tasks), std::move(on_done));
+}
+
+static void onRelocationCopied(
+    tr_session* session,
+    tr_torrent_id_t tor_id,
+    uint64_t relocation_id,
+    int error_code,
+    std::string const& error_message)
+{
+    auto* const tor = session->torrents().get(tor_id);
+    if (tor == nullptr || !tor->relocation_ || tor->relocation_->id != relocation_id)
+    {
+        return; // the relocation was cancelled
+    }
+
+    if (error_code != 0)
+    {
+        auto const relocation = std::move(*tor->relocation_);
+        tor->relocation_.reset();
+        failRelocation(tor, relocation, error_code, error_message);
+        return;
+    }
+
+    continueRelocation(tor);
+}
+
+static void startRelocation(
+    tr_torrent* tor,
+    std::string const& path,
+    double volatile* setme_progress,
+    int volatile* setme_state)
+{
+    static auto next_id = uint64_t{};
+
+    auto relocation = tr_torrent::Relocation{};
+    relocation.id = ++next_id;
+    relocation.old_parent = tor->currentDir();
+    relocation.path = path;
+    relocation.dirty_pieces = tr_bitfield{ tor->pieceCount() };
+    relocation.setme_progress = setme_progress;
+    relocation.setme_state = setme_state;
+
+    if (setme_progress != nullptr)
+    {
+        *setme_progress = 0.0;
+    }
+
+    // the new location's device is needed to decide what gets copied
+    if (tr_error* error = nullptr; !tr_sys_path_is_same(relocation.old_parent, relocation.path) &&
+        !tr_sys_dir_create(relocation.path, TR_SYS_DIR_CREATE_PARENTS, 0777, &error))
+    {
+        failRelocation(tor, relocation, error->code, error->message);
+        tr_error_clear(&error);
+        return;
+    }
+
+    tor->relocation_ = std::move(relocation);
+    continueRelocation(tor);
+}
+
 static void setLocationInSessionThread(
     tr_torrent* tor,
     std::string const& path,
@@ -2020,6 +2628,22 @@ static void setLocationInSessionThread(
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tor->session->amInSessionThread());
 
+    // a new move replaces any that's still in progress
+    cancelRelocation(tor);
+
+    // Files going to another filesystem are copied in the background
+    // while the torrent keeps seeding from the old ones.
+    if (move_from_old_path && tor->storage().backend() == TR_STORAGE_FILESYSTEM)
+    {
+        if (setme_state != nullptr)
+        {
+            *setme_state = TR_LOC_MOVING;
+        }
+
+        startRelocation(tor, path, setme_progress, setme_state);
+        return;
+    }
+
     auto ok = bool{ true };
     if (move_from_old_path)
     {
@@ -2033,7 +2657,7 @@ static void setLocationInSessionThread(
         tor->session->verifyRemove(tor);
 
         tr_error* error = nullptr;
-        ok = tor->metainfo_.files().move(tor->currentDir(), path, setme_progress, tor->name(), &error);
+        ok = tor->storage().move(tor->currentDir().sv(), path, setme_progress, &error);
         if (error != nullptr)
         {
             tor->setLocalError(fmt::format(
@@ -2141,30 +2765,11 @@ static void tr_torrentFileCompleted(tr_torrent* tor, tr_file_index_t i)
      * mtime timestamp for changes to know if we need to reverify pieces */
     tor->file_mtimes_[i] = tr_time();
 
-    /* if the torrent's current filename isn't the same as the one in the
-     * metadata -- for example, if it had the ".part" suffix appended to
-     * it until now -- then rename it to match the one in the metadata */
-    if (auto found = tor->findFile(i); found)
+    /* a relocation copies and moves the files by the names they had when
+     * it found them, so leave the rename until the relocation's over */
+    if (!tor->relocation_)
     {
-        if (auto const& file_subpath = tor->fileSubpath(i); file_subpath != found->subpath())
-        {
-            auto const& oldpath = found->filename();
-            auto const newpath = tr_pathbuf{ found->base(), '/', file_subpath };
-            tr_error* error = nullptr;
-
-            if (!tr_sys_path_rename(oldpath, newpath, &error))
-            {
-                tr_logAddErrorTor(
-                    tor,
-                    fmt::format(
-                        _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
-                        fmt::arg("old_path", oldpath),
-                        fmt::arg("path", newpath),
-                        fmt::arg("error", error->message),
-                        fmt::arg("error_code", error->code)));
-                tr_error_free(error);
-            }
-        }
+        renameCompletedFile(tor, i);
     }
 }
 
@@ -2251,8 +2856,8 @@ void tr_torrent::refreshCurrentDir()
     }
     else
     {
-        auto const found = findFile(0);
-        dir = found ? tr_interned_string{ found->base() } : incompleteDir();
+        auto const found = storage().dataDir();
+        dir = !std::empty(found) ? tr_interned_string{ found } : incompleteDir();
     }
 
     TR_ASSERT(!std::empty(dir));
@@ -2326,58 +2931,127 @@ void tr_torrentSetQueuePosition(tr_torrent* tor, size_t queue_position)
     TR_ASSERT(queueIsSequenced(tor->session));
 }
 
-struct CompareTorrentByQueuePosition
+// Moving a batch of torrents one at a time with tr_torrentSetQueuePosition()
+// walks the whole session for each of them, which adds up when the batch is
+// thousands of torrents. Instead, rearrange the queue as a whole and then
+// renumber it once.
+namespace
+{
+
+class QueueBatch
 {
-    constexpr bool operator()(tr_torrent const* a, tr_torrent const* b) const noexcept
+public:
+    QueueBatch(tr_torrent* const* torrents, size_t torrent_count)
+    {
+        auto* const session = torrent_count > 0U ? torrents[0]->session : nullptr;
+        if (session == nullptr)
+        {
+            return;
+        }
+
+        TR_ASSERT(queueIsSequenced(session));
+
+        // the positions are sequenced, so they index the queue
+        queue_.resize(std::size(session->torrents()));
+        for (auto* const tor : session->torrents())
+        {
+            queue_[tor->queuePosition] = tor;
+        }
+
+        selected_.resize(std::size(queue_));
+        for (size_t i = 0; i < torrent_count; ++i)
+        {
+            selected_[torrents[i]->queuePosition] = true;
+        }
+    }
+
+    // Give the torrents their new positions
+    void renumber()
     {
-        return a->queuePosition < b->queuePosition;
+        for (size_t pos = 0, n = std::size(queue_); pos < n; ++pos)
+        {
+            if (auto* const tor = queue_[pos]; tor->queuePosition != pos)
+            {
+                tor->queuePosition = pos;
+                tor->markChanged();
+            }
+        }
     }
-};
 
-void tr_torrentsQueueMoveTop(tr_torrent* const* torrents_in, size_t torrent_count)
-{
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::rbegin(torrents), std::rend(torrents), CompareTorrentByQueuePosition{});
-    for (auto* tor : torrents)
+    void moveTop()
     {
-        tr_torrentSetQueuePosition(tor, 0);
+        std::stable_partition(std::begin(queue_), std::end(queue_), [this](auto const* tor) { return isSelected(tor); });
     }
-}
 
-void tr_torrentsQueueMoveUp(tr_torrent* const* torrents_in, size_t torrent_count)
-{
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition{});
-    for (auto* tor : torrents)
+    void moveBottom()
+    {
+        std::stable_partition(std::begin(queue_), std::end(queue_), [this](auto const* tor) { return !isSelected(tor); });
+    }
+
+    // Each selected torrent swaps places with the one ahead of it,
+    // front to back, just like moving them up one at a time would.
+    void moveUp()
     {
-        if (tor->queuePosition > 0)
+        for (size_t pos = 1, n = std::size(queue_); pos < n; ++pos)
         {
-            tr_torrentSetQueuePosition(tor, tor->queuePosition - 1);
+            if (isSelected(queue_[pos]))
+            {
+                std::swap(queue_[pos - 1], queue_[pos]);
+            }
         }
     }
-}
 
-void tr_torrentsQueueMoveDown(tr_torrent* const* torrents_in, size_t torrent_count)
-{
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::rbegin(torrents), std::rend(torrents), CompareTorrentByQueuePosition{});
-    for (auto* tor : torrents)
+    void moveDown()
     {
-        if (tor->queuePosition < UINT_MAX)
+        for (size_t pos = std::size(queue_); pos > 1U; --pos)
         {
-            tr_torrentSetQueuePosition(tor, tor->queuePosition + 1);
+            if (isSelected(queue_[pos - 2]))
+            {
+                std::swap(queue_[pos - 2], queue_[pos - 1]);
+            }
         }
     }
-}
 
-void tr_torrentsQueueMoveBottom(tr_torrent* const* torrents_in, size_t torrent_count)
-{
-    auto torrents = std::vector<tr_torrent*>(torrents_in, torrents_in + torrent_count);
-    std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition{});
-    for (auto* tor : torrents)
+private:
+    // queuePosition isn't updated until the batch is done,
+    // so it still identifies which torrents were selected
+    [[nodiscard]] bool isSelected(tr_torrent const* tor) const
     {
-        tr_torrentSetQueuePosition(tor, UINT_MAX);
+        return selected_[tor->queuePosition];
     }
+
+    std::vector<tr_torrent*> queue_;
+    std::vector<bool> selected_;
+};
+
+} // namespace
+
+void tr_torrentsQueueMoveTop(tr_torrent* const* torrents, size_t torrent_count)
+{
+    auto batch = QueueBatch{ torrents, torrent_count };
+    batch.moveTop();
+    batch.renumber();
+}
+
+void tr_torrentsQueueMoveUp(tr_torrent* const* torrents, size_t torrent_count)
+{
+    auto batch = QueueBatch{ torrents, torrent_count };
+    batch.moveUp();
+    batch.renumber();
+}
+
+void tr_torrentsQueueMoveDown(tr_torrent* const* torrents, size_t torrent_count)
+{
+    auto batch = QueueBatch{ torrents, torrent_count };
+    batch.moveDown();
+    batch.renumber();
+}
+
+void tr_torrentsQueueMoveBottom(tr_torrent* const* torrents, size_t torrent_count)
+{
+    auto batch = QueueBatch{ torrents, torrent_count };
+    batch.moveBottom();
+    batch.renumber();
 }
 
 static void torrentSetQueued(tr_torrent* tor, bool queued)
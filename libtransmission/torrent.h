@@ -9,8 +9,10 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <algorithm>
 #include <cstddef> // size_t
 #include <ctime>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -28,6 +30,7 @@
 #include "interned-string.h"
 #include "log.h"
 #include "session.h"
+#include "storage.h"
 #include "torrent-metainfo.h"
 #include "tr-macros.h"
 
@@ -410,6 +413,18 @@ public:
 
     [[nodiscard]] bool hasAnyLocalData() const;
 
+    /// STORAGE
+
+    [[nodiscard]] tr_storage& storage() noexcept
+    {
+        return *storage_;
+    }
+
+    [[nodiscard]] tr_storage const& storage() const noexcept
+    {
+        return *storage_;
+    }
+
     /// METAINFO - TRACKERS
 
     [[nodiscard]] auto const& announceList() const noexcept
@@ -770,6 +785,44 @@ public:
 
     tr_session* session = nullptr;
 
+    // where the torrent's data is kept
+    std::unique_ptr<tr_storage> storage_;
+
+    // A move of the torrent's files by setLocation(). Files that are going to
+    // another filesystem are copied in the background by tr_relocator while
+    // the torrent keeps using the old ones. Once they're copied, the torrent
+    // switches to the new location and the rest of the files are renamed.
+    struct Relocation
+    {
+        struct File
+        {
+            tr_file_index_t index = {};
+            std::string src;
+            std::string dst;
+            bool copy = false; // if false, it's renamed when the torrent switches over
+            bool copied = false;
+            uint64_t size = 0; // when it was found
+        };
+
+        uint64_t id = 0;
+        std::string old_parent;
+        std::string path;
+        std::vector<File> files;
+
+        // pieces that were written after their files started being copied,
+        // so they need to be copied again
+        tr_bitfield dirty_pieces = tr_bitfield{ 0 };
+
+        // bytes handed to tr_relocator so far, and how many of those are copied
+        uint64_t bytes_total = 0;
+        uint64_t bytes_done = 0;
+
+        double volatile* setme_progress = nullptr;
+        int volatile* setme_state = nullptr;
+    };
+
+    std::optional<Relocation> relocation_;
+
     tr_torrent_announcer* torrent_announcer = nullptr;
 
     tr_swarm* swarm = nullptr;
@@ -852,17 +905,42 @@ private:
     float verify_progress_ = -1;
     tr_interned_string bandwidth_group_;
 
+    void onPiecesWantedChanged();
+
     void setFilesWanted(tr_file_index_t const* files, size_t n_files, bool wanted, bool is_bootstrapping)
     {
         auto const lock = unique_lock();
 
-        files_wanted_.set(files, n_files, wanted);
-        completion.invalidateSizeWhenDone();
+        // find the pieces whose wanted state might change...
+        auto spans = std::vector<tr_file_piece_map::piece_span_t>{};
+        spans.reserve(n_files);
+        for (size_t i = 0; i < n_files; ++i)
+        {
+            spans.push_back(fpm_.pieceSpan(files[i]));
+        }
+        std::sort(std::begin(spans), std::end(spans), [](auto const& a, auto const& b) { return a.begin < b.begin; });
+
+        // ...merge them so that no piece gets counted twice...
+        auto merged = std::vector<tr_file_piece_map::piece_span_t>{};
+        merged.reserve(std::size(spans));
+        for (auto const& span : spans)
+        {
+            if (!std::empty(merged) && span.begin <= merged.back().end)
+            {
+                merged.back().end = std::max(merged.back().end, span.end);
+            }
+            else
+            {
+                merged.push_back(span);
+            }
+        }
+
+        // ...and let completion update sizeWhenDone() for just those pieces
+        completion.changeWanted(merged, [this, files, n_files, wanted]() { files_wanted_.set(files, n_files, wanted); });
 
         if (!is_bootstrapping)
         {
-            setDirty();
-            recheckCompleteness();
+            onPiecesWantedChanged();
         }
     }
 };
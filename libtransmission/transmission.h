@@ -20,6 +20,7 @@
 #ifdef __cplusplus
 #include <string>
 #include <string_view>
+#include <vector>
 #endif
 
 #include "tr-macros.h"
@@ -67,6 +68,19 @@ enum tr_preallocation_mode
     TR_PREALLOCATE_FULL = 2
 };
 
+enum tr_storage_backend
+{
+    // each of the torrent's files is a file on disk
+    TR_STORAGE_FILESYSTEM = 0,
+
+    // torrent data only lives in memory. Only tests can use this;
+    // it's not a valid `storage-backend` setting
+    TR_STORAGE_MEMORY = 1,
+
+    // all of the torrent's data is in a single preallocated file
+    TR_STORAGE_CONTAINER = 2
+};
+
 enum tr_encryption_mode
 {
     TR_CLEAR_PREFERRED,
@@ -893,6 +907,17 @@ void tr_torrentStart(tr_torrent* torrent);
 /** @brief Stop (pause) a torrent */
 void tr_torrentStop(tr_torrent* torrent);
 
+/** @brief Like tr_torrentStart() on each of the torrents, but in a single pass
+ * that also spreads their tracker announces out over time */
+void tr_torrentsStart(tr_torrent* const* torrents, size_t torrent_count);
+
+/** @brief Like tr_torrentsStart(), but resumes them right away regardless of the queues */
+void tr_torrentsStartNow(tr_torrent* const* torrents, size_t torrent_count);
+
+/** @brief Like tr_torrentStop() on each of the torrents, but in a single pass
+ * that also spreads their tracker announces out over time */
+void tr_torrentsStop(tr_torrent* const* torrents, size_t torrent_count);
+
 using tr_torrent_rename_done_func = void (*)( //
     tr_torrent* torrent,
     char const* oldpath,
@@ -1466,6 +1491,9 @@ void tr_torrentAmountFinished(tr_torrent const* torrent, float* tab, int n_tabs)
  */
 void tr_torrentVerify(tr_torrent* torrent);
 
+/** @brief Like tr_torrentVerify() on each of the torrents, but in a single pass */
+void tr_torrentsVerify(tr_torrent* const* torrents, size_t torrent_count);
+
 bool tr_torrentHasMetadata(tr_torrent const* tor);
 
 /**
@@ -1581,6 +1609,18 @@ struct tr_stat
         @see tr_stat.activity */
     float recheckProgress;
 
+    /** How much of the torrent's new files have been created and
+        preallocated in the background. Data for those files is kept
+        in the cache until they're ready.
+        Range is [0..1], and is 1 when nothing is being preallocated. */
+    float preallocationProgress;
+
+    /** How much of the torrent's data has been copied to its new
+        location by tr_torrentSetLocation(). The torrent keeps using
+        its old location until the copy is done.
+        Range is [0..1], and is 1 when nothing is being copied. */
+    float moveProgress;
+
     /** How much has been downloaded of the entire torrent.
         Range is [0..1] */
     float percentComplete;
@@ -1682,6 +1722,73 @@ tr_stat const* tr_torrentStat(tr_torrent* torrent);
     reduce the CPU load if you're calling tr_torrentStat() frequently. */
 tr_stat const* tr_torrentStatCached(tr_torrent* torrent);
 
+#ifdef __cplusplus
+/**
+ * @brief A snapshot of the tr_stat fields that clients sort and filter by,
+ *        taken for every torrent in the session at once.
+ *
+ * Each field is stored in its own array, and row `i` of every array
+ * describes the torrent `id[i]`. Sorting or filtering thousands of
+ * torrents can then walk a few contiguous arrays instead of calling
+ * tr_torrentStat() on both sides of every comparison.
+ */
+struct tr_stat_columns
+{
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return std::size(id);
+    }
+
+    void resize(size_t n)
+    {
+        id.resize(n);
+        activity.resize(n);
+        error.resize(n);
+        priority.resize(n);
+        finished.resize(n);
+        queue_position.resize(n);
+        added_date.resize(n);
+        eta.resize(n);
+        total_size.resize(n);
+        percent_complete.resize(n);
+        seed_ratio_percent_done.resize(n);
+        recheck_progress.resize(n);
+        ratio.resize(n);
+        piece_upload_speed_KBps.resize(n);
+        piece_download_speed_KBps.resize(n);
+        peers_sending_to_us.resize(n);
+        peers_getting_from_us.resize(n);
+        webseeds_sending_to_us.resize(n);
+    }
+
+    std::vector<tr_torrent_id_t> id;
+    std::vector<tr_torrent_activity> activity;
+    std::vector<tr_stat_errtype> error;
+    std::vector<tr_priority_t> priority;
+    std::vector<uint8_t> finished;
+    std::vector<size_t> queue_position;
+    std::vector<time_t> added_date;
+    std::vector<time_t> eta;
+    std::vector<uint64_t> total_size;
+    std::vector<float> percent_complete;
+    std::vector<float> seed_ratio_percent_done;
+    std::vector<float> recheck_progress;
+    std::vector<float> ratio;
+    std::vector<float> piece_upload_speed_KBps;
+    std::vector<float> piece_download_speed_KBps;
+    std::vector<uint16_t> peers_sending_to_us;
+    std::vector<uint16_t> peers_getting_from_us;
+    std::vector<uint16_t> webseeds_sending_to_us;
+};
+
+/** Fill `setme` with a fresh snapshot of every torrent's stats.
+    This runs in a single pass in the session thread, and it also
+    refreshes the values returned by tr_torrentStatCached().
+    `setme`'s arrays are reused, so passing the same object on every
+    refresh avoids reallocating them. */
+void tr_sessionGetStatColumns(tr_session* session, tr_stat_columns* setme);
+#endif
+
 /** @} */
 
 /** @brief Sanity checker to test that the direction is TR_UP or TR_DOWN */
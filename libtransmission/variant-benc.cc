@@ -135,12 +135,14 @@ struct MyHandler : public transmission::benc::Handler
 {
     tr_variant* const top_;
     int const parse_opts_;
+    tr_variant_arena* const arena_;
     std::deque<tr_variant*> stack_;
     std::optional<tr_quark> key_;
 
-    MyHandler(tr_variant* top, int parse_opts)
+    MyHandler(tr_variant* top, int parse_opts, tr_variant_arena* arena)
         : top_{ top }
         , parse_opts_{ parse_opts }
+        , arena_{ arena }
     {
     }
 
@@ -177,7 +179,7 @@ struct MyHandler : public transmission::benc::Handler
         }
         else
         {
-            tr_variantInitStr(variant, sv);
+            tr_variantParserInitStr(variant, sv, arena_);
         }
 
         return true;
@@ -191,7 +193,7 @@ struct MyHandler : public transmission::benc::Handler
             return false;
         }
 
-        tr_variantInitDict(variant, 0);
+        tr_variantParserInitContainer(variant, TR_VARIANT_TYPE_DICT, 0, arena_);
         stack_.push_back(variant);
         return true;
     }
@@ -222,7 +224,7 @@ struct MyHandler : public transmission::benc::Handler
             return false;
         }
 
-        tr_variantInitList(variant, 0);
+        tr_variantParserInitContainer(variant, TR_VARIANT_TYPE_LIST, 0, arena_);
         stack_.push_back(variant);
         return true;
     }
@@ -249,11 +251,11 @@ private:
         }
         else if (auto* parent = stack_.back(); tr_variantIsList(parent))
         {
-            node = tr_variantListAdd(parent);
+            node = tr_variantParserAdd(parent, TR_KEY_NONE, arena_);
         }
         else if (key_ && tr_variantIsDict(parent))
         {
-            node = tr_variantDictAdd(parent, *key_);
+            node = tr_variantParserAdd(parent, *key_, arena_);
             key_.reset();
         }
 
@@ -261,11 +263,17 @@ private:
     }
 };
 
-bool tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc, char const** setme_end, tr_error** error)
+bool tr_variantParseBenc(
+    tr_variant& top,
+    int parse_opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena)
 {
     using Stack = transmission::benc::ParserStack<512>;
     auto stack = Stack{};
-    auto handler = MyHandler{ &top, parse_opts };
+    auto handler = MyHandler{ &top, parse_opts, arena };
     return transmission::benc::parse(benc, stack, handler, setme_end, error) && std::empty(stack);
 }
 
@@ -42,6 +42,26 @@ void tr_variantWalk(tr_variant const* top, VariantWalkFuncs const* walk_funcs, v
 /** @brief Private function that's exposed here only for unit tests */
 [[nodiscard]] std::optional<std::string_view> tr_bencParseStr(std::string_view* benc_inout);
 
-bool tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc, char const** setme_end, tr_error** error);
+// Parser helpers. When `arena` is nullptr, these behave like their public counterparts.
 
-bool tr_variantParseJson(tr_variant& setme, int opts, std::string_view json, char const** setme_end, tr_error** error);
+tr_variant* tr_variantParserAdd(tr_variant* parent, tr_quark key, tr_variant_arena* arena);
+
+void tr_variantParserInitStr(tr_variant* initme, std::string_view str, tr_variant_arena* arena);
+
+void tr_variantParserInitContainer(tr_variant* initme, char type, size_t reserve_count, tr_variant_arena* arena);
+
+bool tr_variantParseBenc(
+    tr_variant& top,
+    int parse_opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena);
+
+bool tr_variantParseJson(
+    tr_variant& setme,
+    int opts,
+    std::string_view json,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena);
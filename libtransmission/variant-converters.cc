@@ -260,6 +260,69 @@ void VariantConverter::save<tr_preallocation_mode>(tr_variant* tgt, tr_prealloca
 
 ///
 
+namespace StorageBackendHelpers
+{
+// clang-format off
+// TR_STORAGE_MEMORY is left out on purpose: it's only for tests
+static auto constexpr Keys = std::array<std::pair<std::string_view, tr_storage_backend>, 2>{{
+    { "filesystem", TR_STORAGE_FILESYSTEM },
+    { "container", TR_STORAGE_CONTAINER },
+}};
+// clang-format on
+} // namespace StorageBackendHelpers
+
+template<>
+std::optional<tr_storage_backend> VariantConverter::load<tr_storage_backend>(tr_variant* src)
+{
+    using namespace StorageBackendHelpers;
+
+    if (auto val = std::string_view{}; tr_variantGetStrView(src, &val))
+    {
+        auto const needle = tr_strlower(tr_strvStrip(val));
+
+        for (auto const& [name, value] : Keys)
+        {
+            if (name == needle)
+            {
+                return value;
+            }
+        }
+    }
+
+    if (auto val = int64_t{}; tr_variantGetInt(src, &val))
+    {
+        for (auto const& [name, value] : Keys)
+        {
+            if (value == val)
+            {
+                return value;
+            }
+        }
+    }
+
+    return {};
+}
+
+template<>
+void VariantConverter::save<tr_storage_backend>(tr_variant* tgt, tr_storage_backend const& val)
+{
+    using namespace StorageBackendHelpers;
+
+    for (auto const& [name, value] : Keys)
+    {
+        if (value == val)
+        {
+            tr_variantInitStrView(tgt, name);
+            return;
+        }
+    }
+
+    // a backend that can't be a setting, i.e. the test-only TR_STORAGE_MEMORY
+    tr_variantInitStrView(tgt, Keys.front().first);
+}
+
+///
+
 template<>
 std::optional<size_t> VariantConverter::load<size_t>(tr_variant* src)
 {
@@ -7,13 +7,20 @@
 #include <cctype>
 #include <cerrno> /* EILSEQ, EINVAL */
 #include <cmath> /* fabs() */
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <deque>
+#include <limits>
 #include <string>
 #include <string_view>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TR_JSON_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define UTF_CPP_CPLUSPLUS 201703L
 #include <utf8.h>
 
@@ -25,7 +32,6 @@
 #include "transmission.h"
 
 #include "error.h"
-#include "jsonsl.h"
 #include "log.h"
 #include "quark.h"
 #include "tr-assert.h"
@@ -41,360 +47,584 @@ using Buffer = libtransmission::Buffer;
 /* arbitrary value... this is much deeper than our code goes */
 static auto constexpr MaxDepth = size_t{ 64 };
 
-struct json_wrapper_data
-{
-    bool has_content;
-    size_t size;
-    std::string_view key;
-    std::string keybuf;
-    std::string strbuf;
-    tr_error* error;
-    std::deque<tr_variant*> stack;
-    tr_variant* top;
-    int parse_opts;
-
-    /* A very common pattern is for a container's children to be similar,
-     * e.g. they may all be objects with the same set of keys. So when
-     * a container is popped off the stack, remember its size to use as
-     * a preallocation heuristic for the next container at that depth. */
-    std::array<size_t, MaxDepth> preallocGuess;
-};
+/***
+****
+***/
 
-static tr_variant* get_node(struct jsonsl_st* jsn)
+namespace parse_helpers
 {
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
 
-    auto* parent = std::empty(data->stack) ? nullptr : data->stack.back();
+// Returns the first '"' or '\\' in [walk, end), or `end` if there isn't one.
+// This is where the parser spends most of its time on long strings,
+// e.g. the base64-encoded metainfo in a `torrent-add` request.
+[[nodiscard]] char const* findQuoteOrBackslash(char const* walk, char const* end)
+{
+#ifdef TR_JSON_HAVE_SSE2
+    auto const quote = _mm_set1_epi8('"');
+    auto const backslash = _mm_set1_epi8('\\');
 
-    tr_variant* node = nullptr;
-    if (parent == nullptr)
+    for (; end - walk >= 16; walk += 16)
     {
-        node = data->top;
+        auto const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(walk));
+        auto const hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        if (_mm_movemask_epi8(hits) != 0)
+        {
+            break;
+        }
     }
-    else if (tr_variantIsList(parent))
+#else
+    // check a word at a time for a zero byte in (word ^ '"') or (word ^ '\\')
+    static auto constexpr Ones = UINT64_C(0x0101010101010101);
+    static auto constexpr Highs = UINT64_C(0x8080808080808080);
+
+    for (; end - walk >= 8; walk += 8)
     {
-        node = tr_variantListAdd(parent);
+        auto word = uint64_t{};
+        std::memcpy(&word, walk, sizeof(word));
+        auto const quotes = word ^ (Ones * '"');
+        auto const backslashes = word ^ (Ones * '\\');
+        if (((((quotes - Ones) & ~quotes) | ((backslashes - Ones) & ~backslashes)) & Highs) != 0U)
+        {
+            break;
+        }
     }
-    else if (tr_variantIsDict(parent) && !std::empty(data->key))
+#endif
+
+    while (walk != end && *walk != '"' && *walk != '\\')
     {
-        node = tr_variantDictAdd(parent, tr_quark_new(data->key));
-        data->key = ""sv;
+        ++walk;
     }
 
-    return node;
+    return walk;
 }
 
-static void error_handler(jsonsl_t jsn, jsonsl_error_t error, jsonsl_state_st* /*state*/, jsonsl_char_t const* buf)
+[[nodiscard]] constexpr bool isJsonWhitespace(char ch)
 {
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
-
-    tr_error_set(
-        &data->error,
-        EILSEQ,
-        fmt::format(
-            _("Couldn't parse JSON at position {position} '{text}': {error} ({error_code})"),
-            fmt::arg("position", jsn->pos),
-            fmt::arg("text", std::string_view{ buf, std::min(size_t{ 16U }, data->size - jsn->pos) }),
-            fmt::arg("error", jsonsl_strerror(error)),
-            fmt::arg("error_code", error)));
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
 }
 
-static int error_callback(jsonsl_t jsn, jsonsl_error_t error, struct jsonsl_state_st* state, jsonsl_char_t* at)
+[[nodiscard]] constexpr int hexValue(char ch)
 {
-    error_handler(jsn, error, state, at);
-    return 0; /* bail */
+    if ('0' <= ch && ch <= '9')
+    {
+        return ch - '0';
+    }
+
+    if ('a' <= ch && ch <= 'f')
+    {
+        return ch - 'a' + 10;
+    }
+
+    if ('A' <= ch && ch <= 'F')
+    {
+        return ch - 'A' + 10;
+    }
+
+    return -1;
 }
 
-static void action_callback_PUSH(
-    jsonsl_t jsn,
-    jsonsl_action_t /*action*/,
-    struct jsonsl_state_st* state,
-    jsonsl_char_t const* /*buf*/)
+// Parses JSON directly into a tr_variant. Strings that don't need
+// unescaping are views into the input when TR_VARIANT_PARSE_INPLACE
+// is set, and keys are resolved to quarks without copying them.
+class JsonParser
 {
-    auto* const data = static_cast<json_wrapper_data*>(jsn->data);
+public:
+    JsonParser(std::string_view json, int parse_opts, tr_variant_arena* arena)
+        : begin_{ std::data(json) }
+        , walk_{ std::data(json) }
+        , end_{ std::data(json) + std::size(json) }
+        , arena_{ arena }
+        , inplace_{ (parse_opts & TR_VARIANT_PARSE_INPLACE) != 0 }
+    {
+    }
 
-    if ((state->type == JSONSL_T_LIST) || (state->type == JSONSL_T_OBJECT))
+    bool parse(tr_variant& top, tr_error** error)
     {
-        data->has_content = true;
-        tr_variant* node = get_node(jsn);
-        data->stack.push_back(node);
+        skipWhitespace();
 
-        size_t const depth = std::size(data->stack);
-        size_t const n = depth < MaxDepth ? data->preallocGuess[depth] : 0;
-        if (state->type == JSONSL_T_LIST)
+        if (walk_ == end_)
         {
-            tr_variantInitList(node, n);
+            tr_error_set(error, EINVAL, "No content"sv);
+            return false;
         }
-        else
+
+        if (!parseDocument(top))
         {
-            tr_variantInitDict(node, n);
+            tr_error_set(
+                error,
+                EILSEQ,
+                fmt::format(
+                    _("Couldn't parse JSON at position {position} '{text}': {error} ({error_code})"),
+                    fmt::arg("position", walk_ - begin_),
+                    fmt::arg("text", std::string_view{ walk_, std::min(size_t{ 16U }, static_cast<size_t>(end_ - walk_)) }),
+                    fmt::arg("error", err_),
+                    fmt::arg("error_code", EILSEQ)));
+            return false;
         }
+
+        return true;
     }
-}
 
-/* like sscanf(in+2, "%4x", &val) but less slow */
-static bool decode_hex_string(char const* in, unsigned int* setme)
-{
-    TR_ASSERT(in != nullptr);
+    [[nodiscard]] char const* pos() const noexcept
+    {
+        return walk_;
+    }
 
-    unsigned int val = 0;
-    char const* const end = in + 6;
+private:
+    bool fail(std::string_view err)
+    {
+        err_ = err;
+        return false;
+    }
 
-    TR_ASSERT(in[0] == '\\');
-    TR_ASSERT(in[1] == 'u');
-    in += 2;
+    void skipWhitespace()
+    {
+        while (walk_ != end_ && isJsonWhitespace(*walk_))
+        {
+            ++walk_;
+        }
+    }
 
-    do
+    bool parseDocument(tr_variant& top)
     {
-        val <<= 4;
+        auto* node = &top;
 
-        if ('0' <= *in && *in <= '9')
+        for (;;)
         {
-            val += *in - '0';
+            // parse a value into `node`
+            skipWhitespace();
+            if (walk_ == end_)
+            {
+                return fail("unexpected end of input"sv);
+            }
+
+            if (*walk_ == '{' || *walk_ == '[')
+            {
+                if (depth_ == MaxDepth)
+                {
+                    return fail("nested too deeply"sv);
+                }
+
+                auto const type = *walk_ == '{' ? TR_VARIANT_TYPE_DICT : TR_VARIANT_TYPE_LIST;
+                ++walk_;
+                tr_variantParserInitContainer(node, type, prealloc_guess_[depth_], arena_);
+                stack_[depth_++] = node;
+
+                // empty containers are closed below
+                skipWhitespace();
+                if (walk_ == end_ || *walk_ != (type == TR_VARIANT_TYPE_DICT ? '}' : ']'))
+                {
+                    if (node = addChild(); node == nullptr)
+                    {
+                        return false;
+                    }
+
+                    continue;
+                }
+            }
+            else if (!parseScalar(node))
+            {
+                return false;
+            }
+
+            // close any containers that end here, then move on to the next value
+            for (;;)
+            {
+                if (depth_ == 0)
+                {
+                    skipWhitespace();
+                    return walk_ == end_ || fail("unexpected content after the end of the document"sv);
+                }
+
+                skipWhitespace();
+                if (walk_ == end_)
+                {
+                    return fail("unexpected end of input"sv);
+                }
+
+                auto* const parent = stack_[depth_ - 1];
+                auto const closer = tr_variantIsDict(parent) ? '}' : ']';
+
+                if (*walk_ == closer)
+                {
+                    ++walk_;
+                    prealloc_guess_[depth_ - 1] = parent->val.l.count;
+                    --depth_;
+                    continue;
+                }
+
+                if (*walk_ != ',')
+                {
+                    return fail("expected ',' or a closing bracket"sv);
+                }
+
+                ++walk_;
+                break;
+            }
+
+            if (node = addChild(); node == nullptr)
+            {
+                return false;
+            }
         }
-        else if ('a' <= *in && *in <= 'f')
+    }
+
+    // Add a child to the innermost container, reading its key if it's a dict
+    tr_variant* addChild()
+    {
+        auto* const parent = stack_[depth_ - 1];
+
+        if (tr_variantIsList(parent))
         {
-            val += *in - 'a' + 10U;
+            return tr_variantParserAdd(parent, TR_KEY_NONE, arena_);
         }
-        else if ('A' <= *in && *in <= 'F')
+
+        skipWhitespace();
+        auto key = std::string_view{};
+        if (walk_ == end_ || *walk_ != '"' || !parseString(key, keybuf_))
         {
-            val += *in - 'A' + 10U;
+            fail("expected a key"sv);
+            return nullptr;
         }
-        else
+
+        skipWhitespace();
+        if (walk_ == end_ || *walk_ != ':')
         {
-            return false;
+            fail("expected ':'"sv);
+            return nullptr;
         }
-    } while (++in != end);
 
-    *setme = val;
-    return true;
-}
+        ++walk_;
 
-static std::string_view extract_escaped_string(char const* in, size_t in_len, std::string& buf)
-{
-    char const* const in_end = in + in_len;
-
-    buf.clear();
+        // most keys are known ahead of time, so this doesn't allocate
+        return tr_variantParserAdd(parent, tr_quark_new(key), arena_);
+    }
 
-    while (in < in_end)
+    bool parseScalar(tr_variant* node)
     {
-        bool unescaped = false;
-
-        if (*in == '\\' && in_end - in >= 2)
+        switch (*walk_)
         {
-            switch (in[1])
+        case '"':
             {
-            case 'b':
-                buf.push_back('\b');
-                in += 2;
-                unescaped = true;
-                break;
+                auto str = std::string_view{};
+                if (!parseString(str, strbuf_))
+                {
+                    return false;
+                }
 
-            case 'f':
-                buf.push_back('\f');
-                in += 2;
-                unescaped = true;
-                break;
+                // strings without escapes are views into the input
+                if (inplace_ && std::data(str) != std::data(strbuf_))
+                {
+                    tr_variantInitStrView(node, str);
+                }
+                else
+                {
+                    tr_variantParserInitStr(node, str, arena_);
+                }
 
-            case 'n':
-                buf.push_back('\n');
-                in += 2;
-                unescaped = true;
-                break;
+                return true;
+            }
 
-            case 'r':
-                buf.push_back('\r');
-                in += 2;
-                unescaped = true;
-                break;
+        case 't':
+            tr_variantInitBool(node, true);
+            return parseLiteral("true"sv);
 
-            case 't':
-                buf.push_back('\t');
-                in += 2;
-                unescaped = true;
-                break;
+        case 'f':
+            tr_variantInitBool(node, false);
+            return parseLiteral("false"sv);
 
-            case '/':
-                buf.push_back('/');
-                in += 2;
-                unescaped = true;
-                break;
+        case 'n':
+            tr_variantInitQuark(node, TR_KEY_NONE);
+            return parseLiteral("null"sv);
 
-            case '"':
-                buf.push_back('"');
-                in += 2;
-                unescaped = true;
-                break;
+        default:
+            return parseNumber(node);
+        }
+    }
 
-            case '\\':
-                buf.push_back('\\');
-                in += 2;
-                unescaped = true;
-                break;
+    bool parseLiteral(std::string_view literal)
+    {
+        if (static_cast<size_t>(end_ - walk_) < std::size(literal) || std::string_view{ walk_, std::size(literal) } != literal)
+        {
+            return fail("expected a value"sv);
+        }
 
-            case 'u':
-                if (in_end - in >= 6)
-                {
-                    unsigned int val = 0;
+        walk_ += std::size(literal);
+        return true;
+    }
 
-                    if (decode_hex_string(in, &val))
-                    {
-                        try
-                        {
-                            auto buf8 = std::array<char, 8>{};
-                            auto const it = utf8::append(val, std::data(buf8));
-                            buf.append(std::data(buf8), it - std::data(buf8));
-                        }
-                        catch (utf8::exception const&) // invalid codepoint
-                        {
-                            buf.push_back('?');
-                        }
-                        unescaped = true;
-                        in += 6;
-                        break;
-                    }
-                }
+    bool parseNumber(tr_variant* node)
+    {
+        auto const* const begin = walk_;
+        auto const skip_digits = [this]()
+        {
+            auto const* const digits_begin = walk_;
+            while (walk_ != end_ && '0' <= *walk_ && *walk_ <= '9')
+            {
+                ++walk_;
             }
-        }
+            return walk_ != digits_begin;
+        };
 
-        if (!unescaped)
+        auto const negative = *walk_ == '-';
+        if (negative)
         {
-            buf.push_back(*in);
-            ++in;
+            ++walk_;
         }
-    }
 
-    return buf;
-}
+        auto const* const int_begin = walk_;
+        if (!skip_digits())
+        {
+            return fail("expected a value"sv);
+        }
 
-static std::pair<std::string_view, bool> extract_string(jsonsl_t jsn, struct jsonsl_state_st* state, std::string& buf)
-{
-    // figure out where the string is
-    char const* in_begin = jsn->base + state->pos_begin;
-    if (*in_begin == '"')
-    {
-        in_begin++;
-    }
+        auto const* const int_end = walk_;
+        auto is_real = false;
 
-    char const* const in_end = jsn->base + state->pos_cur;
-    size_t const in_len = in_end - in_begin;
-    if (memchr(in_begin, '\\', in_len) == nullptr)
-    {
-        /* it's not escaped */
-        return std::make_pair(std::string_view{ in_begin, in_len }, true);
-    }
+        if (walk_ != end_ && *walk_ == '.')
+        {
+            ++walk_;
+            is_real = true;
+            if (!skip_digits())
+            {
+                return fail("invalid number"sv);
+            }
+        }
 
-    return std::make_pair(extract_escaped_string(in_begin, in_len, buf), false);
-}
+        if (walk_ != end_ && (*walk_ == 'e' || *walk_ == 'E'))
+        {
+            ++walk_;
+            is_real = true;
+            if (walk_ != end_ && (*walk_ == '+' || *walk_ == '-'))
+            {
+                ++walk_;
+            }
 
-static void action_callback_POP(
-    jsonsl_t jsn,
-    jsonsl_action_t /*action*/,
-    struct jsonsl_state_st* state,
-    jsonsl_char_t const* /*buf*/)
-{
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
+            if (!skip_digits())
+            {
+                return fail("invalid number"sv);
+            }
+        }
 
-    if (state->type == JSONSL_T_STRING)
-    {
-        auto const [str, inplace] = extract_string(jsn, state, data->strbuf);
-        if (inplace && ((data->parse_opts & TR_VARIANT_PARSE_INPLACE) != 0))
+        if (is_real)
         {
-            tr_variantInitStrView(get_node(jsn), str);
+            auto const sv = std::string_view{ begin, static_cast<size_t>(walk_ - begin) };
+            tr_variantInitReal(node, tr_parseNum<double>(sv).value_or(0.0));
+            return true;
         }
-        else
+
+        // out-of-range values are clamped, as strtoll() would
+        static auto constexpr Max = uint64_t{ std::numeric_limits<int64_t>::max() };
+        auto const limit = negative ? Max + 1U : Max;
+        auto val = uint64_t{};
+        for (auto const* it = int_begin; it != int_end; ++it)
         {
-            tr_variantInitStr(get_node(jsn), str);
+            auto const digit = static_cast<uint64_t>(*it - '0');
+            if (val > (limit - digit) / 10U)
+            {
+                val = limit;
+                break;
+            }
+
+            val = val * 10U + digit;
         }
-        data->has_content = true;
-    }
-    else if (state->type == JSONSL_T_HKEY)
-    {
-        data->has_content = true;
-        auto const [key, inplace] = extract_string(jsn, state, data->keybuf);
-        data->key = key;
+
+        tr_variantInitInt(node, negative ? static_cast<int64_t>(0U - val) : static_cast<int64_t>(val));
+        return true;
     }
-    else if (state->type == JSONSL_T_LIST || state->type == JSONSL_T_OBJECT)
+
+    // On success, `setme` is either a view into the input or into `buf`
+    bool parseString(std::string_view& setme, std::string& buf)
     {
-        auto const depth = std::size(data->stack);
-        auto const* const v = data->stack.back();
-        data->stack.pop_back();
-        if (depth < MaxDepth)
+        TR_ASSERT(*walk_ == '"');
+        auto const* const begin = ++walk_;
+
+        walk_ = findQuoteOrBackslash(walk_, end_);
+        if (walk_ == end_)
         {
-            data->preallocGuess[depth] = v->val.l.count;
+            return fail("unterminated string"sv);
         }
+
+        if (*walk_ == '"')
+        {
+            setme = std::string_view{ begin, static_cast<size_t>(walk_ - begin) };
+            ++walk_;
+            return true;
+        }
+
+        buf.assign(begin, walk_);
+
+        while (walk_ != end_)
+        {
+            if (*walk_ == '"')
+            {
+                ++walk_;
+                setme = buf;
+                return true;
+            }
+
+            // *walk_ is a backslash
+            unescape(buf);
+
+            auto const* const run_begin = walk_;
+            walk_ = findQuoteOrBackslash(walk_, end_);
+            buf.append(run_begin, walk_);
+        }
+
+        return fail("unterminated string"sv);
     }
-    else if (state->type == JSONSL_T_SPECIAL)
+
+    // Unescape the escape sequence at walk_ into `buf`.
+    // Malformed escapes are kept verbatim rather than rejected.
+    void unescape(std::string& buf)
     {
-        if ((state->special_flags & JSONSL_SPECIALf_NUMNOINT) != 0)
+        TR_ASSERT(*walk_ == '\\');
+
+        if (end_ - walk_ < 2)
         {
-            auto sv = std::string_view{ jsn->base + state->pos_begin, jsn->pos - state->pos_begin };
-            tr_variantInitReal(get_node(jsn), tr_parseNum<double>(sv).value_or(0.0));
+            buf.push_back(*walk_++);
+            return;
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_NUMERIC) != 0)
+
+        auto const ch = walk_[1];
+        auto unescaped = char{};
+
+        switch (ch)
         {
-            char const* begin = jsn->base + state->pos_begin;
-            data->has_content = true;
-            tr_variantInitInt(get_node(jsn), std::strtoll(begin, nullptr, 10));
+        case 'b':
+            unescaped = '\b';
+            break;
+
+        case 'f':
+            unescaped = '\f';
+            break;
+
+        case 'n':
+            unescaped = '\n';
+            break;
+
+        case 'r':
+            unescaped = '\r';
+            break;
+
+        case 't':
+            unescaped = '\t';
+            break;
+
+        case '/':
+        case '"':
+        case '\\':
+            unescaped = ch;
+            break;
+
+        case 'u':
+            if (auto codepoint = parseHex4(walk_); codepoint >= 0)
+            {
+                walk_ += 6;
+
+                // a utf-16 surrogate pair
+                if (0xD800 <= codepoint && codepoint <= 0xDBFF)
+                {
+                    if (auto const low = parseHex4(walk_); 0xDC00 <= low && low <= 0xDFFF)
+                    {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        walk_ += 6;
+                    }
+                }
+
+                try
+                {
+                    auto buf8 = std::array<char, 8>{};
+                    auto const* const it = utf8::append(static_cast<uint32_t>(codepoint), std::data(buf8));
+                    buf.append(std::data(buf8), it - std::data(buf8));
+                }
+                catch (utf8::exception const&) // invalid codepoint
+                {
+                    buf.push_back('?');
+                }
+
+                return;
+            }
+            break;
+
+        default:
+            break;
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_BOOLEAN) != 0)
+
+        if (unescaped != '\0')
         {
-            bool const b = (state->special_flags & JSONSL_SPECIALf_TRUE) != 0;
-            data->has_content = true;
-            tr_variantInitBool(get_node(jsn), b);
+            buf.push_back(unescaped);
+            walk_ += 2;
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_NULL) != 0)
+        else
         {
-            data->has_content = true;
-            tr_variantInitQuark(get_node(jsn), TR_KEY_NONE);
+            buf.push_back(*walk_++);
         }
     }
-}
 
-bool tr_variantParseJson(tr_variant& setme, int parse_opts, std::string_view json, char const** setme_end, tr_error** error)
-{
-    TR_ASSERT((parse_opts & TR_VARIANT_PARSE_JSON) != 0);
+    // Returns the value of the `\uXXXX` escape at `in`, or -1
+    [[nodiscard]] int parseHex4(char const* in) const
+    {
+        if (end_ - in < 6 || in[0] != '\\' || in[1] != 'u')
+        {
+            return -1;
+        }
+
+        auto val = 0;
+        for (auto const* it = in + 2; it != in + 6; ++it)
+        {
+            auto const nibble = hexValue(*it);
+            if (nibble < 0)
+            {
+                return -1;
+            }
+
+            val = (val << 4) | nibble;
+        }
 
-    auto data = json_wrapper_data{};
+        return val;
+    }
 
-    jsonsl_t jsn = jsonsl_new(MaxDepth);
-    jsn->action_callback_PUSH = action_callback_PUSH;
-    jsn->action_callback_POP = action_callback_POP;
-    jsn->error_callback = error_callback;
-    jsn->data = &data;
-    jsonsl_enable_all_callbacks(jsn);
+    char const* const begin_;
+    char const* walk_;
+    char const* const end_;
+    tr_variant_arena* const arena_;
+    bool const inplace_;
 
-    data.error = nullptr;
-    data.size = std::size(json);
-    data.has_content = false;
-    data.key = ""sv;
-    data.parse_opts = parse_opts;
-    data.preallocGuess = {};
-    data.stack = {};
-    data.top = &setme;
+    std::string_view err_;
+    std::string keybuf_;
+    std::string strbuf_;
 
-    /* parse it */
-    jsonsl_feed(jsn, static_cast<jsonsl_char_t const*>(std::data(json)), std::size(json));
+    size_t depth_ = 0;
+    std::array<tr_variant*, MaxDepth> stack_ = {};
 
-    /* EINVAL if there was no content */
-    if (data.error == nullptr && !data.has_content)
-    {
-        tr_error_set(&data.error, EINVAL, "No content");
-    }
+    /* A very common pattern is for a container's children to be similar,
+     * e.g. they may all be objects with the same set of keys. So when
+     * a container is closed, remember its size to use as a preallocation
+     * heuristic for the next container at that depth. */
+    std::array<size_t, MaxDepth> prealloc_guess_ = {};
+};
+
+} // namespace parse_helpers
+
+bool tr_variantParseJson(
+    tr_variant& setme,
+    int parse_opts,
+    std::string_view json,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena)
+{
+    TR_ASSERT((parse_opts & TR_VARIANT_PARSE_JSON) != 0);
+
+    auto parser = parse_helpers::JsonParser{ json, parse_opts, arena };
+    auto const success = parser.parse(setme, error);
 
-    /* maybe set the end ptr */
     if (setme_end != nullptr)
     {
-        *setme_end = std::data(json) + jsn->pos;
+        *setme_end = parser.pos();
     }
 
-    /* cleanup */
-    auto const success = data.error == nullptr;
-    if (data.error != nullptr)
-    {
-        tr_error_propagate(error, &data.error);
-    }
-    jsonsl_destroy(jsn);
     return success;
 }
 
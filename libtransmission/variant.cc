@@ -4,7 +4,9 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::sort
+#include <cstdint>
 #include <cstring>
+#include <memory>
 #include <stack>
 #include <string>
 #include <string_view>
@@ -129,19 +131,188 @@ static constexpr char const* getStr(tr_variant const* v)
     return tr_variant_string_get_string(&v->val.s);
 }
 
-static constexpr int dictIndexOf(tr_variant const* dict, tr_quark const key)
+/***
+****  Arena
+***/
+
+void* tr_variant_arena::allocate(size_t size, size_t alignment)
+{
+    void* ptr = pos_;
+    auto space = static_cast<size_t>(end_ - pos_);
+
+    if (pos_ == nullptr || std::align(alignment, size, ptr, space) == nullptr)
+    {
+        auto const block_size = std::max(block_size_, size + alignment);
+        blocks_.emplace_back(new std::byte[block_size]);
+        pos_ = blocks_.back().get();
+        end_ = pos_ + block_size;
+
+        ptr = pos_;
+        space = block_size;
+        std::align(alignment, size, ptr, space);
+    }
+
+    last_ = static_cast<std::byte*>(ptr);
+    pos_ = last_ + size;
+    size_ += size;
+    return ptr;
+}
+
+void* tr_variant_arena::reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment)
+{
+    // if `ptr` is the most recent allocation and there's room, grow it in place
+    if (ptr != nullptr && ptr == last_ && new_size <= static_cast<size_t>(end_ - last_))
+    {
+        pos_ = last_ + new_size;
+        size_ = size_ - old_size + new_size;
+        return ptr;
+    }
+
+    auto* const grown = allocate(new_size, alignment);
+
+    if (ptr != nullptr)
+    {
+        std::memcpy(grown, ptr, std::min(old_size, new_size));
+    }
+
+    return grown;
+}
+
+/***
+****  Dict index
+***/
+
+// Dicts with more children than this get a hash index of their keys.
+// Smaller dicts are searched linearly, which is just as fast for them.
+static auto constexpr DictIndexThreshold = size_t{ 16U };
+
+struct tr_variant_index
+{
+    // Each slot holds the position + 1 of the first child with a given key,
+    // or 0 if the slot is empty. Collisions are resolved by linear probing.
+    std::vector<uint32_t> slots;
+
+    size_t shift = 0;
+
+    [[nodiscard]] constexpr size_t home(tr_quark const key) const noexcept
+    {
+        // fibonacci hashing; quarks are small, dense integers
+        return static_cast<size_t>((uint64_t{ key } * UINT64_C(0x9E3779B97F4A7C15)) >> shift);
+    }
+
+    [[nodiscard]] size_t next(size_t slot) const noexcept
+    {
+        return (slot + 1U) & (std::size(slots) - 1U);
+    }
+};
+
+static void dictIndexInsert(tr_variant* dict, size_t pos)
+{
+    auto& index = *dict->val.l.index;
+    auto const* const vals = dict->val.l.vals;
+    auto const key = vals[pos].key;
+
+    for (auto i = index.home(key);; i = index.next(i))
+    {
+        auto& slot = index.slots[i];
+
+        if (slot == 0U)
+        {
+            slot = static_cast<uint32_t>(pos + 1U);
+            return;
+        }
+
+        // keep the first child with this key, the same one a linear search finds
+        if (vals[slot - 1U].key == key)
+        {
+            return;
+        }
+    }
+}
+
+static void dictIndexRebuild(tr_variant* dict)
 {
-    if (tr_variantIsDict(dict))
+    auto const count = dict->val.l.count;
+    auto*& index = dict->val.l.index;
+
+    if (count <= DictIndexThreshold)
+    {
+        delete index;
+        index = nullptr;
+        return;
+    }
+
+    // keep the load factor at or below 50%
+    auto n_bits = size_t{ 5U };
+    while ((size_t{ 1U } << n_bits) < count * 2U)
+    {
+        ++n_bits;
+    }
+
+    if (index == nullptr)
+    {
+        index = new tr_variant_index{};
+    }
+
+    index->slots.assign(size_t{ 1U } << n_bits, 0U);
+    index->shift = 64U - n_bits;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        dictIndexInsert(dict, i);
+    }
+}
+
+// Update `dict`'s index after a child has been appended to it
+static void dictIndexAppend(tr_variant* dict)
+{
+    auto const count = dict->val.l.count;
+
+    if (auto const* const index = dict->val.l.index; index != nullptr && count * 2U <= std::size(index->slots))
+    {
+        dictIndexInsert(dict, count - 1U);
+    }
+    else if (count > DictIndexThreshold)
+    {
+        dictIndexRebuild(dict);
+    }
+}
+
+static int dictIndexOf(tr_variant const* dict, tr_quark const key)
+{
+    if (!tr_variantIsDict(dict))
+    {
+        return -1;
+    }
+
+    auto const* const vals = dict->val.l.vals;
+
+    if (auto const* const index = dict->val.l.index; index != nullptr)
     {
-        for (size_t i = 0; i < dict->val.l.count; ++i)
+        for (auto i = index->home(key);; i = index->next(i))
         {
-            if (dict->val.l.vals[i].key == key)
+            auto const slot = index->slots[i];
+
+            if (slot == 0U)
+            {
+                return -1;
+            }
+
+            if (vals[slot - 1U].key == key)
             {
-                return (int)i;
+                return static_cast<int>(slot - 1U);
             }
         }
     }
 
+    for (size_t i = 0; i < dict->val.l.count; ++i)
+    {
+        if (vals[i].key == key)
+        {
+            return (int)i;
+        }
+    }
+
     return -1;
 }
 
@@ -389,7 +560,7 @@ void tr_variantInitList(tr_variant* initme, size_t reserve_count)
     tr_variantListReserve(initme, reserve_count);
 }
 
-static tr_variant* containerReserve(tr_variant* v, size_t count)
+static tr_variant* containerReserve(tr_variant* v, size_t count, tr_variant_arena* arena = nullptr)
 {
     TR_ASSERT(tr_variantIsContainer(v));
 
@@ -403,16 +574,65 @@ static tr_variant* containerReserve(tr_variant* v, size_t count)
             n *= 2U;
         }
 
-        auto* vals = new tr_variant[n];
-        std::copy_n(v->val.l.vals, v->val.l.count, vals);
-        delete[] v->val.l.vals;
+        auto* const old_vals = v->val.l.vals;
+        auto const old_count = v->val.l.count;
+        tr_variant* vals = nullptr;
+
+        if (arena != nullptr)
+        {
+            if (v->in_arena)
+            {
+                auto* const mem = arena->reallocate(
+                    old_vals,
+                    sizeof(tr_variant) * v->val.l.alloc,
+                    sizeof(tr_variant) * n,
+                    alignof(tr_variant));
+                vals = static_cast<tr_variant*>(mem);
+            }
+            else
+            {
+                vals = static_cast<tr_variant*>(arena->allocate(sizeof(tr_variant) * n, alignof(tr_variant)));
+                std::uninitialized_copy_n(old_vals, old_count, vals);
+                delete[] old_vals;
+            }
+
+            std::uninitialized_default_construct(vals + old_count, vals + n);
+        }
+        else
+        {
+            vals = new tr_variant[n];
+            std::copy_n(old_vals, old_count, vals);
+
+            // arena memory is released along with the arena
+            if (!v->in_arena)
+            {
+                delete[] old_vals;
+            }
+        }
+
         v->val.l.vals = vals;
         v->val.l.alloc = n;
+        v->in_arena = arena != nullptr;
     }
 
     return v->val.l.vals + v->val.l.count;
 }
 
+static tr_variant* containerAdd(tr_variant* container, tr_quark const key, tr_variant_arena* arena = nullptr)
+{
+    tr_variant* child = containerReserve(container, 1, arena);
+    ++container->val.l.count;
+    child->key = key;
+    tr_variantInit(child, TR_VARIANT_TYPE_INT);
+
+    if (tr_variantIsDict(container))
+    {
+        dictIndexAppend(container);
+    }
+
+    return child;
+}
+
 void tr_variantListReserve(tr_variant* list, size_t count)
 {
     TR_ASSERT(tr_variantIsList(list));
@@ -437,12 +657,7 @@ tr_variant* tr_variantListAdd(tr_variant* list)
 {
     TR_ASSERT(tr_variantIsList(list));
 
-    tr_variant* child = containerReserve(list, 1);
-    ++list->val.l.count;
-    child->key = 0;
-    tr_variantInit(child, TR_VARIANT_TYPE_INT);
-
-    return child;
+    return containerAdd(list, 0);
 }
 
 tr_variant* tr_variantListAddInt(tr_variant* list, int64_t value)
@@ -512,12 +727,7 @@ tr_variant* tr_variantDictAdd(tr_variant* dict, tr_quark const key)
 {
     TR_ASSERT(tr_variantIsDict(dict));
 
-    tr_variant* val = containerReserve(dict, 1);
-    ++dict->val.l.count;
-    val->key = key;
-    tr_variantInit(val, TR_VARIANT_TYPE_INT);
-
-    return val;
+    return containerAdd(dict, key);
 }
 
 static tr_variant* dictFindOrAdd(tr_variant* dict, tr_quark const key, int type)
@@ -635,6 +845,12 @@ bool tr_variantDictRemove(tr_variant* dict, tr_quark const key)
 
         --dict->val.l.count;
 
+        // removals are rare enough that it's simplest to reindex
+        if (dict->val.l.index != nullptr)
+        {
+            dictIndexRebuild(dict);
+        }
+
         removed = true;
     }
 
@@ -887,7 +1103,12 @@ static void freeStringFunc(tr_variant const* v, void* /*user_data*/)
 
 static void freeContainerEndFunc(tr_variant const* v, void* /*user_data*/)
 {
-    delete[] v->val.l.vals;
+    delete v->val.l.index;
+
+    if (!v->in_arena)
+    {
+        delete[] v->val.l.vals;
+    }
 }
 
 static VariantWalkFuncs constexpr FreeWalkFuncs = {
@@ -1109,15 +1330,56 @@ int tr_variantToFile(tr_variant const* v, tr_variant_fmt fmt, std::string_view f
 ****
 ***/
 
-bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char const** setme_end, tr_error** error)
+tr_variant* tr_variantParserAdd(tr_variant* parent, tr_quark key, tr_variant_arena* arena)
+{
+    TR_ASSERT(tr_variantIsContainer(parent));
+
+    return containerAdd(parent, key, arena);
+}
+
+void tr_variantParserInitStr(tr_variant* initme, std::string_view str, tr_variant_arena* arena)
+{
+    auto const len = std::size(str);
+
+    // short strings are stored inline anyway
+    if (arena == nullptr || len < sizeof(initme->val.s.str.buf))
+    {
+        tr_variantInitStr(initme, str);
+        return;
+    }
+
+    auto* const buf = static_cast<char*>(arena->allocate(len + 1U, alignof(char)));
+    std::copy_n(std::data(str), len, buf);
+    buf[len] = '\0';
+    tr_variantInitStrView(initme, { buf, len });
+}
+
+void tr_variantParserInitContainer(tr_variant* initme, char type, size_t reserve_count, tr_variant_arena* arena)
+{
+    tr_variantInit(initme, type);
+
+    if (reserve_count > 0U)
+    {
+        containerReserve(initme, reserve_count, arena);
+    }
+}
+
+static bool variantFromBuf(
+    tr_variant* setme,
+    int opts,
+    std::string_view buf,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena)
 {
     // supported formats: benc, json
     TR_ASSERT((opts & (TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_JSON)) != 0);
 
     *setme = {};
 
-    auto const success = ((opts & TR_VARIANT_PARSE_BENC) != 0) ? tr_variantParseBenc(*setme, opts, buf, setme_end, error) :
-                                                                 tr_variantParseJson(*setme, opts, buf, setme_end, error);
+    auto const success = ((opts & TR_VARIANT_PARSE_BENC) != 0) ?
+        tr_variantParseBenc(*setme, opts, buf, setme_end, error, arena) :
+        tr_variantParseJson(*setme, opts, buf, setme_end, error, arena);
 
     if (!success)
     {
@@ -1127,6 +1389,22 @@ bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char c
     return success;
 }
 
+bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char const** setme_end, tr_error** error)
+{
+    return variantFromBuf(setme, opts, buf, setme_end, error, nullptr);
+}
+
+bool tr_variantFromBuf(
+    tr_variant* setme,
+    tr_variant_arena& arena,
+    int opts,
+    std::string_view buf,
+    char const** setme_end,
+    tr_error** error)
+{
+    return variantFromBuf(setme, opts, buf, setme_end, error, &arena);
+}
+
 bool tr_variantFromFile(tr_variant* setme, tr_variant_parse_opts opts, std::string_view filename, tr_error** error)
 {
     // can't do inplace when this function is allocating & freeing the memory...
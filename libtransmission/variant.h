@@ -5,14 +5,17 @@
 
 #pragma once
 
-#include <cstddef> // size_t
+#include <cstddef> // size_t, std::byte, std::max_align_t
 #include <cstdint> // int64_t
+#include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "quark.h"
 
 struct tr_error;
+struct tr_variant_index;
 
 /**
  * @addtogroup tr_variant Variant
@@ -68,6 +71,9 @@ struct tr_variant
 {
     char type = '\0';
 
+    // true if this container's children are owned by a tr_variant_arena
+    bool in_arena = false;
+
     tr_quark key = TR_KEY_NONE;
 
     union
@@ -85,6 +91,9 @@ struct tr_variant
             size_t alloc;
             size_t count;
             struct tr_variant* vals;
+
+            // dicts with many children keep a hash index of their keys
+            struct tr_variant_index* index;
         } l;
     } val = {};
 };
@@ -99,6 +108,55 @@ struct tr_variant
  */
 void tr_variantClear(tr_variant*);
 
+/**
+ * @brief A bump allocator for short-lived parsed variants.
+ *
+ * Parsing a document into an arena -- e.g. an RPC request or a .resume
+ * file -- takes its containers and long strings from a few large blocks
+ * instead of making a heap allocation for each one, and releases them
+ * all at once when the arena is destroyed.
+ *
+ * The arena must outlive the variants that are parsed into it.
+ * It's still fine to modify them or to call `tr_variantClear()`;
+ * anything added after parsing is allocated on the heap as usual.
+ */
+class tr_variant_arena
+{
+public:
+    static auto constexpr DefaultBlockSize = size_t{ 16U * 1024U };
+
+    explicit tr_variant_arena(size_t block_size = DefaultBlockSize)
+        : block_size_{ block_size }
+    {
+    }
+
+    tr_variant_arena(tr_variant_arena&&) = delete;
+    tr_variant_arena(tr_variant_arena const&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena&&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena const&) = delete;
+    ~tr_variant_arena() = default;
+
+    [[nodiscard]] void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Like allocate(), but grows `ptr` in place if it was the most recent allocation.
+    // The first `old_size` bytes are preserved.
+    [[nodiscard]] void* reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment = alignof(std::max_align_t));
+
+    // Total number of bytes handed out
+    [[nodiscard]] constexpr size_t size() const noexcept
+    {
+        return size_;
+    }
+
+private:
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    size_t const block_size_;
+    std::byte* pos_ = nullptr;
+    std::byte* end_ = nullptr;
+    std::byte* last_ = nullptr;
+    size_t size_ = 0;
+};
+
 /***
 ****  Serialization / Deserialization
 ***/
@@ -150,6 +208,36 @@ bool tr_variantFromBuf(
         error);
 }
 
+/**
+ * @brief Parse `buf` into `setme`, taking memory from `arena`.
+ * @see tr_variant_arena
+ */
+bool tr_variantFromBuf(
+    tr_variant* setme,
+    tr_variant_arena& arena,
+    int variant_parse_opts,
+    std::string_view buf,
+    char const** setme_end = nullptr,
+    tr_error** error = nullptr);
+
+template<typename T>
+bool tr_variantFromBuf(
+    tr_variant* setme,
+    tr_variant_arena& arena,
+    int variant_parse_opts,
+    T const& buf,
+    char const** setme_end = nullptr,
+    tr_error** error = nullptr)
+{
+    return tr_variantFromBuf(
+        setme,
+        arena,
+        variant_parse_opts,
+        std::string_view{ std::data(buf), static_cast<size_t>(std::size(buf)) },
+        setme_end,
+        error);
+}
+
 [[nodiscard]] constexpr bool tr_variantIsType(tr_variant const* b, int type)
 {
     return b != nullptr && b->type == type;
@@ -179,6 +267,7 @@ constexpr void tr_variantInit(tr_variant* initme, char type)
 {
     initme->val = {};
     initme->type = type;
+    initme->in_arena = false;
 }
 
 constexpr void tr_variantInitStrView(tr_variant* initme, std::string_view in)
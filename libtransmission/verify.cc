@@ -17,20 +17,15 @@
 
 #include "completion.h"
 #include "crypto-utils.h"
-#include "file.h"
+#include "disk-scheduler.h"
 #include "log.h"
+#include "session.h"
+#include "storage.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "utils.h" // tr_time(), tr_wait_msec()
 #include "verify.h"
 
-namespace
-{
-
-auto constexpr MsecToSleepPerSecondDuringVerify = int{ 100 };
-
-}
-
 int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
 {
     // higher priority comes before lower priority
@@ -60,106 +55,64 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& s
 {
     auto const begin = tr_time();
 
-    tr_sys_file_t fd = TR_BAD_SYS_FILE;
-    uint64_t file_pos = 0;
     bool changed = false;
-    bool had_piece = false;
-    time_t last_slept_at = 0;
-    uint32_t piece_pos = 0;
-    tr_file_index_t file_index = 0;
-    tr_file_index_t prev_file_index = ~file_index;
-    tr_piece_index_t piece = 0;
-    auto buffer = std::vector<std::byte>(1024 * 256);
+    auto buffer = std::vector<uint8_t>(1024 * 256);
     auto sha = tr_sha1::create();
+    auto const reader = tor->storage().verifyReader();
 
-    tr_logAddDebugTor(tor, "verifying torrent...");
-
-    while (!stop_flag && piece < tor->pieceCount())
+    // verifying is Background I/O, so it yields to seeding and downloading on the same disk
+    auto& scheduler = tor->session->diskScheduler();
+    auto const device = scheduler.deviceOf(tor->currentDir().sv());
+    auto const cancelled = [&stop_flag]()
     {
-        auto const file_length = tor->fileSize(file_index);
-
-        /* if we're starting a new piece... */
-        if (piece_pos == 0)
-        {
-            had_piece = tor->hasPiece(piece);
-        }
-
-        /* if we're starting a new file... */
-        if (file_pos == 0 && fd == TR_BAD_SYS_FILE && file_index != prev_file_index)
-        {
-            auto const found = tor->findFile(file_index);
-            fd = !found ? TR_BAD_SYS_FILE : tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
-            prev_file_index = file_index;
-        }
-
-        /* figure out how much we can read this pass */
-        uint64_t left_in_piece = tor->pieceSize(piece) - piece_pos;
-        uint64_t left_in_file = file_length - file_pos;
-        uint64_t bytes_this_pass = std::min(left_in_file, left_in_piece);
-        bytes_this_pass = std::min(bytes_this_pass, uint64_t(std::size(buffer)));
+        return stop_flag.load();
+    };
 
-        /* read a bit */
-        if (fd != TR_BAD_SYS_FILE)
-        {
-            auto num_read = uint64_t{};
-            if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
-            {
-                bytes_this_pass = num_read;
-                sha->add(std::data(buffer), bytes_this_pass);
-                tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
-            }
-        }
+    tr_logAddDebugTor(tor, "verifying torrent...");
 
-        /* move our offsets */
-        left_in_piece -= bytes_this_pass;
-        left_in_file -= bytes_this_pass;
-        piece_pos += bytes_this_pass;
-        file_pos += bytes_this_pass;
+    for (tr_piece_index_t piece = 0, n_pieces = tor->pieceCount(); !stop_flag && piece < n_pieces; ++piece)
+    {
+        auto const had_piece = tor->hasPiece(piece);
 
-        /* if we're finishing a piece... */
-        if (left_in_piece == 0)
+        // hash the piece, giving up if any of its data is missing
+        auto loc = tor->pieceLoc(piece);
+        auto left_in_piece = tor->pieceSize(piece);
+        auto readable = true;
+        while (readable && left_in_piece != 0)
         {
-            if (auto const has_piece = sha->finish() == tor->pieceHash(piece); has_piece || had_piece)
+            auto const len = std::min(left_in_piece, static_cast<uint32_t>(std::size(buffer)));
+            auto const ticket = scheduler.wait(device, tr_disk_scheduler::IoClass::Background, cancelled);
+            if (!ticket)
             {
-                tor->setHasPiece(piece, has_piece);
-                changed |= has_piece != had_piece;
+                break;
             }
 
-            tor->checked_pieces_.set(piece, true);
-            tor->markChanged();
-
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (auto const now = tr_time(); last_slept_at != now)
+            readable = reader->read(loc, len, std::data(buffer)) == 0;
+            if (readable)
             {
-                last_slept_at = now;
-                tr_wait_msec(MsecToSleepPerSecondDuringVerify);
+                sha->add(std::data(buffer), len);
             }
 
-            sha->clear();
-            ++piece;
-            tor->setVerifyProgress(piece / float(tor->pieceCount()));
-            piece_pos = 0;
+            loc = tor->byteLoc(loc.byte + len);
+            left_in_piece -= len;
         }
 
-        /* if we're finishing a file... */
-        if (left_in_file == 0)
+        if (stop_flag) // stopped partway through the piece
         {
-            if (fd != TR_BAD_SYS_FILE)
-            {
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
-            }
+            break;
+        }
 
-            ++file_index;
-            file_pos = 0;
+        if (auto const has_piece = readable && sha->finish() == tor->pieceHash(piece); has_piece || had_piece)
+        {
+            tor->setHasPiece(piece, has_piece);
+            changed |= has_piece != had_piece;
         }
-    }
 
-    /* cleanup */
-    if (fd != TR_BAD_SYS_FILE)
-    {
-        tr_sys_file_close(fd);
+        tor->checked_pieces_.set(piece, true);
+        tor->markChanged();
+
+        sha->clear();
+        tor->setVerifyProgress((piece + 1) / float(n_pieces));
     }
 
     /* stopwatch */
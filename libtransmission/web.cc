@@ -6,7 +6,6 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
-#include <condition_variable>
 #include <list>
 #include <map>
 #include <memory>
@@ -23,12 +22,15 @@
 
 #include <curl/curl.h>
 
+#include <event2/event.h>
+
 #include <fmt/core.h>
 #include <fmt/format.h>
 
 #include "crypto-utils.h"
 #include "log.h"
 #include "peer-io.h"
+#include "session-thread.h"
 #include "tr-assert.h"
 #include "utils-ev.h"
 #include "utils.h"
@@ -188,6 +190,14 @@ public:
             this->user_agent = *ua;
         }
 
+        // other threads wake the curl thread's event loop with event_active()
+        tr_session_thread::tr_evthread_init();
+        evbase_.reset(event_base_new());
+        wake_event_.reset(event_new(evbase_.get(), -1, 0, onWakeStatic, this));
+        curl_timer_.reset(evtimer_new(evbase_.get(), onCurlTimerStatic, this));
+        pause_timer_.reset(evtimer_new(evbase_.get(), onPauseTimerStatic, this));
+        deadline_timer_.reset(evtimer_new(evbase_.get(), onWakeStatic, this));
+
         auto const lock = std::unique_lock{ tasks_mutex_ };
         curl_thread = std::make_unique<std::thread>(&Impl::curlThreadFunc, this);
     }
@@ -200,14 +210,21 @@ public:
     ~Impl()
     {
         deadline_ = tr_time();
-        queued_tasks_cv_.notify_one();
+        wake();
         curl_thread->join();
+
+        // free the events before the event base that they belong to
+        deadline_timer_.reset();
+        pause_timer_.reset();
+        curl_timer_.reset();
+        wake_event_.reset();
+        evbase_.reset();
     }
 
     void startShutdown(std::chrono::milliseconds deadline)
     {
         deadline_ = tr_time() + std::chrono::duration_cast<std::chrono::seconds>(deadline).count();
-        queued_tasks_cv_.notify_one();
+        wake();
     }
 
     void fetch(FetchOptions&& options)
@@ -219,7 +236,7 @@ public:
 
         auto const lock = std::unique_lock{ tasks_mutex_ };
         queued_tasks_.emplace_back(*this, std::move(options));
-        queued_tasks_cv_.notify_one();
+        wake();
     }
 
     class Task
@@ -551,6 +568,13 @@ public:
             /* don't bother asking the server to compress webseed fragments */
             (void)curl_easy_setopt(e, CURLOPT_ENCODING, "identity");
             (void)curl_easy_setopt(e, CURLOPT_RANGE, range->c_str());
+
+#if LIBCURL_VERSION_NUM >= 0x072F00 // CURL_HTTP_VERSION_2TLS was added in 7.47.0
+            /* webseeds make many parallel requests to the same server,
+               so prefer to multiplex them over one HTTP/2 connection */
+            (void)curl_easy_setopt(e, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            (void)curl_easy_setopt(e, CURLOPT_PIPEWAIT, 1L);
+#endif
         }
     }
 
@@ -568,7 +592,7 @@ public:
 
         for (auto it = std::begin(paused); it != std::end(paused);)
         {
-            if (it->first + BandwidthPauseMsec < now)
+            if (it->first + BandwidthPauseMsec <= now)
             {
                 curl_easy_pause(it->second, CURLPAUSE_CONT);
                 it = paused.erase(it);
@@ -607,113 +631,240 @@ public:
         remove_task(task);
     }
 
-    // the thread started by Impl.curl_thread runs this function
-    void curlThreadFunc()
+    // Wake the curl thread's event loop so that it picks up new tasks
+    // or notices a shutdown deadline. Safe to call from any thread.
+    void wake()
     {
-        auto const multi = curl_helpers::multi_unique_ptr{ curl_multi_init() };
+        event_active(wake_event_.get(), 0, 0);
+    }
+
+    static void onWakeStatic(evutil_socket_t /*fd*/, short /*flags*/, void* vimpl)
+    {
+        static_cast<Impl*>(vimpl)->onWake();
+    }
 
-        auto repeats = unsigned{};
-        for (;;)
+    void onWake()
+    {
+        // add queued tasks
+        if (auto const lock = std::unique_lock{ tasks_mutex_ }; !std::empty(queued_tasks_))
         {
-            if (deadline_reached())
+            for (auto& task : queued_tasks_)
             {
-                while (!std::empty(running_tasks_))
-                {
-                    auto& task = running_tasks_.front();
-                    curl_multi_remove_handle(multi.get(), task.easy());
-                    timeout_task(task);
-                }
+                initEasy(task);
+                curl_multi_add_handle(multi(), task.easy());
             }
 
-            if (deadline_exists() && is_idle())
-            {
-                break;
-            }
+            running_tasks_.splice(std::end(running_tasks_), queued_tasks_);
+        }
 
-            if (auto lock = std::unique_lock{ tasks_mutex_ }; lock.owns_lock())
+        if (deadline_reached())
+        {
+            while (!std::empty(running_tasks_))
             {
-                // sleep until there's something to do
-                auto const stop_waiting = [this]()
-                {
-                    return !is_idle() || !deadline_exists();
-                };
-                if (!stop_waiting())
-                {
-                    queued_tasks_cv_.wait(lock, stop_waiting);
-                }
+                auto& task = running_tasks_.front();
+                curl_multi_remove_handle(multi(), task.easy());
+                timeout_task(task);
+            }
+        }
+        else if (deadline_exists())
+        {
+            // come back when the deadline is reached
+            auto tv = timeval{};
+            tv.tv_sec = std::max(deadline() - tr_time(), time_t{ 1 });
+            evtimer_add(deadline_timer_.get(), &tv);
+        }
 
-                // add queued tasks
-                if (!std::empty(queued_tasks_))
-                {
-                    for (auto& task : queued_tasks_)
-                    {
-                        initEasy(task);
-                        curl_multi_add_handle(multi.get(), task.easy());
-                    }
+        exitIfDone();
+    }
 
-                    running_tasks_.splice(std::end(running_tasks_), queued_tasks_);
-                }
-            }
+    void exitIfDone()
+    {
+        if (auto const lock = std::unique_lock{ tasks_mutex_ }; deadline_exists() && is_idle())
+        {
+            event_base_loopbreak(evbase_.get());
+        }
+    }
 
-            resumePausedTasks();
+    // curl tells us which sockets to watch and for what
+    static int onCurlSocket(CURL* /*easy*/, curl_socket_t fd, int what, void* vimpl, void* vevent)
+    {
+        auto* const impl = static_cast<Impl*>(vimpl);
+        auto* event = static_cast<struct event*>(vevent);
 
-            // Adapted from https://curl.se/libcurl/c/curl_multi_wait.html docs.
-            // 'numfds' being zero means either a timeout or no file descriptors to
-            // wait for. Try timeout on first occurrence, then assume no file
-            // descriptors and no file descriptors to wait for means wait for 100
-            // milliseconds.
-            auto numfds = int{};
-            curl_multi_wait(multi.get(), nullptr, 0, 1000, &numfds);
-            if (numfds == 0)
-            {
-                ++repeats;
-                if (repeats > 1U)
-                {
-                    tr_wait_msec(100);
-                }
-            }
-            else
+        if (what == CURL_POLL_REMOVE)
+        {
+            if (event != nullptr)
             {
-                repeats = 0;
+                event_free(event);
+                curl_multi_assign(impl->multi(), fd, nullptr);
             }
 
-            // nonblocking update of the tasks
-            auto n_running = int{};
-            curl_multi_perform(multi.get(), &n_running);
+            return 0;
+        }
+
+        auto flags = short{ EV_PERSIST };
+        if ((what & CURL_POLL_IN) != 0)
+        {
+            flags |= EV_READ;
+        }
+        if ((what & CURL_POLL_OUT) != 0)
+        {
+            flags |= EV_WRITE;
+        }
+
+        if (event == nullptr)
+        {
+            event = event_new(impl->evbase_.get(), fd, flags, onSocketReadyStatic, impl);
+            curl_multi_assign(impl->multi(), fd, event);
+        }
+        else
+        {
+            event_del(event);
+            event_assign(event, impl->evbase_.get(), fd, flags, onSocketReadyStatic, impl);
+        }
+
+        event_add(event, nullptr);
+        return 0;
+    }
+
+    // curl tells us when it next needs to be called for timeouts
+    static int onCurlTimer(CURLM* /*multi*/, long timeout_ms, void* vimpl)
+    {
+        auto* const timer = static_cast<Impl*>(vimpl)->curl_timer_.get();
+
+        if (timeout_ms < 0)
+        {
+            evtimer_del(timer);
+        }
+        else
+        {
+            auto tv = timeval{};
+            tv.tv_sec = timeout_ms / 1000;
+            tv.tv_usec = (timeout_ms % 1000) * 1000;
+            evtimer_add(timer, &tv);
+        }
+
+        return 0;
+    }
+
+    static void onSocketReadyStatic(evutil_socket_t fd, short flags, void* vimpl)
+    {
+        auto action = int{};
+        if ((flags & EV_READ) != 0)
+        {
+            action |= CURL_CSELECT_IN;
+        }
+        if ((flags & EV_WRITE) != 0)
+        {
+            action |= CURL_CSELECT_OUT;
+        }
+
+        static_cast<Impl*>(vimpl)->socketAction(fd, action);
+    }
+
+    static void onCurlTimerStatic(evutil_socket_t /*fd*/, short /*flags*/, void* vimpl)
+    {
+        static_cast<Impl*>(vimpl)->socketAction(CURL_SOCKET_TIMEOUT, 0);
+    }
 
-            // process any tasks that just finished
-            CURLMsg* msg = nullptr;
-            auto unused = int{};
-            while ((msg = curl_multi_info_read(multi.get(), &unused)) != nullptr)
+    static void onPauseTimerStatic(evutil_socket_t /*fd*/, short /*flags*/, void* vimpl)
+    {
+        auto* const impl = static_cast<Impl*>(vimpl);
+        impl->resumePausedTasks();
+        impl->schedulePauseTimer();
+    }
+
+    void schedulePauseTimer()
+    {
+        if (!std::empty(paused_easy_handles) && evtimer_pending(pause_timer_.get(), nullptr) == 0)
+        {
+            auto tv = timeval{};
+            tv.tv_usec = BandwidthPauseMsec * 1000;
+            evtimer_add(pause_timer_.get(), &tv);
+        }
+    }
+
+    void socketAction(curl_socket_t fd, int action)
+    {
+        auto n_running = int{};
+        curl_multi_socket_action(multi(), fd, action, &n_running);
+
+        processFinishedTasks();
+        schedulePauseTimer();
+        exitIfDone();
+    }
+
+    void processFinishedTasks()
+    {
+        CURLMsg* msg = nullptr;
+        auto unused = int{};
+        while ((msg = curl_multi_info_read(multi(), &unused)) != nullptr)
+        {
+            if (msg->msg == CURLMSG_DONE && msg->easy_handle != nullptr)
             {
-                if (msg->msg == CURLMSG_DONE && msg->easy_handle != nullptr)
-                {
-                    auto* const e = msg->easy_handle;
-
-                    Task* task = nullptr;
-                    curl_easy_getinfo(e, CURLINFO_PRIVATE, (void*)&task);
-
-                    auto req_bytes_sent = long{};
-                    auto total_time = double{};
-                    curl_easy_getinfo(e, CURLINFO_REQUEST_SIZE, &req_bytes_sent);
-                    curl_easy_getinfo(e, CURLINFO_TOTAL_TIME, &total_time);
-                    curl_easy_getinfo(e, CURLINFO_RESPONSE_CODE, &task->response.status);
-                    task->response.did_connect = task->response.status > 0 || req_bytes_sent > 0;
-                    task->response.did_timeout = task->response.status == 0 &&
-                        std::chrono::duration<double>(total_time) >= task->timeoutSecs();
-                    curl_multi_remove_handle(multi.get(), e);
-                    remove_task(*task);
-                }
+                auto* const e = msg->easy_handle;
+
+                Task* task = nullptr;
+                curl_easy_getinfo(e, CURLINFO_PRIVATE, (void*)&task);
+
+                auto req_bytes_sent = long{};
+                auto total_time = double{};
+                curl_easy_getinfo(e, CURLINFO_REQUEST_SIZE, &req_bytes_sent);
+                curl_easy_getinfo(e, CURLINFO_TOTAL_TIME, &total_time);
+                curl_easy_getinfo(e, CURLINFO_RESPONSE_CODE, &task->response.status);
+                task->response.did_connect = task->response.status > 0 || req_bytes_sent > 0;
+                task->response.did_timeout = task->response.status == 0 &&
+                    std::chrono::duration<double>(total_time) >= task->timeoutSecs();
+                curl_multi_remove_handle(multi(), e);
+                remove_task(*task);
             }
         }
     }
 
+    [[nodiscard]] CURLM* multi() const noexcept
+    {
+        return multi_.get();
+    }
+
+    // the thread started by Impl.curl_thread runs this function
+    void curlThreadFunc()
+    {
+        multi_.reset(curl_multi_init());
+
+        (void)curl_multi_setopt(multi(), CURLMOPT_SOCKETFUNCTION, onCurlSocket);
+        (void)curl_multi_setopt(multi(), CURLMOPT_SOCKETDATA, this);
+        (void)curl_multi_setopt(multi(), CURLMOPT_TIMERFUNCTION, onCurlTimer);
+        (void)curl_multi_setopt(multi(), CURLMOPT_TIMERDATA, this);
+
+#if LIBCURL_VERSION_NUM >= 0x072B00 // CURLPIPE_MULTIPLEX was added in 7.43.0
+        // let parallel requests to the same HTTP/2 server share a connection
+        (void)curl_multi_setopt(multi(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+        // pick up any tasks that were queued before the loop started
+        wake();
+
+        // Sleep until curl's sockets or timers or a wake() need attention.
+        // onWake() and socketAction() break out of the loop once we've
+        // been asked to shut down and have no tasks left.
+        event_base_loop(evbase_.get(), EVLOOP_NO_EXIT_ON_EMPTY);
+
+        multi_.reset();
+    }
+
     curl_helpers::shared_unique_ptr const curlsh_{ curl_share_init() };
 
     std::map<std::string /*host*/, std::stack<curl_helpers::easy_unique_ptr>, std::less<>> easy_pool_;
 
+    libtransmission::evhelpers::evbase_unique_ptr evbase_;
+    libtransmission::evhelpers::event_unique_ptr wake_event_;
+    libtransmission::evhelpers::event_unique_ptr curl_timer_;
+    libtransmission::evhelpers::event_unique_ptr pause_timer_;
+    libtransmission::evhelpers::event_unique_ptr deadline_timer_;
+
+    curl_helpers::multi_unique_ptr multi_;
+
     std::mutex tasks_mutex_;
-    std::condition_variable queued_tasks_cv_;
     std::list<Task> queued_tasks_;
     std::list<Task> running_tasks_;
 
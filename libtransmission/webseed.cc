@@ -44,8 +44,13 @@ private:
     libtransmission::evhelpers::evbuffer_unique_ptr const content_{ evbuffer_new() };
 
 public:
-    tr_webseed_task(tr_torrent* tor, tr_webseed* webseed_in, tr_block_span_t blocks_in)
+    tr_webseed_task(
+        tr_torrent* tor,
+        tr_webseed* webseed_in,
+        std::shared_ptr<libtransmission::WebseedLimiter> limiter_in,
+        tr_block_span_t blocks_in)
         : webseed{ webseed_in }
+        , limiter{ std::move(limiter_in) }
         , session{ tor->session }
         , blocks{ blocks_in }
         , end_byte{ tor->blockLoc(blocks.end - 1).byte + tor->blockSize(blocks.end - 1) }
@@ -55,6 +60,10 @@ public:
 
     tr_webseed* const webseed;
 
+    // held by the task so that a request which outlives its
+    // webseed is still counted against the host until it finishes
+    std::shared_ptr<libtransmission::WebseedLimiter> const limiter;
+
     [[nodiscard]] auto* content() const
     {
         return content_.get();
@@ -70,87 +79,6 @@ public:
     bool dead = false;
 };
 
-/**
- * Manages how many web tasks should be running at a time.
- *
- * - When all is well, allow multiple tasks running in parallel.
- * - If we get an error, throttle down to only one at a time
- *   until we get piece data.
- * - If we have too many errors in a row, put the peer in timeout
- *   and don't allow _any_ connections for awhile.
- */
-class ConnectionLimiter
-{
-public:
-    constexpr void taskStarted() noexcept
-    {
-        ++n_tasks;
-    }
-
-    void taskFinished(bool success)
-    {
-        if (!success)
-        {
-            taskFailed();
-        }
-
-        TR_ASSERT(n_tasks > 0);
-        --n_tasks;
-    }
-
-    constexpr void gotData() noexcept
-    {
-        TR_ASSERT(n_tasks > 0);
-        n_consecutive_failures = 0;
-        paused_until = 0;
-    }
-
-    [[nodiscard]] size_t slotsAvailable() const noexcept
-    {
-        if (isPaused())
-        {
-            return 0;
-        }
-
-        auto const max = maxConnections();
-        if (n_tasks >= max)
-        {
-            return 0;
-        }
-
-        return max - n_tasks;
-    }
-
-private:
-    [[nodiscard]] bool isPaused() const noexcept
-    {
-        return paused_until > tr_time();
-    }
-
-    [[nodiscard]] constexpr size_t maxConnections() const noexcept
-    {
-        return n_consecutive_failures > 0 ? 1 : MaxConnections;
-    }
-
-    void taskFailed()
-    {
-        TR_ASSERT(n_tasks > 0);
-
-        if (++n_consecutive_failures >= MaxConsecutiveFailures)
-        {
-            paused_until = tr_time() + TimeoutIntervalSecs;
-        }
-    }
-
-    static time_t constexpr TimeoutIntervalSecs = 120;
-    static size_t constexpr MaxConnections = 4;
-    static size_t constexpr MaxConsecutiveFailures = MaxConnections;
-
-    size_t n_tasks = 0;
-    size_t n_consecutive_failures = 0;
-    time_t paused_until = 0;
-};
-
 void task_request_next_chunk(tr_webseed_task* task);
 void onBufferGotData(evbuffer* /*buf*/, evbuffer_cb_info const* info, void* vtask);
 
@@ -163,6 +91,7 @@ public:
         , base_url{ url }
         , callback{ callback_in }
         , callback_data{ callback_data_in }
+        , limiter{ session->webseedLimiters().get(url) }
         , idle_timer_{ session->timerMaker().create([this]() { on_idle(this); }) }
         , have_{ tor->pieceCount() }
         , bandwidth_{ &tor->bandwidth_ }
@@ -249,7 +178,7 @@ public:
     {
         bandwidth_.notifyBandwidthConsumed(TR_DOWN, n_bytes, true, tr_time_msec());
         publish(tr_peer_event::GotPieceData(n_bytes));
-        connection_limiter.gotData();
+        limiter->gotData(n_bytes);
     }
 
     void publishRejection(tr_block_span_t block_span)
@@ -271,7 +200,7 @@ public:
 
         for (auto const *span = block_spans, *end = span + n_spans; span != end; ++span)
         {
-            auto* const task = new tr_webseed_task{ tor, this, *span };
+            auto* const task = new tr_webseed_task{ tor, this, limiter, *span };
             evbuffer_add_cb(task->content(), onBufferGotData, task);
             tasks.insert(task);
             task_request_next_chunk(task);
@@ -282,7 +211,7 @@ public:
 
     [[nodiscard]] RequestLimit canRequest() const noexcept override
     {
-        auto const n_slots = connection_limiter.slotsAvailable();
+        auto const n_slots = limiter->slotsAvailable();
         if (n_slots == 0)
         {
             return {};
@@ -294,10 +223,7 @@ public:
         }
 
         // Prefer to request large, contiguous chunks from webseeds.
-        // The actual value of '64' is arbitrary here;
-        // we could probably be smarter about this.
-        auto constexpr PreferredBlocksPerTask = size_t{ 64 };
-        return { n_slots, n_slots * PreferredBlocksPerTask };
+        return { n_slots, limiter->blocksAvailable(n_slots, activeReqCount(TR_CLIENT_TO_PEER)) };
     }
 
     void publish(tr_peer_event const& peer_event)
@@ -313,7 +239,7 @@ public:
     tr_peer_callback const callback;
     void* const callback_data;
 
-    ConnectionLimiter connection_limiter;
+    std::shared_ptr<libtransmission::WebseedLimiter> const limiter;
     std::set<tr_webseed_task*> tasks;
 
 private:
@@ -330,32 +256,35 @@ private:
 ****
 ***/
 
-struct write_block_data
+// all the new blocks from one fetch, handed to the cache in a single batch
+struct write_blocks_data
 {
-private:
-    libtransmission::evhelpers::evbuffer_unique_ptr const content_{ evbuffer_new() };
-
-public:
-    write_block_data(
-        tr_session* session,
-        tr_torrent_id_t tor_id,
-        tr_block_index_t block,
-        std::unique_ptr<std::vector<uint8_t>>& data,
-        tr_webseed* webseed)
+    write_blocks_data(tr_session* session, tr_torrent_id_t tor_id, tr_webseed* webseed)
         : session_{ session }
         , tor_id_{ tor_id }
-        , block_{ block }
-        , data_{ std::move(data) }
         , webseed_{ webseed }
     {
     }
 
-    void write_block_func()
+    void add(tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>> data)
+    {
+        blocks_.emplace_back(block, std::move(data));
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return std::empty(blocks_);
+    }
+
+    void write_blocks_func()
     {
         if (auto const* const tor = tr_torrentFindFromId(session_, tor_id_); tor != nullptr)
         {
-            session_->cache->writeBlock(tor_id_, block_, data_);
-            webseed_->publish(tr_peer_event::GotBlock(tor->blockInfo(), block_));
+            for (auto& [block, data] : blocks_)
+            {
+                session_->cache->writeBlock(tor_id_, block, data);
+                webseed_->publish(tr_peer_event::GotBlock(tor->blockInfo(), block));
+            }
         }
 
         delete this;
@@ -364,9 +293,8 @@ public:
 private:
     tr_session* const session_;
     tr_torrent_id_t const tor_id_;
-    tr_block_index_t const block_;
-    std::unique_ptr<std::vector<uint8_t>> data_;
     tr_webseed* const webseed_;
+    std::vector<std::pair<tr_block_index_t, std::unique_ptr<std::vector<uint8_t>>>> blocks_;
 };
 
 void useFetchedBlocks(tr_webseed_task* task)
@@ -381,6 +309,7 @@ void useFetchedBlocks(tr_webseed_task* task)
         return;
     }
 
+    auto* const data = new write_blocks_data{ session, tor->id(), webseed };
     auto* const buf = task->content();
     for (;;)
     {
@@ -399,8 +328,7 @@ void useFetchedBlocks(tr_webseed_task* task)
             auto block_buf = std::make_unique<std::vector<uint8_t>>();
             block_buf->resize(block_size);
             evbuffer_remove(task->content(), std::data(*block_buf), std::size(*block_buf));
-            auto* const data = new write_block_data{ session, tor->id(), task->loc.block, block_buf, webseed };
-            session->runInSessionThread(&write_block_data::write_block_func, data);
+            data->add(task->loc.block, std::move(block_buf));
         }
 
         task->loc = tor->byteLoc(task->loc.byte + block_size);
@@ -408,6 +336,14 @@ void useFetchedBlocks(tr_webseed_task* task)
         TR_ASSERT(task->loc.byte <= task->end_byte);
         TR_ASSERT(task->loc.byte == task->end_byte || task->loc.block_offset == 0);
     }
+
+    if (data->empty())
+    {
+        delete data;
+        return;
+    }
+
+    session->runInSessionThread(&write_blocks_data::write_blocks_func, data);
 }
 
 /***
@@ -436,8 +372,7 @@ void on_idle(tr_webseed* webseed)
     }
 
     // Prefer to request large, contiguous chunks from webseeds.
-    // The actual value of '64' is arbitrary here; we could probably
-    // be smarter about this.
+    // canRequest() sizes max_blocks to the webseed's recent speed.
     auto spans = tr_peerMgrGetNextRequests(webseed->getTorrent(), webseed, max_blocks);
     if (std::size(spans) > max_spans)
     {
@@ -454,7 +389,7 @@ void onPartialDataFetched(tr_web::FetchResponse const& web_response)
     auto* const task = static_cast<tr_webseed_task*>(vtask);
     auto* const webseed = task->webseed;
 
-    webseed->connection_limiter.taskFinished(success);
+    task->limiter->taskFinished(success);
 
     if (task->dead)
     {
@@ -524,7 +459,7 @@ void task_request_next_chunk(tr_webseed_task* task)
     auto const this_chunk = std::min(left_in_file, left_in_task);
     TR_ASSERT(this_chunk > 0U);
 
-    webseed->connection_limiter.taskStarted();
+    task->limiter->taskStarted();
 
     auto url = tr_urlbuf{};
     makeUrl(webseed, tor->fileSubpath(file_index), std::back_inserter(url));
@@ -541,6 +476,40 @@ void task_request_next_chunk(tr_webseed_task* task)
 ****
 ***/
 
+namespace libtransmission
+{
+
+std::shared_ptr<WebseedLimiter> WebseedLimiters::get(std::string_view url)
+{
+    auto host = std::string{ url };
+    if (auto const parsed = tr_urlParse(url); parsed)
+    {
+        host = fmt::format(FMT_STRING("{:s}:{:d}"), parsed->host, parsed->port);
+    }
+
+    auto& weak = limiters_[host];
+    auto limiter = weak.lock();
+    if (!limiter)
+    {
+        limiter = std::make_shared<WebseedLimiter>();
+        weak = limiter;
+    }
+
+    if (std::size(limiters_) >= sweep_at_)
+    {
+        for (auto it = std::begin(limiters_); it != std::end(limiters_);)
+        {
+            it = it->second.expired() ? limiters_.erase(it) : std::next(it);
+        }
+
+        sweep_at_ = std::max(MinSweepSize, std::size(limiters_) * 2U);
+    }
+
+    return limiter;
+}
+
+} // namespace libtransmission
+
 tr_peer* tr_webseedNew(tr_torrent* torrent, std::string_view url, tr_peer_callback callback, void* callback_data)
 {
     return new tr_webseed(torrent, url, callback, callback_data);
@@ -9,10 +9,208 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <algorithm>
+#include <cstddef> // size_t
+#include <ctime> // time_t
+#include <functional> // std::less
+#include <map>
+#include <memory>
+#include <string>
 #include <string_view>
 
+#include "transmission.h"
+
+#include "block-info.h"
+#include "history.h"
 #include "peer-common.h"
+#include "tr-assert.h"
+#include "utils.h" // tr_time()
 
 tr_peer* tr_webseedNew(struct tr_torrent* torrent, std::string_view, tr_peer_callback callback, void* callback_data);
 
 tr_webseed_view tr_webseedView(tr_peer const* peer);
+
+namespace libtransmission
+{
+
+/**
+ * Manages how many web tasks should be running at a time on one host.
+ * Every webseed on the same host shares one of these, so that listing
+ * several mirrors on one server doesn't multiply the load on it.
+ *
+ * - When all is well, allow multiple tasks running in parallel.
+ *   While every slot is busy and the measured speed keeps going up,
+ *   add another slot; if adding one made things slower, take it back.
+ * - If we get an error, halve the number of slots and throttle down
+ *   to only one at a time until we get piece data.
+ * - If we have too many errors in a row, put the host in timeout
+ *   and don't allow _any_ connections for awhile.
+ */
+class WebseedLimiter
+{
+public:
+    static size_t constexpr MinConnections = 1;
+    static size_t constexpr InitialConnections = 4;
+    static size_t constexpr MaxConnections = 16;
+    static size_t constexpr MaxConsecutiveFailures = InitialConnections;
+    static time_t constexpr TimeoutIntervalSecs = 120;
+
+    static size_t constexpr MinBlocksPerTask = 64;
+    static size_t constexpr MaxBlocksPerTask = 1024;
+
+    // A task keeps everything it fetches in memory until the fetch is
+    // done, so cap how much one webseed can have requested at a time.
+    static size_t constexpr MaxBufferedBlocks = 64 * 1024 * 1024 / tr_block_info::BlockSize;
+
+    constexpr void taskStarted() noexcept
+    {
+        ++n_tasks_;
+    }
+
+    void taskFinished(bool success)
+    {
+        if (success)
+        {
+            taskSucceeded();
+        }
+        else
+        {
+            taskFailed();
+        }
+
+        TR_ASSERT(n_tasks_ > 0);
+        --n_tasks_;
+    }
+
+    void gotData(size_t n_bytes)
+    {
+        TR_ASSERT(n_tasks_ > 0);
+        n_consecutive_failures_ = 0;
+        paused_until_ = 0;
+        bytes_.add(tr_time(), n_bytes);
+    }
+
+    [[nodiscard]] size_t slotsAvailable() const noexcept
+    {
+        if (isPaused())
+        {
+            return 0;
+        }
+
+        auto const max = maxConnections();
+        if (n_tasks_ >= max)
+        {
+            return 0;
+        }
+
+        return max - n_tasks_;
+    }
+
+    // How many blocks each new task should ask for. Size the requests so
+    // that each takes about TargetTaskSecs at the current speed: fast
+    // servers get fewer, bigger range requests, and slow ones don't sit
+    // on blocks that other peers could be sending us.
+    [[nodiscard]] size_t blocksPerTask() const noexcept
+    {
+        auto const speed_per_task = speed() / std::max(n_tasks_, size_t{ 1 });
+        auto const n_blocks = speed_per_task * TargetTaskSecs / tr_block_info::BlockSize;
+        return std::clamp(n_blocks, MinBlocksPerTask, MaxBlocksPerTask);
+    }
+
+    // How many blocks a webseed that already has `n_blocks_buffered`
+    // blocks in flight may request across `n_slots` new tasks.
+    [[nodiscard]] size_t blocksAvailable(size_t n_slots, size_t n_blocks_buffered) const noexcept
+    {
+        if (n_blocks_buffered >= MaxBufferedBlocks)
+        {
+            return 0;
+        }
+
+        return std::min(n_slots * blocksPerTask(), MaxBufferedBlocks - n_blocks_buffered);
+    }
+
+    [[nodiscard]] tr_bytes_per_second_t speed() const noexcept
+    {
+        return bytes_.count(tr_time(), SpeedSecs) / SpeedSecs;
+    }
+
+    // true if the host is in timeout after too many errors in a row
+    [[nodiscard]] bool isPaused() const noexcept
+    {
+        return paused_until_ > tr_time();
+    }
+
+private:
+    [[nodiscard]] constexpr size_t maxConnections() const noexcept
+    {
+        return n_consecutive_failures_ > 0 ? 1 : max_connections_;
+    }
+
+    void taskSucceeded()
+    {
+        // if we weren't using all our slots, the speed
+        // doesn't tell us anything about the slot count
+        if (n_tasks_ < max_connections_)
+        {
+            return;
+        }
+
+        auto const speed = this->speed();
+
+        if (speed * 10 > speed_at_last_change_ * 11 && max_connections_ < MaxConnections)
+        {
+            ++max_connections_;
+            speed_at_last_change_ = speed;
+        }
+        else if (speed * 10 < speed_at_last_change_ * 9 && max_connections_ > MinConnections)
+        {
+            --max_connections_;
+            speed_at_last_change_ = speed;
+        }
+    }
+
+    void taskFailed()
+    {
+        TR_ASSERT(n_tasks_ > 0);
+
+        max_connections_ = std::max(max_connections_ / 2, MinConnections);
+        speed_at_last_change_ = 0;
+
+        if (++n_consecutive_failures_ >= MaxConsecutiveFailures)
+        {
+            paused_until_ = tr_time() + TimeoutIntervalSecs;
+        }
+    }
+
+    static size_t constexpr TargetTaskSecs = 4;
+    static unsigned int constexpr SpeedSecs = 4;
+
+    size_t n_tasks_ = 0;
+    size_t n_consecutive_failures_ = 0;
+    time_t paused_until_ = 0;
+
+    size_t max_connections_ = InitialConnections;
+    tr_bytes_per_second_t speed_at_last_change_ = 0;
+
+    tr_recentHistory<size_t, SpeedSecs * 2> bytes_;
+};
+
+// The limiters of a session's webseeds, one per host. The webseeds and
+// their tasks hold on to their host's limiter, so it lives as long as
+// any of them do. Only used in the session thread.
+class WebseedLimiters
+{
+public:
+    // @return the limiter for `url`'s host
+    [[nodiscard]] std::shared_ptr<WebseedLimiter> get(std::string_view url);
+
+private:
+    // Forgetting the hosts that are no longer used waits until the map has
+    // doubled in size since the last time, so that it's cheap on average.
+    static size_t constexpr MinSweepSize = 16;
+    size_t sweep_at_ = MinSweepSize;
+
+    std::map<std::string, std::weak_ptr<WebseedLimiter>, std::less<>> limiters_;
+};
+
+} // namespace libtransmission
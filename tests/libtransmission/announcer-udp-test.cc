@@ -5,6 +5,7 @@
 
 #include <cstring> // for std::memcpy()
 #include <deque>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -646,3 +647,154 @@ TEST_F(AnnouncerUdpTest, canAnnounce)
     EXPECT_TRUE(response);
     expectEqual(expected_response, *response);
 }
+
+TEST_F(AnnouncerUdpTest, pipelinesManyAnnounces)
+{
+    static auto constexpr NumAnnounces = size_t{ 1000 };
+
+    // build the announcer
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // queue up a lot of announces to the same tracker
+    auto requests = std::vector<tr_announce_request>{};
+    auto responses = std::map<tr_sha1_digest_t, tr_announce_response>{};
+    for (size_t i = 0; i < NumAnnounces; ++i)
+    {
+        auto& request = requests.emplace_back();
+        request.event = TR_ANNOUNCE_EVENT_NONE;
+        request.port = tr_port::fromHost(80);
+        request.numwant = 20;
+        request.announce_url = "https://127.0.0.1/announce";
+        request.peer_id = tr_peerIdInit();
+        request.info_hash = tr_rand_obj<tr_sha1_digest_t>();
+        announcer->announce(
+            request,
+            [&responses](tr_announce_response const& resp) { responses.try_emplace(resp.info_hash, resp); });
+    }
+
+    // Announcer will request a connection. Verify and grant the request
+    auto sent = waitForAnnouncerToSendMessage(mediator);
+    auto connect_transaction_id = parseConnectionRequest(sent);
+    auto const connection_id = sendConnectionResponse(*announcer, connect_transaction_id);
+
+    // All the announces should be sent right away without waiting for responses
+    EXPECT_EQ(NumAnnounces, std::size(mediator.sent_));
+    auto udp_ann_reqs = std::vector<UdpAnnounceReq>{};
+    while (!std::empty(mediator.sent_))
+    {
+        auto buf = libtransmission::Buffer(mediator.sent_.front().buf_);
+        mediator.sent_.pop_front();
+        udp_ann_reqs.emplace_back(parseAnnounceRequest(buf, connection_id));
+    }
+
+    // Have the tracker respond in reverse order
+    for (auto it = std::rbegin(udp_ann_reqs); it != std::rend(udp_ann_reqs); ++it)
+    {
+        auto buf = libtransmission::Buffer{};
+        buf.addUint32(AnnounceAction);
+        buf.addUint32(it->transaction_id);
+        buf.addUint32(1800U); // interval
+        buf.addUint32(1U); // leechers
+        buf.addUint32(2U); // seeders
+
+        auto const response_size = std::size(buf);
+        auto arr = std::array<uint8_t, 128>{};
+        buf.toBuf(std::data(arr), response_size);
+        EXPECT_TRUE(announcer->handleMessage(std::data(arr), response_size));
+    }
+
+    // Confirm that every announce got its own response
+    EXPECT_EQ(NumAnnounces, std::size(responses));
+    for (auto const& request : requests)
+    {
+        auto const it = responses.find(request.info_hash);
+        ASSERT_NE(std::end(responses), it);
+        EXPECT_TRUE(it->second.did_connect);
+        EXPECT_EQ(2, it->second.seeders);
+        EXPECT_EQ(1, it->second.leechers);
+    }
+
+    // Confirm that nothing else got sent
+    EXPECT_TRUE(std::empty(mediator.sent_));
+}
+
+TEST_F(AnnouncerUdpTest, retransmitsUnansweredRequests)
+{
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // tell announcer to scrape
+    auto [request, expected_response] = buildSimpleScrapeRequestAndResponse();
+    auto n_responses = size_t{};
+    announcer->scrape(request, [&n_responses](tr_scrape_response const& /*resp*/) { ++n_responses; });
+
+    // Announcer will request a connection. Verify and grant the request
+    auto sent = waitForAnnouncerToSendMessage(mediator);
+    auto const connect_transaction_id = parseConnectionRequest(sent);
+    auto const connection_id = sendConnectionResponse(*announcer, connect_transaction_id);
+
+    // The announcer should have sent a UDP scrape request
+    sent = waitForAnnouncerToSendMessage(mediator);
+    auto const [scrape_transaction_id, info_hashes] = parseScrapeRequest(sent, connection_id);
+    expectEqual(request, info_hashes);
+
+    // Don't answer it. After a while, the same request should get resent
+    tr_timeUpdate(tr_time() + 16);
+    announcer->upkeep();
+    ASSERT_EQ(1U, std::size(mediator.sent_));
+    sent = waitForAnnouncerToSendMessage(mediator);
+    auto const [resent_transaction_id, resent_info_hashes] = parseScrapeRequest(sent, connection_id);
+    EXPECT_EQ(scrape_transaction_id, resent_transaction_id);
+    expectEqual(request, resent_info_hashes);
+
+    // Answer it this time
+    auto buf = libtransmission::Buffer{};
+    buf.addUint32(ScrapeAction);
+    buf.addUint32(scrape_transaction_id);
+    buf.addUint32(expected_response.rows[0].seeders);
+    buf.addUint32(expected_response.rows[0].downloads);
+    buf.addUint32(expected_response.rows[0].leechers);
+    auto const response_size = std::size(buf);
+    auto arr = std::array<uint8_t, 256>{};
+    buf.toBuf(std::data(arr), response_size);
+    EXPECT_TRUE(announcer->handleMessage(std::data(arr), response_size));
+    EXPECT_EQ(1U, n_responses);
+
+    // Now that it's been answered, it should never be resent or time out
+    tr_timeUpdate(tr_time() + 16);
+    announcer->upkeep();
+    EXPECT_TRUE(std::empty(mediator.sent_));
+    EXPECT_EQ(1U, n_responses);
+}
+
+TEST_F(AnnouncerUdpTest, expiresUnansweredRequests)
+{
+    auto mediator = MockMediator{};
+    auto announcer = tr_announcer_udp::create(mediator);
+    auto upkeep_timer = createUpkeepTimer(mediator, announcer);
+
+    // tell announcer to scrape
+    auto [request, expected_response] = buildSimpleScrapeRequestAndResponse();
+    auto response = std::optional<tr_scrape_response>{};
+    announcer->scrape(request, [&response](tr_scrape_response const& resp) { response = resp; });
+
+    // Announcer will request a connection. Verify and grant the request
+    auto sent = waitForAnnouncerToSendMessage(mediator);
+    auto const connect_transaction_id = parseConnectionRequest(sent);
+    auto const connection_id = sendConnectionResponse(*announcer, connect_transaction_id);
+
+    // The announcer should have sent a UDP scrape request
+    sent = waitForAnnouncerToSendMessage(mediator);
+    auto const [scrape_transaction_id, info_hashes] = parseScrapeRequest(sent, connection_id);
+    EXPECT_NE(0U, scrape_transaction_id);
+
+    // Never answer it. It should eventually time out.
+    tr_timeUpdate(tr_time() + TR_SCRAPE_TIMEOUT_SEC.count());
+    announcer->upkeep();
+    ASSERT_TRUE(response);
+    EXPECT_TRUE(response->did_timeout);
+    EXPECT_FALSE(response->did_connect);
+}
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <limits>
 #include <vector>
 
@@ -445,3 +446,208 @@ TEST(Bitfield, bitwiseAnd)
     b &= a;
     EXPECT_NEAR(0.1F, a.percent(), 0.01);
 }
+
+namespace
+{
+
+auto makeRandomBitfield(size_t bit_count, size_t n_set)
+{
+    auto bf = tr_bitfield{ bit_count };
+    for (size_t i = 0; i < n_set; ++i)
+    {
+        bf.set(tr_rand_int_weak(bit_count));
+    }
+    return bf;
+}
+
+void expectSetAlgebraMatchesBits(tr_bitfield const& a, tr_bitfield const& b)
+{
+    auto const n = std::size(a);
+
+    auto intersects = false;
+    auto and_not_count = size_t{};
+    auto first_and_not = n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        intersects |= a.test(i) && b.test(i);
+        if (a.test(i) && !b.test(i))
+        {
+            ++and_not_count;
+            first_and_not = std::min(first_and_not, i);
+        }
+    }
+
+    EXPECT_EQ(intersects, a.intersects(b));
+    EXPECT_EQ(intersects, b.intersects(a));
+    EXPECT_EQ(and_not_count, a.countAndNot(b));
+    EXPECT_EQ(first_and_not, a.findNextAndNot(b, 0, n));
+
+    // walking with findNextAndNot() should visit the same bits
+    auto walked = size_t{};
+    for (auto i = a.findNextAndNot(b, 0, n); i < n; i = a.findNextAndNot(b, i + 1, n))
+    {
+        EXPECT_TRUE(a.test(i));
+        EXPECT_FALSE(b.test(i));
+        ++walked;
+    }
+    EXPECT_EQ(and_not_count, walked);
+}
+
+} // namespace
+
+TEST(Bitfield, setAlgebra)
+{
+    auto constexpr IterCount = int{ 1000 };
+
+    for (auto i = 0; i < IterCount; ++i)
+    {
+        auto const bit_count = size_t{ 1U } + tr_rand_int_weak(1000);
+        auto const a = makeRandomBitfield(bit_count, tr_rand_int_weak(bit_count));
+        auto const b = makeRandomBitfield(bit_count, tr_rand_int_weak(bit_count));
+        expectSetAlgebraMatchesBits(a, b);
+    }
+}
+
+TEST(Bitfield, setAlgebraHasAllNone)
+{
+    auto const bit_count = size_t{ 300 };
+
+    auto all = tr_bitfield{ bit_count };
+    all.setHasAll();
+    auto none = tr_bitfield{ bit_count };
+    none.setHasNone();
+    auto some = makeRandomBitfield(bit_count, 50U);
+    auto empty = tr_bitfield{ bit_count };
+
+    for (auto const* const a : { &all, &none, &some, &empty })
+    {
+        for (auto const* const b : { &all, &none, &some, &empty })
+        {
+            expectSetAlgebraMatchesBits(*a, *b);
+        }
+    }
+
+    EXPECT_TRUE(all.intersects(some));
+    EXPECT_FALSE(all.intersects(none));
+    EXPECT_EQ(bit_count - some.count(), all.countAndNot(some));
+    EXPECT_EQ(some.count(), some.countAndNot(none));
+    EXPECT_EQ(0U, some.countAndNot(all));
+    EXPECT_EQ(bit_count, some.findNextAndNot(all, 0, bit_count));
+}
+
+TEST(Bitfield, findNextAndNotWithUnknownSize)
+{
+    // e.g. a magnet link's peer that said it has everything
+    auto all = tr_bitfield{ 0 };
+    all.setHasAll();
+
+    auto some = tr_bitfield{ 1000 };
+    some.setSpan(0, 700);
+    EXPECT_EQ(700U, all.findNextAndNot(some, 0, 1000));
+    EXPECT_EQ(900U, all.findNextAndNot(some, 900, 1000));
+    EXPECT_EQ(1000U, all.findNextAndNot(all, 0, 1000));
+
+    // e.g. a magnet link's peer that sent a have message
+    auto one = tr_bitfield{ 0 };
+    one.set(500);
+    EXPECT_EQ(500U, one.findNextAndNot(tr_bitfield{ 1000 }, 0, 1000));
+    EXPECT_EQ(1000U, one.findNextAndNot(some, 0, 1000));
+    EXPECT_EQ(400U, one.findNextAndNot(some, 0, 400));
+}
+
+TEST(Bitfield, rawRoundTripsAcrossWords)
+{
+    // bit counts on either side of the word and byte boundaries
+    for (auto const bit_count : { 1U, 7U, 8U, 9U, 63U, 64U, 65U, 127U, 128U, 129U, 1001U })
+    {
+        auto const bf = makeRandomBitfield(bit_count, bit_count / 2U);
+        auto const raw = bf.raw();
+        ASSERT_EQ((bit_count + 7U) / 8U, std::size(raw));
+
+        for (size_t i = 0; i < bit_count; ++i)
+        {
+            EXPECT_EQ(bf.test(i), (raw[i / 8U] & (0x80 >> (i % 8U))) != 0);
+        }
+
+        auto copy = tr_bitfield{ bit_count };
+        copy.setRaw(std::data(raw), std::size(raw));
+        EXPECT_EQ(bf.count(), copy.count());
+        EXPECT_EQ(raw, copy.raw());
+    }
+}
+
+TEST(Bitfield, setAlgebraAtScale)
+{
+    // e.g. a torrent with a million pieces
+    auto constexpr BitCount = size_t{ 1000000 };
+
+    // sparse vs. dense
+    auto const a = makeRandomBitfield(BitCount, BitCount / 1000U);
+    auto const b = makeRandomBitfield(BitCount, BitCount);
+    expectSetAlgebraMatchesBits(a, b);
+    expectSetAlgebraMatchesBits(b, a);
+
+    // disjoint halves: nothing in common until the very last bit
+    auto lo = tr_bitfield{ BitCount };
+    lo.setSpan(0, BitCount / 2U);
+    auto hi = tr_bitfield{ BitCount };
+    hi.setSpan(BitCount / 2U, BitCount);
+    EXPECT_FALSE(lo.intersects(hi));
+    EXPECT_EQ(BitCount / 2U, lo.countAndNot(hi));
+    EXPECT_EQ(BitCount / 2U, hi.findNextAndNot(lo, 0, BitCount));
+    lo.set(BitCount - 1U);
+    EXPECT_TRUE(lo.intersects(hi));
+    EXPECT_EQ(BitCount / 2U - 1U, hi.countAndNot(lo));
+}
+
+TEST(Bitfield, setAlgebraCost)
+{
+    // Time the word kernels against testing each bit on a million-piece
+    // torrent that's nearly done: the pieces we have vs. a peer's pieces
+    auto constexpr BitCount = size_t{ 1000000 };
+    static auto constexpr NumRuns = 20;
+
+    auto ours = tr_bitfield{ BitCount };
+    ours.setSpan(0, BitCount);
+    for (size_t i = 0; i < BitCount; i += 997U)
+    {
+        ours.unset(i);
+    }
+    auto const theirs = makeRandomBitfield(BitCount, BitCount);
+
+    auto bit_count = size_t{};
+    auto bit_time = std::chrono::steady_clock::duration{};
+    auto word_count = size_t{};
+    auto word_time = std::chrono::steady_clock::duration{};
+    for (int run = 0; run < NumRuns; ++run)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        bit_count = 0U;
+        for (size_t i = 0; i < BitCount; ++i)
+        {
+            if (theirs.test(i) && !ours.test(i))
+            {
+                ++bit_count;
+            }
+        }
+        bit_time += std::chrono::steady_clock::now() - begin;
+
+        begin = std::chrono::steady_clock::now();
+        word_count = 0U;
+        for (auto i = theirs.findNextAndNot(ours, 0, BitCount); i < BitCount; i = theirs.findNextAndNot(ours, i + 1, BitCount))
+        {
+            ++word_count;
+        }
+        EXPECT_EQ(word_count, theirs.countAndNot(ours));
+        word_time += std::chrono::steady_clock::now() - begin;
+    }
+
+    EXPECT_EQ(bit_count, word_count);
+
+    auto const usec_per_run = [](auto duration)
+    {
+        return static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(duration / NumRuns).count());
+    };
+    ::testing::Test::RecordProperty("bit_usec_per_run", usec_per_run(bit_time));
+    ::testing::Test::RecordProperty("word_usec_per_run", usec_per_run(word_time));
+}
@@ -3,7 +3,14 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <cstdint>
 #include <cstring> // strlen()
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
 // #include <unistd.h> // sync()
 
 #include "transmission.h"
@@ -123,4 +130,138 @@ TEST_F(BlocklistTest, updating)
     // cleanup
 }
 
+TEST_F(BlocklistTest, mergesEnabledBlocklists)
+{
+    createFileWithContents(tr_pathbuf{ session_->configDir(), "/blocklists/level1"sv }, Contents1);
+    createFileWithContents(
+        tr_pathbuf{ session_->configDir(), "/blocklists/level2"sv },
+        "Overlap:216.16.1.150-216.16.1.160\n"
+        "Evilcorp:216.88.88.0-216.88.88.255\n"
+        "IPv6 neighbor:2001:db9::-2001:db9::ffff\n");
+    tr_sessionReloadBlocklists(session_);
+    tr_blocklistSetEnabled(session_, true);
+
+    // ranges from both lists are honored
+    EXPECT_TRUE(addressIsBlocked("10.1.2.3"));
+    EXPECT_TRUE(addressIsBlocked("216.88.88.88"));
+    EXPECT_TRUE(addressIsBlocked("2001:db9::1"));
+    EXPECT_FALSE(addressIsBlocked("2001:db9::1:0"));
+
+    // overlapping ranges from different lists are coalesced
+    EXPECT_FALSE(addressIsBlocked("216.16.1.143"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.144"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.155"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.160"));
+    EXPECT_FALSE(addressIsBlocked("216.16.1.161"));
+
+    // nothing is blocked when the blocklists are disabled
+    tr_blocklistSetEnabled(session_, false);
+    EXPECT_FALSE(addressIsBlocked("10.1.2.3"));
+    EXPECT_FALSE(addressIsBlocked("216.88.88.88"));
+}
+
+TEST_F(BlocklistTest, indexCoalescesAdjacentRanges)
+{
+    auto const dir = tr_pathbuf{ sandboxDir(), "/adjacent"sv };
+    createFileWithContents(
+        tr_pathbuf{ dir, "/level1"sv },
+        "a:1.2.3.0-1.2.3.9\n"
+        "b:1.2.3.10-1.2.3.19\n"
+        "c:1.2.3.21-1.2.3.29\n"
+        "d:255.255.255.0-255.255.255.254\n"
+        "e:255.255.255.255-255.255.255.255\n"
+        "f:2001:db8::-2001:db8::ffff\n"
+        "g:2001:db8::1:0-2001:db8::1:ffff\n"
+        "h:2001:db8:0:0:8000::-2001:db8::ffff:ffff:ffff:ffff\n"
+        "i:2001:db8:0:1::-2001:db8:0:1::1\n");
+
+    // a+b, c, d+e, f+g, h+i
+    auto const index = BlocklistIndex{ Blocklist::loadBlocklists(dir, true) };
+    EXPECT_EQ(5U, index.size());
+
+    for (auto const* const str : { "1.2.3.9", "1.2.3.10", "255.255.255.255", "2001:db8::ffff", "2001:db8::1:0" })
+    {
+        EXPECT_TRUE(index.contains(*tr_address::from_string(str))) << str;
+    }
+    EXPECT_FALSE(index.contains(*tr_address::from_string("1.2.3.20")));
+    EXPECT_FALSE(index.contains(*tr_address::from_string("2001:db8::2:0")));
+}
+
+TEST_F(BlocklistTest, batchLookup)
+{
+    createFileWithContents(tr_pathbuf{ session_->configDir(), "/blocklists/level1"sv }, Contents1);
+    tr_sessionReloadBlocklists(session_);
+    tr_blocklistSetEnabled(session_, true);
+
+    auto addrs = std::vector<tr_address>{};
+    for (auto const* const str : { "0.0.0.1", "10.1.2.3", "216.16.1.151", "216.16.1.152", "2001:db8::1", "1::1" })
+    {
+        addrs.push_back(*tr_address::from_string(str));
+    }
+
+    auto blocked = std::make_unique<bool[]>(std::size(addrs));
+    session_->addressesAreBlocked(std::data(addrs), std::size(addrs), blocked.get());
+    for (size_t i = 0; i < std::size(addrs); ++i)
+    {
+        EXPECT_EQ(session_->addressIsBlocked(addrs[i]), blocked[i]) << addrs[i].display_name();
+    }
+    EXPECT_FALSE(blocked[0]);
+    EXPECT_TRUE(blocked[1]);
+    EXPECT_TRUE(blocked[2]);
+    EXPECT_FALSE(blocked[3]);
+    EXPECT_TRUE(blocked[4]);
+    EXPECT_FALSE(blocked[5]);
+}
+
+TEST_F(BlocklistTest, lookupAtScaleMatchesLinearScan)
+{
+    static auto constexpr NumRanges = size_t{ 2000 };
+    static auto constexpr NumLookups = size_t{ 20000 };
+
+    auto rng = std::mt19937{ 1234 };
+    auto dist = std::uniform_int_distribution<uint32_t>{};
+
+    auto const to_str = [](uint32_t ip)
+    {
+        return std::to_string(ip >> 24U) + '.' + std::to_string((ip >> 16U) & 0xFFU) + '.' +
+            std::to_string((ip >> 8U) & 0xFFU) + '.' + std::to_string(ip & 0xFFU);
+    };
+
+    // build a big random IPv4 blocklist with plenty of overlaps
+    auto ranges = std::vector<std::pair<uint32_t, uint32_t>>{};
+    auto contents = std::string{};
+    for (size_t i = 0; i < NumRanges; ++i)
+    {
+        auto const low = dist(rng);
+        auto const high = low + std::min(dist(rng) % 100000U, UINT32_MAX - low);
+        ranges.emplace_back(low, high);
+
+        contents += "range:" + to_str(low) + '-' + to_str(high) + '\n';
+    }
+    createFileWithContents(tr_pathbuf{ session_->configDir(), "/blocklists/big"sv }, contents);
+    tr_sessionReloadBlocklists(session_);
+    tr_blocklistSetEnabled(session_, true);
+
+    for (size_t i = 0; i < NumLookups; ++i)
+    {
+        // half the probes land next to a range boundary, where off-by-ones would show up
+        auto ip = dist(rng);
+        if (i % 2U == 0U)
+        {
+            auto const& [low, high] = ranges[ip % std::size(ranges)];
+            ip = (ip & 1U) != 0U ? low - 1U + (ip & 2U) / 2U : high + (ip & 2U) / 2U;
+        }
+
+        auto const expected = std::any_of(
+            std::begin(ranges),
+            std::end(ranges),
+            [ip](auto const& range) { return range.first <= ip && ip <= range.second; });
+
+        auto addr = tr_address{};
+        addr.type = TR_AF_INET;
+        addr.addr.addr4.s_addr = htonl(ip);
+        EXPECT_EQ(expected, session_->addressIsBlocked(addr)) << addr.display_name();
+    }
+}
+
 } // namespace libtransmission::test
@@ -0,0 +1,265 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "cache.h"
+#include "crypto-utils.h" // for tr_rand_int_weak()
+
+#include "gtest/gtest.h"
+
+using ReadCacheTest = ::testing::Test;
+using CacheFlushTest = ::testing::Test;
+
+namespace
+{
+
+auto constexpr PieceSize = size_t{ 1024 };
+
+[[nodiscard]] std::vector<uint8_t> makePiece(tr_piece_index_t piece)
+{
+    return std::vector<uint8_t>(PieceSize, static_cast<uint8_t>(piece));
+}
+
+[[nodiscard]] bool isCached(ReadCache& cache, ReadCache::Key const& key)
+{
+    auto buf = std::array<uint8_t, 1>{};
+    return cache.read(key, 0, 1, std::data(buf));
+}
+
+} // namespace
+
+TEST_F(ReadCacheTest, readsAndCounts)
+{
+    auto cache = ReadCache{ PieceSize * 8 };
+    auto const key = ReadCache::Key{ 1, 0 };
+
+    auto buf = std::array<uint8_t, 16>{};
+    EXPECT_FALSE(cache.read(key, 0, std::size(buf), std::data(buf)));
+
+    auto piece = makePiece(7);
+    piece[PieceSize - 1] = 42;
+    cache.add(key, std::move(piece));
+    EXPECT_EQ(PieceSize, cache.stats().size_bytes);
+
+    EXPECT_TRUE(cache.read(key, PieceSize - std::size(buf), std::size(buf), std::data(buf)));
+    EXPECT_EQ(7, buf.front());
+    EXPECT_EQ(42, buf.back());
+
+    // reads past the end of the piece are misses
+    EXPECT_FALSE(cache.read(key, PieceSize - 1, std::size(buf), std::data(buf)));
+
+    auto const stats = cache.stats();
+    EXPECT_EQ(1U, stats.hits);
+    EXPECT_EQ(2U, stats.misses);
+}
+
+TEST_F(ReadCacheTest, rejectsOversizedPieces)
+{
+    auto cache = ReadCache{ PieceSize };
+    EXPECT_FALSE(cache.accepts(PieceSize));
+
+    cache.add({ 1, 0 }, makePiece(0));
+    EXPECT_EQ(0U, cache.stats().size_bytes);
+}
+
+TEST_F(ReadCacheTest, acceptsPiecesUpToHalfTheLimit)
+{
+    // e.g. at the default cache-size-mb when nothing is waiting to be written
+    static auto constexpr Limit = size_t{ 4U * 1024U * 1024U };
+    auto const cache = ReadCache{ Limit };
+    EXPECT_TRUE(cache.accepts(Limit / 2U));
+    EXPECT_FALSE(cache.accepts(Limit / 2U + 1U));
+}
+
+TEST_F(ReadCacheTest, popularPiecesSurviveScans)
+{
+    static auto constexpr NumPieces = tr_piece_index_t{ 8 };
+    auto cache = ReadCache{ PieceSize * NumPieces };
+
+    // piece 0 is read once, falls out of the fifo, and is read again;
+    // that makes it popular enough to be promoted into the lru
+    auto const popular = ReadCache::Key{ 1, 0 };
+    cache.add(popular, makePiece(0));
+    for (tr_piece_index_t piece = 1; piece <= NumPieces; ++piece)
+    {
+        cache.add({ 1, piece }, makePiece(piece));
+    }
+    EXPECT_FALSE(isCached(cache, popular));
+    cache.add(popular, makePiece(0));
+    EXPECT_TRUE(isCached(cache, popular));
+
+    // a peer that downloads the whole torrent shouldn't push it out
+    for (tr_piece_index_t piece = 100; piece < 100 + NumPieces * 4; ++piece)
+    {
+        cache.add({ 2, piece }, makePiece(piece));
+    }
+    EXPECT_TRUE(isCached(cache, popular));
+    EXPECT_LE(cache.stats().size_bytes, PieceSize * NumPieces);
+}
+
+TEST_F(ReadCacheTest, erasesTorrents)
+{
+    auto cache = ReadCache{ PieceSize * 16 };
+    cache.add({ 1, 0 }, makePiece(0));
+    cache.add({ 2, 0 }, makePiece(0));
+    cache.add({ 2, 1 }, makePiece(1));
+    cache.add({ 3, 0 }, makePiece(0));
+
+    cache.erase(tr_torrent_id_t{ 2 });
+    EXPECT_TRUE(isCached(cache, { 1, 0 }));
+    EXPECT_FALSE(isCached(cache, { 2, 0 }));
+    EXPECT_FALSE(isCached(cache, { 2, 1 }));
+    EXPECT_TRUE(isCached(cache, { 3, 0 }));
+
+    cache.erase(ReadCache::Key{ 1, 0 });
+    EXPECT_FALSE(isCached(cache, { 1, 0 }));
+    EXPECT_EQ(PieceSize, cache.stats().size_bytes);
+}
+
+TEST_F(ReadCacheTest, shrinkingTheLimitTrims)
+{
+    auto cache = ReadCache{ PieceSize * 16 };
+    for (tr_piece_index_t piece = 0; piece < 4; ++piece)
+    {
+        cache.add({ 1, piece }, makePiece(piece));
+    }
+    EXPECT_EQ(PieceSize * 4, cache.stats().size_bytes);
+
+    cache.setLimit(PieceSize * 2);
+    EXPECT_LE(cache.stats().size_bytes, PieceSize * 2);
+
+    cache.setLimit(0);
+    EXPECT_EQ(0U, cache.stats().size_bytes);
+}
+
+TEST_F(CacheFlushTest, writesInElevatorOrder)
+{
+    auto runs = std::vector<Cache::FlushRun>{};
+    runs.push_back({ "/b", 1, { 10, 12 }, 1, false });
+    runs.push_back({ "/a", 2, { 50, 51 }, 2, false });
+    runs.push_back({ "/a", 3, { 0, 4 }, 3, false });
+    runs.push_back({ "/a", 2, { 5, 9 }, 4, false });
+    runs.push_back({ "/b", 1, { 0, 2 }, 5, false });
+
+    auto const plan = Cache::planFlush(runs, 100);
+    ASSERT_EQ(std::size(runs), std::size(plan));
+
+    auto const expected = std::vector<std::pair<tr_torrent_id_t, tr_block_index_t>>{
+        { 2, 5 },
+        { 2, 50 },
+        { 3, 0 },
+        { 1, 0 },
+        { 1, 10 },
+    };
+    for (size_t i = 0; i < std::size(expected); ++i)
+    {
+        EXPECT_EQ(expected[i].first, plan[i].tor_id);
+        EXPECT_EQ(expected[i].second, plan[i].blocks.begin);
+    }
+}
+
+TEST_F(CacheFlushTest, prefersOldestThenWholePieces)
+{
+    auto runs = std::vector<Cache::FlushRun>{};
+    runs.push_back({ "/a", 1, { 0, 1 }, 5, false });
+    runs.push_back({ "/a", 1, { 10, 11 }, 1, false }); // oldest
+    runs.push_back({ "/a", 1, { 20, 21 }, 9, true }); // newest, but holds a whole piece
+    runs.push_back({ "/a", 1, { 30, 31 }, 3, false });
+
+    auto const plan = Cache::planFlush(runs, 3);
+    ASSERT_EQ(3U, std::size(plan));
+    EXPECT_EQ(10U, plan[0].blocks.begin);
+    EXPECT_EQ(20U, plan[1].blocks.begin);
+    EXPECT_EQ(30U, plan[2].blocks.begin);
+}
+
+TEST_F(CacheFlushTest, skipsHeldRuns)
+{
+    auto runs = std::vector<Cache::FlushRun>{};
+    runs.push_back({ "/a", 1, { 0, 4 }, 1, false, true }); // oldest, but its file is being preallocated
+    runs.push_back({ "/a", 1, { 10, 14 }, 2, false, false });
+    runs.push_back({ "/a", 2, { 0, 4 }, 3, true, true });
+
+    auto const plan = Cache::planFlush(runs, 100);
+    ASSERT_EQ(1U, std::size(plan));
+    EXPECT_EQ(10U, plan.front().blocks.begin);
+}
+
+TEST_F(CacheFlushTest, stopsWhenEnoughBlocksAreChosen)
+{
+    auto runs = std::vector<Cache::FlushRun>{};
+    for (tr_block_index_t i = 0; i < 10; ++i)
+    {
+        runs.push_back({ "/a", 1, { i * 10, i * 10 + 4 }, static_cast<time_t>(i), false });
+    }
+
+    auto const plan = Cache::planFlush(runs, 9);
+    EXPECT_EQ(3U, std::size(plan));
+    EXPECT_TRUE(std::empty(Cache::planFlush({}, 9)));
+}
+
+// Simulate many concurrent downloads scattering blocks across several
+// torrents, and record the disk offsets that each policy would write.
+TEST_F(CacheFlushTest, diskPattern)
+{
+    static auto constexpr NumTorrents = 4;
+    static auto constexpr NumRuns = 256;
+
+    auto runs = std::vector<Cache::FlushRun>{};
+    auto dirs = std::array<std::string, NumTorrents>{};
+    for (int i = 0; i < NumTorrents; ++i)
+    {
+        dirs[i] = "/downloads/" + std::to_string(i % 2);
+    }
+    for (int i = 0; i < NumRuns; ++i)
+    {
+        auto const tor_id = static_cast<tr_torrent_id_t>(tr_rand_int_weak(size_t{ NumTorrents }));
+        auto const begin = static_cast<tr_block_index_t>((i * 7919) % NumRuns) * 16; // scattered, but no overlaps
+        runs.push_back({ dirs[tor_id], tor_id, { begin, begin + 4 }, static_cast<time_t>(i), false });
+    }
+
+    // a seek is any write that doesn't continue forward on the same torrent
+    auto const count_seeks = [](std::vector<Cache::FlushRun> const& writes)
+    {
+        auto n_seeks = size_t{};
+        for (size_t i = 1; i < std::size(writes); ++i)
+        {
+            auto const& prev = writes[i - 1];
+            auto const& cur = writes[i];
+            n_seeks += prev.tor_id != cur.tor_id || cur.blocks.begin < prev.blocks.end ? 1U : 0U;
+        }
+        return n_seeks;
+    };
+
+    // the old policy wrote the oldest run first, one at a time
+    auto const oldest_first = runs;
+    auto const planned = Cache::planFlush(runs, NumRuns * 4);
+    ASSERT_EQ(std::size(oldest_first), std::size(planned));
+
+    auto offsets = std::string{};
+    for (auto const& run : planned)
+    {
+        offsets += std::to_string(run.tor_id) + ':' + std::to_string(run.blocks.begin) + ' ';
+    }
+    RecordProperty("write_offsets", offsets);
+    RecordProperty("seeks_oldest_first", static_cast<int>(count_seeks(oldest_first)));
+    RecordProperty("seeks_planned", static_cast<int>(count_seeks(planned)));
+
+    // one sweep per torrent
+    EXPECT_LT(count_seeks(planned), size_t{ NumTorrents });
+    EXPECT_GT(count_seeks(oldest_first), count_seeks(planned));
+    EXPECT_TRUE(std::is_sorted(
+        std::begin(planned),
+        std::end(planned),
+        [](auto const& a, auto const& b) { return std::make_pair(a.dir, a.tor_id) < std::make_pair(b.dir, b.tor_id); }));
+}
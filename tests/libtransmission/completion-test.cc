@@ -7,6 +7,7 @@
 #include <array>
 #include <cstdint>
 #include <set>
+#include <utility>
 
 #include "transmission.h"
 
@@ -504,3 +505,88 @@ TEST_F(CompletionTest, wantNone)
     EXPECT_LE(completion.leftUntilDone(), completion.sizeWhenDone());
     EXPECT_EQ(completion.leftUntilDone(), 0);
 }
+
+TEST_F(CompletionTest, incrementalTotalsMatchRecalculation)
+{
+    // use a piece size that isn't a multiple of the block size
+    // so that some blocks straddle two pieces
+    auto constexpr PieceSize = uint64_t{ BlockSize * 3 + BlockSize / 3 };
+    auto constexpr TotalSize = uint64_t{ PieceSize * 97 + 1234 };
+
+    auto torrent = TestTorrent{};
+    auto const block_info = tr_block_info{ TotalSize, PieceSize };
+    auto completion = tr_completion(&torrent, &block_info);
+    auto const n_blocks = block_info.blockCount();
+    auto const n_pieces = block_info.pieceCount();
+
+    // prime the cached totals so that they get updated incrementally
+    EXPECT_EQ(0, completion.hasValid());
+    EXPECT_EQ(TotalSize, completion.sizeWhenDone());
+
+    auto const expect_totals_match = [&]()
+    {
+        auto fresh = tr_completion(&torrent, &block_info);
+        fresh.setBlocks(completion.blocks());
+        EXPECT_EQ(fresh.hasTotal(), completion.hasTotal());
+        EXPECT_EQ(fresh.hasValid(), completion.hasValid());
+        EXPECT_EQ(fresh.sizeWhenDone(), completion.sizeWhenDone());
+        EXPECT_EQ(fresh.leftUntilDone(), completion.leftUntilDone());
+
+        // the pieces that were kept up-to-date match the ones that were rebuilt
+        EXPECT_EQ(fresh.createPieceBitfield(), completion.createPieceBitfield());
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            EXPECT_EQ(completion.countMissingBlocksInPiece(piece) == 0, completion.hasPiece(piece));
+        }
+    };
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        switch (tr_rand_int_weak(4))
+        {
+        case 0:
+            completion.addBlock(tr_block_index_t(tr_rand_int_weak(size_t{ n_blocks })));
+            break;
+
+        case 1:
+            completion.addPiece(tr_piece_index_t(tr_rand_int_weak(size_t{ n_pieces })));
+            break;
+
+        case 2:
+            completion.removePiece(tr_piece_index_t(tr_rand_int_weak(size_t{ n_pieces })));
+            break;
+
+        default:
+            {
+                auto const begin = tr_piece_index_t(tr_rand_int_weak(size_t{ n_pieces }));
+                auto const end = std::min(n_pieces, tr_piece_index_t(begin + 1 + tr_rand_int_weak(8)));
+                auto const wanted = tr_rand_int_weak(2) == 0;
+                auto const spans = std::array<std::pair<tr_piece_index_t, tr_piece_index_t>, 1>{ { { begin, end } } };
+                completion.changeWanted(
+                    spans,
+                    [&]()
+                    {
+                        for (auto piece = begin; piece < end; ++piece)
+                        {
+                            if (wanted)
+                            {
+                                torrent.dnd_pieces.erase(piece);
+                            }
+                            else
+                            {
+                                torrent.dnd_pieces.insert(piece);
+                            }
+                        }
+                    });
+            }
+            break;
+        }
+
+        if (i % 100 == 0)
+        {
+            expect_totals_match();
+        }
+    }
+
+    expect_totals_match();
+}
@@ -14,6 +14,7 @@
 #define tr_base64_decode_impl tr_base64_decode_impl_
 #define tr_base64_encode tr_base64_encode_
 #define tr_base64_encode_impl tr_base64_encode_impl_
+#define tr_powm tr_powm_
 #define tr_rand_buffer tr_rand_buffer_
 #define tr_rand_int tr_rand_int_
 #define tr_rand_int_weak tr_rand_int_weak_
@@ -47,6 +48,7 @@
 #undef tr_base64_decode_impl
 #undef tr_base64_encode
 #undef tr_base64_encode_impl
+#undef tr_powm
 #undef tr_rand_buffer
 #undef tr_rand_int
 #undef tr_rand_int_weak
@@ -75,6 +77,7 @@
 #define tr_base64_decode_impl_ tr_base64_decode_impl
 #define tr_base64_encode_ tr_base64_encode
 #define tr_base64_encode_impl_ tr_base64_encode_impl
+#define tr_powm_ tr_powm
 #define tr_rand_buffer_ tr_rand_buffer
 #define tr_rand_int_ tr_rand_int
 #define tr_rand_int_weak_ tr_rand_int_weak
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <numeric>
@@ -12,6 +13,9 @@
 #include <string>
 #include <string_view>
 #include <unordered_set>
+#include <vector>
+
+#include <math/wide_integer/uintwide_t.h>
 
 #include "transmission.h"
 
@@ -47,6 +51,68 @@ std::string toString(std::array<std::byte, N> const& array)
     return ostr.str();
 }
 
+template<size_t N>
+std::array<std::byte, N> fromHex(std::string_view hex)
+{
+    auto ret = std::array<std::byte, N>{};
+    for (size_t i = 0; i < N; ++i)
+    {
+        ret[i] = std::byte(std::stoi(std::string{ hex.substr(i * 2, 2) }, nullptr, 16));
+    }
+    return ret;
+}
+
+// The generic wide-integer implementation that MSE used to use,
+// kept here as a reference for the specialized one.
+namespace dh_ref
+{
+using DH = tr_message_stream_encryption::DH;
+using key_t = math::wide_integer::uintwide_t<DH::KeySize * 8U>;
+using private_key_t = math::wide_integer::uintwide_t<DH::PrivateKeySize * 8U>;
+
+template<typename UIntWide, size_t N>
+UIntWide importBits(std::array<std::byte, N> const& bigend_bin)
+{
+    auto ret = UIntWide{};
+    for (auto const walk : bigend_bin)
+    {
+        ret <<= 8;
+        ret += static_cast<uint8_t>(walk);
+    }
+    return ret;
+}
+
+DH::key_bigend_t exportBits(key_t i)
+{
+    auto ret = DH::key_bigend_t{};
+    for (auto walk = std::rbegin(ret), end = std::rend(ret); walk != end; ++walk)
+    {
+        *walk = std::byte(static_cast<uint8_t>(i & 0xFF));
+        i >>= 8;
+    }
+    return ret;
+}
+
+auto const Prime = key_t{
+    "0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD"
+    "3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563"
+};
+
+DH::key_bigend_t pow(DH::key_bigend_t const& base, DH::private_key_bigend_t const& exponent)
+{
+    return exportBits(
+        math::wide_integer::powm(importBits<key_t>(base), importBits<private_key_t>(exponent), Prime));
+}
+
+DH::key_bigend_t powG(DH::private_key_bigend_t const& exponent)
+{
+    auto generator = DH::key_bigend_t{};
+    generator.back() = std::byte{ 2 };
+    return pow(generator, exponent);
+}
+
+} // namespace dh_ref
+
 } // namespace
 
 TEST(Crypto, DH)
@@ -66,6 +132,123 @@ TEST(Crypto, DH)
     EXPECT_NE(toString(a.secret()), toString(c.secret()));
 }
 
+TEST(Crypto, DHKnownAnswers)
+{
+    auto private_key_a = tr_message_stream_encryption::DH::private_key_bigend_t{};
+    auto private_key_b = tr_message_stream_encryption::DH::private_key_bigend_t{};
+    for (size_t i = 0; i < std::size(private_key_a); ++i)
+    {
+        private_key_a[i] = std::byte(i + 1U);
+        private_key_b[std::size(private_key_b) - 1U - i] = std::byte(i + 1U);
+    }
+
+    auto constexpr ExpectedA = "96e112dab29e8c5272accb9b17b26887ce54a144a4e3b697c7d159b7a817e556b0918db2b4c658e02a87f7e5"
+                               "fb14b18a553e084cbf3dad2d30f16596ccb982d406258c61b30c5c1dae2ddc60bdbd48d79896312aad6323"
+                               "8c39e1a633821eb693"sv;
+    auto constexpr ExpectedB = "9f06bbabc80bb3768a237074daad1a41914dee9c5be9e067ac7a7c140949bd126f5ef7101ce9cfd1f85176c0"
+                               "96f588bdd9cae0d030661089484e7f75d844805274d93150595c673db75a3a05b8f22d4d0c753b35c67e1e"
+                               "b114e0f20874fdb3c2"sv;
+    auto constexpr ExpectedSecret = "134654a5d684336c6077e53df18fb9d331822beba07c295d362edf7952bb991821626fbcc0b917a72ee2fc"
+                                    "298e5adc1fc6f700558b343897f9e605a25f8051f71eb69f88e3cf36fb061abceb0f109794b4ae3c956e"
+                                    "d10c59958f0bb578831691"sv;
+
+    auto a = tr_message_stream_encryption::DH{ private_key_a };
+    auto b = tr_message_stream_encryption::DH{ private_key_b };
+    EXPECT_EQ(fromHex<96>(ExpectedA), a.publicKey());
+    EXPECT_EQ(fromHex<96>(ExpectedB), b.publicKey());
+
+    a.setPeerPublicKey(b.publicKey());
+    b.setPeerPublicKey(a.publicKey());
+    EXPECT_EQ(fromHex<96>(ExpectedSecret), a.secret());
+    EXPECT_EQ(fromHex<96>(ExpectedSecret), b.secret());
+
+    // the built-in arithmetic and the crypto library's agree
+    using DH = tr_message_stream_encryption::DH;
+    EXPECT_EQ(fromHex<96>(ExpectedSecret), DH::pow(b.publicKey(), private_key_a, false));
+    EXPECT_EQ(fromHex<96>(ExpectedSecret), DH::pow(b.publicKey(), private_key_a, true));
+}
+
+TEST(Crypto, DHMatchesReference)
+{
+    using DH = tr_message_stream_encryption::DH;
+
+    auto bases = std::vector<DH::key_bigend_t>{};
+    bases.emplace_back(); // zero
+    bases.emplace_back().back() = std::byte{ 1 };
+    bases.emplace_back().fill(std::byte{ 0xFF }); // larger than P
+    for (int i = 0; i < 8; ++i)
+    {
+        bases.push_back(tr_rand_obj<DH::key_bigend_t>());
+    }
+
+    auto exponents = std::vector<DH::private_key_bigend_t>{};
+    exponents.emplace_back(); // zero
+    exponents.emplace_back().fill(std::byte{ 0xFF });
+    for (int i = 0; i < 8; ++i)
+    {
+        exponents.push_back(DH::randomPrivateKey());
+    }
+
+    for (auto const& exponent : exponents)
+    {
+        EXPECT_EQ(dh_ref::powG(exponent), DH::powG(exponent));
+
+        for (auto const& base : bases)
+        {
+            auto const expected = dh_ref::pow(base, exponent);
+            EXPECT_EQ(expected, DH::pow(base, exponent, false));
+            EXPECT_EQ(expected, DH::pow(base, exponent, true));
+        }
+    }
+}
+
+TEST(Crypto, DHHandshakesPerSecond)
+{
+    using DH = tr_message_stream_encryption::DH;
+    static auto constexpr NumHandshakes = 200;
+
+    // each side of a handshake computes its public key and the shared secret
+    auto const peer_public_key = DH{}.publicKey();
+    auto private_keys = std::vector<DH::private_key_bigend_t>{};
+    for (int i = 0; i < NumHandshakes; ++i)
+    {
+        private_keys.push_back(DH::randomPrivateKey());
+    }
+
+    auto const time_handshakes = [&private_keys](auto const& handshake)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        for (auto const& private_key : private_keys)
+        {
+            handshake(private_key);
+        }
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+        return static_cast<int>(std::size(private_keys) / elapsed.count());
+    };
+
+    auto checksum = std::byte{};
+    auto const reference = time_handshakes(
+        [&](auto const& private_key)
+        { checksum ^= dh_ref::powG(private_key)[0] ^ dh_ref::pow(peer_public_key, private_key)[0]; });
+    auto const builtin = time_handshakes(
+        [&](auto const& private_key)
+        { checksum ^= DH::powG(private_key)[0] ^ DH::pow(peer_public_key, private_key, false)[0]; });
+    auto const current = time_handshakes(
+        [&](auto const& private_key)
+        {
+            auto dh = DH{ private_key };
+            checksum ^= dh.publicKey()[0];
+            dh.setPeerPublicKey(peer_public_key);
+            checksum ^= dh.secret()[0];
+        });
+
+    RecordProperty("handshakes_per_second_reference", reference);
+    RecordProperty("handshakes_per_second_builtin", builtin);
+    RecordProperty("handshakes_per_second", current);
+    RecordProperty("checksum", static_cast<int>(checksum));
+    EXPECT_GT(builtin, reference);
+}
+
 TEST(Crypto, encryptDecrypt)
 {
     auto a_dh = tr_message_stream_encryption::DH{};
@@ -0,0 +1,161 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+#include <string_view>
+#include <thread>
+
+#include "transmission.h"
+
+#include "disk-scheduler.h"
+#include "tr-strbuf.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+using IoClass = tr_disk_scheduler::IoClass;
+
+namespace libtransmission::test
+{
+
+class DiskSchedulerTest : public SandboxedTest
+{
+protected:
+    static auto constexpr Device = tr_disk_scheduler::device_t{ 1 };
+    static auto constexpr OtherDevice = tr_disk_scheduler::device_t{ 2 };
+
+    // Does I/O of `io_class` that takes `duration`
+    static void doIo(tr_disk_scheduler& scheduler, IoClass io_class, std::chrono::milliseconds duration)
+    {
+        auto const ticket = scheduler.wait(Device, io_class);
+        std::this_thread::sleep_for(duration);
+    }
+
+    // @return true if Background I/O could start on `device` within `timeout`
+    [[nodiscard]] static bool canStartBackground(
+        tr_disk_scheduler& scheduler,
+        tr_disk_scheduler::device_t device,
+        std::chrono::milliseconds timeout)
+    {
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        auto const ticket = scheduler.wait(
+            device,
+            IoClass::Background,
+            [deadline]() { return std::chrono::steady_clock::now() >= deadline; });
+        return static_cast<bool>(ticket);
+    }
+};
+
+TEST_F(DiskSchedulerTest, startsRightAwayWhenAlone)
+{
+    auto scheduler = tr_disk_scheduler{};
+
+    for (int i = 0; i < 3; ++i)
+    {
+        doIo(scheduler, IoClass::Background, 20ms);
+        EXPECT_TRUE(canStartBackground(scheduler, Device, 0ms));
+    }
+
+    EXPECT_EQ(0U, scheduler.stats()[static_cast<size_t>(IoClass::Background)].waits);
+}
+
+TEST_F(DiskSchedulerTest, limitsInFlight)
+{
+    auto scheduler = tr_disk_scheduler{};
+    scheduler.setClassConfig(IoClass::Background, { 1U, 1U });
+
+    auto ticket = scheduler.wait(Device, IoClass::Background);
+    EXPECT_TRUE(ticket);
+    EXPECT_FALSE(canStartBackground(scheduler, Device, 20ms));
+
+    ticket = {};
+    EXPECT_TRUE(canStartBackground(scheduler, Device, 20ms));
+}
+
+TEST_F(DiskSchedulerTest, backgroundYieldsToBusierClasses)
+{
+    auto scheduler = tr_disk_scheduler{};
+
+    // background has recently used more than its 1/9 share
+    doIo(scheduler, IoClass::Background, 200ms);
+
+    // and now the session thread is seeding from the same device
+    auto const seeding = scheduler.start(Device, IoClass::SeedRead);
+    EXPECT_FALSE(canStartBackground(scheduler, Device, 50ms));
+
+    // but other devices aren't affected
+    EXPECT_TRUE(canStartBackground(scheduler, OtherDevice, 0ms));
+
+    // seeding never waits
+    EXPECT_TRUE(scheduler.start(Device, IoClass::SeedRead));
+}
+
+TEST_F(DiskSchedulerTest, busyClassesShareByWeight)
+{
+    auto scheduler = tr_disk_scheduler{};
+
+    // background has recently used 40% of the device
+    doIo(scheduler, IoClass::Background, 200ms);
+
+    // that's less than its share if its weight equals seeding's
+    scheduler.setClassConfig(IoClass::Background, { 8U, 1U });
+    auto const seeding = scheduler.start(Device, IoClass::SeedRead);
+    EXPECT_TRUE(canStartBackground(scheduler, Device, 0ms));
+}
+
+TEST_F(DiskSchedulerTest, countsStats)
+{
+    auto scheduler = tr_disk_scheduler{};
+
+    doIo(scheduler, IoClass::Flush, 2ms);
+    doIo(scheduler, IoClass::Flush, 2ms);
+    static_cast<void>(scheduler.start(Device, IoClass::HashRead));
+
+    auto const stats = scheduler.stats();
+    auto const& flush = stats[static_cast<size_t>(IoClass::Flush)];
+    EXPECT_EQ(2U, flush.count);
+    EXPECT_EQ(0U, flush.waits);
+    EXPECT_EQ(2U, std::accumulate(std::begin(flush.latency_histogram), std::end(flush.latency_histogram), uint64_t{}));
+
+    // 2ms is more than 2^10 usec
+    auto const n_slow = std::accumulate(
+        std::begin(flush.latency_histogram) + 11,
+        std::end(flush.latency_histogram),
+        uint64_t{});
+    EXPECT_EQ(2U, n_slow);
+
+    EXPECT_EQ(1U, stats[static_cast<size_t>(IoClass::HashRead)].count);
+    EXPECT_EQ(0U, stats[static_cast<size_t>(IoClass::SeedRead)].count);
+}
+
+TEST_F(DiskSchedulerTest, deviceOfMissingPathUsesParent)
+{
+    auto scheduler = tr_disk_scheduler{};
+
+    auto const dir = sandboxDir();
+    auto const missing = tr_pathbuf{ dir, "/does/not/exist"sv };
+    EXPECT_EQ(scheduler.deviceOf(dir), scheduler.deviceOf(missing));
+}
+
+TEST_F(DiskSchedulerTest, deviceFuncOverridesFilesystem)
+{
+    auto scheduler = tr_disk_scheduler{};
+
+    auto const dir = sandboxDir();
+    auto const real_device = scheduler.deviceOf(dir);
+
+    auto const fake_device = ~real_device;
+    scheduler.setDeviceFunc([fake_device](std::string_view /*path*/) { return fake_device; });
+    EXPECT_EQ(fake_device, scheduler.deviceOf(dir));
+
+    // and the cache doesn't keep the fake result
+    scheduler.setDeviceFunc({});
+    EXPECT_EQ(real_device, scheduler.deviceOf(dir));
+}
+
+} // namespace libtransmission::test
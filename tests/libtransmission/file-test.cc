@@ -4,13 +4,16 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <chrono>
 #include <cstring>
 #include <ostream>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #ifndef _WIN32
+#include <sys/mman.h> // mincore()
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -20,6 +23,7 @@
 
 #include "transmission.h"
 
+#include "crypto-utils.h" // tr_rand_buffer()
 #include "error.h"
 #include "file.h"
 #include "tr-macros.h"
@@ -1079,6 +1083,39 @@ TEST_F(FileTest, fileCopy)
     EXPECT_EQ(nullptr, err);
 }
 
+TEST_F(FileTest, fileCopyRange)
+{
+    auto const test_dir = createTestDir(currentTestName());
+    auto const path1 = tr_pathbuf{ test_dir, "/a"sv };
+    auto const path2 = tr_pathbuf{ test_dir, "/b"sv };
+
+    auto contents = std::vector<char>(100000);
+    tr_rand_buffer(std::data(contents), std::size(contents));
+    EXPECT_TRUE(tr_saveFile(path1, contents));
+
+    tr_error* err = nullptr;
+    auto const in = tr_sys_file_open(path1, TR_SYS_FILE_READ, 0, &err);
+    ASSERT_NE(TR_BAD_SYS_FILE, in) << *err;
+    auto const out = tr_sys_file_open(path2, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600, &err);
+    ASSERT_NE(TR_BAD_SYS_FILE, out) << *err;
+
+    // copy the second half first, then the first
+    EXPECT_TRUE(tr_sys_file_copy_range(in, 50000, out, 50000, 50000, &err)) << *err;
+    EXPECT_TRUE(tr_sys_file_copy_range(in, 0, out, 0, 50000, &err)) << *err;
+
+    // reading past the end of the source is an error
+    EXPECT_FALSE(tr_sys_file_copy_range(in, 90000, out, 90000, 20000, &err));
+    EXPECT_NE(nullptr, err);
+    tr_error_clear(&err);
+
+    tr_sys_file_close(out);
+    tr_sys_file_close(in);
+
+    auto actual = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(path2, actual));
+    EXPECT_EQ(contents, actual);
+}
+
 TEST_F(FileTest, fileOpen)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -1275,6 +1312,138 @@ TEST_F(FileTest, filePreallocate)
     tr_sys_path_remove(path1);
 }
 
+TEST_F(FileTest, fileReadWriteAligned)
+{
+    auto const test_dir = createTestDir(currentTestName());
+    auto const path = tr_pathbuf{ test_dir, "/a"sv };
+
+    // a file whose size isn't a multiple of the alignment
+    auto contents = std::vector<char>(TR_SYS_FILE_DIRECT_ALIGNMENT * 2 + 1000);
+    tr_rand_buffer(std::data(contents), std::size(contents));
+    EXPECT_TRUE(tr_saveFile(path, contents));
+
+    tr_error* err = nullptr;
+    auto fd = tr_sys_file_open(path, TR_SYS_FILE_READ | TR_SYS_FILE_WRITE | TR_SYS_FILE_DIRECT, 0600, &err);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd) << *err;
+
+    // unaligned reads, including ones that straddle alignment boundaries or run past EOF
+    for (auto const& [offset, len] : std::array<std::pair<uint64_t, uint64_t>, 5>{
+             { { 0, 10 }, { 100, TR_SYS_FILE_DIRECT_ALIGNMENT }, { 4000, 5000 }, { 0, std::size(contents) }, { 9000, 1000 } } })
+    {
+        auto buf = std::vector<char>(len);
+        auto n_read = uint64_t{};
+        EXPECT_TRUE(tr_sys_file_read_at_aligned(fd, std::data(buf), len, offset, &n_read, &err)) << *err;
+        EXPECT_EQ(std::min(len, std::size(contents) - offset), n_read);
+        EXPECT_TRUE(std::equal(std::begin(buf), std::begin(buf) + n_read, std::begin(contents) + offset));
+    }
+
+    // unaligned write in the middle of the file
+    auto patch = std::vector<char>(3000, 'x');
+    EXPECT_TRUE(tr_sys_file_write_at_aligned(fd, std::data(patch), std::size(patch), 3000, &err)) << *err;
+    std::copy(std::begin(patch), std::end(patch), std::begin(contents) + 3000);
+
+    // unaligned write that extends the file
+    patch.assign(2000, 'y');
+    EXPECT_TRUE(tr_sys_file_write_at_aligned(fd, std::data(patch), std::size(patch), std::size(contents) - 500, &err))
+        << *err;
+    contents.resize(std::size(contents) + 1500);
+    std::copy(std::begin(patch), std::end(patch), std::end(contents) - std::size(patch));
+
+    tr_sys_file_close(fd);
+
+    auto const info = tr_sys_path_get_info(path);
+    EXPECT_TRUE(info);
+    EXPECT_EQ(std::size(contents), info->size);
+
+    auto actual = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(path, actual));
+    EXPECT_EQ(contents, actual);
+
+    tr_sys_path_remove(path);
+}
+
+// Compare throughput and page cache footprint of buffered and direct reads.
+// Disabled by default because it writes and rereads a 32 MiB file;
+// run it with --gtest_also_run_disabled_tests.
+TEST_F(FileTest, DISABLED_fileDirectReadBenchmark)
+{
+    static auto constexpr FileSize = size_t{ 32U * 1024U * 1024U };
+    static auto constexpr ReadSize = size_t{ 16U * 1024U };
+
+    auto const test_dir = createTestDir(currentTestName());
+    auto const path = tr_pathbuf{ test_dir, "/a"sv };
+
+    auto contents = std::vector<char>(FileSize);
+    tr_rand_buffer(std::data(contents), std::size(contents));
+    EXPECT_TRUE(tr_saveFile(path, contents));
+
+    // start each pass with none of the file in the page cache
+    auto const drop_cache = [&path]()
+    {
+        auto const fd = tr_sys_file_open(path, TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, 0);
+        tr_sys_file_flush(fd);
+        tr_sys_file_advise(fd, 0, FileSize, TR_SYS_FILE_ADVICE_DONT_NEED);
+        tr_sys_file_close(fd);
+    };
+
+    auto const read_all = [&path](bool direct)
+    {
+        auto const flags = TR_SYS_FILE_READ | (direct ? TR_SYS_FILE_DIRECT : 0);
+        auto const fd = tr_sys_file_open(path, flags, 0);
+        EXPECT_NE(TR_BAD_SYS_FILE, fd);
+
+        auto buf = std::vector<char>(ReadSize);
+        auto const begin = std::chrono::steady_clock::now();
+        for (uint64_t offset = 0; offset < FileSize; offset += ReadSize)
+        {
+            auto n_read = uint64_t{};
+            EXPECT_TRUE(
+                direct ? tr_sys_file_read_at_aligned(fd, std::data(buf), ReadSize, offset, &n_read) :
+                         tr_sys_file_read_at(fd, std::data(buf), ReadSize, offset, &n_read));
+        }
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+
+        tr_sys_file_close(fd);
+        return static_cast<int>(FileSize / (1024 * 1024) / std::max(elapsed.count(), 0.001));
+    };
+
+    // how many of the file's pages are in the page cache?
+    auto const count_cached_pages = [&path]()
+    {
+        auto n_cached = size_t{};
+#ifdef __linux__
+        auto const fd = tr_sys_file_open(path, TR_SYS_FILE_READ, 0);
+        if (auto* const map = mmap(nullptr, FileSize, PROT_READ, MAP_SHARED, fd, 0); map != MAP_FAILED)
+        {
+            auto const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            auto vec = std::vector<unsigned char>((FileSize + page_size - 1) / page_size);
+            if (mincore(map, FileSize, std::data(vec)) == 0)
+            {
+                n_cached = std::count_if(std::begin(vec), std::end(vec), [](auto page) { return (page & 1) != 0; });
+            }
+            munmap(map, FileSize);
+        }
+        tr_sys_file_close(fd);
+#endif
+        return n_cached;
+    };
+
+    drop_cache();
+    RecordProperty("buffered_mib_per_second", read_all(false));
+    auto const buffered_pages = count_cached_pages();
+    RecordProperty("buffered_cached_pages", static_cast<int>(buffered_pages));
+
+    drop_cache();
+    RecordProperty("direct_mib_per_second", read_all(true));
+    auto const direct_pages = count_cached_pages();
+    RecordProperty("direct_cached_pages", static_cast<int>(direct_pages));
+
+    // if the filesystem doesn't support direct I/O, it falls back to buffered
+    EXPECT_LE(direct_pages, buffered_pages);
+
+    tr_sys_path_remove(path);
+}
+
 TEST_F(FileTest, dirCreate)
 {
     auto const test_dir = createTestDir(currentTestName());
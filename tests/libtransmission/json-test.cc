@@ -5,14 +5,22 @@
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
+#include <chrono>
 #include <clocale> // setlocale()
+#include <cstdint>
 #include <string>
 #include <string_view>
 
+#include <fmt/format.h>
+
 #include "transmission.h"
+#include "crypto-utils.h" // tr_rand_int_weak()
+#include "error.h"
 #include "variant.h"
 #include "variant-common.h"
 
+#include "jsonsl-parser.h"
+
 #include "gtest/gtest.h"
 
 using namespace std::literals;
@@ -220,3 +228,223 @@ INSTANTIATE_TEST_SUITE_P( //
         "da_DK.UTF-8",
         "fr_FR.UTF-8",
         "ru_RU.UTF-8"));
+
+using JSONParserTest = ::testing::Test;
+
+namespace
+{
+
+bool parseJson(tr_variant* setme, std::string_view json)
+{
+    return tr_variantFromBuf(setme, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
+}
+
+void addRandomValue(tr_variant* parent, int depth)
+{
+    auto* const child = tr_variantIsDict(parent) ?
+        tr_variantDictAdd(parent, tr_quark_new(fmt::format("key-{}", tr_rand_int_weak(1000)))) :
+        tr_variantListAdd(parent);
+
+    switch (depth > 3 ? tr_rand_int_weak(4) : tr_rand_int_weak(6))
+    {
+    case 0:
+        tr_variantInitInt(child, static_cast<int64_t>(tr_rand_int_weak(INT32_MAX)) - INT32_MAX / 2);
+        break;
+
+    case 1:
+        tr_variantInitReal(child, tr_rand_int_weak(100000) / 8.0);
+        break;
+
+    case 2:
+        tr_variantInitBool(child, tr_rand_int_weak(2) != 0);
+        break;
+
+    case 3:
+        tr_variantInitStr(child, fmt::format("str \"{}\" \\ \t {}", tr_rand_int_weak(1000), "é中"));
+        break;
+
+    default:
+        auto const n = tr_rand_int_weak(8);
+        if (tr_rand_int_weak(2) != 0)
+        {
+            tr_variantInitDict(child, n);
+        }
+        else
+        {
+            tr_variantInitList(child, n);
+        }
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            addRandomValue(child, depth + 1);
+        }
+        break;
+    }
+}
+
+} // namespace
+
+TEST_F(JSONParserTest, rejectsMalformedInput)
+{
+    for (auto const json : { "[1,2"sv, "{"sv, R"({"a":1)"sv, R"({"a")"sv, R"({"a":})"sv, "[1,]"sv, R"("abc)"sv, "tru"sv,
+                             "[1] [2]"sv, R"({"a":1}x)"sv, "-"sv, "1."sv, "1e"sv })
+    {
+        tr_variant top;
+        tr_error* error = nullptr;
+        EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json, nullptr, &error))
+            << json;
+        EXPECT_NE(nullptr, error) << json;
+        tr_error_clear(&error);
+    }
+}
+
+TEST_F(JSONParserTest, parsesScalarsAndEdgeCases)
+{
+    tr_variant top;
+    auto i = int64_t{};
+
+    EXPECT_TRUE(parseJson(&top, " 42 "sv));
+    EXPECT_TRUE(tr_variantGetInt(&top, &i));
+    EXPECT_EQ(42, i);
+    tr_variantClear(&top);
+
+    // out-of-range integers are clamped the same way strtoll() does
+    EXPECT_TRUE(parseJson(&top, "[99999999999999999999,-99999999999999999999]"sv));
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(&top, 0), &i));
+    EXPECT_EQ(INT64_MAX, i);
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(&top, 1), &i));
+    EXPECT_EQ(INT64_MIN, i);
+    tr_variantClear(&top);
+
+    auto d = double{};
+    EXPECT_TRUE(parseJson(&top, "[-1.5e3]"sv));
+    EXPECT_TRUE(tr_variantGetReal(tr_variantListChild(&top, 0), &d));
+    EXPECT_DOUBLE_EQ(-1500.0, d);
+    tr_variantClear(&top);
+
+    // empty and escaped keys
+    auto sv = std::string_view{};
+    EXPECT_TRUE(parseJson(&top, R"({"":1,"abc":"x"})"sv));
+    EXPECT_TRUE(tr_variantDictFindInt(&top, tr_quark_new(""sv), &i));
+    EXPECT_EQ(1, i);
+    EXPECT_TRUE(tr_variantDictFindStrView(&top, tr_quark_new("abc"sv), &sv));
+    EXPECT_EQ("x"sv, sv);
+    tr_variantClear(&top);
+
+    // surrogate pairs are combined into a single codepoint
+    EXPECT_TRUE(parseJson(&top, R"(["\ud83d\ude00"])"sv));
+    EXPECT_TRUE(tr_variantGetStrView(tr_variantListChild(&top, 0), &sv));
+    EXPECT_EQ("\xf0\x9f\x98\x80"sv, sv);
+    tr_variantClear(&top);
+}
+
+TEST_F(JSONParserTest, inplaceStringsPointIntoInput)
+{
+    auto const in = std::string{ R"({"name":"a string that is too long to be stored inline","escaped":"a\nb"})" };
+
+    tr_variant top;
+    EXPECT_TRUE(parseJson(&top, in));
+
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&top, TR_KEY_name, &sv));
+    EXPECT_EQ("a string that is too long to be stored inline"sv, sv);
+    EXPECT_GE(std::data(sv), std::data(in));
+    EXPECT_LT(std::data(sv), std::data(in) + std::size(in));
+
+    EXPECT_TRUE(tr_variantDictFindStrView(&top, tr_quark_new("escaped"sv), &sv));
+    EXPECT_EQ("a\nb"sv, sv);
+
+    tr_variantClear(&top);
+}
+
+TEST_F(JSONParserTest, rejectsDeepNesting)
+{
+    auto const ok = std::string(64, '[') + std::string(64, ']');
+    auto const too_deep = std::string(100000, '[') + std::string(100000, ']');
+
+    tr_variant top;
+    EXPECT_TRUE(parseJson(&top, ok));
+    tr_variantClear(&top);
+    EXPECT_FALSE(parseJson(&top, too_deep));
+}
+
+TEST_F(JSONParserTest, matchesJsonslParser)
+{
+    for (int run = 0; run < 100; ++run)
+    {
+        tr_variant src;
+        tr_variantInitDict(&src, 8);
+        for (int i = 0; i < 8; ++i)
+        {
+            addRandomValue(&src, 0);
+        }
+        auto const json = tr_variantToStr(&src, TR_VARIANT_FMT_JSON);
+        tr_variantClear(&src);
+
+        tr_variant fast;
+        tr_variant slow;
+        ASSERT_TRUE(tr_variantParseJson(fast, TR_VARIANT_PARSE_JSON, json, nullptr, nullptr, nullptr)) << json;
+        ASSERT_TRUE(tr_variantParseJsonsl(slow, TR_VARIANT_PARSE_JSON, json, nullptr, nullptr, nullptr)) << json;
+        EXPECT_EQ(tr_variantToStr(&slow, TR_VARIANT_FMT_BENC), tr_variantToStr(&fast, TR_VARIANT_FMT_BENC));
+        tr_variantClear(&fast);
+        tr_variantClear(&slow);
+    }
+}
+
+// Compare the throughput of the two parsers on typical RPC payloads:
+// a torrent-add with a large base64 metainfo, a torrent-set with a long
+// files-wanted list, and a torrent-get response.
+TEST_F(JSONParserTest, parseThroughput)
+{
+    auto constexpr B64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"sv;
+    auto metainfo = std::string(1024 * 1024, '\0');
+    for (auto& ch : metainfo)
+    {
+        ch = B64[tr_rand_int_weak(std::size(B64))];
+    }
+    auto const add = fmt::format(R"({{"method":"torrent-add","arguments":{{"metainfo":"{}"}},"tag":1}})", metainfo);
+
+    auto ids = std::string{};
+    for (int i = 0; i < 50000; ++i)
+    {
+        ids += fmt::format("{}{}", i == 0 ? "" : ",", i);
+    }
+    auto const set = fmt::format(R"({{"method":"torrent-set","arguments":{{"ids":[1],"files-wanted":[{}]}},"tag":2}})", ids);
+
+    tr_variant response;
+    tr_variantInitDict(&response, 1);
+    auto* const torrents = tr_variantDictAddList(tr_variantDictAddDict(&response, TR_KEY_arguments, 1), TR_KEY_torrents, 500);
+    for (int i = 0; i < 500; ++i)
+    {
+        auto* const tor = tr_variantListAddDict(torrents, 5);
+        tr_variantDictAddInt(tor, TR_KEY_id, i);
+        tr_variantDictAddStr(tor, TR_KEY_name, fmt::format("Some.Torrent.Name.{}.1080p", i));
+        tr_variantDictAddInt(tor, TR_KEY_rateDownload, i * 1000);
+        tr_variantDictAddReal(tor, TR_KEY_percentDone, 0.5);
+        tr_variantDictAddBool(tor, TR_KEY_isFinished, false);
+    }
+    auto const get = tr_variantToStr(&response, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&response);
+
+    using ParseFunc = bool (*)(tr_variant&, int, std::string_view, char const**, tr_error**, tr_variant_arena*);
+    auto const mbps = [](ParseFunc parse, std::string_view json)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        auto n_runs = 0;
+        for (; n_runs < 10; ++n_runs)
+        {
+            auto arena = tr_variant_arena{};
+            tr_variant top;
+            EXPECT_TRUE(parse(top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json, nullptr, nullptr, &arena));
+            tr_variantClear(&top);
+        }
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+        return static_cast<int>(std::size(json) * n_runs / elapsed.count() / 1e6);
+    };
+
+    for (auto const& [name, json] : { std::pair{ "add"sv, std::string_view{ add } }, { "set"sv, set }, { "get"sv, get } })
+    {
+        RecordProperty(fmt::format("{}_jsonsl_mbps", name), mbps(tr_variantParseJsonsl, json));
+        RecordProperty(fmt::format("{}_mbps", name), mbps(tr_variantParseJson, json));
+    }
+}
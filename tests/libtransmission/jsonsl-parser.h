@@ -0,0 +1,21 @@
+// This file Copyright (C) 2008-2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <string_view>
+
+#include "transmission.h"
+
+#include "variant.h"
+
+/** @brief The previous jsonsl-based JSON parser, kept to compare tr_variantParseJson() against */
+bool tr_variantParseJsonsl(
+    tr_variant& setme,
+    int opts,
+    std::string_view json,
+    char const** setme_end,
+    tr_error** error,
+    tr_variant_arena* arena);
@@ -5,10 +5,12 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdlib> // mktemp()
 #include <numeric>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -216,4 +218,82 @@ TEST_F(MakemetaTest, singleFile)
     testBuilder(builder);
 }
 
+TEST_F(MakemetaTest, hashThreadCountsAgree)
+{
+    // files that aren't aligned to piece boundaries, including empty ones
+    auto const top = tr_pathbuf{ sandboxDir(), "/folder"sv };
+    auto const sizes = std::array<size_t, 7>{ 100000U, 0U, 16384U, 1U, 70000U, 0U, 250000U };
+    auto stream = std::vector<char>{};
+    for (size_t i = 0; i < std::size(sizes); ++i)
+    {
+        auto payload = std::vector<char>(sizes[i]);
+        tr_rand_buffer(std::data(payload), std::size(payload));
+        createFileWithContents(tr_pathbuf{ top, fmt::format("/file-{:d}", i) }, std::data(payload), std::size(payload));
+        stream.insert(std::end(stream), std::begin(payload), std::end(payload));
+    }
+
+    auto bencs = std::vector<std::string>{};
+    for (size_t const n_threads : { 1U, 2U, 7U })
+    {
+        auto builder = tr_metainfo_builder{ top };
+        builder.setPieceSize(16384U);
+        builder.setAnonymize(true);
+        builder.setHashThreadCount(n_threads);
+        EXPECT_EQ(nullptr, builder.makeChecksums().get());
+        EXPECT_EQ(builder.pieceCount(), builder.checksumStatus().first);
+        bencs.emplace_back(builder.benc());
+    }
+    EXPECT_EQ(bencs[0], bencs[1]);
+    EXPECT_EQ(bencs[0], bencs[2]);
+
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parseBenc(bencs.front()));
+    ASSERT_EQ((std::size(stream) + 16383U) / 16384U, metainfo.pieceCount());
+    for (tr_piece_index_t piece = 0; piece < metainfo.pieceCount(); ++piece)
+    {
+        auto const begin = size_t{ piece } * 16384U;
+        auto const end = std::min(begin + 16384U, std::size(stream));
+        auto const expected = tr_sha1::digest(std::string_view{ std::data(stream) + begin, end - begin });
+        EXPECT_EQ(expected, metainfo.pieceHash(piece));
+    }
+}
+
+TEST_F(MakemetaTest, missingFileFails)
+{
+    auto const files = makeRandomFiles(sandboxDir(), 1);
+    auto const [filename, payload] = files.front();
+    auto builder = tr_metainfo_builder{ filename };
+    EXPECT_TRUE(tr_sys_path_remove(filename));
+
+    tr_error* error = builder.makeChecksums().get();
+    EXPECT_NE(nullptr, error);
+    tr_error_clear(&error);
+}
+
+// Compare how fast pieces get hashed with one thread vs. one per core
+TEST_F(MakemetaTest, checksumThroughput)
+{
+    static auto constexpr TotalSize = size_t{ 64U * 1024U * 1024U };
+    auto const filename = tr_pathbuf{ sandboxDir(), "/big-file"sv };
+    auto payload = std::vector<std::byte>(TotalSize);
+    tr_rand_buffer(std::data(payload), std::size(payload));
+    createFileWithContents(filename, std::data(payload), std::size(payload));
+
+    auto const mbps = [&filename](size_t n_threads)
+    {
+        auto builder = tr_metainfo_builder{ filename };
+        builder.setPieceSize(256U * 1024U);
+        builder.setHashThreadCount(n_threads);
+
+        auto const begin = std::chrono::steady_clock::now();
+        EXPECT_EQ(nullptr, builder.makeChecksums().get());
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+        return static_cast<int>(TotalSize / elapsed.count() / 1e6);
+    };
+
+    RecordProperty("hash_threads", static_cast<int>(std::thread::hardware_concurrency()));
+    RecordProperty("single_thread_mbps", mbps(1U));
+    RecordProperty("multi_thread_mbps", mbps(0U));
+}
+
 } // namespace libtransmission::test
@@ -3,19 +3,32 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <event2/buffer.h>
 
 #include "transmission.h"
 
 #include "cache.h" // tr_cacheWriteBlock()
+#include "crypto-utils.h"
+#include "disk-scheduler.h"
 #include "file.h" // tr_sys_path_*()
+#include "inout.h"
+#include "makemeta.h"
+#include "relocator.h"
+#include "session.h"
+#include "torrent.h"
 #include "tr-strbuf.h"
+#include "utils.h"
 #include "variant.h"
 
 #include "test-fixtures.h"
@@ -187,4 +200,263 @@ TEST_F(MoveTest, setLocation)
     tr_torrentRemove(tor, true, nullptr, nullptr);
 }
 
+/***
+****
+***/
+
+class RelocationTest : public SessionTest
+{
+protected:
+    static auto constexpr SourceDevice = tr_disk_scheduler::device_t{ 1 };
+    static auto constexpr HeldDevice = tr_disk_scheduler::device_t{ 2 };
+    static auto constexpr TargetDevice = tr_disk_scheduler::device_t{ 3 };
+
+    void SetUp() override
+    {
+        SessionTest::SetUp();
+
+        source_dir_ = tr_pathbuf{ sandboxDir(), "/Downloads"sv };
+        target_dir_ = tr_pathbuf{ sandboxDir(), "/other-disk"sv };
+
+        // Pretend that the target dir is on another disk, so that setLocation()
+        // copies the files instead of renaming them. Files in "held" dirs are on
+        // a disk of their own, so that holdCopying() can hold up their copies.
+        auto& disk_scheduler = session_->diskScheduler();
+        disk_scheduler.setDeviceFunc(
+            [target_dir = target_dir_](std::string_view path)
+            {
+                if (tr_strvStartsWith(path, target_dir))
+                {
+                    return TargetDevice;
+                }
+
+                return tr_strvEndsWith(path, "/held"sv) ? HeldDevice : SourceDevice;
+            });
+
+        auto config = disk_scheduler.classConfig(tr_disk_scheduler::IoClass::Background);
+        config.max_in_flight = 1U;
+        disk_scheduler.setClassConfig(tr_disk_scheduler::IoClass::Background, config);
+    }
+
+    // Add a seed with two files: "copied/a", which can be copied right away,
+    // and "held/b", which can't be copied while holdCopying()'s ticket is held.
+    [[nodiscard]] tr_torrent* addSeed()
+    {
+        auto const top = tr_pathbuf{ source_dir_, "/relocate-me"sv };
+        contents_[0] = createRandomFile(tr_pathbuf{ top, "/copied/a"sv }, 256U * 1024U);
+        contents_[1] = createRandomFile(tr_pathbuf{ top, "/held/b"sv }, 16U * 1024U);
+
+        auto builder = tr_metainfo_builder{ top.sv() };
+        EXPECT_EQ(nullptr, builder.makeChecksums().get());
+        auto const metainfo = builder.benc();
+
+        auto* const ctor = tr_ctorNew(session_);
+        EXPECT_TRUE(tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo), nullptr));
+        tr_ctorSetDownloadDir(ctor, TR_FORCE, source_dir_.c_str());
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        auto* const tor = tr_torrentNew(ctor, nullptr);
+        tr_ctorFree(ctor);
+
+        EXPECT_NE(nullptr, tor);
+        EXPECT_TRUE(tr_strvEndsWith(tr_torrentFile(tor, 0).name, "copied/a"sv));
+        EXPECT_TRUE(tr_strvEndsWith(tr_torrentFile(tor, 1).name, "held/b"sv));
+        return tor;
+    }
+
+    [[nodiscard]] auto holdCopying()
+    {
+        return session_->diskScheduler().start(HeldDevice, tr_disk_scheduler::IoClass::Background);
+    }
+
+    // @return true once "copied/a" has been copied and "held/b" is waiting its turn
+    [[nodiscard]] bool waitForFirstCopy(tr_torrent const* tor)
+    {
+        auto const test = [this, tor]()
+        {
+            auto const progress = session_->relocator().progress(tor->id());
+            return progress && progress->done >= std::size(contents_[0]);
+        };
+        return waitFor(test, MaxWaitMsec);
+    }
+
+    [[nodiscard]] std::vector<char> createRandomFile(std::string_view path, size_t len) const
+    {
+        auto contents = std::vector<char>(len);
+        tr_rand_buffer(std::data(contents), std::size(contents));
+        createFileWithContents(path, std::data(contents), std::size(contents));
+        return contents;
+    }
+
+    [[nodiscard]] static std::vector<char> load(std::string_view path)
+    {
+        auto contents = std::vector<char>{};
+        EXPECT_TRUE(tr_loadFile(path, contents));
+        return contents;
+    }
+
+    std::string source_dir_;
+    std::string target_dir_;
+    std::array<std::vector<char>, 2> contents_;
+};
+
+TEST_F(RelocationTest, copiesToAnotherDevice)
+{
+    auto* const tor = addSeed();
+    auto hold = holdCopying();
+
+    auto progress = double{ -1.0 };
+    auto state = int{ -1 };
+    tr_torrentSetLocation(tor, target_dir_.c_str(), true, &progress, &state);
+
+    // the torrent keeps using its old files while they're copied
+    EXPECT_TRUE(waitForFirstCopy(tor));
+    EXPECT_EQ(TR_LOC_MOVING, state);
+    auto const old_path = tr_pathbuf{ source_dir_, "/relocate-me/copied/a"sv };
+    EXPECT_EQ(old_path.sv(), tr_torrentFindFile(tor, 0));
+    auto const n_bytes = std::size(contents_[0]) + std::size(contents_[1]);
+    EXPECT_FLOAT_EQ(static_cast<float>(std::size(contents_[0])) / n_bytes, tr_torrentStat(tor)->moveProgress);
+
+    // once they've all been copied, the torrent switches over to the copies
+    hold = {};
+    EXPECT_TRUE(waitFor([&state]() { return state == TR_LOC_DONE; }, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_DONE, state);
+    EXPECT_EQ(1.0, progress);
+    EXPECT_FLOAT_EQ(1.0F, tr_torrentStat(tor)->moveProgress);
+    EXPECT_EQ(target_dir_, tor->currentDir().sv());
+
+    for (tr_file_index_t i = 0; i < 2U; ++i)
+    {
+        auto const name = tr_torrentFile(tor, i).name;
+        auto const new_path = tr_pathbuf{ target_dir_, '/', name };
+        EXPECT_EQ(new_path.sv(), tr_torrentFindFile(tor, i));
+        EXPECT_EQ(contents_[i], load(new_path));
+        EXPECT_FALSE(tr_sys_path_exists(tr_pathbuf{ source_dir_, '/', name }));
+    }
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RelocationTest, recopiesDirtyPieces)
+{
+    auto* const tor = addSeed();
+    auto hold = holdCopying();
+
+    auto state = int{ -1 };
+    tr_torrentSetLocation(tor, target_dir_.c_str(), true, nullptr, &state);
+    EXPECT_TRUE(waitForFirstCopy(tor));
+
+    // write to the first piece after it's been copied, like a download would
+    auto const piece = std::vector<uint8_t>(tor->pieceSize(0), 'z');
+    ASSERT_LE(std::size(piece), std::size(contents_[0]));
+    auto written = std::promise<int>{};
+    session_->runInSessionThread(
+        [tor, &piece, &written]()
+        {
+            auto const loc = tor->pieceLoc(0);
+            written.set_value(tr_ioWrite(tor, loc, std::size(piece), std::data(piece)));
+        });
+    EXPECT_EQ(0, written.get_future().get());
+
+    hold = {};
+    EXPECT_TRUE(waitFor([&state]() { return state == TR_LOC_DONE; }, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_DONE, state);
+
+    // the copy has the new data
+    auto expected = contents_[0];
+    std::fill_n(std::begin(expected), std::size(piece), 'z');
+    EXPECT_EQ(expected, load(tr_pathbuf{ target_dir_, "/relocate-me/copied/a"sv }));
+    EXPECT_EQ(contents_[1], load(tr_pathbuf{ target_dir_, "/relocate-me/held/b"sv }));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RelocationTest, renamesFilesCompletedDuringMove)
+{
+    tr_sessionSetIncompleteFileNamingEnabled(session_, true);
+    auto* const tor = addSeed();
+
+    // pretend that "held/b" is still being downloaded
+    auto const old_partial = tr_pathbuf{ source_dir_, "/relocate-me/held/b.part"sv };
+    EXPECT_TRUE(tr_sys_path_rename(tr_pathbuf{ source_dir_, "/relocate-me/held/b"sv }, old_partial));
+    auto const [begin_piece, end_piece] = tor->piecesInFile(1);
+    auto unmarked = std::promise<void>{};
+    session_->runInSessionThread(
+        [tor, begin_piece = begin_piece, end_piece = end_piece, &unmarked]()
+        {
+            for (auto piece = begin_piece; piece < end_piece; ++piece)
+            {
+                tor->completion.setHasPiece(piece, false);
+            }
+            unmarked.set_value();
+        });
+    unmarked.get_future().get();
+
+    auto hold = holdCopying();
+    auto state = int{ -1 };
+    tr_torrentSetLocation(tor, target_dir_.c_str(), true, nullptr, &state);
+    EXPECT_TRUE(waitForFirstCopy(tor));
+
+    // finish downloading "held/b" while its copy is waiting its turn
+    auto completed = std::promise<bool>{};
+    session_->runInSessionThread(
+        [tor, begin_piece = begin_piece, end_piece = end_piece, &completed]()
+        {
+            for (auto piece = begin_piece; piece < end_piece; ++piece)
+            {
+                auto const [begin_block, end_block] = tor->blockSpanForPiece(piece);
+                for (auto block = begin_block; block < end_block; ++block)
+                {
+                    tr_torrentGotBlock(tor, block);
+                }
+            }
+            completed.set_value(tor->completion.hasBlocks(tr_torGetFileBlockSpan(tor, 1)));
+        });
+    EXPECT_TRUE(completed.get_future().get());
+
+    // the file keeps its partial name until the move's over...
+    EXPECT_TRUE(tr_sys_path_exists(old_partial));
+
+    // ...and then it's renamed in its new location
+    hold = {};
+    EXPECT_TRUE(waitFor([&state]() { return state == TR_LOC_DONE; }, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_DONE, state);
+    auto const new_path = tr_pathbuf{ target_dir_, "/relocate-me/held/b"sv };
+    EXPECT_EQ(new_path.sv(), tr_torrentFindFile(tor, 1));
+    EXPECT_EQ(contents_[1], load(new_path));
+    EXPECT_FALSE(tr_sys_path_exists(tr_pathbuf{ target_dir_, "/relocate-me/held/b.part"sv }));
+    EXPECT_FALSE(tr_sys_path_exists(old_partial));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RelocationTest, cancelDeletesPartialCopies)
+{
+    auto* const tor = addSeed();
+    auto hold = holdCopying();
+
+    auto state = int{ -1 };
+    tr_torrentSetLocation(tor, target_dir_.c_str(), true, nullptr, &state);
+    EXPECT_TRUE(waitForFirstCopy(tor));
+
+    auto const copies = std::array<tr_pathbuf, 2>{ tr_pathbuf{ target_dir_, "/relocate-me/copied/a"sv },
+                                                   tr_pathbuf{ target_dir_, "/relocate-me/held/b"sv } };
+    EXPECT_TRUE(tr_sys_path_exists(copies[0]));
+    EXPECT_TRUE(tr_sys_path_exists(copies[1]));
+
+    // a new setLocation() cancels the move that's in progress
+    auto new_state = int{ -1 };
+    tr_torrentSetLocation(tor, source_dir_.c_str(), false, nullptr, &new_state);
+    EXPECT_TRUE(waitFor([&new_state]() { return new_state == TR_LOC_DONE; }, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_ERROR, state);
+
+    // the copies are gone and the torrent's files are where they were
+    EXPECT_FALSE(tr_sys_path_exists(copies[0]));
+    EXPECT_FALSE(tr_sys_path_exists(copies[1]));
+    EXPECT_EQ(source_dir_, tor->currentDir().sv());
+    EXPECT_EQ(contents_[0], load(tr_pathbuf{ source_dir_, "/relocate-me/copied/a"sv }));
+    EXPECT_EQ(contents_[1], load(tr_pathbuf{ source_dir_, "/relocate-me/held/b"sv }));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
 } // namespace libtransmission::test
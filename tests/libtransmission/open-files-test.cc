@@ -4,12 +4,17 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
 #include <string_view>
+#include <vector>
 
 #include "transmission.h"
 
 #include "error.h"
 #include "file.h"
+#include "open-files.h"
 #include "tr-strbuf.h"
 
 #include "test-fixtures.h"
@@ -18,6 +23,30 @@ using namespace std::literals;
 
 using OpenFilesTest = libtransmission::test::SessionTest;
 
+namespace
+{
+
+// new files are preallocated in the background; wait for that to finish
+[[nodiscard]] std::optional<tr_sys_file_t> getWhenReady(
+    tr_open_files& open_files,
+    tr_torrent_id_t tor_id,
+    tr_file_index_t file_num,
+    std::string_view filename,
+    tr_preallocation_mode allocation,
+    uint64_t file_size)
+{
+    auto fd = open_files.get(tor_id, file_num, true, filename, allocation, file_size);
+    if (!fd && errno == EAGAIN)
+    {
+        EXPECT_TRUE(libtransmission::test::waitFor([&]() { return !open_files.isPreallocating(tor_id, file_num); }, 5000));
+        fd = open_files.get(tor_id, file_num, true, filename, allocation, file_size);
+    }
+
+    return fd;
+}
+
+} // namespace
+
 TEST_F(OpenFilesTest, getCachedFailsIfNotCached)
 {
     auto const fd = session_->openFiles().get(0, 0, false);
@@ -112,7 +141,7 @@ TEST_F(OpenFilesTest, createsMissingFileIfWriteRequested)
     EXPECT_FALSE(fd);
     EXPECT_FALSE(tr_sys_path_exists(filename));
 
-    fd = session_->openFiles().get(0, 0, true, filename, TR_PREALLOCATE_FULL, std::size(Contents));
+    fd = getWhenReady(session_->openFiles(), 0, 0, filename, TR_PREALLOCATE_FULL, std::size(Contents));
     EXPECT_TRUE(fd);
     EXPECT_NE(TR_BAD_SYS_FILE, *fd);
     EXPECT_TRUE(tr_sys_path_exists(filename));
@@ -171,7 +200,7 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     for (int i = 0; i < LargerThanCacheLimit; ++i)
     {
         auto filename = tr_pathbuf{ sandboxDir(), fmt::format("/file-{:d}.txt"sv, i) };
-        EXPECT_TRUE(session_->openFiles().get(TorId, i, true, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+        EXPECT_TRUE(getWhenReady(session_->openFiles(), TorId, i, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
     }
 
     // Do a lookup-only for the files again *in the same order*. By following the
@@ -190,3 +219,131 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     EXPECT_EQ(sorted, results);
     EXPECT_GT(std::count(std::begin(results), std::end(results), true), 0);
 }
+
+TEST_F(OpenFilesTest, preallocatesNewFilesInTheBackground)
+{
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    static auto constexpr FileSize = uint64_t{ 4 * 1024 * 1024 };
+    auto const filename = tr_pathbuf{ sandboxDir(), "/subdir/big-file.bin" };
+    auto& open_files = session_->openFiles();
+
+    // the first attempt hands the work off instead of blocking on it
+    errno = 0;
+    EXPECT_FALSE(open_files.get(TorId, 0, true, filename, TR_PREALLOCATE_FULL, FileSize));
+    EXPECT_EQ(EAGAIN, errno);
+    EXPECT_TRUE(tr_sys_path_exists(filename));
+
+    EXPECT_TRUE(libtransmission::test::waitFor([&]() { return !open_files.isPreallocating(TorId, 0); }, 5000));
+    EXPECT_FALSE(open_files.preallocationProgress(TorId));
+
+    auto const fd = open_files.get(TorId, 0, true, filename, TR_PREALLOCATE_FULL, FileSize);
+    EXPECT_TRUE(fd);
+    auto const info = tr_sys_path_get_info(filename);
+    ASSERT_TRUE(info);
+    EXPECT_EQ(FileSize, info->size);
+}
+
+TEST_F(OpenFilesTest, cancelingPreallocationLeavesAUsableFile)
+{
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    static auto constexpr FileSize = uint64_t{ 64 * 1024 * 1024 };
+    auto& open_files = session_->openFiles();
+
+    for (tr_file_index_t i = 0; i < 4; ++i)
+    {
+        auto const filename = tr_pathbuf{ sandboxDir(), fmt::format("/file-{:d}.bin"sv, i) };
+        EXPECT_FALSE(open_files.get(TorId, i, true, filename, TR_PREALLOCATE_FULL, FileSize));
+    }
+
+    open_files.cancelPreallocation(TorId, 3);
+    EXPECT_FALSE(open_files.isPreallocating(TorId, 3));
+    open_files.cancelPreallocation(TorId);
+    for (tr_file_index_t i = 0; i < 4; ++i)
+    {
+        EXPECT_FALSE(open_files.isPreallocating(TorId, i));
+    }
+    EXPECT_FALSE(open_files.preallocationProgress(TorId));
+
+    // the files can be written to right away
+    auto const filename = tr_pathbuf{ sandboxDir(), "/file-0.bin"sv };
+    EXPECT_TRUE(open_files.get(TorId, 0, true, filename, TR_PREALLOCATE_FULL, FileSize));
+}
+
+TEST_F(OpenFilesTest, resumingPreallocationKeepsWrittenData)
+{
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    static auto constexpr FileSize = uint64_t{ 16 * 1024 * 1024 };
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr Offset = uint64_t{ 1024 * 1024 };
+    static auto constexpr NumFiles = tr_file_index_t{ 4 };
+    auto& open_files = session_->openFiles();
+
+    auto filenames = std::vector<tr_pathbuf>{};
+    for (tr_file_index_t i = 0; i < NumFiles; ++i)
+    {
+        filenames.emplace_back(sandboxDir(), fmt::format("/file-{:d}.bin"sv, i));
+        EXPECT_FALSE(open_files.get(TorId, i, true, filenames.back(), TR_PREALLOCATE_FULL, FileSize));
+    }
+
+    // stopping the torrent cancels the preallocation, and then
+    // the cache flushes the blocks that were waiting for it
+    open_files.cancelPreallocation(TorId);
+    for (auto const& filename : filenames)
+    {
+        auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_WRITE, 0666);
+        ASSERT_NE(TR_BAD_SYS_FILE, fd);
+        EXPECT_TRUE(tr_sys_file_write_at(fd, std::data(Contents), std::size(Contents), Offset, nullptr));
+        tr_sys_file_close(fd);
+    }
+
+    // a file that's gone by the time the torrent starts again is left alone
+    EXPECT_TRUE(tr_sys_path_remove(filenames.back()));
+
+    open_files.resumePreallocation(TorId);
+    for (tr_file_index_t i = 0; i < NumFiles; ++i)
+    {
+        EXPECT_TRUE(libtransmission::test::waitFor([&]() { return !open_files.isPreallocating(TorId, i); }, 5000));
+    }
+    EXPECT_FALSE(tr_sys_path_exists(filenames.back()));
+    filenames.pop_back();
+
+    for (auto const& filename : filenames)
+    {
+        auto const info = tr_sys_path_get_info(filename);
+        ASSERT_TRUE(info);
+        EXPECT_EQ(FileSize, info->size);
+
+        auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_READ, 0);
+        ASSERT_NE(TR_BAD_SYS_FILE, fd);
+        auto buf = std::array<char, std::size(Contents)>{};
+        EXPECT_TRUE(tr_sys_file_read_at(fd, std::data(buf), std::size(buf), Offset, nullptr));
+        EXPECT_EQ(Contents, std::string_view(std::data(buf), std::size(buf)));
+        tr_sys_file_close(fd);
+    }
+}
+
+TEST_F(OpenFilesTest, reportsPreallocationFailures)
+{
+    static auto constexpr TorId = tr_torrent_id_t{ 1 };
+    static auto constexpr FileNum = tr_file_index_t{ 2 };
+
+    auto failed_tor_id = std::atomic<tr_torrent_id_t>{};
+    auto failed_file_num = std::atomic<tr_file_index_t>{};
+    auto failed_err = std::atomic<int>{};
+    auto preallocator = tr_preallocator{ nullptr,
+                                         [&](tr_torrent_id_t tor_id, tr_file_index_t file_num, std::string_view, int err)
+                                         {
+                                             failed_tor_id = tor_id;
+                                             failed_file_num = file_num;
+                                             failed_err = err;
+                                         } };
+
+    // the preallocator expects the file to exist already, so this fails
+    auto const filename = tr_pathbuf{ sandboxDir(), "/missing-file.bin"sv };
+    preallocator.add(TorId, FileNum, filename, TR_PREALLOCATE_FULL, 1024U);
+
+    EXPECT_TRUE(libtransmission::test::waitFor([&]() { return failed_err != 0; }, 5000));
+    EXPECT_EQ(TorId, failed_tor_id);
+    EXPECT_EQ(FileNum, failed_file_num);
+    EXPECT_EQ(ENOENT, failed_err);
+}
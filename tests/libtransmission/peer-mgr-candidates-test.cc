@@ -0,0 +1,332 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <ctime> // time_t
+#include <iterator> // std::back_inserter
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "net.h"
+#include "peer-mgr-candidates.h"
+
+#include "gtest/gtest.h"
+
+class PeerMgrCandidatesTest : public ::testing::Test
+{
+protected:
+    struct MockAtom
+    {
+        explicit MockAtom(tr_address addr_in)
+            : addr{ addr_in }
+        {
+        }
+
+        tr_address const addr;
+        std::optional<uint64_t> candidate_score;
+
+        uint64_t base_score = 0; // smaller is better
+        time_t retry_at = 0; // not a candidate before this time
+    };
+
+    struct MockMediator final : public CandidateQueue<MockAtom>::Mediator
+    {
+        mutable std::map<tr_address, MockAtom> atoms_;
+
+        [[nodiscard]] MockAtom* find(tr_address const& addr) const final
+        {
+            auto const iter = atoms_.find(addr);
+            return iter != std::end(atoms_) ? &iter->second : nullptr;
+        }
+
+        [[nodiscard]] uint64_t score(MockAtom const& atom, uint8_t salt) const final
+        {
+            return (atom.base_score << 8U) | salt;
+        }
+
+        [[nodiscard]] bool isCandidate(MockAtom const& atom, time_t now) const final
+        {
+            return atom.retry_at <= now;
+        }
+
+        [[nodiscard]] time_t retryAt(MockAtom const& atom, time_t /*now*/) const final
+        {
+            return atom.retry_at;
+        }
+
+        MockAtom& add(uint32_t n, uint64_t base_score)
+        {
+            auto addr = tr_address{};
+            addr.type = TR_AF_INET;
+            addr.addr.addr4.s_addr = htonl(0x0A000000U + n);
+
+            auto& atom = atoms_.try_emplace(addr, addr).first->second;
+            atom.base_score = base_score;
+            return atom;
+        }
+    };
+
+    // pop up to `max` candidates, best first
+    static std::vector<MockAtom*> popCandidates(CandidateQueue<MockAtom>& queue, time_t now, size_t max)
+    {
+        auto ret = std::vector<MockAtom*>{};
+
+        while (std::size(ret) < max)
+        {
+            auto* const atom = queue.peek(now);
+            if (atom == nullptr)
+            {
+                break;
+            }
+
+            queue.pop();
+            ret.push_back(atom);
+        }
+
+        return ret;
+    }
+
+    static auto constexpr Now = time_t{ 1000000 };
+
+    MockMediator mediator_;
+};
+
+TEST_F(PeerMgrCandidatesTest, returnsBestFirst)
+{
+    static auto constexpr NumAtoms = uint32_t{ 1000 };
+
+    auto queue = CandidateQueue<MockAtom>{ mediator_ };
+    for (uint32_t i = 0; i < NumAtoms; ++i)
+    {
+        // scores in a scrambled order, with some ties
+        queue.queue(mediator_.add(i, (i * 7919U) % (NumAtoms / 2U)));
+    }
+
+    auto const popped = popCandidates(queue, Now, NumAtoms * 2U);
+    EXPECT_EQ(NumAtoms, std::size(popped));
+    EXPECT_EQ(NumAtoms, std::size(std::set<MockAtom*>(std::begin(popped), std::end(popped))));
+    EXPECT_TRUE(std::is_sorted(
+        std::begin(popped),
+        std::end(popped),
+        [](auto const* a, auto const* b) { return a->base_score < b->base_score; }));
+    EXPECT_EQ(nullptr, queue.peek(Now));
+}
+
+TEST_F(PeerMgrCandidatesTest, rescoresTheTopEntry)
+{
+    auto queue = CandidateQueue<MockAtom>{ mediator_ };
+    auto& a = mediator_.add(1, 10);
+    auto& b = mediator_.add(2, 20);
+    queue.queue(a);
+    queue.queue(b);
+
+    // a got worse after it was queued
+    a.base_score = 30;
+    EXPECT_EQ(&b, queue.peek(Now));
+    queue.pop();
+    EXPECT_FALSE(b.candidate_score);
+
+    EXPECT_EQ(&a, queue.peek(Now));
+    EXPECT_EQ(uint64_t{ 30 }, *a.candidate_score >> 8U);
+}
+
+TEST_F(PeerMgrCandidatesTest, dropsStaleEntries)
+{
+    auto queue = CandidateQueue<MockAtom>{ mediator_ };
+    auto& a = mediator_.add(1, 10);
+    auto& b = mediator_.add(2, 20);
+    auto const b_addr = b.addr;
+    queue.queue(a);
+    queue.queue(b);
+
+    // queueing an atom again with the same score is a no-op...
+    queue.queue(a);
+    EXPECT_EQ(2U, queue.size());
+
+    // ...but with a new score, the old entry is left behind
+    a.base_score = 5;
+    queue.queue(a);
+    EXPECT_EQ(3U, queue.size());
+
+    // and b gets pruned from the pool
+    mediator_.atoms_.erase(b_addr);
+
+    auto const popped = popCandidates(queue, Now, 10U);
+    EXPECT_EQ(std::vector<MockAtom*>{ &a }, popped);
+    EXPECT_EQ(0U, queue.size());
+}
+
+TEST_F(PeerMgrCandidatesTest, parksAtomsUntilTheyCanRetry)
+{
+    auto queue = CandidateQueue<MockAtom>{ mediator_ };
+    auto& a = mediator_.add(1, 10);
+    auto& b = mediator_.add(2, 20);
+    a.retry_at = Now + 10;
+    queue.queue(a);
+    queue.queue(b);
+
+    // a is better, but can't be tried yet
+    EXPECT_EQ(&b, queue.peek(Now));
+    queue.pop();
+    EXPECT_EQ(nullptr, queue.peek(Now));
+    EXPECT_FALSE(a.candidate_score);
+    EXPECT_EQ(1U, queue.size());
+
+    EXPECT_EQ(nullptr, queue.peek(Now + 9));
+    EXPECT_EQ(&a, queue.peek(Now + 10));
+}
+
+// Only the entry at the top of the queue is re-scored, so entries further
+// down can have stale scores. Check that those atoms still get their turn.
+TEST_F(PeerMgrCandidatesTest, staleScoresDontStarveCandidates)
+{
+    static auto constexpr NumAtoms = uint32_t{ 1000 };
+    static auto constexpr PerPulse = size_t{ 16 };
+
+    auto queue = CandidateQueue<MockAtom>{ mediator_ };
+    auto atoms = std::vector<MockAtom*>{};
+    for (uint32_t i = 0; i < NumAtoms; ++i)
+    {
+        atoms.push_back(&mediator_.add(i, i));
+        queue.queue(*atoms.back());
+    }
+
+    // Change the scores of most atoms without requeueing them.
+    // Some get better, which the queue only notices when they reach the top.
+    // Some get worse, and get pushed back behind their new neighbours.
+    for (uint32_t i = 0; i < NumAtoms; ++i)
+    {
+        if (i % 3U == 0U)
+        {
+            atoms[i]->base_score = i / 2U;
+        }
+        else if (i % 3U == 1U)
+        {
+            atoms[i]->base_score = NumAtoms + i;
+        }
+    }
+
+    // Each pulse tries the best few atoms. Trying an atom makes its score
+    // worse, like tr_peerMgr's lastConnectionAttemptAt, and then it gets
+    // queued again, like a failed handshake.
+    auto next_score = uint64_t{ NumAtoms };
+    auto n_picks = std::map<MockAtom const*, size_t>{};
+    auto n_picked_before_any_repeat = size_t{};
+    auto repeated = false;
+    auto n_pulses = size_t{};
+    while (std::size(n_picks) < NumAtoms && n_pulses < NumAtoms)
+    {
+        ++n_pulses;
+        for (auto* const atom : popCandidates(queue, Now, PerPulse))
+        {
+            if (n_picks[atom]++ > 0U)
+            {
+                repeated = true;
+            }
+            else if (!repeated)
+            {
+                ++n_picked_before_any_repeat;
+            }
+
+            atom->base_score = next_score++;
+            queue.queue(*atom);
+        }
+    }
+
+    // Every atom whose score didn't get worse had its turn
+    // before anyone got a second one, stale entry or not...
+    EXPECT_EQ(NumAtoms - NumAtoms / 3U, n_picked_before_any_repeat);
+
+    // ...and the ones that did get worse still had theirs
+    // before anyone else got a third.
+    EXPECT_EQ(NumAtoms, std::size(n_picks));
+    for (auto const& [atom, n] : n_picks)
+    {
+        EXPECT_LE(n, 3U);
+    }
+
+    // the entries left behind are bounded by the number of atoms
+    EXPECT_LE(queue.size(), NumAtoms * 2U);
+}
+
+// Compare one reconnect pulse with the queue against scoring
+// and sorting every atom, which is what the pulse used to do.
+TEST_F(PeerMgrCandidatesTest, pulseCost)
+{
+    static auto constexpr NumAtoms = uint32_t{ 100000 };
+    static auto constexpr PerPulse = size_t{ 16 };
+    static auto constexpr NumPulses = 50;
+
+    auto queue = CandidateQueue<MockAtom>{ mediator_ };
+    auto atoms = std::vector<MockAtom*>{};
+    for (uint32_t i = 0; i < NumAtoms; ++i)
+    {
+        atoms.push_back(&mediator_.add(i, (i * 7919U) % NumAtoms));
+        queue.queue(*atoms.back());
+    }
+
+    auto const scan_pulse = [this, &atoms]()
+    {
+        auto scored = std::vector<std::pair<uint64_t, MockAtom*>>{};
+        scored.reserve(std::size(atoms));
+        for (auto* const atom : atoms)
+        {
+            if (mediator_.isCandidate(*atom, Now))
+            {
+                scored.emplace_back(mediator_.score(*atom, 0), atom);
+            }
+        }
+
+        auto const n = std::min(PerPulse, std::size(scored));
+        std::partial_sort(std::begin(scored), std::begin(scored) + n, std::end(scored));
+        auto ret = std::vector<MockAtom*>{};
+        std::transform(
+            std::begin(scored),
+            std::begin(scored) + n,
+            std::back_inserter(ret),
+            [](auto const& pair) { return pair.second; });
+        return ret;
+    };
+
+    auto next_score = uint64_t{ NumAtoms };
+    auto queue_time = std::chrono::steady_clock::duration{};
+    auto scan_time = std::chrono::steady_clock::duration{};
+    for (int pulse = 0; pulse < NumPulses; ++pulse)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        auto const expected = scan_pulse();
+        scan_time += std::chrono::steady_clock::now() - begin;
+
+        begin = std::chrono::steady_clock::now();
+        auto const picked = popCandidates(queue, Now, PerPulse);
+        queue_time += std::chrono::steady_clock::now() - begin;
+
+        // every base score is unique, so both should pick the same atoms
+        EXPECT_EQ(expected, picked);
+
+        for (auto* const atom : picked)
+        {
+            atom->base_score = next_score++;
+            queue.queue(*atom);
+        }
+    }
+
+    auto const usec_per_pulse = [](auto duration)
+    {
+        return static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(duration / NumPulses).count());
+    };
+    RecordProperty("queue_usec_per_pulse", usec_per_pulse(queue_time));
+    RecordProperty("scan_usec_per_pulse", usec_per_pulse(scan_time));
+}
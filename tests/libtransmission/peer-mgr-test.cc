@@ -0,0 +1,93 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <limits>
+#include <vector>
+
+#include "transmission.h"
+
+#include "net.h"
+#include "peer-mgr.h"
+#include "torrent.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+using PeerMgrTest = SessionTest;
+
+namespace
+{
+
+[[nodiscard]] std::vector<tr_pex> makePex(size_t n, uint32_t first_address = 0x0A000001U)
+{
+    auto pex = std::vector<tr_pex>{};
+    pex.reserve(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto addr = tr_address{};
+        addr.type = TR_AF_INET;
+        addr.addr.addr4.s_addr = htonl(static_cast<uint32_t>(first_address + i));
+        pex.emplace_back(addr, tr_port::fromHost(51413));
+    }
+
+    return pex;
+}
+
+[[nodiscard]] size_t countInterestingPeers(tr_torrent const* tor)
+{
+    return std::size(tr_peerMgrGetPeers(tor, TR_AF_INET, TR_PEERS_INTERESTING, std::numeric_limits<size_t>::max()));
+}
+
+} // namespace
+
+TEST_F(PeerMgrTest, addPexMergesDuplicates)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    static auto constexpr NumPex = size_t{ 1000 };
+    auto const pex = makePex(NumPex);
+    EXPECT_EQ(NumPex, tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)));
+    EXPECT_EQ(NumPex, countInterestingPeers(tor));
+
+    // adding the same peers again should not grow the pool
+    EXPECT_EQ(NumPex, tr_peerMgrAddPex(tor, TR_PEER_FROM_TRACKER, std::data(pex), std::size(pex)));
+    EXPECT_EQ(NumPex, countInterestingPeers(tor));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(PeerMgrTest, addPexAtScaleKeepsPoolBounded)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    // a PEX flood from a very popular swarm
+    static auto constexpr NumPex = size_t{ 100000 };
+    static auto constexpr BatchSize = size_t{ 50 };
+    auto const pex = makePex(NumPex);
+    auto n_used = size_t{};
+    for (size_t i = 0; i < NumPex; i += BatchSize)
+    {
+        n_used += tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex) + i, BatchSize);
+    }
+    EXPECT_EQ(NumPex, n_used);
+
+    // stale atoms should have been pruned along the way. None of them
+    // are in use, so the pool stays within the cap, and pruning only
+    // trims it down to 90% of the cap.
+    auto const n_peers = countInterestingPeers(tor);
+    EXPECT_LE(n_peers, TR_MAX_ATOMS_PER_SWARM);
+    EXPECT_GE(n_peers, TR_MAX_ATOMS_PER_SWARM * 9U / 10U);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+} // namespace libtransmission::test
@@ -26,6 +26,8 @@ protected:
         mutable std::map<tr_piece_index_t, tr_priority_t> piece_priority_;
         mutable std::set<tr_block_index_t> can_request_block_;
         mutable std::set<tr_piece_index_t> can_request_piece_;
+        mutable tr_bitfield peer_pieces_{ 0 };
+        mutable tr_bitfield client_pieces_{ 0 };
         tr_piece_index_t piece_count_ = 0;
         bool is_endgame_ = false;
 
@@ -68,6 +70,24 @@ protected:
         {
             return piece_priority_[piece];
         }
+
+        // the peer has every piece that can be requested...
+        [[nodiscard]] tr_bitfield const& peerPieces() const final
+        {
+            peer_pieces_ = tr_bitfield{ piece_count_ };
+            for (auto const piece : can_request_piece_)
+            {
+                peer_pieces_.set(piece);
+            }
+            return peer_pieces_;
+        }
+
+        // ...and we have none of them
+        [[nodiscard]] tr_bitfield const& clientPieces() const final
+        {
+            client_pieces_ = tr_bitfield{ piece_count_ };
+            return client_pieces_;
+        }
     };
 };
 
@@ -0,0 +1,204 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "error.h"
+#include "file.h"
+#include "relocator.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class RelocatorTest : public SandboxedTest
+{
+protected:
+    static auto constexpr TorId = tr_torrent_id_t{ 1 };
+    static auto constexpr OtherTorId = tr_torrent_id_t{ 2 };
+
+    // Adds a job and returns a future for its error code
+    static std::future<int> addJob(tr_relocator& relocator, tr_torrent_id_t tor_id, std::vector<tr_relocator::Task> tasks)
+    {
+        auto promise = std::make_shared<std::promise<int>>();
+        auto future = promise->get_future();
+        relocator.add(
+            tor_id,
+            std::move(tasks),
+            [promise](tr_error const* error) { promise->set_value(error != nullptr ? error->code : 0); });
+        return future;
+    }
+
+    [[nodiscard]] std::vector<char> createRandomFile(std::string_view path, size_t len) const
+    {
+        auto contents = std::vector<char>(len);
+        tr_rand_buffer(std::data(contents), std::size(contents));
+        createFileWithContents(path, std::data(contents), std::size(contents));
+        return contents;
+    }
+
+    [[nodiscard]] static std::vector<char> load(std::string_view path)
+    {
+        auto contents = std::vector<char>{};
+        EXPECT_TRUE(tr_loadFile(path, contents));
+        return contents;
+    }
+};
+
+TEST_F(RelocatorTest, copiesFiles)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/old/a"sv };
+    auto const dst = tr_pathbuf{ sandboxDir(), "/new/torrent/a"sv };
+    auto const contents = createRandomFile(src, 100000);
+
+    auto relocator = tr_relocator{};
+    auto done = addJob(relocator, TorId, { { std::string{ src }, std::string{ dst }, 0U, std::size(contents), true } });
+    EXPECT_EQ(0, done.get());
+    EXPECT_EQ(contents, load(dst));
+
+    // the source is left alone
+    EXPECT_EQ(contents, load(src));
+}
+
+TEST_F(RelocatorTest, copiesRanges)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/a"sv };
+    auto const dst = tr_pathbuf{ sandboxDir(), "/b"sv };
+    auto const old_contents = createRandomFile(src, 1000);
+
+    auto relocator = tr_relocator{};
+    EXPECT_EQ(0, addJob(relocator, TorId, { { std::string{ src }, std::string{ dst }, 0U, 1000U, true } }).get());
+
+    // the source changes after it's been copied, so the changed part is copied again
+    auto const new_contents = createRandomFile(src, 1000);
+    EXPECT_EQ(0, addJob(relocator, TorId, { { std::string{ src }, std::string{ dst }, 200U, 100U, false } }).get());
+
+    auto expected = old_contents;
+    std::copy_n(std::begin(new_contents) + 200, 100, std::begin(expected) + 200);
+    EXPECT_EQ(expected, load(dst));
+}
+
+TEST_F(RelocatorTest, copiesNow)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/a"sv };
+    auto const dst = tr_pathbuf{ sandboxDir(), "/new/b"sv };
+    auto const old_contents = createRandomFile(src, 1000);
+
+    tr_error* error = nullptr;
+    EXPECT_TRUE(tr_relocator::copyNow({ std::string{ src }, std::string{ dst }, 0U, 1000U, true }, &error));
+    EXPECT_EQ(nullptr, error);
+    EXPECT_EQ(old_contents, load(dst));
+
+    // e.g. the last few pieces that changed since the file was copied
+    auto const new_contents = createRandomFile(src, 1000);
+    EXPECT_TRUE(tr_relocator::copyNow({ std::string{ src }, std::string{ dst }, 900U, 500U, false }, &error));
+    EXPECT_EQ(nullptr, error);
+
+    auto expected = old_contents;
+    std::copy_n(std::begin(new_contents) + 900, 100, std::begin(expected) + 900);
+    EXPECT_EQ(expected, load(dst));
+
+    auto const missing = tr_pathbuf{ sandboxDir(), "/missing"sv };
+    EXPECT_FALSE(tr_relocator::copyNow({ std::string{ missing }, std::string{ dst }, 0U, 1000U, false }, &error));
+    EXPECT_NE(nullptr, error);
+    tr_error_clear(&error);
+}
+
+TEST_F(RelocatorTest, skipsPastEndOfSource)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/a"sv };
+    auto const dst = tr_pathbuf{ sandboxDir(), "/b"sv };
+    auto const contents = createRandomFile(src, 1000);
+
+    // e.g. a file that hasn't been downloaded all the way to its end yet
+    auto relocator = tr_relocator{};
+    EXPECT_EQ(0, addJob(relocator, TorId, { { std::string{ src }, std::string{ dst }, 0U, 5000U, true } }).get());
+    EXPECT_EQ(contents, load(dst));
+}
+
+TEST_F(RelocatorTest, reportsErrors)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/missing"sv };
+    auto const dst = tr_pathbuf{ sandboxDir(), "/b"sv };
+
+    auto relocator = tr_relocator{};
+    EXPECT_NE(0, addJob(relocator, TorId, { { std::string{ src }, std::string{ dst }, 0U, 1000U, true } }).get());
+    EXPECT_FALSE(relocator.progress(TorId));
+}
+
+TEST_F(RelocatorTest, limitsConcurrency)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/a"sv };
+    createFileWithContents(src, "hello"sv);
+    auto const task = [&src](std::string_view dst)
+    {
+        return tr_relocator::Task{ std::string{ src }, std::string{ dst }, 0U, 1000U, true };
+    };
+
+    for (size_t const max_concurrent : { 1U, 2U })
+    {
+        auto relocator = tr_relocator{ nullptr, max_concurrent };
+
+        // the first job's worker is held up in on_done()
+        auto release = std::promise<void>{};
+        auto released = release.get_future().share();
+        relocator.add(
+            TorId,
+            { task(tr_pathbuf{ sandboxDir(), "/b"sv }) },
+            [released](tr_error const* /*error*/) { released.wait(); });
+
+        auto second = addJob(relocator, OtherTorId, { task(tr_pathbuf{ sandboxDir(), "/c"sv }) });
+        auto const second_ran = second.wait_for(200ms) == std::future_status::ready;
+        EXPECT_EQ(max_concurrent > 1U, second_ran);
+
+        release.set_value();
+        EXPECT_EQ(0, second.get());
+    }
+}
+
+TEST_F(RelocatorTest, cancels)
+{
+    auto const src = tr_pathbuf{ sandboxDir(), "/a"sv };
+    auto const dst = tr_pathbuf{ sandboxDir(), "/b"sv };
+    createFileWithContents(src, "hello"sv);
+    auto const task = tr_relocator::Task{ std::string{ src }, std::string{ dst }, 0U, 1000U, true };
+
+    auto relocator = tr_relocator{};
+
+    // keep the only worker busy so that the next job is still waiting
+    auto release = std::promise<void>{};
+    auto released = release.get_future().share();
+    relocator.add(OtherTorId, { task }, [released](tr_error const* /*error*/) { released.wait(); });
+
+    auto n_done = std::make_shared<std::atomic<int>>();
+    relocator.add(TorId, { task }, [n_done](tr_error const* /*error*/) { ++*n_done; });
+    auto const progress = relocator.progress(TorId);
+    ASSERT_TRUE(progress);
+    EXPECT_EQ(0U, progress->done);
+    EXPECT_EQ(1000U, progress->total);
+
+    relocator.cancel(TorId);
+    EXPECT_FALSE(relocator.progress(TorId));
+
+    release.set_value();
+    relocator.cancel(OtherTorId);
+    EXPECT_EQ(0, *n_done);
+}
+
+} // namespace libtransmission::test
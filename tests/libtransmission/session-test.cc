@@ -5,9 +5,13 @@
 
 #include "transmission.h"
 
+#include "announce-list.h"
+#include "makemeta.h"
 #include "session-alt-speeds.h"
 #include "session-id.h"
 #include "session.h"
+#include "torrent.h"
+#include "tr-strbuf.h"
 #include "version.h"
 
 #include "test-fixtures.h"
@@ -16,9 +20,14 @@
 #include <array>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <future>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
 
 using namespace std::literals;
 
@@ -346,4 +355,295 @@ TEST_F(SessionTest, savesSettings)
     tr_variantClear(&settings);
 }
 
+TEST_F(SessionTest, statColumns)
+{
+    auto cols = tr_stat_columns{};
+    tr_sessionGetStatColumns(session_, &cols);
+    EXPECT_EQ(0U, std::size(cols));
+
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    tr_torrentSetPriority(tor, TR_PRI_HIGH);
+    tr_sessionGetStatColumns(session_, &cols);
+    ASSERT_EQ(1U, std::size(cols));
+
+    auto const* const st = tr_torrentStatCached(tor);
+    EXPECT_EQ(st->id, cols.id[0]);
+    EXPECT_EQ(st->activity, cols.activity[0]);
+    EXPECT_EQ(st->error, cols.error[0]);
+    EXPECT_EQ(TR_PRI_HIGH, cols.priority[0]);
+    EXPECT_EQ(st->queuePosition, cols.queue_position[0]);
+    EXPECT_EQ(st->addedDate, cols.added_date[0]);
+    EXPECT_EQ(tr_torrentTotalSize(tor), cols.total_size[0]);
+    EXPECT_EQ(st->percentComplete, cols.percent_complete[0]);
+    EXPECT_EQ(st->ratio, cols.ratio[0]);
+    EXPECT_EQ(std::size(cols), std::size(cols.webseeds_sending_to_us));
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    tr_sessionGetStatColumns(session_, &cols);
+    EXPECT_EQ(0U, std::size(cols));
+}
+
+TEST_F(SessionTest, queueMoves)
+{
+    auto constexpr Filenames = std::array<std::string_view, 4>{ "Android-x86 8.1 r6 iso.torrent"sv,
+                                                                "debian-11.2.0-amd64-DVD-1.iso.torrent"sv,
+                                                                "ubuntu-18.04.6-desktop-amd64.iso.torrent"sv,
+                                                                "ubuntu-20.04.4-desktop-amd64.iso.torrent"sv };
+
+    auto torrents = std::vector<tr_torrent*>{};
+    for (auto const& name : Filenames)
+    {
+        auto* const ctor = tr_ctorNew(session_);
+        auto const filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', name };
+        EXPECT_TRUE(tr_ctorSetMetainfoFromFile(ctor, filename.c_str(), nullptr));
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        torrents.push_back(tr_torrentNew(ctor, nullptr));
+        ASSERT_NE(nullptr, torrents.back());
+        tr_ctorFree(ctor);
+    }
+
+    // @return the indices of `torrents`, in queue order
+    auto const queue = [&torrents]()
+    {
+        auto ret = std::vector<size_t>(std::size(torrents));
+        for (size_t i = 0; i < std::size(torrents); ++i)
+        {
+            ret[tr_torrentGetQueuePosition(torrents[i])] = i;
+        }
+        return ret;
+    };
+
+    auto const move = [&torrents](auto func, std::initializer_list<size_t> indices)
+    {
+        auto selected = std::vector<tr_torrent*>{};
+        for (auto const i : indices)
+        {
+            selected.push_back(torrents[i]);
+        }
+        func(std::data(selected), std::size(selected));
+    };
+
+    EXPECT_EQ((std::vector<size_t>{ 0, 1, 2, 3 }), queue());
+
+    move(tr_torrentsQueueMoveTop, { 3, 2 });
+    EXPECT_EQ((std::vector<size_t>{ 2, 3, 0, 1 }), queue());
+
+    move(tr_torrentsQueueMoveBottom, { 2 });
+    EXPECT_EQ((std::vector<size_t>{ 3, 0, 1, 2 }), queue());
+
+    // moving the front torrent up leaves it where it is
+    move(tr_torrentsQueueMoveUp, { 3, 1 });
+    EXPECT_EQ((std::vector<size_t>{ 3, 1, 0, 2 }), queue());
+
+    move(tr_torrentsQueueMoveDown, { 3, 2 });
+    EXPECT_EQ((std::vector<size_t>{ 1, 3, 0, 2 }), queue());
+
+    for (auto* const tor : torrents)
+    {
+        tr_torrentRemove(tor, false, nullptr, nullptr);
+    }
+}
+
+class BatchTest : public SessionTest
+{
+protected:
+    static auto constexpr MaxWaitMsec = 5000;
+
+    // Add `n` small paused seeds, in queue order.
+    // They announce to a local port that nothing is listening on.
+    [[nodiscard]] std::vector<tr_torrent*> addPausedSeeds(size_t n)
+    {
+        auto ret = std::vector<tr_torrent*>{};
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto const filename = tr_pathbuf{ sandboxDir(), '/', fmt::format("seed-{:03}", i) };
+            createFileWithContents(filename, fmt::format("this is seed #{}", i));
+
+            auto builder = tr_metainfo_builder{ filename.sv() };
+            auto trackers = tr_announce_list{};
+            trackers.add("http://127.0.0.1:9/announce"sv, trackers.nextTier());
+            builder.setAnnounceList(std::move(trackers));
+            EXPECT_EQ(nullptr, builder.makeChecksums().get());
+            auto const metainfo = builder.benc();
+
+            auto* const ctor = tr_ctorNew(session_);
+            EXPECT_TRUE(tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo), nullptr));
+            tr_ctorSetDownloadDir(ctor, TR_FORCE, sandboxDir().c_str());
+            tr_ctorSetPaused(ctor, TR_FORCE, true);
+            ret.push_back(tr_torrentNew(ctor, nullptr));
+            tr_ctorFree(ctor);
+            EXPECT_NE(nullptr, ret.back());
+        }
+
+        return ret;
+    }
+
+    // Run `func` in the session thread after the tasks already queued there.
+    template<typename Func>
+    auto inSessionThread(Func func)
+    {
+        auto promise = std::promise<decltype(func())>{};
+        session_->runInSessionThread([&promise, &func]() { promise.set_value(func()); });
+        return promise.get_future().get();
+    }
+
+    static void removeAll(std::vector<tr_torrent*> const& torrents)
+    {
+        for (auto* const tor : torrents)
+        {
+            tr_torrentRemove(tor, false, nullptr, nullptr);
+        }
+    }
+};
+
+TEST_F(BatchTest, startCountsFreeSlotsOncePerBatch)
+{
+    tr_sessionSetQueueEnabled(session_, TR_UP, true);
+    tr_sessionSetQueueSize(session_, TR_UP, 2);
+
+    auto torrents = addPausedSeeds(4U);
+    ASSERT_EQ(4U, std::size(torrents));
+
+    // the batch is started in queue order, not in the order given here
+    auto reversed = std::vector<tr_torrent*>(std::rbegin(torrents), std::rend(torrents));
+    tr_torrentsStart(std::data(reversed), std::size(reversed));
+
+    auto const activities = inSessionThread(
+        [&torrents]()
+        {
+            auto ret = std::vector<tr_torrent_activity>{};
+            for (auto const* const tor : torrents)
+            {
+                ret.push_back(tor->activity());
+            }
+            return ret;
+        });
+    EXPECT_EQ(
+        (std::vector<tr_torrent_activity>{ TR_STATUS_SEED, TR_STATUS_SEED, TR_STATUS_SEED_WAIT, TR_STATUS_SEED_WAIT }),
+        activities);
+
+    removeAll(torrents);
+}
+
+TEST_F(BatchTest, startNowBypassesTheQueue)
+{
+    tr_sessionSetQueueEnabled(session_, TR_UP, true);
+    tr_sessionSetQueueSize(session_, TR_UP, 2);
+
+    auto torrents = addPausedSeeds(4U);
+    ASSERT_EQ(4U, std::size(torrents));
+
+    tr_torrentsStartNow(std::data(torrents), std::size(torrents));
+
+    auto const n_seeding = inSessionThread(
+        [&torrents]()
+        {
+            return std::count_if(
+                std::begin(torrents),
+                std::end(torrents),
+                [](auto const* tor) { return tor->activity() == TR_STATUS_SEED; });
+        });
+    EXPECT_EQ(4, n_seeding);
+
+    removeAll(torrents);
+}
+
+TEST_F(BatchTest, stopTakesEffectImmediately)
+{
+    auto torrents = addPausedSeeds(4U);
+    ASSERT_EQ(4U, std::size(torrents));
+
+    tr_torrentsStartNow(std::data(torrents), std::size(torrents));
+    tr_torrentsStop(std::data(torrents), std::size(torrents));
+
+    // tr_torrentStop() only flags the torrent and leaves the
+    // rest to the next pulse, but a batch stop is done at once
+    auto const n_stopped = inSessionThread(
+        [&torrents]()
+        {
+            return std::count_if(
+                std::begin(torrents),
+                std::end(torrents),
+                [](auto const* tor)
+                { return !tor->isRunning && !tor->isStopping && tor->activity() == TR_STATUS_STOPPED; });
+        });
+    EXPECT_EQ(4, n_stopped);
+
+    removeAll(torrents);
+}
+
+TEST_F(BatchTest, verifyRestartsRunningTorrents)
+{
+    auto torrents = addPausedSeeds(4U);
+    ASSERT_EQ(4U, std::size(torrents));
+
+    // start two of them
+    tr_torrentsStartNow(std::data(torrents), 2U);
+    tr_torrentsVerify(std::data(torrents), std::size(torrents));
+
+    // wait for the batch to be queued for verification...
+    inSessionThread([]() { return true; });
+    auto const is_done = [&torrents]()
+    {
+        return std::all_of(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* tor) { return tor->verifyState() == TR_VERIFY_NONE; });
+    };
+    EXPECT_TRUE(waitFor(is_done, MaxWaitMsec));
+
+    // ...and check that only the ones that were running got restarted
+    EXPECT_TRUE(waitFor([&torrents]() { return torrents[0]->isRunning && torrents[1]->isRunning; }, MaxWaitMsec));
+    EXPECT_FALSE(torrents[2]->isRunning);
+    EXPECT_FALSE(torrents[3]->isRunning);
+
+    removeAll(torrents);
+}
+
+TEST_F(BatchTest, startSpreadsAnnounces)
+{
+    static auto constexpr NumTorrents = size_t{ 60 };
+    static auto constexpr PerSecond = size_t{ 20 }; // BatchAnnouncesPerSecond
+
+    auto torrents = addPausedSeeds(NumTorrents);
+    ASSERT_EQ(NumTorrents, std::size(torrents));
+
+    tr_torrentsStartNow(std::data(torrents), std::size(torrents));
+
+    auto const [now, views] = inSessionThread(
+        [&torrents]()
+        {
+            auto ret = std::vector<tr_tracker_view>{};
+            for (auto const* const tor : torrents)
+            {
+                ret.push_back(tr_torrentTracker(tor, 0U));
+            }
+            return std::make_pair(tr_time(), ret);
+        });
+
+    // The batch announces PerSecond torrents per second, in queue order.
+    // Work out when the batch started from its last torrent, which
+    // is still waiting unless this test stalled for seconds.
+    ASSERT_EQ(TR_TRACKER_WAITING, views.back().announceState);
+    auto const batch_start = views.back().nextAnnounceTime - static_cast<time_t>((NumTorrents - 1U) / PerSecond);
+    EXPECT_LE(batch_start, now);
+
+    for (size_t i = 0; i < NumTorrents; ++i)
+    {
+        auto const announce_at = batch_start + static_cast<time_t>(i / PerSecond);
+        if (announce_at > now)
+        {
+            EXPECT_EQ(TR_TRACKER_WAITING, views[i].announceState) << i;
+            EXPECT_EQ(announce_at, views[i].nextAnnounceTime) << i;
+        }
+        else
+        {
+            EXPECT_NE(TR_TRACKER_WAITING, views[i].announceState) << i;
+        }
+    }
+
+    removeAll(torrents);
+}
+
 } // namespace libtransmission::test
@@ -0,0 +1,151 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "transmission.h"
+
+#include "session-thread.h"
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+using SessionThreadTest = ::testing::Test;
+
+TEST_F(SessionThreadTest, smallTasksAreStoredInline)
+{
+    auto n_calls = 0;
+    auto* const counter = &n_calls;
+    auto small = [counter]()
+    {
+        ++*counter;
+    };
+    EXPECT_TRUE(tr_session_thread::Task::isInline<decltype(small)>());
+
+    auto big_buf = std::array<char, tr_session_thread::Task::InlineSize + 1>{};
+    auto big = [counter, big_buf]()
+    {
+        *counter += big_buf.front() + 1;
+    };
+    EXPECT_FALSE(tr_session_thread::Task::isInline<decltype(big)>());
+
+    // both kinds survive being moved around
+    auto tasks = std::vector<tr_session_thread::Task>{};
+    tasks.emplace_back(small);
+    tasks.emplace_back(big);
+    tasks.emplace_back(std::move(small));
+    tasks.reserve(std::size(tasks) * 4);
+    for (auto& task : tasks)
+    {
+        task();
+    }
+    EXPECT_EQ(3, n_calls);
+
+    auto moved = std::move(tasks.front());
+    EXPECT_TRUE(moved);
+    EXPECT_FALSE(tasks.front()); // NOLINT(bugprone-use-after-move)
+}
+
+TEST_F(SessionThreadTest, runsTasksInPostingOrder)
+{
+    static auto constexpr NumTasks = 1000;
+
+    auto session_thread = tr_session_thread::create();
+    auto order = std::vector<int>{};
+    auto done = std::promise<void>{};
+
+    for (int i = 0; i < NumTasks; ++i)
+    {
+        session_thread->run(
+            [&order, &done, i]()
+            {
+                order.push_back(i);
+                if (i + 1 == NumTasks)
+                {
+                    done.set_value();
+                }
+            });
+    }
+
+    ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(5s));
+    ASSERT_EQ(NumTasks, static_cast<int>(std::size(order)));
+    for (int i = 0; i < NumTasks; ++i)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST_F(SessionThreadTest, runsTasksInlineWhenInSessionThread)
+{
+    auto session_thread = tr_session_thread::create();
+    auto ran_inline = std::promise<bool>{};
+
+    session_thread->run(
+        [&session_thread, &ran_inline]()
+        {
+            auto ran = false;
+            session_thread->run([&ran]() { ran = true; });
+            ran_inline.set_value(ran);
+        });
+
+    auto future = ran_inline.get_future();
+    ASSERT_EQ(std::future_status::ready, future.wait_for(5s));
+    EXPECT_TRUE(future.get());
+}
+
+TEST_F(SessionThreadTest, crossThreadPostThroughput)
+{
+    static auto constexpr NumProducers = 4;
+    static auto constexpr TasksPerProducer = 100000;
+    static auto constexpr NumTasks = NumProducers * TasksPerProducer;
+
+    auto session_thread = tr_session_thread::create();
+    auto n_ran = std::atomic<int>{};
+    auto all_done = std::promise<void>{};
+
+    auto const begin = std::chrono::steady_clock::now();
+    auto producers = std::vector<std::thread>{};
+    for (int i = 0; i < NumProducers; ++i)
+    {
+        producers.emplace_back(
+            [&]()
+            {
+                for (int j = 0; j < TasksPerProducer; ++j)
+                {
+                    session_thread->run(
+                        [&n_ran, &all_done]()
+                        {
+                            if (++n_ran == NumTasks)
+                            {
+                                all_done.set_value();
+                            }
+                        });
+                }
+            });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    ASSERT_EQ(std::future_status::ready, all_done.get_future().wait_for(30s));
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+
+    auto const stats = session_thread->stats();
+    EXPECT_EQ(uint64_t{ NumTasks }, stats.tasks_posted);
+    RecordProperty("posts_per_second", static_cast<int>(NumTasks / elapsed.count()));
+    RecordProperty("wakeups", static_cast<int>(stats.wakeups));
+
+    // posts that arrive while a drain is pending share its wakeup
+    EXPECT_GE(stats.wakeups, 1U);
+    EXPECT_LT(stats.wakeups, stats.tasks_posted);
+}
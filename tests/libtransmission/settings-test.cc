@@ -299,6 +299,72 @@ TEST_F(SettingsTest, canSavePreallocation)
     tr_variantClear(&dict);
 }
 
+TEST_F(SettingsTest, canLoadStorageBackend)
+{
+    static auto constexpr Key = TR_KEY_storage_backend;
+
+    auto settings = std::make_unique<tr_session_settings>();
+    auto const default_value = settings->storage_backend;
+    auto constexpr ExpectedValue = TR_STORAGE_CONTAINER;
+    ASSERT_NE(ExpectedValue, default_value);
+
+    auto dict = tr_variant{};
+    tr_variantInitDict(&dict, 1);
+    tr_variantDictAddInt(&dict, Key, ExpectedValue);
+    settings->load(&dict);
+    tr_variantClear(&dict);
+    EXPECT_EQ(ExpectedValue, settings->storage_backend);
+
+    settings = std::make_unique<tr_session_settings>();
+    tr_variantInitDict(&dict, 1);
+    tr_variantDictAddStrView(&dict, Key, "container");
+    settings->load(&dict);
+    tr_variantClear(&dict);
+    EXPECT_EQ(ExpectedValue, settings->storage_backend);
+}
+
+TEST_F(SettingsTest, cannotLoadMemoryStorageBackend)
+{
+    static auto constexpr Key = TR_KEY_storage_backend;
+
+    // the memory backend is only for tests
+    auto settings = std::make_unique<tr_session_settings>();
+    auto const default_value = settings->storage_backend;
+    ASSERT_NE(TR_STORAGE_MEMORY, default_value);
+
+    auto dict = tr_variant{};
+    tr_variantInitDict(&dict, 1);
+    tr_variantDictAddStrView(&dict, Key, "memory");
+    settings->load(&dict);
+    tr_variantClear(&dict);
+    EXPECT_EQ(default_value, settings->storage_backend);
+
+    tr_variantInitDict(&dict, 1);
+    tr_variantDictAddInt(&dict, Key, TR_STORAGE_MEMORY);
+    settings->load(&dict);
+    tr_variantClear(&dict);
+    EXPECT_EQ(default_value, settings->storage_backend);
+}
+
+TEST_F(SettingsTest, canSaveStorageBackend)
+{
+    static auto constexpr Key = TR_KEY_storage_backend;
+
+    auto settings = tr_session_settings{};
+    auto const default_value = settings.storage_backend;
+    auto constexpr ExpectedValue = TR_STORAGE_CONTAINER;
+    ASSERT_NE(ExpectedValue, default_value);
+
+    auto dict = tr_variant{};
+    tr_variantInitDict(&dict, 100);
+    settings.storage_backend = ExpectedValue;
+    settings.save(&dict);
+    auto val = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&dict, Key, &val));
+    EXPECT_EQ("container"sv, val);
+    tr_variantClear(&dict);
+}
+
 TEST_F(SettingsTest, canLoadSizeT)
 {
     static auto constexpr Key = TR_KEY_queue_stalled_minutes;
@@ -0,0 +1,169 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "transmission.h"
+
+#include "file.h" // tr_sys_path_exists()
+#include "inout.h"
+#include "resume.h"
+#include "storage.h"
+#include "torrent.h"
+#include "tr-strbuf.h"
+#include "variant.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class StorageTest
+    : public SessionTest
+    , public ::testing::WithParamInterface<tr_storage_backend>
+{
+protected:
+    void SetUp() override
+    {
+        SessionTest::SetUp();
+
+        setStorageBackend(GetParam());
+    }
+
+    static auto constexpr MaxWaitMsec = 5000;
+
+    // Write every piece of the zero torrent. Returns the first error.
+    // EAGAIN means that the data is still being preallocated.
+    [[nodiscard]] int writeZeroes(tr_torrent* tor)
+    {
+        auto err = std::atomic<int>{ -1 };
+
+        session_->runInSessionThread(
+            [tor, &err]()
+            {
+                auto const buf = std::vector<uint8_t>(tor->pieceSize());
+                auto ret = 0;
+                for (tr_piece_index_t piece = 0, n = tor->pieceCount(); piece < n && ret == 0; ++piece)
+                {
+                    ret = tr_ioWrite(tor, tor->pieceLoc(piece), tor->pieceSize(piece), std::data(buf));
+                }
+                err = ret;
+            });
+
+        waitFor([&err]() { return err != -1; }, MaxWaitMsec);
+        return err;
+    }
+
+    [[nodiscard]] int read(tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t* setme)
+    {
+        auto err = std::atomic<int>{ -1 };
+
+        session_->runInSessionThread(
+            [tor, loc, len, setme, &err]() { err = tr_ioRead(tor, loc, len, setme, tr_disk_scheduler::IoClass::SeedRead); });
+
+        waitFor([&err]() { return err != -1; }, MaxWaitMsec);
+        return err;
+    }
+};
+
+TEST_P(StorageTest, writeReadAndVerify)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_EQ(GetParam(), tor->storage().backend());
+    EXPECT_FALSE(tor->storage().hasAnyData());
+    EXPECT_EQ(tor->totalSize(), tr_torrentStat(tor)->leftUntilDone);
+
+    // nothing's been written yet
+    auto buf = std::vector<uint8_t>(tr_block_info::BlockSize, '\1');
+    EXPECT_NE(0, read(tor, tor->pieceLoc(0), std::size(buf), std::data(buf)));
+
+    // write the torrent, waiting for preallocation if needed
+    auto err = int{};
+    EXPECT_TRUE(waitFor([this, tor, &err]() { return (err = writeZeroes(tor)) != EAGAIN; }, MaxWaitMsec));
+    EXPECT_EQ(0, err);
+    EXPECT_TRUE(tor->storage().hasAnyData());
+
+    // read some data that spans a file boundary
+    auto const file_end = tr_torrentFile(tor, 0).length;
+    auto const loc = tor->byteLoc(file_end - std::size(buf) / 2);
+    EXPECT_EQ(0, read(tor, loc, std::size(buf), std::data(buf)));
+    EXPECT_EQ(std::vector<uint8_t>(std::size(buf)), buf);
+
+    // verify that every piece was stored
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0U, tr_torrentStat(tor)->leftUntilDone);
+
+    // the container backend doesn't create the torrent's files
+    auto const container = tr_pathbuf{ tor->downloadDir(), '/', tor->infoHashString(), ".container"sv };
+    EXPECT_EQ(GetParam() == TR_STORAGE_CONTAINER, tr_sys_path_exists(container));
+    EXPECT_EQ(GetParam() == TR_STORAGE_FILESYSTEM, !std::empty(tr_torrentFindFile(tor, 0)));
+
+    // removing the torrent removes its data
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+    EXPECT_TRUE(waitFor([&container]() { return !tr_sys_path_exists(container); }, MaxWaitMsec));
+}
+
+TEST_P(StorageTest, setLocationMovesData)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    auto err = int{};
+    EXPECT_TRUE(waitFor([this, tor, &err]() { return (err = writeZeroes(tor)) != EAGAIN; }, MaxWaitMsec));
+    EXPECT_EQ(0, err);
+
+    auto const old_container = tr_pathbuf{ tor->currentDir(), '/', tor->infoHashString(), ".container"sv };
+    auto const target_dir = tr_pathbuf{ sandboxDir(), "/target"sv };
+    auto state = int{ -1 };
+    tr_torrentSetLocation(tor, target_dir, true, nullptr, &state);
+    EXPECT_TRUE(waitFor([&state]() { return state == TR_LOC_DONE; }, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_DONE, state);
+    EXPECT_EQ(target_dir.sv(), tor->currentDir().sv());
+
+    // the container moved with the torrent
+    auto const new_container = tr_pathbuf{ target_dir, '/', tor->infoHashString(), ".container"sv };
+    EXPECT_FALSE(tr_sys_path_exists(old_container));
+    EXPECT_EQ(GetParam() == TR_STORAGE_CONTAINER, tr_sys_path_exists(new_container));
+
+    // and the data can still be read
+    auto buf = std::vector<uint8_t>(tr_block_info::BlockSize, '\1');
+    EXPECT_EQ(0, read(tor, tor->pieceLoc(0), std::size(buf), std::data(buf)));
+    EXPECT_EQ(std::vector<uint8_t>(std::size(buf)), buf);
+    EXPECT_TRUE(tor->storage().hasAnyData());
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_P(StorageTest, resumeFileRestoresBackend)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    tr_resume::save(tor);
+
+    // changing the setting doesn't change the backend of torrents that were already added
+    setStorageBackend(GetParam() == TR_STORAGE_CONTAINER ? TR_STORAGE_FILESYSTEM : TR_STORAGE_CONTAINER);
+    tor->storage_ = tr_storage::create(session_->storageBackend(), *tor);
+
+    auto* const ctor = tr_ctorNew(session_);
+    auto const loaded = tr_resume::load(tor, tr_resume::StorageBackend, ctor, nullptr);
+    tr_ctorFree(ctor);
+
+    // The memory backend is only for tests and isn't saved, so its resume file looks like
+    // one from before there was a choice of backends. Those torrents are on the filesystem.
+    EXPECT_NE(0U, loaded & tr_resume::StorageBackend);
+    EXPECT_EQ(GetParam() == TR_STORAGE_MEMORY ? TR_STORAGE_FILESYSTEM : GetParam(), tor->storage().backend());
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Storage,
+    StorageTest,
+    ::testing::Values(TR_STORAGE_FILESYSTEM, TR_STORAGE_MEMORY, TR_STORAGE_CONTAINER));
+
+} // namespace libtransmission::test
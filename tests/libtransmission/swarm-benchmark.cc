@@ -0,0 +1,521 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// An end-to-end transfer benchmark. One seeder and N leecher sessions run
+// in this process and share a synthetic torrent over TCP or µTP, so that
+// regressions in peer-io, bandwidth, the cache, or piece hashing show up
+// as a change in throughput, CPU use, memory use, or event-loop lag.
+//
+// Results are printed as JSON (or saved with --output) so that runs can
+// be compared across releases, e.g.
+//
+//   swarm-benchmark --leechers 4 --size 512 --piece-size 1024 --transport utp
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <ifaddrs.h>
+#include <net/if.h> // IFF_LOOPBACK
+#include <sys/resource.h> // getrusage()
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "crypto-utils.h" // tr_rand_buffer()
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "makemeta.h"
+#include "net.h"
+#include "peer-mgr.h" // tr_peerMgrAddPex()
+#include "session.h"
+#include "tr-getopt.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+#include "variant.h"
+#include "version.h" // LONG_VERSION_STRING
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace
+{
+
+char constexpr MyName[] = "swarm-benchmark";
+char constexpr Usage[] = "Usage: swarm-benchmark [options]";
+
+auto constexpr Options = std::array<tr_option, 12>{
+    { { 'n', "leechers", "Number of leecher sessions (default: 4)", "n", true, "<count>" },
+      { 's', "size", "Total torrent size in MiB (default: 256)", "s", true, "<MiB>" },
+      { 'p', "piece-size", "Piece size in KiB (default: based on the torrent size)", "p", true, "<KiB>" },
+      { 'f', "files", "Number of files to split the torrent into (default: 1)", "f", true, "<count>" },
+      { 't', "transport", "Peer transport: 'tcp' or 'utp' (default: tcp)", "t", true, "<tcp|utp>" },
+      { 'a', "address", "Local IPv4 address to run the swarm on (default: first non-loopback)", "a", true, "<address>" },
+      { 'P', "port", "First peer port to use (default: 51500)", "P", true, "<port>" },
+      { 'c', "cache", "Per-session cache size in MiB (default: libtransmission's default)", "c", true, "<MiB>" },
+      { 'T', "timeout", "Give up after this many seconds (default: 600)", "T", true, "<seconds>" },
+      { 'o', "output", "Save the JSON results to this file instead of printing them", "o", true, "<file>" },
+      { 'v', "verbose", "Show libtransmission's log messages", "v", false, nullptr },
+      { 0, nullptr, nullptr, nullptr, false, nullptr } }
+};
+
+struct Config
+{
+    size_t n_leechers = 4;
+    uint64_t total_size = 256U * 1024U * 1024U;
+    uint32_t piece_size = 0;
+    size_t n_files = 1;
+    bool utp = false;
+    std::string address;
+    uint16_t first_port = 51500;
+    std::optional<int64_t> cache_size_mb;
+    std::chrono::seconds timeout = 600s;
+    std::string output;
+    bool verbose = false;
+};
+
+bool parseCommandLine(Config& config, int argc, char const* const* argv)
+{
+    int c = 0;
+    char const* optarg = nullptr;
+
+    while ((c = tr_getopt(Usage, argc, argv, std::data(Options), &optarg)) != TR_OPT_DONE)
+    {
+        switch (c)
+        {
+        case 'n':
+            config.n_leechers = std::max(1UL, strtoul(optarg, nullptr, 10));
+            break;
+
+        case 's':
+            config.total_size = std::max(1ULL, strtoull(optarg, nullptr, 10)) * 1024U * 1024U;
+            break;
+
+        case 'p':
+            config.piece_size = static_cast<uint32_t>(strtoul(optarg, nullptr, 10) * 1024U);
+            break;
+
+        case 'f':
+            config.n_files = std::max(1UL, strtoul(optarg, nullptr, 10));
+            break;
+
+        case 't':
+            config.utp = optarg == "utp"sv;
+            break;
+
+        case 'a':
+            config.address = optarg;
+            break;
+
+        case 'P':
+            config.first_port = static_cast<uint16_t>(strtoul(optarg, nullptr, 10));
+            break;
+
+        case 'c':
+            config.cache_size_mb = strtoll(optarg, nullptr, 10);
+            break;
+
+        case 'T':
+            config.timeout = std::chrono::seconds{ strtoul(optarg, nullptr, 10) };
+            break;
+
+        case 'o':
+            config.output = optarg;
+            break;
+
+        case 'v':
+            config.verbose = true;
+            break;
+
+        default:
+            tr_getopt_usage(MyName, Usage, std::data(Options));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// libtransmission won't connect to peers on 127.0.0.0/8, so run the swarm
+// on one of this machine's other addresses. Traffic to it still never
+// leaves the machine.
+std::string findLocalAddress()
+{
+    auto ret = std::string{};
+
+    ifaddrs* ifa_list = nullptr;
+    if (getifaddrs(&ifa_list) != 0)
+    {
+        return ret;
+    }
+
+    for (auto const* ifa = ifa_list; ifa != nullptr && std::empty(ret); ifa = ifa->ifa_next)
+    {
+        if (ifa->ifa_addr == nullptr || ifa->ifa_addr->sa_family != AF_INET || (ifa->ifa_flags & IFF_LOOPBACK) != 0)
+        {
+            continue;
+        }
+
+        auto const addr = tr_address::from_sockaddr(ifa->ifa_addr);
+        if (addr && addr->first.is_valid_for_peers(tr_port::fromHost(1)))
+        {
+            ret = addr->first.display_name();
+        }
+    }
+
+    freeifaddrs(ifa_list);
+    return ret;
+}
+
+// Measures how long tasks posted to a session wait before they run.
+// That's a good proxy for how busy the session's event loop is.
+class LagProbe
+{
+public:
+    explicit LagProbe(tr_session* session)
+        : session_{ session }
+    {
+    }
+
+    void sample()
+    {
+        if (in_flight_.exchange(true))
+        {
+            return;
+        }
+
+        session_->runInSessionThread(
+            [this, posted_at = std::chrono::steady_clock::now()]()
+            {
+                auto const lag = std::chrono::steady_clock::now() - posted_at;
+                auto const lag_usec = std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+                total_usec_ += lag_usec;
+                max_usec_ = std::max(max_usec_.load(), static_cast<uint64_t>(lag_usec));
+                ++n_samples_;
+                in_flight_ = false;
+            });
+    }
+
+    [[nodiscard]] double meanMsec() const noexcept
+    {
+        return n_samples_ != 0U ? total_usec_ / 1000.0 / n_samples_ : 0.0;
+    }
+
+    [[nodiscard]] double maxMsec() const noexcept
+    {
+        return max_usec_ / 1000.0;
+    }
+
+private:
+    tr_session* const session_;
+    std::atomic<bool> in_flight_ = false;
+    std::atomic<uint64_t> total_usec_ = 0;
+    std::atomic<uint64_t> max_usec_ = 0;
+    std::atomic<uint64_t> n_samples_ = 0;
+};
+
+struct Peer
+{
+    tr_session* session = nullptr;
+    tr_torrent* tor = nullptr;
+    uint16_t port = 0;
+    std::unique_ptr<LagProbe> lag;
+    std::optional<std::chrono::steady_clock::time_point> done_at;
+};
+
+[[nodiscard]] tr_session* createSession(Config const& config, std::string_view dir, uint16_t port)
+{
+    tr_sys_dir_create(tr_pathbuf{ dir, "/Downloads"sv }, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+    auto settings = tr_variant{};
+    tr_variantInitDict(&settings, 16);
+    tr_variantDictAddStr(&settings, TR_KEY_download_dir, tr_pathbuf{ dir, "/Downloads"sv });
+    tr_variantDictAddStr(&settings, TR_KEY_bind_address_ipv4, config.address);
+    tr_variantDictAddInt(&settings, TR_KEY_peer_port, port);
+    tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, false);
+    tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, config.utp);
+    tr_variantDictAddBool(&settings, TR_KEY_tcp_enabled, !config.utp);
+    tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_pex_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_rpc_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_incomplete_dir_enabled, false);
+    tr_variantDictAddInt(&settings, TR_KEY_peer_limit_global, 1000);
+    tr_variantDictAddInt(&settings, TR_KEY_peer_limit_per_torrent, 1000);
+    tr_variantDictAddInt(&settings, TR_KEY_message_level, config.verbose ? TR_LOG_DEBUG : TR_LOG_ERROR);
+    if (config.cache_size_mb)
+    {
+        tr_variantDictAddInt(&settings, TR_KEY_cache_size_mb, *config.cache_size_mb);
+    }
+
+    auto* const session = tr_sessionInit(tr_pathbuf{ dir }, !config.verbose, &settings);
+    tr_variantClear(&settings);
+    return session;
+}
+
+// Fill the seeder's download dir with random files and make a torrent of them
+[[nodiscard]] std::string createPayload(Config const& config, std::string_view download_dir)
+{
+    auto const top = tr_pathbuf{ download_dir, "/payload"sv };
+    tr_sys_dir_create(top, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+    auto buf = std::vector<char>(1024U * 1024U);
+    auto const file_size = config.total_size / config.n_files;
+    for (size_t i = 0; i < config.n_files; ++i)
+    {
+        auto left = i + 1U == config.n_files ? config.total_size - file_size * i : file_size;
+        auto const fd = tr_sys_file_open(
+            tr_pathbuf{ top, fmt::format("/file-{:04d}", i) },
+            TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | TR_SYS_FILE_TRUNCATE,
+            0600);
+
+        while (left > 0U)
+        {
+            auto const n = std::min(left, uint64_t{ std::size(buf) });
+            tr_rand_buffer(std::data(buf), n);
+            tr_sys_file_write(fd, std::data(buf), n, nullptr);
+            left -= n;
+        }
+
+        tr_sys_file_close(fd);
+    }
+
+    auto builder = tr_metainfo_builder{ top };
+    if (config.piece_size != 0U && !builder.setPieceSize(config.piece_size))
+    {
+        fmt::print(stderr, "ERROR: piece size must be at least 16 KiB and must be a power of two.\n");
+        return {};
+    }
+
+    builder.setAnonymize(true);
+    if (tr_error* error = builder.makeChecksums().get(); error != nullptr)
+    {
+        fmt::print(stderr, "ERROR: couldn't hash the payload: {:s}\n", error->message);
+        tr_error_free(error);
+        return {};
+    }
+
+    return builder.benc();
+}
+
+[[nodiscard]] tr_torrent* addTorrent(tr_session* session, std::string_view benc)
+{
+    auto* const ctor = tr_ctorNew(session);
+    tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), nullptr);
+    tr_ctorSetPaused(ctor, TR_FORCE, false);
+    auto* const tor = tr_torrentNew(ctor, nullptr);
+    tr_ctorFree(ctor);
+    return tor;
+}
+
+[[nodiscard]] bool waitFor(std::chrono::steady_clock::time_point deadline, std::function<bool()> const& test)
+{
+    while (!test())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(50ms);
+    }
+
+    return true;
+}
+
+[[nodiscard]] double cpuSeconds(rusage const& ru)
+{
+    auto const to_seconds = [](timeval const& tv)
+    {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    };
+    return to_seconds(ru.ru_utime) + to_seconds(ru.ru_stime);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto config = Config{};
+    if (!parseCommandLine(config, argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    tr_logSetLevel(config.verbose ? TR_LOG_DEBUG : TR_LOG_ERROR);
+    libtransmission::test::ensureFormattersInited();
+
+    if (std::empty(config.address))
+    {
+        config.address = findLocalAddress();
+    }
+
+    auto const address = tr_address::from_string(config.address);
+    if (!address || !address->is_ipv4())
+    {
+        fmt::print(stderr, "ERROR: need a non-loopback IPv4 address to run the swarm on; try --address\n");
+        return EXIT_FAILURE;
+    }
+
+    auto const sandbox = libtransmission::test::Sandbox{};
+
+    // create the sessions
+    auto peers = std::vector<Peer>(config.n_leechers + 1U);
+    for (size_t i = 0; i < std::size(peers); ++i)
+    {
+        auto& peer = peers[i];
+        peer.port = static_cast<uint16_t>(config.first_port + i);
+        peer.session = createSession(config, fmt::format("{:s}/peer-{:d}", sandbox.path(), i), peer.port);
+        peer.lag = std::make_unique<LagProbe>(peer.session);
+    }
+
+    // seed the payload
+    auto& seeder = peers.front();
+    auto const benc = createPayload(config, tr_sessionGetDownloadDir(seeder.session));
+    if (std::empty(benc))
+    {
+        return EXIT_FAILURE;
+    }
+
+    auto const deadline = std::chrono::steady_clock::now() + config.timeout;
+    seeder.tor = addTorrent(seeder.session, benc);
+    if (seeder.tor == nullptr ||
+        !waitFor(deadline, [&seeder]() { return tr_torrentStat(seeder.tor)->activity == TR_STATUS_SEED; }))
+    {
+        fmt::print(stderr, "ERROR: the seeder didn't finish verifying the payload\n");
+        return EXIT_FAILURE;
+    }
+
+    // start the clock and let the leechers find each other
+    auto ru_begin = rusage{};
+    getrusage(RUSAGE_SELF, &ru_begin);
+    auto const begin = std::chrono::steady_clock::now();
+
+    auto pex = std::vector<tr_pex>{};
+    for (auto const& peer : peers)
+    {
+        auto const flags = ADDED_F_CONNECTABLE | (config.utp ? ADDED_F_UTP_FLAGS : 0);
+        pex.emplace_back(*address, tr_port::fromHost(peer.port), static_cast<uint8_t>(flags));
+    }
+
+    for (size_t i = 1; i < std::size(peers); ++i)
+    {
+        auto& peer = peers[i];
+        peer.tor = addTorrent(peer.session, benc);
+        peer.session->runInSessionThread([tor = peer.tor, pex]()
+                                         { tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)); });
+    }
+
+    // wait for the leechers to finish, sampling event-loop lag as we go
+    auto const all_done = waitFor(
+        deadline,
+        [&peers]()
+        {
+            auto n_done = size_t{};
+            for (auto& peer : peers)
+            {
+                peer.lag->sample();
+
+                if (!peer.done_at && tr_torrentStat(peer.tor)->leftUntilDone == 0U)
+                {
+                    peer.done_at = std::chrono::steady_clock::now();
+                }
+
+                n_done += peer.done_at ? 1U : 0U;
+            }
+            return n_done == std::size(peers);
+        });
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    auto ru_end = rusage{};
+    getrusage(RUSAGE_SELF, &ru_end);
+
+    // build the report
+    auto const bytes_moved = static_cast<double>(config.total_size) * config.n_leechers;
+    auto const cpu_seconds = cpuSeconds(ru_end) - cpuSeconds(ru_begin);
+    auto worst_lag = 0.0;
+    auto mean_lag = 0.0;
+    for (auto const& peer : peers)
+    {
+        worst_lag = std::max(worst_lag, peer.lag->maxMsec());
+        mean_lag += peer.lag->meanMsec() / std::size(peers);
+    }
+
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 3);
+    tr_variantDictAddStrView(&top, TR_KEY_version, LONG_VERSION_STRING);
+
+    auto* const args = tr_variantDictAddDict(&top, tr_quark_new("config"sv), 6);
+    tr_variantDictAddInt(args, tr_quark_new("leechers"sv), config.n_leechers);
+    tr_variantDictAddInt(args, tr_quark_new("total_size"sv), config.total_size);
+    tr_variantDictAddInt(args, tr_quark_new("piece_size"sv), tr_torrentView(seeder.tor).piece_size);
+    tr_variantDictAddInt(args, tr_quark_new("files"sv), config.n_files);
+    tr_variantDictAddStrView(args, tr_quark_new("transport"sv), config.utp ? "utp"sv : "tcp"sv);
+    tr_variantDictAddInt(args, TR_KEY_cache_size_mb, tr_sessionGetCacheLimit_MB(seeder.session));
+
+    auto* const results = tr_variantDictAddDict(&top, tr_quark_new("results"sv), 8);
+    tr_variantDictAddBool(results, tr_quark_new("completed"sv), all_done);
+    tr_variantDictAddReal(results, tr_quark_new("seconds"sv), elapsed);
+    tr_variantDictAddReal(results, tr_quark_new("mb_per_second"sv), bytes_moved / 1e6 / elapsed);
+    tr_variantDictAddReal(results, tr_quark_new("cpu_seconds"sv), cpu_seconds);
+    tr_variantDictAddReal(results, tr_quark_new("cpu_seconds_per_gb"sv), cpu_seconds / (bytes_moved / 1e9));
+    tr_variantDictAddInt(results, tr_quark_new("peak_rss_kib"sv), ru_end.ru_maxrss);
+    tr_variantDictAddReal(results, tr_quark_new("event_loop_lag_mean_ms"sv), mean_lag);
+    tr_variantDictAddReal(results, tr_quark_new("event_loop_lag_max_ms"sv), worst_lag);
+
+    auto* const leecher_seconds = tr_variantDictAddList(results, tr_quark_new("leecher_seconds"sv), config.n_leechers);
+    for (size_t i = 1; i < std::size(peers); ++i)
+    {
+        auto const& done_at = peers[i].done_at;
+        tr_variantListAddReal(
+            leecher_seconds,
+            done_at ? std::chrono::duration<double>(*done_at - begin).count() : -1.0);
+    }
+
+    auto const json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON);
+    tr_variantClear(&top);
+
+    if (std::empty(config.output))
+    {
+        fmt::print("{:s}\n", json);
+    }
+    else if (tr_error* error = nullptr; !tr_saveFile(config.output, json, &error))
+    {
+        fmt::print(stderr, "ERROR: couldn't save '{:s}': {:s}\n", config.output, error->message);
+        tr_error_free(error);
+    }
+
+    fmt::print(
+        stderr,
+        "{:d} leechers, {:s}: {:.1f} MB/s, {:.2f} CPU seconds per GB, {:d} KiB peak RSS, {:.1f} ms max event-loop lag\n",
+        config.n_leechers,
+        config.utp ? "µTP" : "TCP",
+        bytes_moved / 1e6 / elapsed,
+        cpu_seconds / (bytes_moved / 1e9),
+        ru_end.ru_maxrss,
+        worst_lag);
+
+    for (auto& peer : peers)
+    {
+        tr_sessionClose(peer.session);
+    }
+
+    return all_done ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -491,6 +491,13 @@ protected:
         return tor;
     }
 
+    // Pick the storage backend of torrents that get added after this.
+    // Unlike the `storage-backend` setting, this can pick TR_STORAGE_MEMORY.
+    void setStorageBackend(tr_storage_backend backend)
+    {
+        session_->settings_.storage_backend = backend;
+    }
+
     void blockingTorrentVerify(tr_torrent* tor)
     {
         EXPECT_NE(nullptr, tor->session);
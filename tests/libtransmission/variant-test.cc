@@ -15,10 +15,14 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath> // lrint()
 #include <cctype> // isspace()
 #include <string>
 #include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
 
 #include "gtest/gtest.h"
 
@@ -560,3 +564,264 @@ TEST_F(VariantTest, variantFromBufFuzz)
         }
     }
 }
+
+TEST_F(VariantTest, largeDictLookups)
+{
+    static auto constexpr NumKeys = 1000;
+
+    auto keys = std::vector<tr_quark>{};
+    for (int i = 0; i < NumKeys; ++i)
+    {
+        keys.push_back(tr_quark_new(fmt::format("large-dict-key-{:d}", i)));
+    }
+
+    auto dict = tr_variant{};
+    tr_variantInitDict(&dict, 0);
+    for (int i = 0; i < NumKeys; ++i)
+    {
+        tr_variantDictAddInt(&dict, keys[i], i);
+    }
+
+    // replacing a value keeps just one child for the key
+    tr_variantDictAddInt(&dict, keys[7], -7);
+    EXPECT_EQ(size_t{ NumKeys }, dict.val.l.count);
+
+    auto i = int64_t{};
+    for (int n = 0; n < NumKeys; ++n)
+    {
+        EXPECT_TRUE(tr_variantDictFindInt(&dict, keys[n], &i));
+        EXPECT_EQ(n == 7 ? -7 : n, i);
+    }
+    EXPECT_EQ(nullptr, tr_variantDictFind(&dict, tr_quark_new("large-dict-missing-key"sv)));
+
+    // remove every other key
+    for (int n = 0; n < NumKeys; n += 2)
+    {
+        EXPECT_TRUE(tr_variantDictRemove(&dict, keys[n]));
+    }
+    for (int n = 0; n < NumKeys; ++n)
+    {
+        EXPECT_EQ(n % 2 != 0, tr_variantDictFindInt(&dict, keys[n], &i));
+    }
+
+    // duplicate keys are legal in parsed data; lookups find the first one
+    auto* const dup = tr_variantDictAdd(&dict, keys[1]);
+    tr_variantInitInt(dup, 100);
+    EXPECT_TRUE(tr_variantDictFindInt(&dict, keys[1], &i));
+    EXPECT_EQ(1, i);
+
+    tr_variantClear(&dict);
+}
+
+TEST_F(VariantTest, mergeLargeDicts)
+{
+    static auto constexpr NumKeys = 500;
+
+    auto tgt = tr_variant{};
+    auto src = tr_variant{};
+    tr_variantInitDict(&tgt, 0);
+    tr_variantInitDict(&src, 0);
+    for (int i = 0; i < NumKeys; ++i)
+    {
+        auto const key = tr_quark_new(fmt::format("merge-key-{:d}", i));
+        tr_variantDictAddInt(&tgt, key, i);
+
+        // the source overwrites odd keys and changes some of their types
+        if (i % 2 != 0)
+        {
+            if (i % 3 == 0)
+            {
+                tr_variantDictAddStr(&src, key, fmt::format("str-{:d}", i));
+            }
+            else
+            {
+                tr_variantDictAddInt(&src, key, -i);
+            }
+        }
+    }
+    tr_variantDictAddBool(&src, tr_quark_new("merge-key-new"sv), true);
+
+    tr_variantMergeDicts(&tgt, &src);
+    EXPECT_EQ(size_t{ NumKeys + 1 }, tgt.val.l.count);
+
+    for (int i = 0; i < NumKeys; ++i)
+    {
+        auto* const child = tr_variantDictFind(&tgt, tr_quark_new(fmt::format("merge-key-{:d}", i)));
+        ASSERT_NE(nullptr, child);
+
+        auto n = int64_t{};
+        auto sv = std::string_view{};
+        if (i % 2 == 0)
+        {
+            EXPECT_TRUE(tr_variantGetInt(child, &n));
+            EXPECT_EQ(i, n);
+        }
+        else if (i % 3 == 0)
+        {
+            EXPECT_TRUE(tr_variantGetStrView(child, &sv));
+            EXPECT_EQ(fmt::format("str-{:d}", i), sv);
+        }
+        else
+        {
+            EXPECT_TRUE(tr_variantGetInt(child, &n));
+            EXPECT_EQ(-i, n);
+        }
+    }
+
+    auto b = bool{};
+    EXPECT_TRUE(tr_variantDictFindBool(&tgt, tr_quark_new("merge-key-new"sv), &b));
+    EXPECT_TRUE(b);
+
+    tr_variantClear(&tgt);
+    tr_variantClear(&src);
+}
+
+TEST_F(VariantTest, arenaParse)
+{
+    auto const long_str = std::string(100, 'x');
+    auto const json = fmt::format(
+        R"({{"a":[1,2,3,{{"b":"{}"}}],"c":{{"d":"short","e":"esc\"aped {}"}},"f":[[],{{}},true,1.5]}})",
+        long_str,
+        long_str);
+
+    for (auto const inplace : { false, true })
+    {
+        auto const opts = TR_VARIANT_PARSE_JSON | (inplace ? TR_VARIANT_PARSE_INPLACE : 0);
+
+        auto heap = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&heap, opts, json));
+
+        auto arena = tr_variant_arena{ 256 };
+        auto top = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&top, arena, opts, json));
+        EXPECT_GT(arena.size(), 0U);
+        EXPECT_EQ(tr_variantToStr(&heap, TR_VARIANT_FMT_JSON_LEAN), tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN));
+
+        // arena-backed variants can still be modified and cleared
+        auto* list = tr_variantDictFind(&top, tr_quark_new("a"sv));
+        ASSERT_TRUE(tr_variantIsList(list));
+        for (int i = 0; i < 100; ++i)
+        {
+            tr_variantListAddStr(list, long_str);
+        }
+        tr_variantDictAddStr(&top, tr_quark_new("c"sv), long_str);
+        EXPECT_EQ(104U, tr_variantListSize(list));
+
+        auto benc = tr_variant{};
+        auto const benc_str = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+        EXPECT_TRUE(tr_variantFromBuf(&benc, arena, TR_VARIANT_PARSE_BENC, benc_str));
+        EXPECT_EQ(benc_str, tr_variantToStr(&benc, TR_VARIANT_FMT_BENC));
+
+        tr_variantClear(&benc);
+        tr_variantClear(&top);
+        tr_variantClear(&heap);
+    }
+}
+
+// Time parse -> lookup -> serialize round trips of typical RPC and
+// .resume payloads, with and without an arena.
+TEST_F(VariantTest, roundTripBenchmark)
+{
+    static auto constexpr NumTorrents = 200;
+    static auto constexpr NumFields = 40;
+    static auto constexpr NumFiles = 2000;
+    static auto constexpr Iterations = 20;
+
+    auto fields = std::vector<tr_quark>{};
+    for (int i = 0; i < NumFields; ++i)
+    {
+        fields.push_back(tr_quark_new(fmt::format("bench-field-{:d}", i)));
+    }
+
+    // a torrent-get response
+    auto rpc = tr_variant{};
+    tr_variantInitDict(&rpc, 2);
+    tr_variantDictAddStrView(&rpc, TR_KEY_result, "success"sv);
+    auto* const args = tr_variantDictAddDict(&rpc, TR_KEY_arguments, 1);
+    auto* const torrents = tr_variantDictAddList(args, TR_KEY_torrents, NumTorrents);
+    for (int i = 0; i < NumTorrents; ++i)
+    {
+        auto* const tor = tr_variantListAddDict(torrents, NumFields);
+        for (int j = 0; j < NumFields; ++j)
+        {
+            if (j % 4 == 0)
+            {
+                tr_variantDictAddStr(tor, fields[j], fmt::format("value of field {:d} of torrent {:d}", j, i));
+            }
+            else
+            {
+                tr_variantDictAddInt(tor, fields[j], int64_t{ i } * j);
+            }
+        }
+    }
+    auto const rpc_json = tr_variantToStr(&rpc, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&rpc);
+
+    // a .resume file
+    auto resume = tr_variant{};
+    tr_variantInitDict(&resume, NumFields + 2);
+    for (int j = 0; j < NumFields; ++j)
+    {
+        tr_variantDictAddInt(&resume, fields[j], j);
+    }
+    auto* const files = tr_variantDictAddList(&resume, TR_KEY_files, NumFiles);
+    auto* const priorities = tr_variantDictAddList(&resume, TR_KEY_priority, NumFiles);
+    for (int i = 0; i < NumFiles; ++i)
+    {
+        tr_variantListAddStr(files, fmt::format("Some Directory/Some Subdirectory/file number {:d}.bin", i));
+        tr_variantListAddInt(priorities, i % 3);
+    }
+    auto const resume_benc = tr_variantToStr(&resume, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&resume);
+
+    auto const round_trip = [&fields](std::string_view payload, int parse_opts, tr_variant_fmt fmt, bool use_arena)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        auto n_found = size_t{};
+
+        for (int iter = 0; iter < Iterations; ++iter)
+        {
+            auto arena = tr_variant_arena{};
+            auto top = tr_variant{};
+            EXPECT_TRUE(
+                use_arena ? tr_variantFromBuf(&top, arena, parse_opts, payload) : tr_variantFromBuf(&top, parse_opts, payload));
+
+            auto const count_fields = [&fields, &n_found](tr_variant* dict)
+            {
+                for (auto const key : fields)
+                {
+                    n_found += tr_variantDictFind(dict, key) != nullptr ? 1U : 0U;
+                }
+            };
+
+            auto* const arguments = tr_variantDictFind(&top, TR_KEY_arguments);
+            auto* list = tr_variantDictFind(arguments, TR_KEY_torrents);
+            if (list != nullptr)
+            {
+                for (size_t i = 0, n = tr_variantListSize(list); i < n; ++i)
+                {
+                    count_fields(tr_variantListChild(list, i));
+                }
+            }
+            else
+            {
+                count_fields(&top);
+            }
+
+            EXPECT_EQ(payload, tr_variantToStr(&top, fmt));
+            tr_variantClear(&top);
+        }
+
+        EXPECT_GE(n_found, size_t{ NumFields * Iterations });
+        auto const elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin);
+        return static_cast<int>(elapsed.count() / Iterations);
+    };
+
+    auto const rpc_opts = TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE;
+    RecordProperty("rpc_usec_heap", round_trip(rpc_json, rpc_opts, TR_VARIANT_FMT_JSON_LEAN, false));
+    RecordProperty("rpc_usec_arena", round_trip(rpc_json, rpc_opts, TR_VARIANT_FMT_JSON_LEAN, true));
+
+    auto const resume_opts = TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE;
+    RecordProperty("resume_usec_heap", round_trip(resume_benc, resume_opts, TR_VARIANT_FMT_BENC, false));
+    RecordProperty("resume_usec_arena", round_trip(resume_benc, resume_opts, TR_VARIANT_FMT_BENC, true));
+}
@@ -0,0 +1,479 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/http.h>
+
+#include "transmission.h"
+
+#include "block-info.h"
+#include "crypto-utils.h"
+#include "makemeta.h"
+#include "session-thread.h" // for tr_evthread_init();
+#include "torrent.h"
+#include "utils-ev.h"
+#include "utils.h"
+#include "web.h"
+#include "webseed.h"
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+// A minimal HTTP server on localhost, running in its own thread,
+// so that tr_web can be exercised without touching the network.
+class LocalServer
+{
+public:
+    // called in the server's thread for every request
+    using Handler = std::function<void(evhttp_request*)>;
+
+    explicit LocalServer(Handler handler = sendBody)
+        : handler_{ std::move(handler) }
+    {
+        tr_session_thread::tr_evthread_init();
+        evbase_.reset(event_base_new());
+        http_.reset(evhttp_new(evbase_.get()));
+        evhttp_set_gencb(http_.get(), onRequest, this);
+
+        auto* const handle = evhttp_bind_socket_with_handle(http_.get(), "127.0.0.1", 0);
+        EXPECT_NE(nullptr, handle);
+        if (handle != nullptr)
+        {
+            auto ss = sockaddr_storage{};
+            auto sslen = socklen_t{ sizeof(ss) };
+            getsockname(evhttp_bound_socket_get_fd(handle), reinterpret_cast<sockaddr*>(&ss), &sslen);
+            port_ = ntohs(reinterpret_cast<sockaddr_in const*>(&ss)->sin_port);
+        }
+
+        thread_ = std::thread([this]() { event_base_loop(evbase_.get(), EVLOOP_NO_EXIT_ON_EMPTY); });
+    }
+
+    LocalServer(LocalServer&&) = delete;
+    LocalServer(LocalServer const&) = delete;
+    LocalServer& operator=(LocalServer&&) = delete;
+    LocalServer& operator=(LocalServer const&) = delete;
+
+    ~LocalServer()
+    {
+        event_base_loopbreak(evbase_.get());
+        thread_.join();
+        http_.reset();
+        evbase_.reset();
+    }
+
+    [[nodiscard]] std::string url() const
+    {
+        return "http://127.0.0.1:" + std::to_string(port_) + "/";
+    }
+
+    static auto constexpr Body = "Hello, World!"sv;
+
+private:
+    static void sendBody(struct evhttp_request* req)
+    {
+        auto const buf = libtransmission::evhelpers::evbuffer_unique_ptr{ evbuffer_new() };
+        evbuffer_add(buf.get(), std::data(Body), std::size(Body));
+        evhttp_send_reply(req, HTTP_OK, "OK", buf.get());
+    }
+
+    static void onRequest(struct evhttp_request* req, void* vself)
+    {
+        static_cast<LocalServer*>(vself)->handler_(req);
+    }
+
+    Handler const handler_;
+    libtransmission::evhelpers::evbase_unique_ptr evbase_;
+    libtransmission::evhelpers::evhttp_unique_ptr http_;
+    std::thread thread_;
+    uint16_t port_ = 0;
+};
+
+class WebTest : public ::testing::Test
+{
+private:
+    void SetUp() override
+    {
+        ::testing::Test::SetUp();
+        tr_timeUpdate(time(nullptr));
+    }
+
+protected:
+    [[nodiscard]] static tr_web::FetchResponse fetchAndWait(tr_web& web, std::string const& url)
+    {
+        // shared so that a response arriving after we time out has somewhere to go
+        auto promise = std::make_shared<std::promise<tr_web::FetchResponse>>();
+        auto future = promise->get_future();
+        web.fetch({ url, [promise](tr_web::FetchResponse const& response) { promise->set_value(response); }, nullptr });
+
+        if (auto const status = future.wait_for(5s); status != std::future_status::ready)
+        {
+            ADD_FAILURE() << "timed out waiting for " << url;
+            return {};
+        }
+
+        return future.get();
+    }
+
+    LocalServer server_;
+    tr_web::Mediator mediator_;
+};
+
+TEST_F(WebTest, fetchesFromLocalServer)
+{
+    auto web = tr_web::create(mediator_);
+
+    auto const response = fetchAndWait(*web, server_.url());
+    EXPECT_EQ(200, response.status);
+    EXPECT_EQ(LocalServer::Body, response.body);
+    EXPECT_TRUE(response.did_connect);
+    EXPECT_FALSE(response.did_timeout);
+}
+
+TEST_F(WebTest, sequentialRequestLatency)
+{
+    static auto constexpr NumRequests = 50;
+
+    auto web = tr_web::create(mediator_);
+    auto const url = server_.url();
+
+    auto const begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < NumRequests; ++i)
+    {
+        EXPECT_EQ(200, fetchAndWait(*web, url).status);
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - begin;
+
+    // New tasks are started as soon as they're submitted, so a round trip
+    // to localhost should take a few milliseconds. Be generous here so
+    // that the test isn't flaky on slow or busy CI machines.
+    auto const latency = std::chrono::duration_cast<std::chrono::microseconds>(elapsed / NumRequests);
+    RecordProperty("mean_latency_usec", static_cast<int>(latency.count()));
+    EXPECT_LT(latency, 100ms);
+}
+
+TEST_F(WebTest, concurrentRequestThroughput)
+{
+    static auto constexpr NumRequests = 200;
+
+    auto n_ok = std::atomic<int>{};
+    auto n_done = std::atomic<int>{};
+    auto all_done = std::promise<void>{};
+
+    // declared after the state its callbacks use, so it's destroyed first
+    auto web = tr_web::create(mediator_);
+    auto const url = server_.url();
+
+    auto const begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < NumRequests; ++i)
+    {
+        web->fetch({ url,
+                     [&](tr_web::FetchResponse const& response)
+                     {
+                         if (response.status == 200 && response.body == LocalServer::Body)
+                         {
+                             ++n_ok;
+                         }
+
+                         if (++n_done == NumRequests)
+                         {
+                             all_done.set_value();
+                         }
+                     },
+                     nullptr });
+    }
+
+    EXPECT_EQ(std::future_status::ready, all_done.get_future().wait_for(30s));
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+
+    EXPECT_EQ(NumRequests, n_ok);
+    RecordProperty("requests_per_second", static_cast<int>(NumRequests / elapsed.count()));
+}
+
+TEST_F(WebTest, shutsDownPromptlyWhenIdle)
+{
+    auto web = tr_web::create(mediator_);
+    EXPECT_EQ(200, fetchAndWait(*web, server_.url()).status);
+
+    // an idle tr_web shouldn't need to wait out its deadline
+    auto const begin = std::chrono::steady_clock::now();
+    web->startShutdown(10s);
+    web.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, 5s);
+}
+
+TEST_F(WebTest, rejectsFetchesAfterShutdown)
+{
+    auto web = tr_web::create(mediator_);
+    web->startShutdown(10s);
+
+    auto called = std::atomic<bool>{ false };
+    web->fetch({ server_.url(), [&called](tr_web::FetchResponse const& /*response*/) { called = true; }, nullptr });
+    web.reset();
+
+    EXPECT_FALSE(called);
+}
+
+TEST(WebseedLimiter, throttlesAndPausesAfterErrors)
+{
+    tr_timeUpdate(time(nullptr));
+
+    auto limiter = WebseedLimiter{};
+    EXPECT_EQ(WebseedLimiter::InitialConnections, limiter.slotsAvailable());
+
+    for (size_t i = 0; i < WebseedLimiter::InitialConnections; ++i)
+    {
+        limiter.taskStarted();
+    }
+    EXPECT_EQ(0U, limiter.slotsAvailable());
+
+    // after an error, only one task at a time...
+    limiter.taskFinished(false);
+    EXPECT_EQ(0U, limiter.slotsAvailable());
+    for (size_t i = 1; i < WebseedLimiter::InitialConnections - 1; ++i)
+    {
+        limiter.taskFinished(false);
+    }
+    EXPECT_EQ(0U, limiter.slotsAvailable());
+
+    // ...and after too many errors in a row, none at all for awhile
+    limiter.taskFinished(false);
+    EXPECT_EQ(0U, limiter.slotsAvailable());
+    tr_timeUpdate(tr_time() + WebseedLimiter::TimeoutIntervalSecs + 1);
+    EXPECT_EQ(1U, limiter.slotsAvailable());
+
+    // getting data means the host is good again
+    limiter.taskStarted();
+    limiter.gotData(tr_block_info::BlockSize);
+    limiter.taskFinished(true);
+    EXPECT_EQ(2U, limiter.slotsAvailable());
+}
+
+TEST(WebseedLimiter, followsTheSpeed)
+{
+    tr_timeUpdate(time(nullptr));
+
+    auto limiter = WebseedLimiter{};
+    auto const start_all = [&limiter]()
+    {
+        for (auto n = limiter.slotsAvailable(); n > 0; --n)
+        {
+            limiter.taskStarted();
+        }
+    };
+
+    // every slot is busy and it's faster than before, so add a slot
+    start_all();
+    limiter.gotData(1024 * 1024);
+    limiter.taskFinished(true);
+    EXPECT_EQ(2U, limiter.slotsAvailable()); // 5 slots, 3 tasks still running
+
+    // every slot is busy and it's slower than before, so take one back
+    start_all();
+    tr_timeUpdate(tr_time() + 60);
+    limiter.gotData(1);
+    limiter.taskFinished(true);
+    EXPECT_EQ(0U, limiter.slotsAvailable());
+    limiter.taskFinished(true);
+    EXPECT_EQ(1U, limiter.slotsAvailable());
+}
+
+TEST(WebseedLimiter, sizesTasksToTheSpeed)
+{
+    tr_timeUpdate(time(nullptr));
+
+    auto limiter = WebseedLimiter{};
+    EXPECT_EQ(WebseedLimiter::MinBlocksPerTask, limiter.blocksPerTask());
+
+    limiter.taskStarted();
+    limiter.gotData(size_t{ 1024 } * 1024 * 1024);
+    EXPECT_EQ(WebseedLimiter::MaxBlocksPerTask, limiter.blocksPerTask());
+}
+
+TEST(WebseedLimiter, capsBufferedBlocks)
+{
+    tr_timeUpdate(time(nullptr));
+
+    auto limiter = WebseedLimiter{};
+    EXPECT_EQ(4U * WebseedLimiter::MinBlocksPerTask, limiter.blocksAvailable(4U, 0U));
+    EXPECT_EQ(10U, limiter.blocksAvailable(4U, WebseedLimiter::MaxBufferedBlocks - 10U));
+    EXPECT_EQ(0U, limiter.blocksAvailable(4U, WebseedLimiter::MaxBufferedBlocks));
+
+    // even with every slot open and the biggest tasks,
+    // a webseed can't have more than the cap in flight
+    limiter.taskStarted();
+    limiter.gotData(size_t{ 1024 } * 1024 * 1024);
+    EXPECT_EQ(WebseedLimiter::MaxBufferedBlocks, limiter.blocksAvailable(WebseedLimiter::MaxConnections, 0U));
+    EXPECT_LE(WebseedLimiter::MaxBufferedBlocks * tr_block_info::BlockSize, size_t{ 64 } * 1024 * 1024);
+}
+
+TEST(WebseedLimiters, oneLimiterPerHost)
+{
+    auto limiters = WebseedLimiters{};
+
+    auto const limiter = limiters.get("http://example.com/a/"sv);
+    EXPECT_EQ(limiter, limiters.get("http://example.com/b/file.bin"sv));
+    EXPECT_NE(limiter, limiters.get("http://example.com:8080/a/"sv));
+    EXPECT_NE(limiter, limiters.get("http://example.org/a/"sv));
+
+    // a host's limiter is dropped once no webseed or task is using it
+    auto const unused = std::weak_ptr<WebseedLimiter>{ limiters.get("http://example.net/"sv) };
+    EXPECT_TRUE(unused.expired());
+}
+
+class WebseedTest : public SessionTest
+{
+protected:
+    static auto constexpr Filename = "webseed-test.bin"sv;
+    static auto constexpr MaxWaitMsec = 30000;
+
+    // a single-file torrent that can only be downloaded from `webseeds`
+    [[nodiscard]] tr_torrent* addWebseedTorrent(std::vector<std::string> webseeds)
+    {
+        auto const filename = tr_pathbuf{ sandboxDir(), "/served/"sv, Filename };
+        createFileWithContents(filename.sv(), content_);
+
+        auto builder = tr_metainfo_builder{ filename };
+        EXPECT_EQ(nullptr, builder.makeChecksums().get());
+        builder.setWebseeds(std::move(webseeds));
+        auto const benc = builder.benc();
+
+        auto* const ctor = tr_ctorNew(session_);
+        EXPECT_TRUE(tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), nullptr));
+        auto* const tor = tr_torrentNew(ctor, nullptr);
+        tr_ctorFree(ctor);
+        EXPECT_NE(nullptr, tor);
+        return tor;
+    }
+
+    // Replies to a range request with that slice of content_.
+    // Returns the number of bytes sent.
+    size_t sendRange(evhttp_request* req) const
+    {
+        auto const* const header = evhttp_find_header(evhttp_request_get_input_headers(req), "Range");
+        auto const range = header != nullptr ? parseRange(header) : std::nullopt;
+        if (!range || range->first > range->second || range->second >= std::size(content_))
+        {
+            evhttp_send_error(req, HTTP_BADREQUEST, nullptr);
+            return {};
+        }
+
+        auto const [first, last] = *range;
+        auto const buf = libtransmission::evhelpers::evbuffer_unique_ptr{ evbuffer_new() };
+        evbuffer_add(buf.get(), std::data(content_) + first, last + 1 - first);
+        evhttp_send_reply(req, 206, "Partial Content", buf.get());
+        return last + 1 - first;
+    }
+
+private:
+    // "bytes=first-last"
+    [[nodiscard]] static std::optional<std::pair<size_t, size_t>> parseRange(std::string_view str)
+    {
+        if (!tr_strvStartsWith(str, "bytes="sv))
+        {
+            return {};
+        }
+        str.remove_prefix(std::size("bytes="sv));
+
+        auto const first = tr_parseNum<size_t>(str, &str);
+        if (!first || !tr_strvStartsWith(str, '-'))
+        {
+            return {};
+        }
+        str.remove_prefix(1);
+
+        auto const last = tr_parseNum<size_t>(str);
+        if (!last)
+        {
+            return {};
+        }
+
+        return std::make_pair(*first, *last);
+    }
+
+    [[nodiscard]] static std::string makeContent()
+    {
+        // not a multiple of the block or piece size
+        auto content = std::string(3 * 1024 * 1024 + 1234, '\0');
+        tr_rand_buffer(std::data(content), std::size(content));
+        return content;
+    }
+
+    std::string const content_ = makeContent();
+};
+
+TEST_F(WebseedTest, downloadsFromLocalServer)
+{
+    auto n_requests = std::atomic<size_t>{};
+    auto max_request_size = std::atomic<size_t>{};
+    auto server = LocalServer{ [&](evhttp_request* req)
+                               {
+                                   auto const n_bytes = sendRange(req);
+                                   ++n_requests;
+                                   max_request_size = std::max(max_request_size.load(), n_bytes);
+                               } };
+
+    // two mirrors on the same host
+    auto const url = server.url();
+    auto* const tor = addWebseedTorrent({ url, url + "mirror/" });
+
+    auto const test = [tor]()
+    {
+        return tr_torrentStat(tor)->leftUntilDone == 0;
+    };
+    EXPECT_TRUE(waitFor(test, MaxWaitMsec));
+
+    EXPECT_LT(0U, n_requests);
+    EXPECT_LE(max_request_size, WebseedLimiter::MaxBlocksPerTask * tr_block_info::BlockSize);
+}
+
+TEST_F(WebseedTest, sharesLimiterAcrossMirrorsOnOneHost)
+{
+    auto n_requests = std::atomic<size_t>{};
+    auto server = LocalServer{ [&n_requests](evhttp_request* req)
+                               {
+                                   ++n_requests;
+                                   evhttp_send_error(req, HTTP_SERVUNAVAIL, nullptr);
+                               } };
+
+    // After too many errors in a row, the host is put in timeout.
+    // If each mirror had its own limiter, they'd each get that many tries.
+    auto const url = server.url();
+    auto* const tor = addWebseedTorrent({ url, url + "mirror/" });
+    EXPECT_NE(nullptr, tor);
+
+    // the limiters are only used in the session thread
+    auto const host_is_paused = [this, &url]()
+    {
+        auto paused = std::promise<bool>{};
+        session_->runInSessionThread([&]() { paused.set_value(session_->webseedLimiters().get(url)->isPaused()); });
+        return paused.get_future().get();
+    };
+    EXPECT_TRUE(waitFor(host_is_paused, MaxWaitMsec));
+
+    // After the first error, only one task at a time is allowed on the host,
+    // so nothing else is in flight by the time it's put in timeout.
+    EXPECT_EQ(WebseedLimiter::MaxConsecutiveFailures, n_requests);
+}
+
+} // namespace libtransmission::test
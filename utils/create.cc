@@ -3,6 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // for std::max()
 #include <array>
 #include <cstdlib> // for strtoul()
 #include <chrono>
@@ -35,7 +36,7 @@ char constexpr Usage[] = "Usage: transmission-create [options] <file|directory>"
 
 uint32_t constexpr KiB = 1024;
 
-auto constexpr Options = std::array<tr_option, 10>{
+auto constexpr Options = std::array<tr_option, 11>{
     { { 'p', "private", "Allow this torrent to only be used with the specified tracker(s)", "p", false, nullptr },
       { 'r', "source", "Set the source for private trackers", "r", true, "<source>" },
       { 'o', "outfile", "Save the generated .torrent to this filename", "o", true, "<file>" },
@@ -44,6 +45,7 @@ auto constexpr Options = std::array<tr_option, 10>{
       { 't', "tracker", "Add a tracker's announce URL", "t", true, "<url>" },
       { 'w', "webseed", "Add a webseed URL", "w", true, "<url>" },
       { 'x', "anonymize", "Omit \"Creation date\" and \"Created by\" info", nullptr, false, nullptr },
+      { 'T', "threads", "Number of threads to hash pieces with (default: one per CPU core)", "T", true, "<count>" },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
 };
@@ -57,6 +59,7 @@ struct app_options
     std::string_view infile;
     std::string_view source;
     uint32_t piece_size = 0;
+    size_t hash_threads = 0;
     bool anonymize = false;
     bool is_private = false;
     bool show_version = false;
@@ -115,6 +118,10 @@ int parseCommandLine(app_options& options, int argc, char const* const* argv)
             options.anonymize = true;
             break;
 
+        case 'T':
+            options.hash_threads = strtoul(optarg, nullptr, 10);
+            break;
+
         case TR_OPT_UNK:
             options.infile = optarg;
             break;
@@ -246,7 +253,9 @@ int tr_main(int argc, char* argv[])
     builder.setAnonymize(options.anonymize);
     builder.setWebseeds(std::move(options.webseeds));
     builder.setAnnounceList(std::move(options.trackers));
+    builder.setHashThreadCount(options.hash_threads);
 
+    auto const begin = std::chrono::steady_clock::now();
     auto future = builder.makeChecksums();
     auto last = std::optional<tr_piece_index_t>{};
     while (future.wait_for(std::chrono::milliseconds(500)) != std::future_status::ready)
@@ -270,6 +279,12 @@ int tr_main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin);
+    fmt::print(
+        "hashed in {:.1f} seconds ({:s}/s) ... ",
+        elapsed.count(),
+        tr_formatter_size_B(static_cast<uint64_t>(builder.totalSize() / std::max(elapsed.count(), 0.001))));
+
     if (tr_error* error = nullptr; !builder.save(options.outfile, &error))
     {
         fmt::print("ERROR: could not save \"{:s}\": {:s} {:d}\n", options.outfile, error->message, error->code);